@@ -0,0 +1,14 @@
+# Component makefile for gesture
+
+ifdef component_compile_rules
+    # ESP_OPEN_RTOS
+    INC_DIRS += $(gesture_ROOT)
+
+    gesture_SRC_DIR = $(gesture_ROOT)
+
+    $(eval $(call component_compile_rules,gesture))
+else
+    # ESP_IDF
+    COMPONENT_SRCDIRS = .
+    COMPONENT_ADD_INCLUDEDIRS = .
+endif
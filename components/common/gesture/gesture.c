@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "gesture.h"
+
+// States are stored in a byte, state 0 is the start state
+#define GESTURE_MAX_STATES 255
+#define NO_STATE 0xFF
+
+
+struct _gesture_recognizer {
+    uint8_t button_count;
+    uint8_t event_count;
+    uint8_t state_count;
+
+    // current position in the DFA
+    uint8_t state;
+    uint32_t last_event_time;
+
+    uint8_t *transitions;   // state_count x (button_count * event_count)
+    uint8_t *actions;       // action reported on entering a state
+    uint16_t *timeouts;     // max time allowed to stay in a state
+};
+
+
+static inline uint8_t *transition(gesture_recognizer_t *r, uint8_t state, uint8_t symbol) {
+    return &r->transitions[state * r->button_count * r->event_count + symbol];
+}
+
+
+static size_t count_states(const gesture_sequence_t *sequence, uint8_t button_count) {
+    size_t states = 0, paths = 1;
+    for (int i = 0; i < sequence->length; i++) {
+        if (sequence->steps[i].button == GESTURE_ANY_BUTTON)
+            paths *= button_count;
+        states += paths;
+    }
+    return states;
+}
+
+
+static bool has_transitions(gesture_recognizer_t *r, uint8_t state) {
+    for (uint8_t symbol = 0; symbol < r->button_count * r->event_count; symbol++)
+        if (*transition(r, state, symbol) != NO_STATE)
+            return true;
+    return false;
+}
+
+
+// Returns -1 if the sequence and one inserted before are a prefix of the
+// other: the recognizer resets on the shorter one, so the longer could
+// never complete
+static int insert(gesture_recognizer_t *r, const gesture_sequence_t *sequence,
+                  uint8_t step, uint8_t state) {
+    if (step == sequence->length) {
+        if (has_transitions(r, state))
+            return -1;
+        if (r->actions[state] == GESTURE_NONE)
+            r->actions[state] = sequence->action;
+        return 0;
+    }
+    if (r->actions[state] != GESTURE_NONE)
+        return -1;
+
+    const gesture_step_t *s = &sequence->steps[step];
+    for (uint8_t button = 0; button < r->button_count; button++) {
+        if (s->button != GESTURE_ANY_BUTTON && s->button != button)
+            continue;
+
+        uint8_t *next = transition(r, state, button * r->event_count + s->event);
+        if (*next == NO_STATE)
+            *next = r->state_count++;
+
+        if (r->timeouts[*next] < sequence->timeout)
+            r->timeouts[*next] = sequence->timeout;
+
+        if (insert(r, sequence, step + 1, *next) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+
+// Turns the trie of sequences into a DFA by filling in the missing transitions
+// with the longest suffix that is still a prefix of some sequence (Aho-Corasick).
+// Returns -1 if a sequence is inside another one or memory runs out.
+static int build_failure_links(gesture_recognizer_t *r) {
+    uint8_t symbol_count = r->button_count * r->event_count;
+    uint8_t *fail = calloc(r->state_count, 1);
+    uint8_t *queue = malloc(r->state_count);
+    if (!fail || !queue) {
+        free(queue);
+        free(fail);
+        return -1;
+    }
+    size_t head = 0, tail = 0;
+
+    for (uint8_t symbol = 0; symbol < symbol_count; symbol++) {
+        uint8_t *next = transition(r, 0, symbol);
+        if (*next == NO_STATE) {
+            *next = 0;
+        } else {
+            fail[*next] = 0;
+            queue[tail++] = *next;
+        }
+    }
+
+    while (head < tail) {
+        uint8_t state = queue[head++];
+        for (uint8_t symbol = 0; symbol < symbol_count; symbol++) {
+            uint8_t *next = transition(r, state, symbol);
+            uint8_t fallback = *transition(r, fail[state], symbol);
+            if (*next == NO_STATE) {
+                *next = fallback;
+                continue;
+            }
+
+            // A sequence that ends inside a longer one would complete
+            // first and reset the recognizer, the longer one never would.
+            // One that ends the longer one is fine: the longer wins.
+            if (r->actions[*next] == GESTURE_NONE && r->actions[fallback] != GESTURE_NONE) {
+                free(queue);
+                free(fail);
+                return -1;
+            }
+            fail[*next] = fallback;
+            queue[tail++] = *next;
+        }
+    }
+
+    free(queue);
+    free(fail);
+    return 0;
+}
+
+
+gesture_recognizer_t *gesture_recognizer_create(const gesture_sequence_t *sequences,
+                                                size_t sequence_count,
+                                                uint8_t button_count,
+                                                uint8_t event_count) {
+    if (!button_count || !event_count || button_count * event_count > 0xFF)
+        return NULL;
+
+    size_t max_states = 1;
+    for (size_t i = 0; i < sequence_count; i++) {
+        const gesture_sequence_t *sequence = &sequences[i];
+        if (!sequence->length || sequence->length > GESTURE_MAX_STEPS ||
+                sequence->action == GESTURE_NONE)
+            return NULL;
+
+        for (int j = 0; j < sequence->length; j++) {
+            const gesture_step_t *step = &sequence->steps[j];
+            if (step->event >= event_count ||
+                    (step->button != GESTURE_ANY_BUTTON && step->button >= button_count))
+                return NULL;
+        }
+
+        max_states += count_states(sequence, button_count);
+    }
+    if (max_states > GESTURE_MAX_STATES)
+        return NULL;
+
+    gesture_recognizer_t *r = malloc(sizeof(gesture_recognizer_t));
+    if (!r)
+        return NULL;
+
+    memset(r, 0, sizeof(*r));
+    r->button_count = button_count;
+    r->event_count = event_count;
+    r->state_count = 1;
+
+    size_t table_size = max_states * button_count * event_count;
+    r->transitions = malloc(table_size);
+    r->actions = calloc(max_states, sizeof(*r->actions));
+    r->timeouts = calloc(max_states, sizeof(*r->timeouts));
+    if (!r->transitions || !r->actions || !r->timeouts) {
+        gesture_recognizer_destroy(r);
+        return NULL;
+    }
+    memset(r->transitions, NO_STATE, table_size);
+
+    for (size_t i = 0; i < sequence_count; i++) {
+        if (insert(r, &sequences[i], 0, 0) < 0) {
+            gesture_recognizer_destroy(r);
+            return NULL;
+        }
+    }
+
+    if (build_failure_links(r) < 0) {
+        gesture_recognizer_destroy(r);
+        return NULL;
+    }
+
+    // Drop the space reserved for wildcard paths that turned out to be shared
+    if (r->state_count < max_states) {
+        uint8_t *transitions = realloc(r->transitions, r->state_count * button_count * event_count);
+        if (transitions)
+            r->transitions = transitions;
+    }
+
+    return r;
+}
+
+
+uint8_t gesture_recognizer_feed(gesture_recognizer_t *r,
+                                uint8_t button, uint8_t event, uint32_t now) {
+    if (button >= r->button_count || event >= r->event_count) {
+        r->state = 0;
+        return GESTURE_NONE;
+    }
+
+    if (r->state && now - r->last_event_time > r->timeouts[r->state])
+        r->state = 0;
+
+    r->state = *transition(r, r->state, button * r->event_count + event);
+    r->last_event_time = now;
+
+    uint8_t action = r->actions[r->state];
+    if (action != GESTURE_NONE)
+        r->state = 0;
+
+    return action;
+}
+
+
+void gesture_recognizer_reset(gesture_recognizer_t *r) {
+    r->state = 0;
+}
+
+
+void gesture_recognizer_destroy(gesture_recognizer_t *r) {
+    if (!r)
+        return;
+
+    free(r->transitions);
+    free(r->actions);
+    free(r->timeouts);
+    free(r);
+}
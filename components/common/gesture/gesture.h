@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define GESTURE_MAX_STEPS 4
+#define GESTURE_ANY_BUTTON 0xFF
+#define GESTURE_NONE 0
+
+typedef struct {
+    uint8_t button;     // button index or GESTURE_ANY_BUTTON
+    uint8_t event;      // e.g. button_event_double_press
+} gesture_step_t;
+
+typedef struct {
+    uint8_t action;         // reported when the sequence completes, must not be GESTURE_NONE
+    uint16_t timeout;       // max time between two steps, in miliseconds
+    uint8_t length;
+    gesture_step_t steps[GESTURE_MAX_STEPS];
+} gesture_sequence_t;
+
+#define GESTURE_STEP(_button, _event) { .button = (_button), .event = (_event) }
+
+#define GESTURE_SEQUENCE(_action, _timeout, ...)                              \
+    {                                                                         \
+        .action = (_action),                                                  \
+        .timeout = (_timeout),                                                \
+        .length = sizeof((gesture_step_t[]){ __VA_ARGS__ }) / sizeof(gesture_step_t), \
+        .steps = { __VA_ARGS__ },                                             \
+    }
+
+typedef struct _gesture_recognizer gesture_recognizer_t;
+
+/**
+    Compiles a table of button sequences into a DFA that recognizes all of them
+    at once. If two sequences complete on the same event, the one listed first wins.
+    A sequence may not be a prefix of another one nor appear inside one,
+    wildcards included: the shorter one would always complete first and the
+    longer never would. A sequence that ends another one is fine, the longer
+    one wins when it completes.
+
+    @param sequences The sequences to recognize
+    @param sequence_count Number of entries in sequences
+    @param button_count Number of buttons, button indexes are 0..button_count-1
+    @param event_count Number of distinct button events, events are 0..event_count-1
+    @return The recognizer or NULL if the table is invalid or too large, or
+            memory runs out.
+*/
+gesture_recognizer_t *gesture_recognizer_create(const gesture_sequence_t *sequences,
+                                                size_t sequence_count,
+                                                uint8_t button_count,
+                                                uint8_t event_count);
+
+/**
+    Feeds one button event into the recognizer. Runs in constant time.
+
+    @param recognizer The recognizer
+    @param button Index of the button that generated the event
+    @param event The button event
+    @param now Current time in miliseconds
+    @return The action of the sequence completed by this event or GESTURE_NONE.
+*/
+uint8_t gesture_recognizer_feed(gesture_recognizer_t *recognizer,
+                                uint8_t button, uint8_t event, uint32_t now);
+
+/**
+    Forgets any partially matched sequence.
+*/
+void gesture_recognizer_reset(gesture_recognizer_t *recognizer);
+
+void gesture_recognizer_destroy(gesture_recognizer_t *recognizer);
@@ -0,0 +1,10 @@
+# Component makefile for seqlock (header only)
+
+ifdef component_compile_rules
+    # ESP_OPEN_RTOS
+    INC_DIRS += $(seqlock_ROOT)
+else
+    # ESP_IDF
+    COMPONENT_ADD_INCLUDEDIRS = .
+    COMPONENT_SRCDIRS =
+endif
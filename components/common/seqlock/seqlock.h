@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+    Sequence lock for state made of several fields that one task updates and
+    others read, e.g. a set of characteristic values shared between the
+    HomeKit server and a control loop. Readers never block and never write
+    shared memory: they copy the fields and retry if a write happened in
+    between, so they always end up with a consistent snapshot.
+
+    The sequence is odd while a write is in progress. Writers have to be
+    serialized and must not be preempted by a reader mid-write, otherwise the
+    reader keeps retrying until the writer runs again. With FreeRTOS on a
+    single core, wrap writes in taskENTER_CRITICAL()/taskEXIT_CRITICAL().
+
+    Writing:
+        seqlock_write_begin(&lock);
+        state.a = a;
+        state.b = b;
+        seqlock_write_end(&lock);
+
+    Reading:
+        uint32_t seq;
+        do {
+            seq = seqlock_read_begin(&lock);
+            a = state.a;
+            b = state.b;
+        } while (seqlock_read_retry(&lock, seq));
+*/
+
+typedef struct {
+    volatile uint32_t sequence;
+} seqlock_t;
+
+#define SEQLOCK_INIT { .sequence = 0 }
+
+#define seqlock_barrier() __sync_synchronize()
+
+
+static inline void seqlock_write_begin(seqlock_t *lock) {
+    lock->sequence++;
+    seqlock_barrier();
+}
+
+
+static inline void seqlock_write_end(seqlock_t *lock) {
+    seqlock_barrier();
+    lock->sequence++;
+}
+
+
+static inline uint32_t seqlock_read_begin(const seqlock_t *lock) {
+    uint32_t sequence = lock->sequence;
+    seqlock_barrier();
+    return sequence;
+}
+
+
+// Returns true if the fields read since seqlock_read_begin may be torn
+static inline bool seqlock_read_retry(const seqlock_t *lock, uint32_t sequence) {
+    seqlock_barrier();
+    return (sequence & 1) || lock->sequence != sequence;
+}
+
+
+/**
+    Copies src into dst as a consistent snapshot.
+*/
+#define SEQLOCK_READ(lock, dst, src) \
+    do { \
+        uint32_t _seqlock_sequence; \
+        do { \
+            _seqlock_sequence = seqlock_read_begin(lock); \
+            (dst) = (src); \
+        } while (seqlock_read_retry((lock), _seqlock_sequence)); \
+    } while (0)
+
+/**
+    Replaces dst with src. Writers still have to be serialized by the caller.
+*/
+#define SEQLOCK_WRITE(lock, dst, src) \
+    do { \
+        seqlock_write_begin(lock); \
+        (dst) = (src); \
+        seqlock_write_end(lock); \
+    } while (0)
@@ -0,0 +1,202 @@
+#include <string.h>
+#include <stdlib.h>
+#include <esp8266.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <timers.h>
+#include "chord.h"
+
+#define CHORD_POLL_INTERVAL 10  // in milliseconds
+#define CHORD_NONE 0xFF
+
+// How long after a chord is released the per-button events are still
+// attributed to it. Covers the repeat press timeout of the button component.
+#define CHORD_CLAIM_TIMEOUT 2000  // in milliseconds
+
+
+typedef struct {
+    uint8_t gpio_count;
+    uint8_t gpios[CHORD_MAX_BUTTONS];
+
+    uint8_t chord_count;
+    uint16_t *chords;
+
+    chord_config_t config;
+    chord_callback_fn callback;
+    void *context;
+
+    uint16_t pressed;           // buttons currently down
+    uint32_t press_time[CHORD_MAX_BUTTONS];
+
+    uint8_t active;             // chord being held or CHORD_NONE
+    uint16_t active_mask;
+    uint32_t active_time;       // when the first button of the chord went down
+
+    // Set on the timer task and cleared by the button callbacks, both under
+    // a critical section
+    uint16_t claimed;           // buttons whose current press belongs to a chord
+    uint32_t claim_expiry;
+
+    TimerHandle_t timer;
+} chord_detector_t;
+
+
+static chord_detector_t *detector = NULL;
+
+
+static inline uint32_t chord_now() {
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+
+static uint8_t chord_find(uint16_t mask) {
+    for (uint8_t i = 0; i < detector->chord_count; i++) {
+        if (detector->chords[i] == mask)
+            return i;
+    }
+    return CHORD_NONE;
+}
+
+
+// True if all the buttons in mask went down within the chord window
+static bool chord_in_window(uint16_t mask) {
+    uint32_t first = 0, last = 0;
+    bool found = false;
+    for (uint8_t i = 0; i < detector->gpio_count; i++) {
+        if (!(mask & CHORD_BUTTON(i)))
+            continue;
+
+        uint32_t t = detector->press_time[i];
+        if (!found || (int32_t)(t - first) < 0)
+            first = t;
+        if (!found || (int32_t)(t - last) > 0)
+            last = t;
+        found = true;
+    }
+    return found && (last - first) <= detector->config.window;
+}
+
+
+static void chord_poll(TimerHandle_t timer) {
+    uint32_t now = chord_now();
+
+    uint16_t pressed = 0;
+    for (uint8_t i = 0; i < detector->gpio_count; i++) {
+        if (gpio_read(detector->gpios[i]) == detector->config.pressed_value)
+            pressed |= CHORD_BUTTON(i);
+    }
+
+    uint16_t went_down = pressed & ~detector->pressed;
+    detector->pressed = pressed;
+
+    if (went_down) {
+        for (uint8_t i = 0; i < detector->gpio_count; i++) {
+            if (went_down & CHORD_BUTTON(i))
+                detector->press_time[i] = now;
+        }
+
+        // A new chord, or a larger chord if more buttons join in time
+        uint16_t mask = (detector->active == CHORD_NONE) ? pressed : (detector->active_mask | pressed);
+        uint8_t chord = chord_find(mask);
+        if (chord != CHORD_NONE && chord_in_window(mask)) {
+            detector->active = chord;
+            taskENTER_CRITICAL();
+            detector->active_mask = mask;
+            detector->claimed |= mask;
+            taskEXIT_CRITICAL();
+
+            detector->active_time = now;
+            for (uint8_t i = 0; i < detector->gpio_count; i++) {
+                if ((mask & CHORD_BUTTON(i)) && (int32_t)(detector->press_time[i] - detector->active_time) < 0)
+                    detector->active_time = detector->press_time[i];
+            }
+        }
+    }
+
+    if (detector->active != CHORD_NONE && !pressed) {
+        uint8_t chord = detector->active;
+        chord_event_t event = (now - detector->active_time >= detector->config.long_press_time)
+            ? chord_event_long_press : chord_event_press;
+
+        detector->active = CHORD_NONE;
+        detector->active_time = 0;
+        taskENTER_CRITICAL();
+        detector->active_mask = 0;
+        detector->claim_expiry = now + CHORD_CLAIM_TIMEOUT;
+        taskEXIT_CRITICAL();
+
+        detector->callback(chord, event, detector->context);
+    }
+}
+
+
+int chord_detector_create(const uint8_t *gpios, uint8_t gpio_count,
+                          const uint16_t *chords, uint8_t chord_count,
+                          chord_config_t config,
+                          chord_callback_fn callback, void *context) {
+    if (detector)
+        return -1;
+
+    if (gpio_count > CHORD_MAX_BUTTONS || !chord_count)
+        return -1;
+
+    detector = malloc(sizeof(chord_detector_t));
+    if (!detector)
+        return -2;
+
+    memset(detector, 0, sizeof(*detector));
+    detector->chords = malloc(chord_count * sizeof(*chords));
+    if (!detector->chords) {
+        chord_detector_destroy();
+        return -2;
+    }
+
+    detector->gpio_count = gpio_count;
+    memcpy(detector->gpios, gpios, gpio_count);
+    detector->chord_count = chord_count;
+    memcpy(detector->chords, chords, chord_count * sizeof(*chords));
+    detector->config = config;
+    detector->callback = callback;
+    detector->context = context;
+    detector->active = CHORD_NONE;
+
+    detector->timer = xTimerCreate(
+        "chord", pdMS_TO_TICKS(CHORD_POLL_INTERVAL), pdTRUE, NULL, chord_poll);
+    if (!detector->timer || xTimerStart(detector->timer, 1) != pdPASS) {
+        chord_detector_destroy();
+        return -2;
+    }
+
+    return 0;
+}
+
+
+bool chord_detector_claimed(uint8_t button) {
+    if (!detector || button >= detector->gpio_count)
+        return false;
+
+    uint16_t bit = CHORD_BUTTON(button);
+    uint32_t now = chord_now();
+
+    taskENTER_CRITICAL();
+    bool claimed = detector->claimed & bit;
+    detector->claimed &= ~bit;
+    // Stale claim of a chord whose button events never arrived
+    bool stale = !(detector->active_mask & bit) && (int32_t)(now - detector->claim_expiry) > 0;
+    taskEXIT_CRITICAL();
+
+    return claimed && !stale;
+}
+
+
+void chord_detector_destroy() {
+    if (!detector)
+        return;
+
+    if (detector->timer)
+        xTimerDelete(detector->timer, portMAX_DELAY);
+
+    free(detector->chords);
+    free(detector);
+    detector = NULL;
+}
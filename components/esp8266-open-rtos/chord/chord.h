@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CHORD_MAX_BUTTONS 16
+
+typedef enum {
+    chord_event_press,
+    chord_event_long_press,
+} chord_event_t;
+
+typedef void (*chord_callback_fn)(uint8_t chord, chord_event_t event, void *context);
+
+typedef struct {
+    bool pressed_value;         // GPIO level of a pressed button
+    uint16_t window;            // max time between the first and last press of a chord, in miliseconds
+    uint16_t long_press_time;   // in miliseconds
+} chord_config_t;
+
+#define CHORD_CONFIG(_pressed_value, ...)                                     \
+    (chord_config_t) {                                                        \
+        .pressed_value = (_pressed_value),                                    \
+        .window = 150,                                                        \
+        .long_press_time = 1000,                                              \
+        __VA_ARGS__                                                           \
+    }
+
+// Bit mask of button indexes, e.g. CHORD_BUTTON(0) | CHORD_BUTTON(1) is the first two buttons
+#define CHORD_BUTTON(_index) (1 << (_index))
+
+/**
+    Starts watching a set of buttons for chords: two or more buttons pressed within
+    config.window of each other. Only the combinations listed in chords are reported,
+    once all their buttons have been released. Buttons keep working on their own,
+    this only samples their GPIO levels.
+
+    @param gpios The GPIO pins of the buttons, the index in this array is the button index
+    @param gpio_count Number of entries in gpios
+    @param chords Bit masks of the button combinations to detect
+    @param chord_count Number of entries in chords
+    @param config Timing configuration
+    @param callback The callback that is called with the index of a detected chord
+    @param context Passed to callback
+    @return A negative integer if this method fails.
+*/
+int chord_detector_create(const uint8_t *gpios, uint8_t gpio_count,
+                          const uint16_t *chords, uint8_t chord_count,
+                          chord_config_t config,
+                          chord_callback_fn callback, void *context);
+
+/**
+    Tells whether the latest press of a button was part of a chord, in which case
+    the regular event for that button should be ignored. Each chord press is
+    reported only once per button.
+
+    @param button The button index
+    @return true if the button was part of a chord.
+*/
+bool chord_detector_claimed(uint8_t button);
+
+void chord_detector_destroy();
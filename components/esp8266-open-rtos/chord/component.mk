@@ -0,0 +1,7 @@
+# Component makefile for chord
+
+INC_DIRS += $(chord_ROOT)
+
+chord_SRC_DIR = $(chord_ROOT)
+
+$(eval $(call component_compile_rules,chord))
@@ -0,0 +1,20 @@
+# Component makefile for config_store
+#
+# Uses the flash_scheduler component, add both to EXTRA_COMPONENTS. The
+# region must not overlap the firmware, OTA slots or HomeKit storage:
+#
+#   CONFIG_STORE_BASE_ADDR = 0xF8000
+#   CONFIG_STORE_SECTORS = 4
+
+INC_DIRS += $(config_store_ROOT)
+
+config_store_SRC_DIR = $(config_store_ROOT)
+
+ifdef CONFIG_STORE_BASE_ADDR
+EXTRA_CFLAGS += -DCONFIG_STORE_BASE_ADDR=$(CONFIG_STORE_BASE_ADDR)
+endif
+ifdef CONFIG_STORE_SECTORS
+EXTRA_CFLAGS += -DCONFIG_STORE_SECTORS=$(CONFIG_STORE_SECTORS)
+endif
+
+$(eval $(call component_compile_rules,config_store))
@@ -0,0 +1,670 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include <spiflash.h>
+#include <flash_scheduler.h>
+
+#include "config_store.h"
+
+// Layout of the region
+//
+// Every sector starts with a header. Sectors with a valid header form the
+// log, oldest sequence first; the others are free. Records follow the
+// header back to back, word aligned, up to the first erased (0xFF) byte.
+// A sector is never written again once a record in it fails its CRC.
+//
+// The newest record of a key wins, a record with RECORD_DELETED removes
+// the key. Garbage collection copies the records still current in the
+// oldest sector to the newest one, then retires the old sector by zeroing
+// its magic. It is erased when it gets reused, so a collection costs no
+// erase. A power loss at any point leaves either the old or the copied
+// records current.
+
+#define SECTOR_SIZE 4096
+#define SECTOR_MAGIC 0x31305343         // "CS01"
+
+#define RECORD_DELETED 0x01
+
+#define ALIGN4(n) (((n) + 3) & ~3)
+#define RECORD_SIZE(key_length, value_length) \
+    ALIGN4(sizeof(record_header_t) + (key_length) + (value_length))
+#define MAX_RECORD_SIZE RECORD_SIZE(CONFIG_STORE_MAX_KEY_LENGTH, CONFIG_STORE_MAX_VALUE_LENGTH)
+
+// Live records always fit into all sectors but the free one, even with
+// the tail of every sector left unused
+#define CAPACITY ((CONFIG_STORE_SECTORS - 1) * (SECTOR_SIZE - sizeof(sector_header_t) - MAX_RECORD_SIZE))
+
+#define INDEX_SIZE (2 * CONFIG_STORE_MAX_KEYS)
+
+_Static_assert(CONFIG_STORE_SECTORS >= 2, "config_store needs at least two sectors");
+_Static_assert(CONFIG_STORE_BASE_ADDR % SECTOR_SIZE == 0, "CONFIG_STORE_BASE_ADDR must be sector aligned");
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;          // position in the log, higher is newer
+    uint32_t erase_count;
+    uint32_t crc;               // of the words above
+} sector_header_t;
+
+typedef struct {
+    uint8_t key_length;         // 0xFF: erased, end of the records
+    uint8_t flags;
+    uint16_t value_length;
+    uint32_t crc;               // of the fields above, key and value
+} record_header_t;
+
+typedef enum {
+    SECTOR_DIRTY = 0,           // free, to be erased before use
+    SECTOR_ERASED,              // free and blank
+    SECTOR_LOG,
+} sector_state_t;
+
+typedef struct {
+    uint32_t address;           // 0 if the slot is empty
+    uint16_t hash;
+    uint16_t size;              // of the record
+} index_entry_t;
+
+
+static struct {
+    sector_state_t state;
+    uint32_t sequence;
+    uint32_t erase_count;
+} sectors[CONFIG_STORE_SECTORS];
+
+static int active = -1;         // sector records are appended to
+static uint32_t write_offset;   // within the active sector
+static uint32_t last_sequence = 0;
+
+static index_entry_t index_table[INDEX_SIZE];
+
+static config_store_stats_t stats;
+
+static SemaphoreHandle_t lock = NULL;
+static StaticSemaphore_t lock_buffer;
+
+// Holds one record at a time, only touched with the lock held
+static uint32_t record_buffer[MAX_RECORD_SIZE / 4];
+
+
+static uint32_t crc32(uint32_t crc, const void *data, size_t length) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    const uint8_t *bytes = data;
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ bytes[i]) & 0x0F] ^ (crc >> 4);
+        crc = table[(crc ^ (bytes[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+
+static uint16_t hash_key(const char *key, size_t length) {
+    // FNV-1a, folded
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        h = (h ^ (uint8_t)key[i]) * 16777619u;
+    return h ^ (h >> 16);
+}
+
+
+static uint32_t sector_address(int sector) {
+    return CONFIG_STORE_BASE_ADDR + sector * SECTOR_SIZE;
+}
+
+
+static uint32_t record_crc(const record_header_t *header, const uint8_t *data) {
+    uint32_t crc = crc32(0, header, offsetof(record_header_t, crc));
+    return crc32(crc, data, header->key_length + header->value_length);
+}
+
+
+static bool is_erased(const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        if (bytes[i] != 0xFF)
+            return false;
+    }
+    return true;
+}
+
+
+static bool range_erased(uint32_t address, uint32_t length) {
+    uint32_t chunk[16];
+    while (length) {
+        uint32_t n = length < sizeof(chunk) ? length : sizeof(chunk);
+        if (!spiflash_read(address, (uint8_t *)chunk, n) || !is_erased(chunk, n))
+            return false;
+        address += n;
+        length -= n;
+    }
+    return true;
+}
+
+
+typedef enum {
+    READ_OK,
+    READ_END,                   // erased space, no more records
+    READ_INVALID,               // torn or corrupt record
+} read_result_t;
+
+// Reads and checks the record at address into record_buffer
+static read_result_t read_record(uint32_t address, uint32_t end) {
+    record_header_t *header = (record_header_t *)record_buffer;
+
+    if (address + sizeof(record_header_t) > end)
+        return READ_END;
+    if (!spiflash_read(address, (uint8_t *)header, sizeof(record_header_t)))
+        return READ_INVALID;
+    if (is_erased(header, sizeof(record_header_t)))
+        return READ_END;
+
+    if (!header->key_length || header->key_length > CONFIG_STORE_MAX_KEY_LENGTH ||
+            header->value_length > CONFIG_STORE_MAX_VALUE_LENGTH ||
+            address + RECORD_SIZE(header->key_length, header->value_length) > end)
+        return READ_INVALID;
+
+    uint8_t *data = (uint8_t *)(header + 1);
+    uint32_t size = RECORD_SIZE(header->key_length, header->value_length) - sizeof(record_header_t);
+    if (!spiflash_read(address + sizeof(record_header_t), data, size))
+        return READ_INVALID;
+
+    return record_crc(header, data) == header->crc ? READ_OK : READ_INVALID;
+}
+
+
+/*------------------------------------------------------------------------------
+ * Index
+ *----------------------------------------------------------------------------*/
+
+// Slot of key, or of the empty slot it would go into
+static int index_find(const char *key, size_t key_length, uint16_t hash, bool *found) {
+    uint8_t stored[sizeof(record_header_t) + CONFIG_STORE_MAX_KEY_LENGTH];
+    int i = hash % INDEX_SIZE;
+
+    while (index_table[i].address) {
+        if (index_table[i].hash == hash) {
+            record_header_t *header = (record_header_t *)stored;
+            if (spiflash_read(index_table[i].address, stored, ALIGN4(sizeof(record_header_t) + key_length)) &&
+                    header->key_length == key_length &&
+                    !memcmp(stored + sizeof(record_header_t), key, key_length)) {
+                *found = true;
+                return i;
+            }
+        }
+        i = (i + 1) % INDEX_SIZE;
+    }
+
+    *found = false;
+    return i;
+}
+
+
+static void index_remove(int slot) {
+    // Backward shift deletion: linear probing without tombstones
+    int hole = slot;
+    index_table[hole].address = 0;
+    for (int j = (hole + 1) % INDEX_SIZE; index_table[j].address; j = (j + 1) % INDEX_SIZE) {
+        int home = index_table[j].hash % INDEX_SIZE;
+        if ((j - home + INDEX_SIZE) % INDEX_SIZE >= (j - hole + INDEX_SIZE) % INDEX_SIZE) {
+            index_table[hole] = index_table[j];
+            index_table[j].address = 0;
+            hole = j;
+        }
+    }
+}
+
+
+// Makes the record in record_buffer, just found at address, current
+static void index_apply(uint32_t address) {
+    record_header_t *header = (record_header_t *)record_buffer;
+    const char *key = (const char *)(header + 1);
+    uint16_t hash = hash_key(key, header->key_length);
+
+    bool found;
+    int slot = index_find(key, header->key_length, hash, &found);
+    if (found) {
+        stats.live_bytes -= index_table[slot].size;
+        stats.keys--;
+        index_remove(slot);
+        if (header->flags & RECORD_DELETED)
+            return;
+        slot = index_find(key, header->key_length, hash, &found);
+    } else if (header->flags & RECORD_DELETED) {
+        return;
+    }
+
+    if (stats.keys == CONFIG_STORE_MAX_KEYS) {
+        printf("config-store: more than %d keys, raise CONFIG_STORE_MAX_KEYS\n", CONFIG_STORE_MAX_KEYS);
+        return;
+    }
+
+    index_table[slot].address = address;
+    index_table[slot].hash = hash;
+    index_table[slot].size = RECORD_SIZE(header->key_length, header->value_length);
+    stats.live_bytes += index_table[slot].size;
+    stats.keys++;
+}
+
+
+/*------------------------------------------------------------------------------
+ * Log
+ *----------------------------------------------------------------------------*/
+
+// Writes size bytes of record_buffer at the end of the active sector and
+// reads them back. A failed record closes the sector.
+static bool write_record(uint32_t size, uint32_t *address) {
+    if (active < 0 || write_offset + size > SECTOR_SIZE)
+        return false;
+
+    *address = sector_address(active) + write_offset;
+    bool written = flash_scheduler_write(*address, (const uint8_t *)record_buffer, size);
+    stats.flash_bytes += size;
+
+    uint32_t check[16];
+    for (uint32_t offset = 0; written && offset < size; offset += sizeof(check)) {
+        uint32_t n = size - offset < sizeof(check) ? size - offset : sizeof(check);
+        written = spiflash_read(*address + offset, (uint8_t *)check, n) &&
+                  !memcmp(check, (uint8_t *)record_buffer + offset, n);
+    }
+
+    if (!written) {
+        printf("config-store: write at 0x%x failed, closing the sector\n", *address);
+        write_offset = SECTOR_SIZE;
+        return false;
+    }
+
+    write_offset += size;
+    return true;
+}
+
+
+static int oldest_sector() {
+    int oldest = -1;
+    for (int i = 0; i < CONFIG_STORE_SECTORS; i++) {
+        if (sectors[i].state == SECTOR_LOG && i != active &&
+                (oldest < 0 || sectors[i].sequence < sectors[oldest].sequence))
+            oldest = i;
+    }
+    return oldest;
+}
+
+
+static int free_sectors() {
+    int count = 0;
+    for (int i = 0; i < CONFIG_STORE_SECTORS; i++) {
+        if (sectors[i].state != SECTOR_LOG)
+            count++;
+    }
+    return count;
+}
+
+
+// Copies the current records of the oldest sector to the active one and
+// retires it
+static int collect() {
+    int victim = oldest_sector();
+    if (victim < 0)
+        return 0;
+
+    uint32_t start = sector_address(victim);
+    uint32_t end = start + SECTOR_SIZE;
+    uint32_t address = start + sizeof(sector_header_t);
+
+    while (read_record(address, end) == READ_OK) {
+        record_header_t *header = (record_header_t *)record_buffer;
+        uint32_t size = RECORD_SIZE(header->key_length, header->value_length);
+        const char *key = (const char *)(header + 1);
+
+        bool found;
+        int slot = index_find(key, header->key_length, hash_key(key, header->key_length), &found);
+        if (found && index_table[slot].address == address) {
+            // read_record left it in record_buffer, ready to go
+            uint32_t copy;
+            if (!write_record(size, &copy))
+                return CONFIG_STORE_FLASH_ERROR;
+            index_table[slot].address = copy;
+        }
+        address += size;
+    }
+
+    static const uint32_t zero = 0;
+    if (!flash_scheduler_write(start, (const uint8_t *)&zero, sizeof(zero)))
+        return CONFIG_STORE_FLASH_ERROR;
+    stats.flash_bytes += sizeof(zero);
+
+    sectors[victim].state = SECTOR_DIRTY;
+    stats.collections++;
+    return 0;
+}
+
+
+// Starts a new sector for the log, the free one erased the fewest times
+static int open_sector() {
+    int next = -1;
+    for (int i = 0; i < CONFIG_STORE_SECTORS; i++) {
+        if (sectors[i].state != SECTOR_LOG &&
+                (next < 0 || sectors[i].erase_count < sectors[next].erase_count))
+            next = i;
+    }
+    if (next < 0)
+        return CONFIG_STORE_FULL;
+
+    if (sectors[next].state == SECTOR_DIRTY) {
+        if (!flash_scheduler_erase_sector(sector_address(next)))
+            return CONFIG_STORE_FLASH_ERROR;
+        sectors[next].erase_count++;
+        stats.erases++;
+    }
+
+    sector_header_t header = {
+        .magic = SECTOR_MAGIC,
+        .sequence = ++last_sequence,
+        .erase_count = sectors[next].erase_count,
+    };
+    header.crc = crc32(0, &header, offsetof(sector_header_t, crc));
+
+    // Written before the sector counts as used: if this fails, it is dirty
+    sectors[next].state = SECTOR_DIRTY;
+    if (!flash_scheduler_write(sector_address(next), (const uint8_t *)&header, sizeof(header)))
+        return CONFIG_STORE_FLASH_ERROR;
+    stats.flash_bytes += sizeof(header);
+
+    sectors[next].state = SECTOR_LOG;
+    sectors[next].sequence = header.sequence;
+    active = next;
+    write_offset = sizeof(sector_header_t);
+
+    // Keep a free sector for the next collection
+    if (!free_sectors())
+        return collect();
+    return 0;
+}
+
+
+// Appends the record in record_buffer, collecting garbage as needed
+static int append(uint32_t size, uint32_t *address) {
+    // Every round either writes or opens a sector, collecting one
+    for (int round = 0; round < 2 * CONFIG_STORE_SECTORS + 2; round++) {
+        if (active >= 0 && write_offset + size <= SECTOR_SIZE) {
+            if (write_record(size, address))
+                return 0;
+            continue;
+        }
+
+        // record_buffer is reused by collection
+        static uint32_t pending[MAX_RECORD_SIZE / 4];
+        memcpy(pending, record_buffer, size);
+        int result = open_sector();
+        memcpy(record_buffer, pending, size);
+        if (result < 0)
+            return result;
+    }
+    return CONFIG_STORE_FLASH_ERROR;
+}
+
+
+/*------------------------------------------------------------------------------
+ * Boot
+ *----------------------------------------------------------------------------*/
+
+static void scan_sector(int sector) {
+    uint32_t start = sector_address(sector);
+    uint32_t end = start + SECTOR_SIZE;
+    uint32_t address = start + sizeof(sector_header_t);
+
+    read_result_t result;
+    while ((result = read_record(address, end)) == READ_OK) {
+        record_header_t *header = (record_header_t *)record_buffer;
+        index_apply(address);
+        address += RECORD_SIZE(header->key_length, header->value_length);
+    }
+
+    if (sector == active) {
+        // Appending goes on only after a clean end: a torn write may have
+        // programmed bytes past what looks like the end
+        if (result == READ_END && range_erased(address, end - address)) {
+            write_offset = address - start;
+        } else {
+            printf("config-store: torn record at 0x%x, closing the sector\n", address);
+            write_offset = SECTOR_SIZE;
+        }
+    }
+}
+
+
+int config_store_init() {
+    if (lock)
+        return 0;
+
+    memset(&stats, 0, sizeof(stats));
+    memset(index_table, 0, sizeof(index_table));
+    active = -1;
+    last_sequence = 0;
+
+    for (int i = 0; i < CONFIG_STORE_SECTORS; i++) {
+        sector_header_t header;
+        if (!spiflash_read(sector_address(i), (uint8_t *)&header, sizeof(header)))
+            return CONFIG_STORE_FLASH_ERROR;
+
+        sectors[i].sequence = 0;
+        sectors[i].erase_count = 0;
+        if (header.magic == SECTOR_MAGIC &&
+                header.crc == crc32(0, &header, offsetof(sector_header_t, crc))) {
+            sectors[i].state = SECTOR_LOG;
+            sectors[i].sequence = header.sequence;
+            sectors[i].erase_count = header.erase_count;
+            if (header.sequence > last_sequence)
+                last_sequence = header.sequence;
+            if (active < 0 || header.sequence > sectors[active].sequence)
+                active = i;
+        } else if (header.magic == 0) {
+            // Retired by a collection, the rest of the header is intact
+            sectors[i].state = SECTOR_DIRTY;
+            sectors[i].erase_count = header.erase_count;
+        } else {
+            sectors[i].state = range_erased(sector_address(i), SECTOR_SIZE) ? SECTOR_ERASED : SECTOR_DIRTY;
+        }
+    }
+
+    // Only a power loss during a collection leaves no free sector. The
+    // newest sector then holds nothing but copies of records still in the
+    // oldest one: drop it, the next write collects again.
+    if (active >= 0 && !free_sectors()) {
+        sectors[active].state = SECTOR_DIRTY;
+        active = -1;
+        for (int i = 0; i < CONFIG_STORE_SECTORS; i++) {
+            if (sectors[i].state == SECTOR_LOG && (active < 0 || sectors[i].sequence > sectors[active].sequence))
+                active = i;
+        }
+    }
+
+    // Oldest first, so that newer records replace older ones in the index
+    uint32_t scanned = 0;
+    while (true) {
+        int next = -1;
+        for (int i = 0; i < CONFIG_STORE_SECTORS; i++) {
+            if (sectors[i].state == SECTOR_LOG && sectors[i].sequence > scanned &&
+                    (next < 0 || sectors[i].sequence < sectors[next].sequence))
+                next = i;
+        }
+        if (next < 0)
+            break;
+        scan_sector(next);
+        scanned = sectors[next].sequence;
+    }
+
+    lock = xSemaphoreCreateMutexStatic(&lock_buffer);
+
+    printf("config-store: %u keys, %u of %u bytes used\n",
+           stats.keys, stats.live_bytes, (uint32_t)CAPACITY);
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ * API
+ *----------------------------------------------------------------------------*/
+
+int config_store_get(const char *key, void *value, size_t size) {
+    size_t key_length = strlen(key);
+    if (!lock || !key_length || key_length > CONFIG_STORE_MAX_KEY_LENGTH)
+        return CONFIG_STORE_NOT_FOUND;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    bool found;
+    int slot = index_find(key, key_length, hash_key(key, key_length), &found);
+    int result = CONFIG_STORE_NOT_FOUND;
+    if (found && read_record(index_table[slot].address, index_table[slot].address + index_table[slot].size) == READ_OK) {
+        record_header_t *header = (record_header_t *)record_buffer;
+        if (header->value_length > size) {
+            result = CONFIG_STORE_TOO_BIG;
+        } else {
+            memcpy(value, (uint8_t *)(header + 1) + key_length, header->value_length);
+            result = header->value_length;
+        }
+    }
+
+    xSemaphoreGive(lock);
+    return result;
+}
+
+
+int config_store_get_string(const char *key, char *buffer, size_t size) {
+    if (!size)
+        return CONFIG_STORE_TOO_BIG;
+
+    int length = config_store_get(key, buffer, size - 1);
+    if (length >= 0)
+        buffer[length] = 0;
+    return length;
+}
+
+
+int32_t config_store_get_int(const char *key, int32_t default_value) {
+    char buffer[12];
+    if (config_store_get_string(key, buffer, sizeof(buffer)) <= 0)
+        return default_value;
+
+    char *end;
+    long value = strtol(buffer, &end, 0);
+    return *end ? default_value : value;
+}
+
+
+// Writes a record for key: value, or a tombstone if value is NULL
+static int put(const char *key, const void *value, size_t length) {
+    size_t key_length = strlen(key);
+    if (!lock)
+        return CONFIG_STORE_FLASH_ERROR;
+    if (!key_length || key_length > CONFIG_STORE_MAX_KEY_LENGTH || length > CONFIG_STORE_MAX_VALUE_LENGTH)
+        return CONFIG_STORE_TOO_BIG;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    int result = 0;
+    uint16_t hash = hash_key(key, key_length);
+    bool found;
+    int slot = index_find(key, key_length, hash, &found);
+
+    record_header_t *header = (record_header_t *)record_buffer;
+    uint32_t size = RECORD_SIZE(key_length, length);
+    uint32_t old_size = found ? index_table[slot].size : 0;
+
+    if (!value && !found) {
+        result = CONFIG_STORE_NOT_FOUND;
+    } else if (value && found &&
+               read_record(index_table[slot].address, index_table[slot].address + old_size) == READ_OK &&
+               header->value_length == length &&
+               !memcmp((uint8_t *)(header + 1) + key_length, value, length)) {
+        // Unchanged, nothing to write
+    } else if (value && !found && stats.keys == CONFIG_STORE_MAX_KEYS) {
+        result = CONFIG_STORE_FULL;
+    } else if (stats.live_bytes - old_size + size > CAPACITY) {
+        result = CONFIG_STORE_FULL;
+    } else {
+        memset(record_buffer, 0xFF, size);
+        header->key_length = key_length;
+        header->flags = value ? 0 : RECORD_DELETED;
+        header->value_length = value ? length : 0;
+        memcpy(header + 1, key, key_length);
+        if (value)
+            memcpy((uint8_t *)(header + 1) + key_length, value, length);
+        header->crc = record_crc(header, (uint8_t *)(header + 1));
+        if (!value)
+            size = RECORD_SIZE(key_length, 0);
+
+        uint32_t address;
+        result = append(size, &address);
+        if (!result) {
+            stats.payload_bytes += key_length + (value ? length : 0);
+
+            // The collection in append may have moved the old record, not
+            // the slot
+            if (found) {
+                stats.live_bytes -= old_size;
+                stats.keys--;
+                index_remove(slot);
+            }
+            if (value) {
+                slot = index_find(key, key_length, hash, &found);
+                index_table[slot].address = address;
+                index_table[slot].hash = hash;
+                index_table[slot].size = size;
+                stats.live_bytes += size;
+                stats.keys++;
+            }
+        }
+    }
+
+    xSemaphoreGive(lock);
+    return result;
+}
+
+
+int config_store_set(const char *key, const void *value, size_t length) {
+    return put(key, value, length);
+}
+
+
+int config_store_set_string(const char *key, const char *value) {
+    return put(key, value, strlen(value));
+}
+
+
+int config_store_set_int(const char *key, int32_t value) {
+    char buffer[12];
+    int length = snprintf(buffer, sizeof(buffer), "%d", value);
+    return put(key, buffer, length);
+}
+
+
+int config_store_delete(const char *key) {
+    return put(key, NULL, 0);
+}
+
+
+void config_store_get_stats(config_store_stats_t *result) {
+    if (lock)
+        xSemaphoreTake(lock, portMAX_DELAY);
+
+    *result = stats;
+    result->min_erase_count = UINT32_MAX;
+    result->max_erase_count = 0;
+    for (int i = 0; i < CONFIG_STORE_SECTORS; i++) {
+        if (sectors[i].erase_count < result->min_erase_count)
+            result->min_erase_count = sectors[i].erase_count;
+        if (sectors[i].erase_count > result->max_erase_count)
+            result->max_erase_count = sectors[i].erase_count;
+    }
+
+    if (lock)
+        xSemaphoreGive(lock);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Flash region of the store: CONFIG_STORE_SECTORS sectors of 4KB from
+// CONFIG_STORE_BASE_ADDR. One sector is always kept free for garbage
+// collection. Set both from the Makefile, see component.mk.
+#ifndef CONFIG_STORE_BASE_ADDR
+#define CONFIG_STORE_BASE_ADDR 0xF8000
+#endif
+
+#ifndef CONFIG_STORE_SECTORS
+#define CONFIG_STORE_SECTORS 4
+#endif
+
+// Keys held at once. The RAM index takes 16 bytes per key.
+#ifndef CONFIG_STORE_MAX_KEYS
+#define CONFIG_STORE_MAX_KEYS 32
+#endif
+
+#define CONFIG_STORE_MAX_KEY_LENGTH 15
+#define CONFIG_STORE_MAX_VALUE_LENGTH 256
+
+#define CONFIG_STORE_NOT_FOUND -1
+#define CONFIG_STORE_TOO_BIG -2         // key or value too long, or buffer too small
+#define CONFIG_STORE_FULL -3            // out of keys or flash space
+#define CONFIG_STORE_FLASH_ERROR -4
+
+typedef struct {
+    uint32_t keys;
+    uint32_t live_bytes;        // flash taken by the current records
+    uint32_t payload_bytes;     // key and value bytes passed to set and delete
+    uint32_t flash_bytes;       // bytes written to flash for them, records,
+                                // sector headers and garbage collection
+    uint32_t erases;
+    uint32_t collections;       // sectors garbage collected
+    uint32_t min_erase_count;   // over all sectors of the region, for wear
+    uint32_t max_erase_count;
+} config_store_stats_t;
+
+/**
+    Scans the region and builds the RAM index of the newest record of each
+    key. Records torn by a power loss fail their CRC and are skipped, so a
+    key reads back either its old or its new value. Call once, early in
+    user_init; anything else fails until then.
+
+    @return A negative integer if this method fails.
+*/
+int config_store_init();
+
+/**
+    Reads the value of key.
+
+    @return Length of the value, CONFIG_STORE_NOT_FOUND or CONFIG_STORE_TOO_BIG
+            if it does not fit into size bytes.
+*/
+int config_store_get(const char *key, void *value, size_t size);
+
+/**
+    Reads a string value into buffer, NUL terminated.
+
+    @return Length of the string, or as config_store_get.
+*/
+int config_store_get_string(const char *key, char *buffer, size_t size);
+
+/**
+    Reads an integer value, stored as a decimal string so that
+    tools/config_store.py can write it.
+
+    @return default_value if key is not set or not a number.
+*/
+int32_t config_store_get_int(const char *key, int32_t default_value);
+
+/**
+    Appends a record with the new value of key. Nothing is written if the
+    value is unchanged. Older records are reclaimed by garbage collection
+    when the log wraps around.
+
+    @return A negative integer if this method fails.
+*/
+int config_store_set(const char *key, const void *value, size_t length);
+
+int config_store_set_string(const char *key, const char *value);
+
+int config_store_set_int(const char *key, int32_t value);
+
+/**
+    Appends a tombstone for key.
+
+    @return A negative integer if this method fails, CONFIG_STORE_NOT_FOUND
+            if key was not set.
+*/
+int config_store_delete(const char *key);
+
+void config_store_get_stats(config_store_stats_t *stats);
@@ -0,0 +1,22 @@
+# Component makefile for cpu_usage
+
+INC_DIRS += $(cpu_usage_ROOT)
+
+cpu_usage_SRC_DIR = $(cpu_usage_ROOT)
+
+$(eval $(call component_compile_rules,cpu_usage))
+
+# The kernel adds up each task's run time at every context switch. The
+# clock is the free running microsecond counter behind sdk_system_get_time()
+# (WDEV.SYS_TIME), read directly since the kernel cannot call into the SDK.
+# It wraps every 71 minutes; the kernel drops the slice a wrap falls in.
+# traceTASK_SWITCHED_IN counts the switches, for the overhead figure.
+#
+# These go to every file of the program, not only to this component, on
+# purpose: they change the layout of the kernel's TCB and TaskStatus_t, so
+# the kernel and all code using FreeRTOS headers have to agree on them.
+# Only programs that list cpu_usage in EXTRA_COMPONENTS get them.
+EXTRA_CFLAGS += -DconfigUSE_TRACE_FACILITY=1 -DconfigGENERATE_RUN_TIME_STATS=1 \
+	'-DportCONFIGURE_TIMER_FOR_RUN_TIME_STATS()=' \
+	'-DportGET_RUN_TIME_COUNTER_VALUE()=(*(volatile uint32_t *)0x3FF20C00)' \
+	'-DtraceTASK_SWITCHED_IN()=do { extern volatile uint32_t cpu_usage_switches; cpu_usage_switches++; } while (0)'
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <string.h>
+#include <espressif/esp_common.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <lwip/sockets.h>
+
+#include "cpu_usage.h"
+
+#define CPU_USAGE_STACK_SIZE 192
+
+// Rounds of the kernel's per switch accounting timed by cpu_usage_init
+#define CALIBRATION_ROUNDS 10000
+
+typedef struct {
+    UBaseType_t number;         // 0 if the slot is free
+    char name[configMAX_TASK_NAME_LEN];
+    bool seen;                  // task was listed in the last sample
+    uint32_t last_counter;
+    uint32_t run_us[CPU_USAGE_WINDOW];
+} task_slot_t;
+
+static task_slot_t slots[CPU_USAGE_MAX_TASKS];
+static uint32_t period_us[CPU_USAGE_WINDOW];
+static uint32_t overhead_us[CPU_USAGE_WINDOW];
+static uint32_t switches[CPU_USAGE_WINDOW];
+static uint32_t last_switches;
+static uint32_t switch_cost_ns;
+static int current = 0;
+static uint32_t last_sample_time;
+static uint32_t skipped = 0;
+
+// Only touched by the sampler task, too big for its stack
+static TaskStatus_t status[CPU_USAGE_MAX_TASKS];
+
+// Counted by the kernel's traceTASK_SWITCHED_IN, see component.mk
+volatile uint32_t cpu_usage_switches = 0;
+
+static TaskHandle_t sampler_task_handle = NULL;
+static StaticTask_t sampler_task_buffer;
+static StackType_t sampler_stack[CPU_USAGE_STACK_SIZE];
+
+
+static task_slot_t *slot_for(UBaseType_t number) {
+    task_slot_t *free_slot = NULL;
+    for (int i = 0; i < CPU_USAGE_MAX_TASKS; i++) {
+        if (slots[i].number == number)
+            return &slots[i];
+        if (!slots[i].number && !free_slot)
+            free_slot = &slots[i];
+    }
+    return free_slot;
+}
+
+
+static void sample(bool first) {
+    uint32_t started = sdk_system_get_time();
+
+    UBaseType_t count = uxTaskGetSystemState(status, CPU_USAGE_MAX_TASKS, NULL);
+    if (!count) {
+        // More tasks than CPU_USAGE_MAX_TASKS, the kernel lists none
+        skipped++;
+        return;
+    }
+
+    vTaskSuspendAll();
+
+    uint32_t switched = cpu_usage_switches;
+    if (!first) {
+        current = (current + 1) % CPU_USAGE_WINDOW;
+        period_us[current] = started - last_sample_time;
+        overhead_us[current] = 0;
+        switches[current] = switched - last_switches;
+    }
+    last_sample_time = started;
+    last_switches = switched;
+
+    for (int i = 0; i < CPU_USAGE_MAX_TASKS; i++) {
+        slots[i].seen = false;
+        slots[i].run_us[current] = 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        task_slot_t *slot = slot_for(status[i].xTaskNumber);
+        if (!slot) {
+            skipped++;
+            continue;
+        }
+
+        if (!slot->number) {
+            slot->number = status[i].xTaskNumber;
+            strncpy(slot->name, status[i].pcTaskName, sizeof(slot->name) - 1);
+            slot->name[sizeof(slot->name) - 1] = 0;
+            // Counters start at zero when a task is created, except for
+            // tasks that were already running when sampling started
+            slot->last_counter = first ? status[i].ulRunTimeCounter : 0;
+            memset(slot->run_us, 0, sizeof(slot->run_us));
+        }
+
+        slot->run_us[current] = status[i].ulRunTimeCounter - slot->last_counter;
+        slot->last_counter = status[i].ulRunTimeCounter;
+        slot->seen = true;
+    }
+
+    // Deleted tasks keep their slot until they drop out of the window
+    for (int i = 0; i < CPU_USAGE_MAX_TASKS; i++) {
+        if (!slots[i].number || slots[i].seen)
+            continue;
+
+        uint32_t total = 0;
+        for (int j = 0; j < CPU_USAGE_WINDOW; j++)
+            total += slots[i].run_us[j];
+        if (!total)
+            slots[i].number = 0;
+    }
+
+    overhead_us[current] = sdk_system_get_time() - started;
+
+    xTaskResumeAll();
+}
+
+
+static void sampler_task(void *_args) {
+    TickType_t wake_time = xTaskGetTickCount();
+    while (true) {
+        vTaskDelayUntil(&wake_time, CPU_USAGE_PERIOD_MS / portTICK_PERIOD_MS);
+        sample(false);
+    }
+}
+
+
+// Times what run time stats add to every context switch in
+// vTaskSwitchContext: a read of the counter, an add to the task's total and
+// the switch count. The loop and any interrupt in between are counted too,
+// so this errs on the high side.
+static uint32_t measure_switch_cost_ns() {
+    static volatile uint32_t switched_in_time, run_time_counter, count;
+
+    uint32_t started = portGET_RUN_TIME_COUNTER_VALUE();
+    for (int i = 0; i < CALIBRATION_ROUNDS; i++) {
+        uint32_t total = portGET_RUN_TIME_COUNTER_VALUE();
+        if (total > switched_in_time)
+            run_time_counter += total - switched_in_time;
+        switched_in_time = total;
+        count++;
+    }
+    uint32_t elapsed = portGET_RUN_TIME_COUNTER_VALUE() - started;
+
+    return (uint64_t)elapsed * 1000 / CALIBRATION_ROUNDS;
+}
+
+
+int cpu_usage_init() {
+    if (sampler_task_handle)
+        return 0;
+
+    switch_cost_ns = measure_switch_cost_ns();
+    sample(true);
+
+    sampler_task_handle = xTaskCreateStatic(sampler_task, "CPU usage", CPU_USAGE_STACK_SIZE,
+                                            NULL, CPU_USAGE_TASK_PRIORITY,
+                                            sampler_stack, &sampler_task_buffer);
+    return sampler_task_handle ? 0 : -1;
+}
+
+
+void cpu_usage_get(cpu_usage_t *usage) {
+    memset(usage, 0, sizeof(*usage));
+
+    vTaskSuspendAll();
+    for (int i = 0; i < CPU_USAGE_WINDOW; i++) {
+        usage->window_us += period_us[i];
+        usage->sampling_us += overhead_us[i];
+        usage->switches += switches[i];
+    }
+
+    for (int i = 0; i < CPU_USAGE_MAX_TASKS; i++) {
+        if (!slots[i].number)
+            continue;
+
+        cpu_usage_task_t *task = &usage->tasks[usage->count++];
+        strcpy(task->name, slots[i].name);
+        task->number = slots[i].number;
+        task->deleted = !slots[i].seen;
+        for (int j = 0; j < CPU_USAGE_WINDOW; j++)
+            task->run_us += slots[i].run_us[j];
+    }
+    xTaskResumeAll();
+
+    usage->switch_cost_ns = switch_cost_ns;
+    usage->overhead_us = usage->sampling_us + (uint64_t)usage->switches * switch_cost_ns / 1000;
+
+    for (int i = 0; i < usage->count; i++) {
+        cpu_usage_task_t *task = &usage->tasks[i];
+        if (usage->window_us)
+            task->permille = (uint64_t)task->run_us * 1000 / usage->window_us;
+
+        // Insertion sort, busiest first
+        cpu_usage_task_t t = *task;
+        int j = i;
+        for (; j > 0 && usage->tasks[j-1].run_us < t.run_us; j--)
+            usage->tasks[j] = usage->tasks[j-1];
+        usage->tasks[j] = t;
+    }
+}
+
+
+typedef void (*line_writer_fn)(const char *line, int length, void *context);
+
+static void format_usage(line_writer_fn write_line, void *context) {
+    cpu_usage_t usage;
+    char line[96];
+    int n;
+
+    cpu_usage_get(&usage);
+
+    n = snprintf(line, sizeof(line), "CPU usage over the last %u ms:\n", usage.window_us / 1000);
+    write_line(line, n, context);
+
+    for (int i = 0; i < usage.count; i++) {
+        const cpu_usage_task_t *task = &usage.tasks[i];
+        n = snprintf(line, sizeof(line), "  %-*s %3u.%u%%  %9u us%s\n",
+                     configMAX_TASK_NAME_LEN, task->name,
+                     task->permille / 10, task->permille % 10, task->run_us,
+                     task->deleted ? "  (deleted)" : "");
+        write_line(line, n, context);
+    }
+
+    uint32_t overhead = usage.window_us ? (uint64_t)usage.overhead_us * 10000 / usage.window_us : 0;
+    n = snprintf(line, sizeof(line), "  accounting overhead %u.%02u%%: sampling %u us, %u switches at %u ns\n",
+                 overhead / 100, overhead % 100, usage.sampling_us, usage.switches, usage.switch_cost_ns);
+    write_line(line, n, context);
+
+    if (skipped) {
+        n = snprintf(line, sizeof(line), "  %u tasks not tracked, raise CPU_USAGE_MAX_TASKS\n", skipped);
+        write_line(line, n, context);
+    }
+}
+
+
+static void print_line(const char *line, int length, void *context) {
+    printf("%s", line);
+}
+
+void cpu_usage_print() {
+    format_usage(print_line, NULL);
+}
+
+
+static void send_line(const char *line, int length, void *context) {
+    write(*(int *)context, line, length);
+}
+
+static void cpu_usage_server_task(void *arg) {
+    uint16_t port = (uintptr_t)arg;
+
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) {
+        printf("cpu-usage: failed to create socket\n");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (bind(s, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(s, 1) < 0) {
+        printf("cpu-usage: failed to listen on port %d\n", port);
+        close(s);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while (true) {
+        int client = accept(s, NULL, NULL);
+        if (client < 0)
+            continue;
+
+        format_usage(send_line, &client);
+        close(client);
+    }
+}
+
+
+void cpu_usage_serve(uint16_t port) {
+    static bool serving = false;
+    if (serving)
+        return;
+
+    serving = true;
+    xTaskCreate(cpu_usage_server_task, "CPU usage srv", 384, (void *)(uintptr_t)port, 1, NULL);
+}
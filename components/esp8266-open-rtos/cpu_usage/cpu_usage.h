@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+#if !configGENERATE_RUN_TIME_STATS || !configUSE_TRACE_FACILITY
+#error "cpu_usage needs configGENERATE_RUN_TIME_STATS and configUSE_TRACE_FACILITY, see its component.mk"
+#endif
+
+// How often the per-task run time counters are sampled
+#ifndef CPU_USAGE_PERIOD_MS
+#define CPU_USAGE_PERIOD_MS 1000
+#endif
+
+// Number of periods in the sliding window usage is reported over
+#ifndef CPU_USAGE_WINDOW
+#define CPU_USAGE_WINDOW 10
+#endif
+
+// Tasks tracked at once, including the idle and timer tasks and those of
+// the SDK (WiFi, lwip)
+#ifndef CPU_USAGE_MAX_TASKS
+#define CPU_USAGE_MAX_TASKS 16
+#endif
+
+#ifndef CPU_USAGE_TASK_PRIORITY
+#define CPU_USAGE_TASK_PRIORITY 3
+#endif
+
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t number;         // FreeRTOS task number, unique per created task
+    bool deleted;               // task is gone but still ran during the window
+    uint32_t run_us;            // run time within the window
+    uint16_t permille;          // share of the window, in 0.1%
+} cpu_usage_task_t;
+
+typedef struct {
+    uint32_t window_us;         // length of the window, at most
+                                // CPU_USAGE_WINDOW * CPU_USAGE_PERIOD_MS
+    uint32_t overhead_us;       // accounting within the window: sampling
+                                // plus switches * switch_cost_ns
+    uint32_t sampling_us;       // time the sampler took
+    uint32_t switches;          // context switches
+    uint32_t switch_cost_ns;    // what run time stats add to a switch,
+                                // measured by cpu_usage_init
+    uint8_t count;
+    cpu_usage_task_t tasks[CPU_USAGE_MAX_TASKS];  // busiest first
+} cpu_usage_t;
+
+/**
+    Starts sampling per-task run time. The kernel accumulates each task's
+    run time at every context switch; a sampler task turns the counters
+    into per-period deltas every CPU_USAGE_PERIOD_MS. Interrupt handlers
+    are charged to the task they interrupted. Times the kernel's part of
+    the accounting first, a few milliseconds.
+
+    @return A negative integer if this method fails.
+*/
+int cpu_usage_init();
+
+/**
+    Snapshot of CPU usage per task over the last CPU_USAGE_WINDOW periods.
+*/
+void cpu_usage_get(cpu_usage_t *usage);
+
+/**
+    Prints the snapshot, one line per task, followed by the share of the
+    window spent on the accounting itself, the sampler's and the kernel's.
+    Takes about 650 bytes of the caller's stack.
+*/
+void cpu_usage_print();
+
+/**
+    Sends the same lines to every client connecting to the given TCP port:
+
+        nc <device> <port>
+
+    Does nothing if the port is already served, so it can be called on every
+    wifi (re)connect.
+*/
+void cpu_usage_serve(uint16_t port);
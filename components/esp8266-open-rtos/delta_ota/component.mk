@@ -0,0 +1,7 @@
+# Component makefile for delta_ota
+
+INC_DIRS += $(delta_ota_ROOT)
+
+delta_ota_SRC_DIR = $(delta_ota_ROOT)
+
+$(eval $(call component_compile_rules,delta_ota))
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <espressif/esp_common.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <lwip/sockets.h>
+#include <spiflash.h>
+#include <rboot-api.h>
+#include <flash_scheduler.h>
+
+#include "delta_patch.h"
+#include "delta_ota.h"
+
+#define SECTOR_SIZE 4096
+// New image bytes are written a flash page at a time
+#define PAGE_SIZE FLASH_SCHEDULER_CHUNK_SIZE
+#define TFTP_BLOCK_SIZE 512
+#define TFTP_TIMEOUT 10  // in seconds
+
+#define TFTP_OP_WRQ 2
+#define TFTP_OP_DATA 3
+#define TFTP_OP_ACK 4
+#define TFTP_OP_ERROR 5
+
+#define TFTP_ERR_NOT_DEFINED 0
+#define TFTP_ERR_FILE_NOT_FOUND 1
+#define TFTP_ERR_DISK_FULL 3
+#define TFTP_ERR_ILLEGAL_OPERATION 4
+
+
+typedef struct {
+    int socket;
+    struct sockaddr_in peer;
+
+    bool is_delta;
+    uint32_t source_address;
+    uint32_t target_address;
+    uint32_t slot_size;
+    uint8_t slot;
+
+    uint32_t written;       // bytes of the new image already in flash
+    uint16_t buffered;
+    uint8_t page[PAGE_SIZE];
+
+    uint8_t packet[4 + TFTP_BLOCK_SIZE];
+
+    delta_patch_t patch;
+} delta_ota_t;
+
+
+static int flash_flush(delta_ota_t *ota) {
+    if (!ota->buffered)
+        return 0;
+
+    // Only the last page is short, so every sector starts with a page
+    uint32_t address = ota->target_address + ota->written;
+    if (address % SECTOR_SIZE == 0 && !flash_scheduler_erase_sector(address))
+        return -1;
+
+    // flash writes go in whole words
+    uint16_t length = (ota->buffered + 3) & ~3;
+    memset(ota->page + ota->buffered, 0xFF, length - ota->buffered);
+    if (!flash_scheduler_write(address, ota->page, length))
+        return -1;
+
+    ota->written += ota->buffered;
+    ota->buffered = 0;
+    return 0;
+}
+
+
+static int write_target(void *context, const uint8_t *data, size_t length) {
+    delta_ota_t *ota = context;
+    if (ota->written + ota->buffered + length > ota->slot_size)
+        return -1;
+
+    while (length) {
+        size_t n = PAGE_SIZE - ota->buffered;
+        if (n > length)
+            n = length;
+        memcpy(ota->page + ota->buffered, data, n);
+        ota->buffered += n;
+        data += n;
+        length -= n;
+
+        if (ota->buffered == PAGE_SIZE && flash_flush(ota))
+            return -1;
+    }
+    return 0;
+}
+
+
+static int read_source(void *context, uint32_t offset, uint8_t *buffer, size_t length) {
+    delta_ota_t *ota = context;
+    return spiflash_read(ota->source_address + offset, buffer, length) ? 0 : -1;
+}
+
+
+static int check_header(void *context, const delta_header_t *header) {
+    delta_ota_t *ota = context;
+
+    if (header->target_size > ota->slot_size) {
+        printf("Delta OTA: new image does not fit, %u > %u bytes\n",
+               header->target_size, ota->slot_size);
+        return -1;
+    }
+
+    // Make sure the delta was built against the image we are running
+    uint32_t crc = 0;
+    uint8_t buffer[256];
+    for (uint32_t offset = 0; offset < header->source_size; offset += sizeof(buffer)) {
+        uint32_t n = header->source_size - offset;
+        if (n > sizeof(buffer))
+            n = sizeof(buffer);
+        if (read_source(ota, offset, buffer, n))
+            return -1;
+        crc = delta_crc32(crc, buffer, n);
+    }
+
+    if (crc != header->source_crc) {
+        printf("Delta OTA: delta does not match the running image\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void tftp_send(delta_ota_t *ota, const uint8_t *packet, size_t length) {
+    sendto(ota->socket, packet, length, 0, (struct sockaddr *)&ota->peer, sizeof(ota->peer));
+}
+
+
+static void tftp_ack(delta_ota_t *ota, uint16_t block) {
+    uint8_t packet[4] = { 0, TFTP_OP_ACK, block >> 8, block & 0xFF };
+    tftp_send(ota, packet, sizeof(packet));
+}
+
+
+static void tftp_error(delta_ota_t *ota, uint16_t code, const char *message) {
+    uint8_t packet[64] = { 0, TFTP_OP_ERROR, code >> 8, code & 0xFF };
+    size_t length = strlen(message) + 1;
+    if (length > sizeof(packet) - 4)
+        length = sizeof(packet) - 4;
+    memcpy(packet + 4, message, length);
+    packet[3 + length] = 0;
+    tftp_send(ota, packet, 4 + length);
+}
+
+
+static bool same_peer(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+
+// Receives the DATA blocks of an accepted write request. Returns true once the
+// whole image is in the inactive slot and verified.
+static bool delta_ota_receive(delta_ota_t *ota) {
+    uint16_t expected = 1;
+    uint32_t received = 0;
+    uint32_t started = xTaskGetTickCount();
+    int result = DELTA_OK;
+
+    flash_scheduler_stats_t stats;
+    flash_scheduler_get_stats(&stats, true);
+
+    tftp_ack(ota, 0);
+
+    while (true) {
+        struct sockaddr_in from;
+        socklen_t from_length = sizeof(from);
+        int length = recvfrom(ota->socket, ota->packet, sizeof(ota->packet), 0,
+                              (struct sockaddr *)&from, &from_length);
+        if (length < 0) {
+            printf("Delta OTA: timeout after %u bytes\n", received);
+            return false;
+        }
+        if (!same_peer(&from, &ota->peer) || length < 4 || ota->packet[1] != TFTP_OP_DATA)
+            continue;
+
+        uint16_t block = (ota->packet[2] << 8) | ota->packet[3];
+        if (block != expected) {
+            // duplicate of a block we already have, its ACK got lost
+            tftp_ack(ota, block);
+            continue;
+        }
+
+        const uint8_t *data = ota->packet + 4;
+        size_t data_length = length - 4;
+        received += data_length;
+
+        if (ota->is_delta) {
+            result = delta_patch_feed(&ota->patch, data, data_length);
+        } else {
+            result = write_target(ota, data, data_length) ? DELTA_ERROR_WRITE : DELTA_OK;
+        }
+
+        if (result < 0) {
+            printf("Delta OTA: failed with error %d after %u bytes\n", result, received);
+            tftp_error(ota, result == DELTA_ERROR_WRITE ? TFTP_ERR_DISK_FULL : TFTP_ERR_NOT_DEFINED,
+                       "Bad image");
+            return false;
+        }
+
+        if (data_length < TFTP_BLOCK_SIZE)
+            break;
+
+        tftp_ack(ota, block);
+        expected++;
+    }
+
+    if (flash_flush(ota)) {
+        tftp_error(ota, TFTP_ERR_DISK_FULL, "Flash write failed");
+        return false;
+    }
+
+    if (ota->is_delta && result != DELTA_DONE) {
+        tftp_error(ota, TFTP_ERR_NOT_DEFINED, "Truncated delta");
+        return false;
+    }
+
+    uint32_t image_length;
+    const char *error;
+    if (!rboot_verify_image(ota->target_address, &image_length, &error)) {
+        printf("Delta OTA: new image is invalid: %s\n", error);
+        tftp_error(ota, TFTP_ERR_NOT_DEFINED, error);
+        return false;
+    }
+
+    tftp_ack(ota, expected);
+
+    uint32_t elapsed = (xTaskGetTickCount() - started) * portTICK_PERIOD_MS;
+    printf("Delta OTA: received %u bytes for a %u byte image in %u ms\n",
+           received, ota->written, elapsed);
+
+    flash_scheduler_get_stats(&stats, false);
+    printf("Delta OTA: worst flash stall %u us per erase, %u us per write chunk, "
+           "%u chunks deferred, %u forced\n",
+           stats.worst_erase_us, stats.worst_write_us, stats.deferred, stats.forced);
+    return true;
+}
+
+
+static bool delta_ota_prepare(delta_ota_t *ota, const char *file_name) {
+    if (!strcmp(file_name, DELTA_OTA_FILE_NAME)) {
+        ota->is_delta = true;
+    } else if (!strcmp(file_name, DELTA_OTA_FULL_FILE_NAME)) {
+        ota->is_delta = false;
+    } else {
+        tftp_error(ota, TFTP_ERR_FILE_NOT_FOUND, "Unknown file");
+        return false;
+    }
+
+    rboot_config config = rboot_get_config();
+    if (config.count < 2) {
+        tftp_error(ota, TFTP_ERR_NOT_DEFINED, "No OTA slot");
+        return false;
+    }
+
+    ota->slot = (config.current_rom + 1) % config.count;
+    ota->source_address = config.roms[config.current_rom];
+    ota->target_address = config.roms[ota->slot];
+    ota->slot_size = (config.roms[1] > config.roms[0])
+        ? config.roms[1] - config.roms[0] : config.roms[0] - config.roms[1];
+    ota->written = 0;
+    ota->buffered = 0;
+
+    delta_patch_init(&ota->patch, check_header, read_source, write_target, ota);
+
+    printf("Delta OTA: receiving %s into slot %d\n", file_name, ota->slot);
+    return true;
+}
+
+
+static void delta_ota_task(void *arg) {
+    int port = (int)arg;
+
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_port = htons(port),
+    };
+    if (s < 0 || bind(s, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        printf("Delta OTA: failed to listen on port %d\n", port);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while (true) {
+        // Longer requests are cut short, and then name no file we take
+        uint8_t request[64];
+        struct sockaddr_in peer;
+        socklen_t peer_length = sizeof(peer);
+
+        struct timeval no_timeout = { 0, 0 };
+        setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &no_timeout, sizeof(no_timeout));
+
+        int length = recvfrom(s, request, sizeof(request) - 1, 0, (struct sockaddr *)&peer, &peer_length);
+        if (length < 4 || request[1] != TFTP_OP_WRQ)
+            continue;
+        request[length] = 0;
+
+        // Buffers live only for the duration of an update, about 3 KB
+        delta_ota_t *ota = malloc(sizeof(delta_ota_t));
+        if (!ota) {
+            printf("Delta OTA: not enough memory\n");
+            continue;
+        }
+        memset(ota, 0, sizeof(*ota));
+        ota->socket = s;
+        ota->peer = peer;
+
+        struct timeval timeout = { TFTP_TIMEOUT, 0 };
+        setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        bool success = delta_ota_prepare(ota, (const char *)request + 2) && delta_ota_receive(ota);
+        uint8_t slot = ota->slot;
+        free(ota);
+
+        if (success) {
+            rboot_set_current_rom(slot);
+            printf("Delta OTA: restarting into slot %d\n", slot);
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            sdk_system_restart();
+        }
+    }
+}
+
+
+void delta_ota_init_server(int port) {
+    xTaskCreate(delta_ota_task, "Delta OTA", DELTA_OTA_STACK_SIZE, (void *)port, 2, NULL);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#define DELTA_OTA_FILE_NAME "firmware.delta"
+#define DELTA_OTA_FULL_FILE_NAME "firmware.bin"
+
+// In words, taken for good when the server starts
+#ifndef DELTA_OTA_STACK_SIZE
+#define DELTA_OTA_STACK_SIZE 768
+#endif
+
+/**
+    Starts a TFTP server that takes firmware updates over the ota-tftp transport.
+    A file named DELTA_OTA_FILE_NAME is a compressed delta against the running
+    image (see tools/delta_ota.py), DELTA_OTA_FULL_FILE_NAME is a complete image.
+    Either way the new image is written into the inactive rboot slot while the
+    transfer runs, and the device reboots into it once it has been verified.
+
+    The server task keeps DELTA_OTA_STACK_SIZE words of stack (3 KB) all the
+    time. An update takes about 3 KB more from the heap while it runs: the
+    2 KB window of the delta decoder, a TFTP packet and a flash page.
+
+    @param port UDP port to listen on, usually TFTP_PORT from ota-tftp.h
+*/
+void delta_ota_init_server(int port);
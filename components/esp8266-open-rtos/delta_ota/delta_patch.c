@@ -0,0 +1,304 @@
+#include <string.h>
+#include <stdbool.h>
+#include "delta_patch.h"
+
+#define HEADER_SIZE 21
+#define COPY_CHUNK 64
+
+#define OP_LITERAL 0
+#define OP_COPY_SOURCE 1
+#define OP_COPY_WINDOW 2
+#define OP_END 3
+
+enum {
+    STATE_HEADER,
+    STATE_COMMAND,
+    STATE_LENGTH,
+    STATE_ARGUMENT,
+    STATE_LITERAL,
+    STATE_DONE,
+    STATE_FAILED,
+};
+
+
+static const uint32_t crc_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t delta_crc32(uint32_t crc, const uint8_t *data, size_t length) {
+    crc = ~crc;
+    while (length--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ crc_table[crc & 0x0F];
+        crc = (crc >> 4) ^ crc_table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+
+static uint32_t read_u32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+
+void delta_patch_init(delta_patch_t *patch,
+                      delta_header_fn on_header,
+                      delta_read_fn read_source,
+                      delta_write_fn write_target,
+                      void *context) {
+    memset(patch, 0, sizeof(*patch));
+    patch->on_header = on_header;
+    patch->read_source = read_source;
+    patch->write_target = write_target;
+    patch->context = context;
+    patch->state = STATE_HEADER;
+}
+
+
+static int emit(delta_patch_t *patch, const uint8_t *data, size_t length) {
+    if (patch->written + length > patch->header.target_size)
+        return DELTA_ERROR_SIZE;
+
+    if (patch->write_target(patch->context, data, length) < 0)
+        return DELTA_ERROR_WRITE;
+
+    patch->crc = delta_crc32(patch->crc, data, length);
+    patch->written += length;
+
+    while (length) {
+        size_t n = DELTA_WINDOW_SIZE - patch->window_position;
+        if (n > length)
+            n = length;
+        memcpy(patch->window + patch->window_position, data, n);
+        patch->window_position = (patch->window_position + n) % DELTA_WINDOW_SIZE;
+        data += n;
+        length -= n;
+    }
+
+    return DELTA_OK;
+}
+
+
+static int copy_source(delta_patch_t *patch, int32_t offset, uint32_t length) {
+    uint32_t position = patch->source_position + offset;
+    if ((offset < 0 && (uint32_t)-offset > patch->source_position) ||
+            position > patch->header.source_size || length > patch->header.source_size - position)
+        return DELTA_ERROR_FORMAT;
+
+    uint8_t buffer[COPY_CHUNK];
+    while (length) {
+        size_t n = (length > COPY_CHUNK) ? COPY_CHUNK : length;
+        if (patch->read_source(patch->context, position, buffer, n) < 0)
+            return DELTA_ERROR_READ;
+
+        int r = emit(patch, buffer, n);
+        if (r < 0)
+            return r;
+
+        position += n;
+        length -= n;
+    }
+
+    patch->source_position = position;
+    return DELTA_OK;
+}
+
+
+static int copy_window(delta_patch_t *patch, uint32_t distance, uint32_t length) {
+    // The header may ask for a window smaller than the one kept
+    if (distance == 0 || distance > (1u << patch->header.window_bits) || distance > patch->written)
+        return DELTA_ERROR_FORMAT;
+
+    uint8_t buffer[COPY_CHUNK];
+    while (length) {
+        // Overlapping copies repeat the last distance bytes
+        size_t n = length;
+        if (n > COPY_CHUNK)
+            n = COPY_CHUNK;
+        if (n > distance)
+            n = distance;
+
+        uint16_t from = (patch->window_position + DELTA_WINDOW_SIZE - distance) % DELTA_WINDOW_SIZE;
+        for (size_t i = 0; i < n; i++)
+            buffer[i] = patch->window[(from + i) % DELTA_WINDOW_SIZE];
+
+        int r = emit(patch, buffer, n);
+        if (r < 0)
+            return r;
+
+        length -= n;
+    }
+
+    return DELTA_OK;
+}
+
+
+static int parse_header(delta_patch_t *patch) {
+    const uint8_t *h = patch->window;
+    if (memcmp(h, DELTA_MAGIC, 4))
+        return DELTA_ERROR_FORMAT;
+
+    patch->header.source_size = read_u32(h + 4);
+    patch->header.source_crc = read_u32(h + 8);
+    patch->header.target_size = read_u32(h + 12);
+    patch->header.target_crc = read_u32(h + 16);
+    patch->header.window_bits = h[20];
+    if (patch->header.window_bits > DELTA_WINDOW_BITS)
+        return DELTA_ERROR_FORMAT;
+
+    if (patch->on_header && patch->on_header(patch->context, &patch->header) < 0)
+        return DELTA_ERROR_ABORTED;
+
+    return DELTA_OK;
+}
+
+
+static int execute(delta_patch_t *patch) {
+    switch (patch->op) {
+        case OP_COPY_SOURCE: {
+            // zigzag decoding
+            int32_t offset = (int32_t)(patch->varint >> 1) ^ -(int32_t)(patch->varint & 1);
+            return copy_source(patch, offset, patch->length);
+        }
+        case OP_COPY_WINDOW:
+            return copy_window(patch, patch->varint, patch->length);
+        default:
+            return DELTA_ERROR_FORMAT;
+    }
+}
+
+
+static int finish(delta_patch_t *patch) {
+    if (patch->written != patch->header.target_size)
+        return DELTA_ERROR_SIZE;
+    if (patch->crc != patch->header.target_crc)
+        return DELTA_ERROR_CRC;
+    return DELTA_DONE;
+}
+
+
+// Sets complete once the last byte of the varint was read
+static int read_varint(delta_patch_t *patch, uint8_t byte, bool *complete) {
+    // The fifth byte has room for the top 4 bits only
+    if (patch->varint_shift > 28 || (patch->varint_shift == 28 && (byte & 0x70)))
+        return DELTA_ERROR_FORMAT;
+
+    patch->varint |= (uint32_t)(byte & 0x7F) << patch->varint_shift;
+    patch->varint_shift += 7;
+    *complete = !(byte & 0x80);
+    return DELTA_OK;
+}
+
+
+static void start_varint(delta_patch_t *patch, uint8_t state) {
+    patch->varint = 0;
+    patch->varint_shift = 0;
+    patch->state = state;
+}
+
+
+static int after_length(delta_patch_t *patch) {
+    if (patch->op == OP_LITERAL) {
+        patch->state = STATE_LITERAL;
+    } else {
+        start_varint(patch, STATE_ARGUMENT);
+    }
+    return DELTA_OK;
+}
+
+
+int delta_patch_feed(delta_patch_t *patch, const uint8_t *data, size_t length) {
+    int r = DELTA_OK;
+    bool complete;
+
+    while (length && r >= 0) {
+        switch (patch->state) {
+            case STATE_HEADER: {
+                // The window is not in use yet, collect the header there
+                size_t n = HEADER_SIZE - patch->header_length;
+                if (n > length)
+                    n = length;
+                memcpy(patch->window + patch->header_length, data, n);
+                patch->header_length += n;
+                data += n;
+                length -= n;
+
+                if (patch->header_length == HEADER_SIZE) {
+                    r = parse_header(patch);
+                    patch->state = STATE_COMMAND;
+                }
+                break;
+            }
+
+            case STATE_COMMAND: {
+                uint8_t command = *data++;
+                length--;
+
+                patch->op = command & 0x03;
+                if (patch->op == OP_END) {
+                    r = finish(patch);
+                    patch->state = STATE_DONE;
+                    break;
+                }
+
+                patch->length = (command >> 2) + 1;
+                if (patch->length == 64) {
+                    start_varint(patch, STATE_LENGTH);
+                } else {
+                    r = after_length(patch);
+                }
+                break;
+            }
+
+            case STATE_LENGTH:
+                r = read_varint(patch, *data++, &complete);
+                length--;
+                if (r >= 0 && complete) {
+                    if (patch->varint > UINT32_MAX - 64) {
+                        r = DELTA_ERROR_FORMAT;
+                        break;
+                    }
+                    patch->length = 64 + patch->varint;
+                    r = after_length(patch);
+                }
+                break;
+
+            case STATE_ARGUMENT:
+                r = read_varint(patch, *data++, &complete);
+                length--;
+                if (r >= 0 && complete) {
+                    r = execute(patch);
+                    patch->state = STATE_COMMAND;
+                }
+                break;
+
+            case STATE_LITERAL: {
+                size_t n = (length < patch->length) ? length : patch->length;
+                r = emit(patch, data, n);
+                data += n;
+                length -= n;
+                patch->length -= n;
+                if (!patch->length)
+                    patch->state = STATE_COMMAND;
+                break;
+            }
+
+            case STATE_DONE:
+                // trailing bytes (e.g. padding) are ignored
+                return DELTA_DONE;
+
+            default:
+                return DELTA_ERROR_FORMAT;
+        }
+    }
+
+    if (r < 0) {
+        patch->state = STATE_FAILED;
+        return r;
+    }
+
+    return (patch->state == STATE_DONE) ? DELTA_DONE : DELTA_OK;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Streaming decoder for the delta image format produced by tools/delta_ota.py.
+ *
+ * A delta is a header followed by commands that rebuild the new image from
+ * literal bytes, ranges of the old (running) image and back references into
+ * the last DELTA_WINDOW_SIZE bytes of output:
+ *
+ *   header:  "HKD1" source_size source_crc target_size target_crc window_bits
+ *            (u32 little endian, window_bits is one byte)
+ *   command: one byte, op in bits 0-1, length-1 in bits 2-7; a length field
+ *            of 63 is followed by a varint with the rest of the length (-64)
+ *     op 0   literal, followed by length bytes
+ *     op 1   copy from source, followed by a zigzag varint offset relative
+ *            to the end of the previous source copy
+ *     op 2   copy from window, followed by a varint distance (1..window)
+ *     op 3   end of delta
+ */
+
+#define DELTA_MAGIC "HKD1"
+#define DELTA_WINDOW_BITS 11
+#define DELTA_WINDOW_SIZE (1 << DELTA_WINDOW_BITS)
+
+#define DELTA_OK 0
+#define DELTA_DONE 1
+#define DELTA_ERROR_FORMAT -1
+#define DELTA_ERROR_READ -2
+#define DELTA_ERROR_WRITE -3
+#define DELTA_ERROR_SIZE -4
+#define DELTA_ERROR_CRC -5
+#define DELTA_ERROR_ABORTED -6
+
+typedef struct {
+    uint32_t source_size;
+    uint32_t source_crc;
+    uint32_t target_size;
+    uint32_t target_crc;
+    uint8_t window_bits;
+} delta_header_t;
+
+typedef int (*delta_header_fn)(void *context, const delta_header_t *header);
+typedef int (*delta_read_fn)(void *context, uint32_t offset, uint8_t *buffer, size_t length);
+typedef int (*delta_write_fn)(void *context, const uint8_t *buffer, size_t length);
+
+typedef struct {
+    delta_header_fn on_header;
+    delta_read_fn read_source;
+    delta_write_fn write_target;
+    void *context;
+
+    delta_header_t header;
+
+    uint8_t state;
+    uint8_t op;
+    uint8_t header_length;
+    uint8_t varint_shift;
+    uint32_t varint;
+    uint32_t length;
+
+    uint32_t source_position;
+    uint32_t written;
+    uint32_t crc;
+
+    uint16_t window_position;
+    uint8_t window[DELTA_WINDOW_SIZE];
+} delta_patch_t;
+
+/**
+    Prepares a decoder. on_header may be NULL; returning a negative value from
+    it aborts the patch, e.g. if the source image does not match.
+*/
+void delta_patch_init(delta_patch_t *patch,
+                      delta_header_fn on_header,
+                      delta_read_fn read_source,
+                      delta_write_fn write_target,
+                      void *context);
+
+/**
+    Feeds the next chunk of the delta, of any size.
+
+    @return DELTA_OK if more input is needed, DELTA_DONE once the target image
+            was completely written and matched its CRC, or a negative DELTA_ERROR_*.
+*/
+int delta_patch_feed(delta_patch_t *patch, const uint8_t *data, size_t length);
+
+uint32_t delta_crc32(uint32_t crc, const uint8_t *data, size_t length);
@@ -0,0 +1,7 @@
+# Component makefile for event_loop
+
+INC_DIRS += $(event_loop_ROOT)
+
+event_loop_SRC_DIR = $(event_loop_ROOT)
+
+$(eval $(call component_compile_rules,event_loop))
@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <espressif/esp_common.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+
+#include "event_loop.h"
+
+
+typedef struct {
+    event_loop_callback_fn callback;
+    void *arg;
+    uint32_t post_time;         // sdk_system_get_time() at the post
+} event_loop_message_t;
+
+const uint32_t event_loop_latency_bounds_us[EVENT_LOOP_LATENCY_BUCKETS] = {
+    100, 500, 1000, 5000, 10000, 50000, 100000, 500000,
+};
+
+
+static QueueHandle_t event_loop_queue = NULL;
+static TaskHandle_t event_loop_task_handle = NULL;
+
+// Reserved up front so that the loop never takes anything from the heap
+static StaticQueue_t event_loop_queue_buffer;
+static uint8_t event_loop_queue_storage[EVENT_LOOP_QUEUE_SIZE * sizeof(event_loop_message_t)];
+static StaticTask_t event_loop_task_buffer;
+static StackType_t event_loop_stack[EVENT_LOOP_STACK_SIZE];
+
+// Scheduled timers, soonest first. Only touched by the event loop task.
+static event_loop_timer_t *timers = NULL;
+
+static event_loop_stats_t stats;
+
+
+static bool tick_before(TickType_t a, TickType_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+
+static void timer_unlink(event_loop_timer_t *timer) {
+    if (!timer->scheduled)
+        return;
+
+    event_loop_timer_t **t = &timers;
+    while (*t && *t != timer)
+        t = &(*t)->next;
+    if (*t)
+        *t = timer->next;
+
+    timer->next = NULL;
+    timer->scheduled = false;
+}
+
+
+static void timer_schedule(event_loop_timer_t *timer, uint32_t delay) {
+    timer_unlink(timer);
+
+    timer->wake_time = xTaskGetTickCount() + delay / portTICK_PERIOD_MS;
+    timer->scheduled = true;
+
+    event_loop_timer_t **t = &timers;
+    while (*t && !tick_before(timer->wake_time, (*t)->wake_time))
+        t = &(*t)->next;
+    timer->next = *t;
+    *t = timer;
+}
+
+
+static void timer_start(void *arg) {
+    event_loop_timer_t *timer = arg;
+    timer_schedule(timer, timer->delay);
+}
+
+
+static void timer_stop(void *arg) {
+    timer_unlink((event_loop_timer_t *)arg);
+}
+
+
+static void coroutine_resume(void *arg) {
+    event_loop_coroutine_t *co = arg;
+    co->function(co);
+}
+
+
+static void coroutine_start(void *arg) {
+    event_loop_coroutine_t *co = arg;
+    if (co->running)
+        return;
+
+    co->running = true;
+    co->resume = 0;
+    co->timer.callback = coroutine_resume;
+    co->timer.arg = co;
+    coroutine_resume(co);
+}
+
+
+static void coroutine_stop(void *arg) {
+    event_loop_coroutine_t *co = arg;
+    timer_unlink(&co->timer);
+    co->running = false;
+    co->resume = 0;
+}
+
+
+void event_loop_sleep(event_loop_coroutine_t *co, uint32_t ms) {
+    timer_schedule(&co->timer, ms);
+}
+
+
+void event_loop_finish(event_loop_coroutine_t *co) {
+    co->running = false;
+    co->resume = 0;
+}
+
+
+static int latency_bucket(uint32_t us) {
+    int i = 0;
+    while (i < EVENT_LOOP_LATENCY_BUCKETS && us > event_loop_latency_bounds_us[i])
+        i++;
+    return i;
+}
+
+
+static void run_message(event_loop_message_t *message) {
+    uint32_t started = sdk_system_get_time();
+    message->callback(message->arg);
+    uint32_t finished = sdk_system_get_time();
+
+    uint32_t wait = started - message->post_time;
+    uint32_t run = finished - started;
+    taskENTER_CRITICAL();
+    stats.callbacks++;
+    stats.wait_buckets[latency_bucket(wait)]++;
+    stats.wait_sum_us += wait;
+    stats.run_buckets[latency_bucket(run)]++;
+    stats.run_sum_us += run;
+    taskEXIT_CRITICAL();
+}
+
+
+static void event_loop_task(void *_args) {
+    event_loop_message_t message;
+
+    while (true) {
+        TickType_t timeout = portMAX_DELAY;
+        if (timers) {
+            TickType_t now = xTaskGetTickCount();
+            timeout = tick_before(now, timers->wake_time) ? timers->wake_time - now : 0;
+        }
+
+        if (xQueueReceive(event_loop_queue, &message, timeout) == pdTRUE)
+            run_message(&message);
+
+        TickType_t now = xTaskGetTickCount();
+        while (timers && !tick_before(now, timers->wake_time)) {
+            event_loop_timer_t *timer = timers;
+            timer_unlink(timer);
+            timer->callback(timer->arg);
+        }
+    }
+}
+
+
+int event_loop_init() {
+    if (event_loop_queue)
+        return 0;
+
+    event_loop_queue = xQueueCreateStatic(EVENT_LOOP_QUEUE_SIZE, sizeof(event_loop_message_t),
+                                          event_loop_queue_storage, &event_loop_queue_buffer);
+    if (!event_loop_queue)
+        return -1;
+
+    event_loop_task_handle = xTaskCreateStatic(event_loop_task, "Event loop", EVENT_LOOP_STACK_SIZE,
+                                               NULL, 2, event_loop_stack, &event_loop_task_buffer);
+    if (!event_loop_task_handle) {
+        printf("Failed to create event loop task\n");
+        vQueueDelete(event_loop_queue);
+        event_loop_queue = NULL;
+        return -2;
+    }
+
+    return 0;
+}
+
+
+bool event_loop_post(event_loop_callback_fn callback, void *arg) {
+    event_loop_message_t message = { callback, arg, sdk_system_get_time() };
+    return xQueueSendToBack(event_loop_queue, &message, 0) == pdTRUE;
+}
+
+
+bool event_loop_post_from_isr(event_loop_callback_fn callback, void *arg) {
+    event_loop_message_t message = { callback, arg, sdk_system_get_time() };
+    BaseType_t woken = pdFALSE;
+    bool result = xQueueSendToBackFromISR(event_loop_queue, &message, &woken) == pdTRUE;
+    portYIELD_FROM_ISR(woken);
+    return result;
+}
+
+
+bool event_loop_timer_start(event_loop_timer_t *timer) {
+    return event_loop_post(timer_start, timer);
+}
+
+
+bool event_loop_timer_stop(event_loop_timer_t *timer) {
+    return event_loop_post(timer_stop, timer);
+}
+
+
+bool event_loop_start(event_loop_coroutine_t *co) {
+    return event_loop_post(coroutine_start, co);
+}
+
+
+bool event_loop_start_from_isr(event_loop_coroutine_t *co) {
+    return event_loop_post_from_isr(coroutine_start, co);
+}
+
+
+bool event_loop_stop(event_loop_coroutine_t *co) {
+    return event_loop_post(coroutine_stop, co);
+}
+
+
+uint32_t event_loop_stack_free() {
+    return event_loop_task_handle ? uxTaskGetStackHighWaterMark(event_loop_task_handle) : 0;
+}
+
+
+void event_loop_get_stats(event_loop_stats_t *result) {
+    taskENTER_CRITICAL();
+    *result = stats;
+    taskEXIT_CRITICAL();
+    result->stack_free = event_loop_task_handle ? uxTaskGetStackHighWaterMark(event_loop_task_handle) : 0;
+}
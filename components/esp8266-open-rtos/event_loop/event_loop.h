@@ -0,0 +1,173 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <FreeRTOS.h>
+
+// Stack of the event loop task, in words. Everything posted to the loop runs
+// on this one stack, so it has to fit the deepest callback. The default is
+// half again the 256 words of the one-off tasks it replaced, as their
+// callbacks now share it. It was not measured: stack_free of
+// event_loop_get_stats tells how much of it an accessory really uses.
+#ifndef EVENT_LOOP_STACK_SIZE
+#define EVENT_LOOP_STACK_SIZE 384
+#endif
+
+#ifndef EVENT_LOOP_QUEUE_SIZE
+#define EVENT_LOOP_QUEUE_SIZE 8
+#endif
+
+// Buckets of the latency histograms, see event_loop_get_stats
+#define EVENT_LOOP_LATENCY_BUCKETS 8
+
+typedef void (*event_loop_callback_fn)(void *arg);
+
+typedef struct event_loop_timer_s event_loop_timer_t;
+struct event_loop_timer_s {
+    event_loop_callback_fn callback;
+    void *arg;
+    uint32_t delay;         // in miliseconds
+
+    bool scheduled;
+    TickType_t wake_time;
+    event_loop_timer_t *next;
+};
+
+/**
+    Static initializer for a one-shot timer that calls callback(arg) on the
+    event loop delay_ms after event_loop_timer_start.
+*/
+#define EVENT_LOOP_TIMER(_callback, _arg, _delay_ms) \
+    { .callback = (_callback), .arg = (_arg), .delay = (_delay_ms) }
+
+typedef struct event_loop_coroutine_s event_loop_coroutine_t;
+typedef void (*event_loop_coroutine_fn)(event_loop_coroutine_t *co);
+
+struct event_loop_coroutine_s {
+    event_loop_coroutine_fn function;
+    void *arg;
+
+    bool running;
+    uint16_t resume;        // line to continue at, 0 to start over
+    event_loop_timer_t timer;
+};
+
+/**
+    Static initializer for a coroutine. The function runs on the event loop
+    and can sleep with EVENT_LOOP_SLEEP without holding a task or a stack.
+    Local variables do not survive a sleep, keep state in statics or in arg.
+    Use at most one EVENT_LOOP_SLEEP per line, and no switch statement
+    around one.
+
+        void blink(event_loop_coroutine_t *co) {
+            static int i;
+            EVENT_LOOP_BEGIN(co);
+            for (i = 0; i < 3; i++) {
+                led_write(true);
+                EVENT_LOOP_SLEEP(co, 100);
+                led_write(false);
+                EVENT_LOOP_SLEEP(co, 100);
+            }
+            EVENT_LOOP_END(co);
+        }
+
+        event_loop_coroutine_t blink_coroutine = EVENT_LOOP_COROUTINE(blink, NULL);
+        ...
+        event_loop_start(&blink_coroutine);
+*/
+#define EVENT_LOOP_COROUTINE(_function, _arg) \
+    { .function = (_function), .arg = (_arg) }
+
+#define EVENT_LOOP_BEGIN(co) \
+    switch ((co)->resume) { \
+        case 0:
+
+#define EVENT_LOOP_SLEEP(co, ms) \
+    do { \
+        (co)->resume = __LINE__; \
+        event_loop_sleep((co), (ms)); \
+        return; \
+        case __LINE__:; \
+    } while (0)
+
+#define EVENT_LOOP_END(co) \
+    } \
+    event_loop_finish(co)
+
+
+// Histograms of posted callbacks: wait is the time from the post to the
+// start of the callback, run the time it took. Bucket i counts the times up
+// to event_loop_latency_bounds_us[i] and above the previous bound; the last
+// bucket counts those above all bounds.
+typedef struct {
+    uint32_t callbacks;
+    uint32_t wait_buckets[EVENT_LOOP_LATENCY_BUCKETS + 1];
+    uint64_t wait_sum_us;
+    uint32_t run_buckets[EVENT_LOOP_LATENCY_BUCKETS + 1];
+    uint64_t run_sum_us;
+    uint32_t stack_free;        // words of the stack never used so far
+} event_loop_stats_t;
+
+extern const uint32_t event_loop_latency_bounds_us[EVENT_LOOP_LATENCY_BUCKETS];
+
+/**
+    Starts the event loop task. Call once, e.g. from user_init.
+
+    @return A negative integer if this method fails.
+*/
+int event_loop_init();
+
+/**
+    Runs callback(arg) on the event loop. Must not be called from an interrupt
+    handler.
+
+    @return false if the queue is full
+*/
+bool event_loop_post(event_loop_callback_fn callback, void *arg);
+
+/**
+    Same as event_loop_post, for interrupt handlers.
+*/
+bool event_loop_post_from_isr(event_loop_callback_fn callback, void *arg);
+
+/**
+    (Re)starts a timer. A timer that is already scheduled is moved to its new
+    expiry time.
+*/
+bool event_loop_timer_start(event_loop_timer_t *timer);
+
+/**
+    Cancels a scheduled timer.
+*/
+bool event_loop_timer_stop(event_loop_timer_t *timer);
+
+/**
+    Starts a coroutine from the beginning. Does nothing if it is already
+    running, e.g. when identify is requested again while it blinks.
+*/
+bool event_loop_start(event_loop_coroutine_t *co);
+
+/**
+    Same as event_loop_start, for interrupt handlers.
+*/
+bool event_loop_start_from_isr(event_loop_coroutine_t *co);
+
+/**
+    Stops a running coroutine at its current sleep.
+*/
+bool event_loop_stop(event_loop_coroutine_t *co);
+
+/**
+    @return The least amount of free stack the event loop task had so far,
+            in words.
+*/
+uint32_t event_loop_stack_free();
+
+/**
+    Copies the latency histograms, counted since boot.
+*/
+void event_loop_get_stats(event_loop_stats_t *stats);
+
+// Used by EVENT_LOOP_SLEEP and EVENT_LOOP_END
+void event_loop_sleep(event_loop_coroutine_t *co, uint32_t ms);
+void event_loop_finish(event_loop_coroutine_t *co);
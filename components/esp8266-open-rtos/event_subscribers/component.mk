@@ -0,0 +1,7 @@
+# Component makefile for event_subscribers
+
+INC_DIRS += $(event_subscribers_ROOT)
+
+event_subscribers_SRC_DIR = $(event_subscribers_ROOT)
+
+$(eval $(call component_compile_rules,event_subscribers))
@@ -0,0 +1,40 @@
+#include <stddef.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <homekit/homekit.h>
+
+#include "event_subscribers.h"
+
+
+// Counted from whatever task notifies, read from another for the metrics
+static uint32_t sent_count = 0;
+static uint32_t skipped_count = 0;
+
+
+bool event_subscribers_any(const homekit_characteristic_t *ch) {
+    // homekit_characteristic_notify only walks this list
+    return ch->callback != NULL;
+}
+
+
+bool event_subscribers_accept(const homekit_characteristic_t *ch) {
+    bool any = event_subscribers_any(ch);
+
+    taskENTER_CRITICAL();
+    if (any)
+        sent_count++;
+    else
+        skipped_count++;
+    taskEXIT_CRITICAL();
+    return any;
+}
+
+
+void event_subscribers_stats(uint32_t *sent, uint32_t *skipped) {
+    taskENTER_CRITICAL();
+    if (sent)
+        *sent = sent_count;
+    if (skipped)
+        *skipped = skipped_count;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <homekit/types.h>
+
+/**
+    Tells whether a notification for the characteristic would reach anybody:
+    a controller subscribed to its events or a callback of the application
+    itself (HOMEKIT_CHARACTERISTIC_CALLBACK). The server only registers a
+    callback while a controller is connected and subscribed, so on an unpaired
+    or idle device this is false for most characteristics.
+
+    @param ch The characteristic
+    @return true if homekit_characteristic_notify would call anything
+*/
+bool event_subscribers_any(const homekit_characteristic_t *ch);
+
+/**
+    Same as event_subscribers_any, but also counts the notification as sent or
+    skipped for event_subscribers_stats. Used by EVENT_SUBSCRIBERS_NOTIFY.
+*/
+bool event_subscribers_accept(const homekit_characteristic_t *ch);
+
+/**
+    Notifies about a new value of the characteristic if anybody is listening.
+    The value expression is only evaluated when the notification is sent, so
+    building it costs nothing when there are no subscribers.
+
+    Only that is saved: without subscribers homekit_characteristic_notify
+    walks an empty list and returns, and the count taken here adds a
+    critical section. tools/event_subscribers times both on the host; with
+    a value as cheap as the examples pass the macro is the slower of the
+    two, it pays off for a value that takes longer to build than the count.
+
+    @param ch The characteristic
+    @param value The new value (evaluated lazily)
+*/
+#define EVENT_SUBSCRIBERS_NOTIFY(ch, value) \
+    do { \
+        homekit_characteristic_t *_event_ch = (ch); \
+        if (event_subscribers_accept(_event_ch)) \
+            homekit_characteristic_notify(_event_ch, (value)); \
+    } while (0)
+
+/**
+    Reports how many notifications went through EVENT_SUBSCRIBERS_NOTIFY
+    since boot. Safe to call from any task.
+
+    @param sent Notifications that had a subscriber
+    @param skipped Notifications that were dropped because nobody listened
+*/
+void event_subscribers_stats(uint32_t *sent, uint32_t *skipped);
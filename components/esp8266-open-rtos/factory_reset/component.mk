@@ -0,0 +1,14 @@
+# Component makefile for factory_reset
+#
+# Uses the flash_scheduler component, add both to EXTRA_COMPONENTS. Works
+# on the HomeKit storage sector, set HOMEKIT_SPI_FLASH_BASE_ADDR before
+# including common.mk when the example moves it.
+
+INC_DIRS += $(factory_reset_ROOT)
+
+factory_reset_SRC_DIR = $(factory_reset_ROOT)
+
+HOMEKIT_SPI_FLASH_BASE_ADDR ?= 0x100000
+factory_reset_CFLAGS = $(CFLAGS) -DFACTORY_RESET_HOMEKIT_ADDR=$(HOMEKIT_SPI_FLASH_BASE_ADDR)
+
+$(eval $(call component_compile_rules,factory_reset))
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <string.h>
+#include <espressif/esp_common.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <spiflash.h>
+#include <flash_scheduler.h>
+
+#include "factory_reset.h"
+
+// What homekit_storage_init writes at the start of a sector it formats.
+// Anything else there makes it format the sector on init.
+static const char homekit_magic[4] __attribute__((aligned(4))) = "HAP";
+
+// The request: "@@@", only bits that are set in the magic as well as in
+// erased flash, so that one word program over either leaves exactly this.
+// Not 0, which homekit_storage_reset writes over the magic.
+static const uint32_t tombstone = 0x00404040;
+
+
+void factory_reset() {
+    uint32_t started = sdk_system_get_time();
+    if (!spiflash_write(FACTORY_RESET_HOMEKIT_ADDR, (uint8_t *)&tombstone, sizeof(tombstone)))
+        printf("factory-reset: failed to write the request, restarting anyway\n");
+
+    printf("factory-reset: requested, restarting after %u us\n", sdk_system_get_time() - started);
+    sdk_system_restart();
+    while (true)
+        vTaskDelay(1000 / portTICK_PERIOD_MS);
+}
+
+
+int factory_reset_init(factory_reset_fn reset) {
+    uint32_t header;
+    if (!spiflash_read(FACTORY_RESET_HOMEKIT_ADDR, (uint8_t *)&header, sizeof(header)))
+        return -1;
+    if (header != tombstone)
+        return 0;
+
+    printf("factory-reset: completing the reset\n");
+    if (reset)
+        reset();
+
+    // Right here rather than in a task, so that homekit_server_init never
+    // finds the sector half done. Nothing is animating yet, the scheduler
+    // does not wait. The request stays until the erase, so a power loss
+    // before it only repeats the reset on the next boot.
+    uint32_t started = sdk_system_get_time();
+    if (!flash_scheduler_erase_sector(FACTORY_RESET_HOMEKIT_ADDR) ||
+            !flash_scheduler_write(FACTORY_RESET_HOMEKIT_ADDR, (const uint8_t *)homekit_magic, sizeof(homekit_magic))) {
+        printf("factory-reset: failed to erase the HomeKit storage\n");
+        return -1;
+    }
+
+    uint32_t now = sdk_system_get_time();
+    printf("factory-reset: HomeKit storage erased in %u ms, pairable %u ms after boot\n",
+           (now - started) / 1000, now / 1000);
+    return 1;
+}
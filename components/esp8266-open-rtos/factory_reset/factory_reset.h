@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// HomeKit storage sector, HOMEKIT_SPI_FLASH_BASE_ADDR of the homekit
+// component. component.mk passes it on.
+#ifndef FACTORY_RESET_HOMEKIT_ADDR
+#define FACTORY_RESET_HOMEKIT_ADDR 0x100000
+#endif
+
+// Resets the rest of the configuration, e.g. wifi_config_reset
+typedef void (*factory_reset_fn)();
+
+/**
+    Requests a factory reset and restarts right away, without erasing
+    anything: it programs a request over the first word of the HomeKit
+    storage sector, a single word program. factory_reset_init does the
+    rest after the restart. Does not return.
+*/
+void factory_reset();
+
+/**
+    Completes a reset requested before the restart. Calls reset, then
+    erases the HomeKit storage sector and formats it the way
+    homekit_server_init would, before returning: a sector erase, tens of
+    milliseconds. If power is lost before the erase, the next boot
+    completes the reset again.
+
+    Call in user_init, before wifi_config_init and homekit_server_init.
+
+    @return 1 if a reset was pending, 0 if not, a negative integer if
+            this method fails.
+*/
+int factory_reset_init(factory_reset_fn reset);
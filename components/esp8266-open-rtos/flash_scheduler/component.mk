@@ -0,0 +1,7 @@
+# Component makefile for flash_scheduler
+
+INC_DIRS += $(flash_scheduler_ROOT)
+
+flash_scheduler_SRC_DIR = $(flash_scheduler_ROOT)
+
+$(eval $(call component_compile_rules,flash_scheduler))
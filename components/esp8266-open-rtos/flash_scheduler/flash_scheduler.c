@@ -0,0 +1,146 @@
+#include <string.h>
+#include <espressif/esp_common.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include <spiflash.h>
+
+#include "flash_scheduler.h"
+
+#define SECTOR_SIZE 4096
+
+// Initial guesses, replaced by measurements as operations complete
+#define ERASE_ESTIMATE_US 30000
+#define WRITE_ESTIMATE_US 800
+
+// Spare time left before the next frame is due
+#define MARGIN_US 2000
+
+// A chunk that has not fit between frames this many times runs anyway
+#define MAX_DEFERRED_FRAMES 8
+
+
+static SemaphoreHandle_t frame_semaphore = NULL;
+static StaticSemaphore_t frame_semaphore_buffer;
+static volatile uint32_t frame_period_us = 0;
+static volatile uint32_t last_frame_us = 0;     // when the last frame was due
+
+static uint32_t erase_estimate_us = ERASE_ESTIMATE_US;
+static uint32_t write_estimate_us = WRITE_ESTIMATE_US;
+
+static flash_scheduler_stats_t stats;
+
+
+void flash_scheduler_set_frame_period(uint16_t period_ms) {
+    if (!frame_semaphore)
+        frame_semaphore = xSemaphoreCreateBinaryStatic(&frame_semaphore_buffer);
+
+    last_frame_us = sdk_system_get_time();
+    frame_period_us = period_ms * 1000;
+}
+
+
+void flash_scheduler_frame_done(void) {
+    // Animations keep to a schedule (vTaskDelayUntil): a frame late by a
+    // stall is followed by one on time, so the gap to it is measured from
+    // when the late one was due. A frame early, or more than half a period
+    // late, starts the schedule over.
+    uint32_t now = sdk_system_get_time();
+    uint32_t due = last_frame_us + frame_period_us;
+    if ((int32_t)(now - due) < 0 || now - due > frame_period_us / 2)
+        due = now;
+    last_frame_us = due;
+    if (frame_semaphore)
+        xSemaphoreGive(frame_semaphore);
+}
+
+
+// Blocks until an operation expected to take estimate_us can run without
+// delaying the next frame.
+static void wait_for_gap(uint32_t estimate_us) {
+    uint32_t period_us = frame_period_us;
+    if (!frame_semaphore || !period_us)
+        return;
+
+    // drop a frame signal left over from before
+    xSemaphoreTake(frame_semaphore, 0);
+
+    for (int deferred = 0; ; deferred++) {
+        uint32_t since_frame = sdk_system_get_time() - last_frame_us;
+        if (since_frame > 2 * period_us)
+            // animation is not running
+            return;
+
+        if (since_frame + estimate_us + MARGIN_US <= period_us)
+            return;
+
+        if (deferred == MAX_DEFERRED_FRAMES) {
+            stats.forced++;
+            return;
+        }
+
+        stats.deferred++;
+        xSemaphoreTake(frame_semaphore, (2 * period_us / 1000) / portTICK_PERIOD_MS + 1);
+    }
+}
+
+
+static uint32_t update_estimate(uint32_t estimate, uint32_t measured) {
+    // moving average over the last few operations
+    return estimate - estimate / 4 + measured / 4;
+}
+
+
+bool flash_scheduler_erase_sector(uint32_t address) {
+    wait_for_gap(erase_estimate_us);
+
+    uint32_t started = sdk_system_get_time();
+    bool result = spiflash_erase_sector(address);
+    uint32_t elapsed = sdk_system_get_time() - started;
+
+    erase_estimate_us = update_estimate(erase_estimate_us, elapsed);
+    stats.erase_count++;
+    if (elapsed > stats.worst_erase_us)
+        stats.worst_erase_us = elapsed;
+
+    return result;
+}
+
+
+bool flash_scheduler_write(uint32_t address, const uint8_t *data, uint32_t length) {
+    while (length) {
+        // keep chunks within a flash page
+        uint32_t n = FLASH_SCHEDULER_CHUNK_SIZE - (address % FLASH_SCHEDULER_CHUNK_SIZE);
+        if (n > length)
+            n = length;
+
+        wait_for_gap(write_estimate_us);
+
+        uint32_t started = sdk_system_get_time();
+        bool result = spiflash_write(address, (uint8_t *)data, n);
+        uint32_t elapsed = sdk_system_get_time() - started;
+
+        write_estimate_us = update_estimate(write_estimate_us, elapsed);
+        stats.write_count++;
+        if (elapsed > stats.worst_write_us)
+            stats.worst_write_us = elapsed;
+
+        if (!result)
+            return false;
+
+        address += n;
+        data += n;
+        length -= n;
+    }
+
+    return true;
+}
+
+
+void flash_scheduler_get_stats(flash_scheduler_stats_t *result, bool reset) {
+    taskENTER_CRITICAL();
+    *result = stats;
+    if (reset)
+        memset(&stats, 0, sizeof(stats));
+    taskEXIT_CRITICAL();
+}
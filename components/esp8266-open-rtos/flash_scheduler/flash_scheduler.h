@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Writes are split into chunks of this many bytes (one flash page)
+#define FLASH_SCHEDULER_CHUNK_SIZE 256
+
+typedef struct {
+    uint32_t erase_count;
+    uint32_t write_count;      // chunks, not calls
+    uint32_t worst_erase_us;   // longest stall caused by a single sector erase
+    uint32_t worst_write_us;   // longest stall caused by a single write chunk
+    uint32_t deferred;         // times a chunk waited for the next frame
+    uint32_t forced;           // chunks run late because they never fit between frames
+} flash_scheduler_stats_t;
+
+/**
+    Declares that an animation is running with the given frame period. While
+    frames keep coming (see flash_scheduler_frame_done), flash erases and writes
+    only start right after a frame, and only if they are expected to finish
+    before the next one is due. The instruction cache is off while the flash is
+    busy, so anything not in IRAM stalls until the chunk is done.
+
+    @param period_ms Frame period in miliseconds, 0 if there is no animation.
+*/
+void flash_scheduler_set_frame_period(uint16_t period_ms);
+
+/**
+    Marks that a frame has just been output. Call it from the animation task
+    right after pushing each frame. Gaps are measured from when the frame was
+    due, for animations paced with vTaskDelayUntil. When frames stop coming,
+    flash operations run without waiting.
+*/
+void flash_scheduler_frame_done(void);
+
+/**
+    Erases the 4KB sector at the given address, waiting for a gap between
+    frames first. Must not be called from an interrupt handler.
+
+    @param address Sector aligned flash address
+    @return true on success
+*/
+bool flash_scheduler_erase_sector(uint32_t address);
+
+/**
+    Writes data to (erased) flash in FLASH_SCHEDULER_CHUNK_SIZE chunks, each one
+    started in a gap between frames. Must not be called from an interrupt
+    handler.
+
+    @param address Word aligned flash address
+    @param data Data to write, length bytes
+    @param length Number of bytes, a multiple of 4
+    @return true on success
+*/
+bool flash_scheduler_write(uint32_t address, const uint8_t *data, uint32_t length);
+
+/**
+    Copies the counters, including the worst-case stall per chunk, and
+    optionally resets them.
+
+    @param stats Where to store the counters
+    @param reset Start counting from zero after the copy
+*/
+void flash_scheduler_get_stats(flash_scheduler_stats_t *stats, bool reset);
@@ -0,0 +1,7 @@
+# Component makefile for getter_cache
+
+INC_DIRS += $(getter_cache_ROOT)
+
+getter_cache_SRC_DIR = $(getter_cache_ROOT)
+
+$(eval $(call component_compile_rules,getter_cache))
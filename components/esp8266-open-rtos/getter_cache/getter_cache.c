@@ -0,0 +1,52 @@
+#include <FreeRTOS.h>
+#include <task.h>
+#include <common_macros.h>
+
+#include "getter_cache.h"
+
+
+void getter_cache_set(getter_cache_t *cache, homekit_value_t value) {
+    taskENTER_CRITICAL();
+    cache->value = value;
+    cache->updated = xTaskGetTickCount();
+    cache->valid = true;
+    taskEXIT_CRITICAL();
+}
+
+
+IRAM void getter_cache_set_from_isr(getter_cache_t *cache, homekit_value_t value) {
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    cache->value = value;
+    cache->updated = xTaskGetTickCountFromISR();
+    cache->valid = true;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+
+static bool getter_cache_expired(getter_cache_t *cache) {
+    if (!cache->valid)
+        return true;
+
+    return cache->ttl && (xTaskGetTickCount() - cache->updated) >= cache->ttl;
+}
+
+
+homekit_value_t getter_cache_get(getter_cache_t *cache) {
+    if (cache->refresh && getter_cache_expired(cache))
+        getter_cache_set(cache, cache->refresh());
+
+    homekit_value_t value = HOMEKIT_NULL_();
+    taskENTER_CRITICAL();
+    if (cache->valid)
+        value = cache->value;
+    taskEXIT_CRITICAL();
+
+    return value;
+}
+
+
+void getter_cache_invalidate(getter_cache_t *cache) {
+    taskENTER_CRITICAL();
+    cache->valid = false;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <FreeRTOS.h>
+#include <homekit/types.h>
+
+typedef homekit_value_t (*getter_cache_refresh_fn)();
+
+typedef struct {
+    homekit_value_t value;
+    bool valid;
+    TickType_t updated;
+    TickType_t ttl;
+    getter_cache_refresh_fn refresh;
+} getter_cache_t;
+
+/**
+    Initializer for a getter cache.
+
+    @param _refresh Reads the value from the hardware when the cache is empty or
+                    has expired, NULL if the cache is only updated with
+                    getter_cache_set.
+    @param _ttl_ms How long a value stays valid, in miliseconds. 0 means it is
+                   valid until replaced.
+*/
+#define GETTER_CACHE(_refresh, _ttl_ms) { \
+    .valid = false, \
+    .ttl = (_ttl_ms) / portTICK_PERIOD_MS, \
+    .refresh = (_refresh), \
+}
+
+/**
+    Stores a new value, e.g. from the sensor path whenever the state changes.
+    Must not be called from an interrupt handler, see getter_cache_set_from_isr.
+
+    @param cache The cache to update
+    @param value The current value
+*/
+void getter_cache_set(getter_cache_t *cache, homekit_value_t value);
+
+/**
+    Same as getter_cache_set, for interrupt handlers. It only masks
+    interrupts, so code that runs both in a handler and in a task can use it
+    too.
+
+    @param cache The cache to update
+    @param value The current value
+*/
+void getter_cache_set_from_isr(getter_cache_t *cache, homekit_value_t value);
+
+/**
+    Returns the cached value, for use in a characteristic getter. The refresh
+    function only runs when there is no value yet or it has expired, so
+    repeated polls by controllers do not touch the hardware.
+
+    @param cache The cache to read
+    @return The cached value, or a null value if there is none and no refresh
+            function.
+*/
+homekit_value_t getter_cache_get(getter_cache_t *cache);
+
+/**
+    Drops the cached value, so the next getter_cache_get refreshes it.
+
+    @param cache The cache to clear
+*/
+void getter_cache_invalidate(getter_cache_t *cache);
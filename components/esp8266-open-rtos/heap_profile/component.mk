@@ -0,0 +1,19 @@
+# Component makefile for heap_profile
+
+INC_DIRS += $(heap_profile_ROOT)
+
+heap_profile_SRC_DIR = $(heap_profile_ROOT)
+
+$(eval $(call component_compile_rules,heap_profile))
+
+# Off unless the build asks for it (make HEAP_PROFILE=1): the calls in the
+# firmware then compile to nothing and malloc is left alone.
+HEAP_PROFILE ?= 0
+
+ifeq ($(HEAP_PROFILE),1)
+EXTRA_CFLAGS += -DHEAP_PROFILE=1
+# The kernel and the SDK allocate through pvPortMalloc, everything else
+# through the C library
+EXTRA_LDFLAGS += -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc -Wl,--wrap=free \
+	-Wl,--wrap=pvPortMalloc -Wl,--wrap=vPortFree
+endif
@@ -0,0 +1,433 @@
+#include "heap_profile.h"
+
+#if HEAP_PROFILE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <espressif/esp_common.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <lwip/sockets.h>
+
+#define HEAP_PROFILE_STACK_SIZE 384
+
+// Slots of the call site hash, indexes into sites
+#define SITE_HASH_SIZE 256
+#define NO_SITE 0xFF
+
+_Static_assert(HEAP_PROFILE_SITES < NO_SITE, "HEAP_PROFILE_SITES must be below 255");
+_Static_assert((HEAP_PROFILE_LIVE & (HEAP_PROFILE_LIVE - 1)) == 0,
+               "HEAP_PROFILE_LIVE must be a power of two");
+
+typedef struct {
+    uint32_t pc;                // return address of the allocating call
+    uint32_t count;             // allocations since boot
+    uint32_t bytes;
+    uint32_t reported_count;    // count and bytes at the previous report
+    uint32_t reported_bytes;
+    uint32_t live_bytes;
+    uint16_t live_count;
+} site_t;
+
+typedef struct {
+    void *ptr;                  // NULL if the slot is free
+    uint32_t time;              // tick count when allocated
+    uint16_t size;
+    uint8_t site;               // NO_SITE if not attributed
+} live_t;
+
+typedef enum {
+    ORDER_PERIOD_BYTES,
+    ORDER_PERIOD_COUNT,
+    ORDER_LIVE_BYTES,
+} order_t;
+
+// What a report line needs of a site, copied out while the tables are
+// held still
+typedef struct {
+    uint32_t pc;
+    uint32_t count;
+    uint32_t bytes;
+    uint32_t oldest;            // tick count of the oldest live allocation
+} report_entry_t;
+
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static site_t sites[HEAP_PROFILE_SITES];
+static uint8_t site_count = 0;
+static uint8_t site_hash[SITE_HASH_SIZE];   // site index + 1, 0 if free
+
+static live_t live[HEAP_PROFILE_LIVE];
+static uint16_t live_count = 0;
+static uint32_t live_bytes = 0;
+
+static uint32_t unattributed = 0;   // allocations from sites beyond HEAP_PROFILE_SITES
+static uint32_t untracked = 0;      // allocations that found the live table full
+
+static TaskHandle_t reporter_task_handle = NULL;
+static StaticTask_t reporter_task_buffer;
+static StackType_t reporter_stack[HEAP_PROFILE_STACK_SIZE];
+
+
+static inline uint32_t hash(uint32_t value) {
+    // Fibonacci hashing, the upper bits mix best
+    return (value * 2654435761u) >> 16;
+}
+
+
+static uint8_t site_for(uint32_t pc) {
+    uint32_t i = hash(pc >> 2) & (SITE_HASH_SIZE - 1);
+    while (site_hash[i]) {
+        if (sites[site_hash[i] - 1].pc == pc)
+            return site_hash[i] - 1;
+        i = (i + 1) & (SITE_HASH_SIZE - 1);
+    }
+
+    if (site_count == HEAP_PROFILE_SITES) {
+        unattributed++;
+        return NO_SITE;
+    }
+
+    sites[site_count].pc = pc;
+    site_hash[i] = ++site_count;
+    return site_count - 1;
+}
+
+
+static void record_alloc(void *ptr, size_t size, uint32_t pc) {
+    if (!ptr)
+        return;
+
+    taskENTER_CRITICAL();
+
+    uint8_t site = site_for(pc);
+    if (site != NO_SITE) {
+        sites[site].count++;
+        sites[site].bytes += size;
+    }
+
+    // Kept at most 3/4 full, so that probes stay short
+    if (live_count >= HEAP_PROFILE_LIVE / 4 * 3) {
+        untracked++;
+    } else {
+        uint32_t i = hash((uint32_t)(uintptr_t)ptr >> 3) & (HEAP_PROFILE_LIVE - 1);
+        while (live[i].ptr)
+            i = (i + 1) & (HEAP_PROFILE_LIVE - 1);
+
+        live[i].ptr = ptr;
+        live[i].time = xTaskGetTickCount();
+        live[i].size = size < UINT16_MAX ? size : UINT16_MAX;
+        live[i].site = site;
+        live_count++;
+        live_bytes += live[i].size;
+        if (site != NO_SITE) {
+            sites[site].live_count++;
+            sites[site].live_bytes += live[i].size;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+
+static void record_free(void *ptr) {
+    if (!ptr)
+        return;
+
+    taskENTER_CRITICAL();
+
+    uint32_t i = hash((uint32_t)(uintptr_t)ptr >> 3) & (HEAP_PROFILE_LIVE - 1);
+    while (live[i].ptr && live[i].ptr != ptr)
+        i = (i + 1) & (HEAP_PROFILE_LIVE - 1);
+
+    if (live[i].ptr) {
+        live_count--;
+        live_bytes -= live[i].size;
+        if (live[i].site != NO_SITE) {
+            sites[live[i].site].live_count--;
+            sites[live[i].site].live_bytes -= live[i].size;
+        }
+
+        // Backward shift deletion: linear probing without tombstones
+        uint32_t hole = i;
+        live[hole].ptr = NULL;
+        for (uint32_t j = (hole + 1) & (HEAP_PROFILE_LIVE - 1); live[j].ptr;
+                j = (j + 1) & (HEAP_PROFILE_LIVE - 1)) {
+            uint32_t home = hash((uint32_t)(uintptr_t)live[j].ptr >> 3) & (HEAP_PROFILE_LIVE - 1);
+            if (((j - home) & (HEAP_PROFILE_LIVE - 1)) >= ((j - hole) & (HEAP_PROFILE_LIVE - 1))) {
+                live[hole] = live[j];
+                live[j].ptr = NULL;
+                hole = j;
+            }
+        }
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+
+void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    record_alloc(ptr, size, (uintptr_t)__builtin_return_address(0));
+    return ptr;
+}
+
+
+void *__wrap_calloc(size_t count, size_t size) {
+    void *ptr = __real_calloc(count, size);
+    record_alloc(ptr, count * size, (uintptr_t)__builtin_return_address(0));
+    return ptr;
+}
+
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    void *result = __real_realloc(ptr, size);
+    if (result || !size) {
+        record_free(ptr);
+        record_alloc(result, size, (uintptr_t)__builtin_return_address(0));
+    }
+    return result;
+}
+
+
+void __wrap_free(void *ptr) {
+    record_free(ptr);
+    __real_free(ptr);
+}
+
+
+// pvPortMalloc and vPortFree are plain malloc and free on esp-open-rtos.
+// Going to the C library directly attributes kernel allocations (task
+// stacks, queues, timers) to their caller rather than to pvPortMalloc.
+
+void *__wrap_pvPortMalloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    record_alloc(ptr, size, (uintptr_t)__builtin_return_address(0));
+    return ptr;
+}
+
+
+void __wrap_vPortFree(void *ptr) {
+    record_free(ptr);
+    __real_free(ptr);
+}
+
+
+static uint32_t site_key(const site_t *site, order_t order) {
+    switch (order) {
+        case ORDER_PERIOD_BYTES: return site->bytes - site->reported_bytes;
+        case ORDER_PERIOD_COUNT: return site->count - site->reported_count;
+        default: return site->live_bytes;
+    }
+}
+
+
+// Copies out the sites with the highest non-zero key, highest first.
+// Called with the scheduler suspended.
+static int top_sites(order_t order, report_entry_t *top) {
+    uint8_t index[HEAP_PROFILE_TOP];
+    int n = 0;
+
+    for (int i = 0; i < site_count; i++) {
+        uint32_t key = site_key(&sites[i], order);
+        if (!key || (n == HEAP_PROFILE_TOP && key <= site_key(&sites[index[n-1]], order)))
+            continue;
+
+        // Insertion into the sorted list, dropping the last one if full
+        int j = n < HEAP_PROFILE_TOP ? n++ : n - 1;
+        for (; j > 0 && site_key(&sites[index[j-1]], order) < key; j--)
+            index[j] = index[j-1];
+        index[j] = i;
+    }
+
+    for (int i = 0; i < n; i++) {
+        const site_t *site = &sites[index[i]];
+        top[i].pc = site->pc;
+        if (order == ORDER_LIVE_BYTES) {
+            top[i].count = site->live_count;
+            top[i].bytes = site->live_bytes;
+        } else {
+            top[i].count = site->count - site->reported_count;
+            top[i].bytes = site->bytes - site->reported_bytes;
+        }
+    }
+
+    if (order == ORDER_LIVE_BYTES) {
+        for (int i = 0; i < n; i++)
+            top[i].oldest = UINT32_MAX;
+        for (int i = 0; i < HEAP_PROFILE_LIVE; i++) {
+            if (!live[i].ptr)
+                continue;
+            for (int j = 0; j < n; j++) {
+                if (live[i].site == index[j] && live[i].time < top[j].oldest)
+                    top[j].oldest = live[i].time;
+            }
+        }
+    }
+
+    return n;
+}
+
+
+typedef void (*line_writer_fn)(const char *line, int length, void *context);
+
+static void format_sites(const char *title, const report_entry_t *top, int count,
+                         bool live_sites, line_writer_fn write_line, void *context) {
+    char line[80];
+    int n;
+
+    n = snprintf(line, sizeof(line), "heap-profile: %s\n", title);
+    write_line(line, n, context);
+
+    TickType_t now = xTaskGetTickCount();
+    for (int i = 0; i < count; i++) {
+        n = snprintf(line, sizeof(line), "heap-profile   0x%08x  %5u allocations %7u bytes",
+                     top[i].pc, top[i].count, top[i].bytes);
+        if (live_sites) {
+            n += snprintf(line + n, sizeof(line) - n, "  oldest %u s",
+                          (now - top[i].oldest) * portTICK_PERIOD_MS / 1000);
+        }
+        n += snprintf(line + n, sizeof(line) - n, "\n");
+        write_line(line, n, context);
+    }
+}
+
+
+static void format_report(line_writer_fn write_line, void *context) {
+    report_entry_t by_bytes[HEAP_PROFILE_TOP];
+    report_entry_t by_count[HEAP_PROFILE_TOP];
+    report_entry_t by_live[HEAP_PROFILE_TOP];
+    uint32_t period_count = 0, period_bytes = 0;
+    uint32_t report_live_count, report_live_bytes, report_untracked, report_unattributed;
+    char line[80];
+    int n;
+
+    vTaskSuspendAll();
+
+    int by_bytes_count = top_sites(ORDER_PERIOD_BYTES, by_bytes);
+    int by_count_count = top_sites(ORDER_PERIOD_COUNT, by_count);
+    int by_live_count = top_sites(ORDER_LIVE_BYTES, by_live);
+
+    for (int i = 0; i < site_count; i++) {
+        period_count += sites[i].count - sites[i].reported_count;
+        period_bytes += sites[i].bytes - sites[i].reported_bytes;
+        sites[i].reported_count = sites[i].count;
+        sites[i].reported_bytes = sites[i].bytes;
+    }
+    report_live_count = live_count;
+    report_live_bytes = live_bytes;
+    report_untracked = untracked;
+    report_unattributed = unattributed;
+
+    xTaskResumeAll();
+
+    n = snprintf(line, sizeof(line), "heap-profile: %u bytes in %u allocations live, %u bytes free\n",
+                 report_live_bytes, report_live_count, (unsigned)xPortGetFreeHeapSize());
+    write_line(line, n, context);
+    n = snprintf(line, sizeof(line), "heap-profile: %u allocations of %u bytes since the previous report\n",
+                 period_count, period_bytes);
+    write_line(line, n, context);
+
+    format_sites("top sites by bytes since the previous report", by_bytes, by_bytes_count,
+                 false, write_line, context);
+    format_sites("top sites by count since the previous report", by_count, by_count_count,
+                 false, write_line, context);
+    format_sites("top sites by live bytes", by_live, by_live_count, true, write_line, context);
+
+    if (report_unattributed) {
+        n = snprintf(line, sizeof(line), "heap-profile: %u allocations not attributed, raise HEAP_PROFILE_SITES\n",
+                     report_unattributed);
+        write_line(line, n, context);
+    }
+    if (report_untracked) {
+        n = snprintf(line, sizeof(line), "heap-profile: %u allocations not tracked, raise HEAP_PROFILE_LIVE\n",
+                     report_untracked);
+        write_line(line, n, context);
+    }
+}
+
+
+static void print_line(const char *line, int length, void *context) {
+    printf("%s", line);
+}
+
+void heap_profile_print() {
+    format_report(print_line, NULL);
+}
+
+
+static void reporter_task(void *arg) {
+    TickType_t period = (uintptr_t)arg / portTICK_PERIOD_MS;
+    TickType_t wake_time = xTaskGetTickCount();
+    while (true) {
+        vTaskDelayUntil(&wake_time, period);
+        heap_profile_print();
+    }
+}
+
+
+int heap_profile_init(uint32_t period_ms) {
+    if (reporter_task_handle || !period_ms)
+        return 0;
+
+    reporter_task_handle = xTaskCreateStatic(reporter_task, "Heap profile", HEAP_PROFILE_STACK_SIZE,
+                                             (void *)(uintptr_t)period_ms, HEAP_PROFILE_TASK_PRIORITY,
+                                             reporter_stack, &reporter_task_buffer);
+    return reporter_task_handle ? 0 : -1;
+}
+
+
+static void send_line(const char *line, int length, void *context) {
+    write(*(int *)context, line, length);
+}
+
+static void heap_profile_server_task(void *arg) {
+    uint16_t port = (uintptr_t)arg;
+
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) {
+        printf("heap-profile: failed to create socket\n");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (bind(s, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(s, 1) < 0) {
+        printf("heap-profile: failed to listen on port %d\n", port);
+        close(s);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while (true) {
+        int client = accept(s, NULL, NULL);
+        if (client < 0)
+            continue;
+
+        format_report(send_line, &client);
+        close(client);
+    }
+}
+
+
+void heap_profile_serve(uint16_t port) {
+    static bool serving = false;
+    if (serving)
+        return;
+
+    serving = true;
+    xTaskCreate(heap_profile_server_task, "Heap profile srv", HEAP_PROFILE_STACK_SIZE,
+                (void *)(uintptr_t)port, 1, NULL);
+}
+
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+// Distinct call sites tracked; allocations from further sites are counted
+// but not attributed
+#ifndef HEAP_PROFILE_SITES
+#define HEAP_PROFILE_SITES 64
+#endif
+
+// Live allocations tracked at once, a power of two. 12 bytes each.
+#ifndef HEAP_PROFILE_LIVE
+#define HEAP_PROFILE_LIVE 256
+#endif
+
+// Sites listed in each of the reports
+#ifndef HEAP_PROFILE_TOP
+#define HEAP_PROFILE_TOP 8
+#endif
+
+#ifndef HEAP_PROFILE_TASK_PRIORITY
+#define HEAP_PROFILE_TASK_PRIORITY 1
+#endif
+
+#if HEAP_PROFILE
+
+/**
+    Prints a report every period_ms. Allocations are recorded from boot
+    whether or not this is called.
+
+    The build records every malloc, calloc, realloc, free, pvPortMalloc and
+    vPortFree with the address it was called from, its size and the time.
+    Each call adds a critical section around a lookup in the call site hash
+    and one in the live allocation table, which is kept at most 3/4 full so
+    that probes stay short. tools/heap_profile measures the probes and the
+    time added on the host; the cost on the device was not measured.
+
+    @return A negative integer if this method fails.
+*/
+int heap_profile_init(uint32_t period_ms);
+
+/**
+    Prints the report: the top call sites since the previous report by
+    bytes and by count, then the sites holding the most live memory with
+    the age of their oldest allocation. Lines start with "heap-profile" and
+    carry raw code addresses; tools/heap_profile.py symbolizes them against
+    the ELF.
+*/
+void heap_profile_print();
+
+/**
+    Sends a report to every client connecting to the given TCP port:
+
+        nc <device> <port> | tools/heap_profile.py --elf build/program.out
+
+    Does nothing if the port is already served, so it can be called on every
+    wifi (re)connect.
+*/
+void heap_profile_serve(uint16_t port);
+
+#else
+
+// Built without HEAP_PROFILE=1: nothing is recorded and the calls go away
+
+static inline int heap_profile_init(uint32_t period_ms) { return 0; }
+static inline void heap_profile_print() {}
+static inline void heap_profile_serve(uint16_t port) {}
+
+#endif
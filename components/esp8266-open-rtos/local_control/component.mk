@@ -0,0 +1,17 @@
+# Component makefile for local_control
+
+INC_DIRS += $(local_control_ROOT)
+
+local_control_SRC_DIR = $(local_control_ROOT)
+
+$(eval $(call component_compile_rules,local_control))
+
+# Off unless the build gives a key (make LOCAL_CONTROL_KEY=<32 hex digits>):
+# local_control_init then fails and the light answers HomeKit only. The
+# key ends up in the firmware image, keep the image private.
+LOCAL_CONTROL_PORT ?= 4210
+
+EXTRA_CFLAGS += -DLOCAL_CONTROL_PORT=$(LOCAL_CONTROL_PORT)
+ifdef LOCAL_CONTROL_KEY
+EXTRA_CFLAGS += -DLOCAL_CONTROL_KEY=\"$(LOCAL_CONTROL_KEY)\"
+endif
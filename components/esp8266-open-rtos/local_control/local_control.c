@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <string.h>
+#include <espressif/esp_common.h>
+#include <esp/hwrand.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <lwip/sockets.h>
+
+#include "local_control.h"
+
+#define VERSION 1
+#define HEADER_SIZE 12
+#define MAC_SIZE 8
+#define STATE_SIZE 8
+#define REPLY_SIZE (HEADER_SIZE + 4 + STATE_SIZE + MAC_SIZE)
+
+#define LOCAL_CONTROL_STACK_SIZE 512
+
+
+static uint8_t key[16];
+static const local_control_handlers_t *handlers;
+
+static uint32_t session;
+static uint32_t last_sequence = 0;
+
+static local_control_stats_t stats;
+
+// Only the local control task touches it
+static uint8_t packet[LOCAL_CONTROL_MAX_PACKET];
+
+static TaskHandle_t task_handle = NULL;
+static StaticTask_t task_buffer;
+static StackType_t task_stack[LOCAL_CONTROL_STACK_SIZE];
+
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND \
+    do { \
+        v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+        v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+        v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+        v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+    } while (0)
+
+static uint64_t read_u64(const uint8_t *p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+// SipHash-2-4: a MAC made for short messages, a few microseconds per packet
+static uint64_t siphash(const uint8_t *data, size_t length) {
+    uint64_t k0 = read_u64(key), k1 = read_u64(key + 8);
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+    const uint8_t *end = data + length - length % 8;
+    for (; data != end; data += 8) {
+        uint64_t m = read_u64(data);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    uint64_t last = (uint64_t)length << 56;
+    for (int i = length % 8 - 1; i >= 0; i--)
+        last |= (uint64_t)data[i] << (8 * i);
+    v3 ^= last;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= last;
+
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+
+static uint32_t read_u32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void write_u32(uint8_t *p, uint32_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+
+static bool mac_valid(const uint8_t *data, size_t length) {
+    uint64_t mac = siphash(data, length - MAC_SIZE);
+
+    // Compared in full, so that timing tells nothing about the MAC
+    uint8_t difference = 0;
+    for (int i = 0; i < MAC_SIZE; i++)
+        difference |= data[length - MAC_SIZE + i] ^ (uint8_t)(mac >> (8 * i));
+    return !difference;
+}
+
+
+static void state_decode(const uint8_t *p, local_control_state_t *state) {
+    uint16_t hue = p[0] | (p[1] << 8);
+    state->hue = (hue % 3600) / 10.0f;
+    state->saturation = p[2] > 100 ? 100 : p[2];
+    state->brightness = p[3] > 100 ? 100 : p[3];
+    state->on = p[4];
+}
+
+static void state_encode(uint8_t *p, const local_control_state_t *state) {
+    uint16_t hue = state->hue * 10 + 0.5f;
+    p[0] = hue;
+    p[1] = hue >> 8;
+    p[2] = state->saturation + 0.5f;
+    p[3] = state->brightness + 0.5f;
+    p[4] = state->on;
+    p[5] = p[6] = p[7] = 0;
+}
+
+
+// Runs a verified command, returns the status to reply with
+static uint8_t handle(uint8_t command, uint32_t request_session, uint32_t sequence,
+                      const uint8_t *payload, size_t length, bool *changed) {
+    if (command == LOCAL_CONTROL_HELLO)
+        return LOCAL_CONTROL_OK;
+
+    if (request_session != session || sequence <= last_sequence) {
+        stats.stale++;
+        return LOCAL_CONTROL_STALE;
+    }
+    last_sequence = sequence;
+
+    switch (command) {
+        case LOCAL_CONTROL_SET: {
+            if (length < 5)
+                return LOCAL_CONTROL_BAD_REQUEST;
+            local_control_state_t state;
+            state_decode(payload, &state);
+            handlers->set(&state);
+            *changed = true;
+            break;
+        }
+        case LOCAL_CONTROL_EFFECT:
+            if (!handlers->effect)
+                return LOCAL_CONTROL_UNSUPPORTED;
+            if (length < 3 || handlers->effect(payload[0], payload[1] | (payload[2] << 8)) < 0)
+                return LOCAL_CONTROL_BAD_REQUEST;
+            break;
+        case LOCAL_CONTROL_FRAME:
+            if (!handlers->frame)
+                return LOCAL_CONTROL_UNSUPPORTED;
+            if (length < 2 || (length - 2) % 3 ||
+                    handlers->frame(payload[0] | (payload[1] << 8), payload + 2, length - 2) < 0)
+                return LOCAL_CONTROL_BAD_REQUEST;
+            break;
+        default:
+            return LOCAL_CONTROL_UNSUPPORTED;
+    }
+
+    stats.applied++;
+    return LOCAL_CONTROL_OK;
+}
+
+
+static void local_control_task(void *arg) {
+    uint16_t port = (uintptr_t)arg;
+
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0) {
+        printf("local-control: failed to create socket\n");
+        task_handle = NULL;
+        vTaskDelete(NULL);
+        return;
+    }
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_port = htons(port),
+    };
+    if (bind(s, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        printf("local-control: failed to listen on port %d\n", port);
+        close(s);
+        task_handle = NULL;
+        vTaskDelete(NULL);
+        return;
+    }
+
+    bool settling = false;
+    while (true) {
+        struct timeval timeout = { 0, settling ? LOCAL_CONTROL_SETTLE_MS * 1000 : 0 };
+        setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        struct sockaddr_in peer;
+        socklen_t peer_length = sizeof(peer);
+        int length = recvfrom(s, packet, sizeof(packet), 0, (struct sockaddr *)&peer, &peer_length);
+        if (length < 0) {
+            if (settling && handlers->settled)
+                handlers->settled();
+            settling = false;
+            continue;
+        }
+
+        uint32_t started = sdk_system_get_time();
+        stats.received++;
+        if (length < HEADER_SIZE + MAC_SIZE || packet[0] != 'L' || packet[1] != VERSION ||
+                (packet[2] & 0x80) || !mac_valid(packet, length)) {
+            stats.bad_mac++;
+            continue;
+        }
+
+        bool changed = false;
+        uint8_t command = packet[2];
+        uint8_t status = handle(command, read_u32(packet + 4), read_u32(packet + 8),
+                                packet + HEADER_SIZE, length - HEADER_SIZE - MAC_SIZE, &changed);
+        settling |= changed;
+
+        // The request is done with, the reply goes into the same buffer
+        local_control_state_t state;
+        handlers->get(&state);
+
+        packet[2] = command | 0x80;
+        packet[3] = status;
+        write_u32(packet + 4, session);
+        write_u32(packet + 8, last_sequence);
+        state_encode(packet + HEADER_SIZE + 4, &state);
+
+        uint32_t elapsed = sdk_system_get_time() - started;
+        if (elapsed > stats.worst_apply_us)
+            stats.worst_apply_us = elapsed;
+        write_u32(packet + HEADER_SIZE, elapsed);
+
+        uint64_t mac = siphash(packet, REPLY_SIZE - MAC_SIZE);
+        for (int i = 0; i < MAC_SIZE; i++)
+            packet[REPLY_SIZE - MAC_SIZE + i] = mac >> (8 * i);
+
+        sendto(s, packet, REPLY_SIZE, 0, (struct sockaddr *)&peer, peer_length);
+    }
+}
+
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+
+int local_control_init(uint16_t port, const char *hex_key, const local_control_handlers_t *local_handlers) {
+    if (task_handle)
+        return 0;
+    if (!hex_key) {
+        printf("local-control: off, built without LOCAL_CONTROL_KEY\n");
+        return -1;
+    }
+    if (strlen(hex_key) != 2 * sizeof(key) || !local_handlers->get || !local_handlers->set)
+        return -1;
+
+    for (int i = 0; i < sizeof(key); i++) {
+        int high = hex_digit(hex_key[2 * i]), low = hex_digit(hex_key[2 * i + 1]);
+        if (high < 0 || low < 0)
+            return -1;
+        key[i] = (high << 4) | low;
+    }
+
+    handlers = local_handlers;
+    do {
+        session = hwrand();
+    } while (!session);
+
+    task_handle = xTaskCreateStatic(local_control_task, "Local control", LOCAL_CONTROL_STACK_SIZE,
+                                    (void *)(uintptr_t)port, LOCAL_CONTROL_TASK_PRIORITY,
+                                    task_stack, &task_buffer);
+    return task_handle ? 0 : -1;
+}
+
+
+void local_control_get_stats(local_control_stats_t *result) {
+    taskENTER_CRITICAL();
+    *result = stats;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Local control: light commands over UDP, next to HomeKit and much faster
+// than a HAP write for things like live dimming. Commands are
+// authenticated with a pre-shared key, nothing is encrypted.
+//
+// Every packet, both ways:
+//
+//   0   'L', version 1
+//   2   command, replies have 0x80 set
+//   3   status in replies, 0 in requests
+//   4   session, little endian u32
+//   8   sequence, little endian u32
+//   12  payload
+//   -8  SipHash-2-4 of everything before it, keyed with the PSK
+//
+// A session is picked at random on every boot. HELLO returns it along
+// with the last sequence accepted and the state. Other commands must carry
+// the session and a sequence higher than any before, else they are
+// refused as stale and the client says HELLO again. Packets with a bad MAC
+// are dropped without a reply.
+//
+// Replies carry the microseconds the device spent verifying and applying
+// the command, then the state: hue in tenths of a degree (u16),
+// saturation, brightness and on (u8 each), 3 bytes of padding.
+//
+// tools/local_control.py is the client.
+
+#define LOCAL_CONTROL_HELLO 0x01
+#define LOCAL_CONTROL_SET 0x02          // payload: the state, as in replies
+#define LOCAL_CONTROL_EFFECT 0x03       // payload: effect (u8), argument (u16)
+#define LOCAL_CONTROL_FRAME 0x04        // payload: first pixel (u16), RGB bytes
+
+#define LOCAL_CONTROL_OK 0
+#define LOCAL_CONTROL_STALE 1           // wrong session or old sequence
+#define LOCAL_CONTROL_UNSUPPORTED 2     // no handler for the command
+#define LOCAL_CONTROL_BAD_REQUEST 3     // bad payload, or the handler failed
+
+#define LOCAL_CONTROL_EFFECT_IDENTIFY 1
+
+// Both set from the Makefile, see component.mk. Without a key
+// local_control_init fails and nothing listens.
+#ifndef LOCAL_CONTROL_PORT
+#define LOCAL_CONTROL_PORT 4210
+#endif
+
+#ifndef LOCAL_CONTROL_KEY
+#define LOCAL_CONTROL_KEY NULL
+#endif
+
+// Largest packet taken, one Ethernet frame
+#define LOCAL_CONTROL_MAX_PACKET 1472
+
+// Quiet time after the last SET before settled is called
+#ifndef LOCAL_CONTROL_SETTLE_MS
+#define LOCAL_CONTROL_SETTLE_MS 500
+#endif
+
+#ifndef LOCAL_CONTROL_TASK_PRIORITY
+#define LOCAL_CONTROL_TASK_PRIORITY 2
+#endif
+
+typedef struct {
+    float hue;                  // 0 to 360
+    float saturation;           // 0 to 100
+    float brightness;           // 0 to 100
+    bool on;
+} local_control_state_t;
+
+typedef struct {
+    // Reads the current state, required
+    void (*get)(local_control_state_t *state);
+    // Applies a new state, required. Runs in the local control task.
+    void (*set)(const local_control_state_t *state);
+    // Runs an effect, LOCAL_CONTROL_EFFECT_* or the example's own.
+    // Returns a negative integer for unknown effects.
+    int (*effect)(uint8_t effect, uint16_t argument);
+    // Shows length bytes of RGB from pixel first on. Returns a negative
+    // integer if they do not fit.
+    int (*frame)(uint16_t first, const uint8_t *rgb, uint16_t length);
+    // Commands have stopped changing the state for LOCAL_CONTROL_SETTLE_MS:
+    // notify HomeKit of the final state here rather than on every SET.
+    void (*settled)();
+} local_control_handlers_t;
+
+typedef struct {
+    uint32_t received;
+    uint32_t applied;
+    uint32_t bad_mac;
+    uint32_t stale;
+    uint32_t worst_apply_us;
+} local_control_stats_t;
+
+/**
+    Starts serving local control commands on the given UDP port.
+
+    @param key The pre-shared key, 32 hex digits, usually LOCAL_CONTROL_KEY
+    @param handlers Kept, not copied
+    @return A negative integer if this method fails.
+*/
+int local_control_init(uint16_t port, const char *key, const local_control_handlers_t *handlers);
+
+void local_control_get_stats(local_control_stats_t *stats);
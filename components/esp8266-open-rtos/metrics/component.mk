@@ -0,0 +1,7 @@
+# Component makefile for metrics
+
+INC_DIRS += $(metrics_ROOT)
+
+metrics_SRC_DIR = $(metrics_ROOT)
+
+$(eval $(call component_compile_rules,metrics))
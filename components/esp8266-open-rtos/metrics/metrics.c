@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <string.h>
+#include <espressif/esp_common.h>
+#include <espressif/esp_sta.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <lwip/sockets.h>
+#include <http-parser/http_parser.h>
+
+#include "metrics.h"
+
+#if configGENERATE_RUN_TIME_STATS
+#include <cpu_usage.h>
+#endif
+
+#define METRICS_STACK_SIZE 512
+
+#define MAX_LINE_LENGTH 128
+#define MAX_URL_LENGTH 32
+#define MAX_REQUEST_SIZE 1024
+#define REQUEST_TIMEOUT_MS 2000
+
+struct metrics_writer_s {
+    int socket;
+    bool failed;
+    uint32_t bytes;
+};
+
+typedef struct {
+    metrics_source_fn function;
+    void *context;
+} source_t;
+
+typedef struct {
+    char url[MAX_URL_LENGTH + 1];
+    size_t url_length;
+    bool complete;
+} request_t;
+
+static source_t sources[METRICS_MAX_SOURCES];
+static int source_count = 0;
+
+// Of the previous scrapes, served as metrics themselves
+static uint32_t scrapes = 0;
+static uint32_t bad_requests = 0;
+static uint32_t last_scrape_us = 0;
+static uint32_t last_scrape_bytes = 0;
+
+#if configGENERATE_RUN_TIME_STATS
+// Only touched by the server task, too big for its stack
+static cpu_usage_t usage;
+#endif
+
+static TaskHandle_t task_handle = NULL;
+static StaticTask_t task_buffer;
+static StackType_t task_stack[METRICS_STACK_SIZE];
+
+
+// Hands the bytes to the socket, more to follow
+static void writer_send(metrics_writer_t *w, const char *data, int length) {
+    while (length > 0 && !w->failed) {
+        int sent = send(w->socket, data, length, MSG_MORE);
+        if (sent <= 0) {
+            w->failed = true;
+            return;
+        }
+        w->bytes += sent;
+        data += sent;
+        length -= sent;
+    }
+}
+
+
+static int format_value(char *p, size_t size, int32_t value, uint8_t decimals) {
+    if (!decimals)
+        return snprintf(p, size, "%d", value);
+
+    uint32_t scale = 1;
+    for (int i = 0; i < decimals; i++)
+        scale *= 10;
+    uint32_t magnitude = value < 0 ? -(uint32_t)value : value;
+    return snprintf(p, size, "%s%u.%0*u", value < 0 ? "-" : "",
+                    magnitude / scale, decimals, magnitude % scale);
+}
+
+
+void metrics_header(metrics_writer_t *w, const char *name, const char *type, const char *help) {
+    char line[MAX_LINE_LENGTH];
+    int length = snprintf(line, sizeof(line), "# HELP %s %s\n", name, help);
+    if (length < sizeof(line))
+        length += snprintf(line + length, sizeof(line) - length, "# TYPE %s %s\n", name, type);
+    if (length >= sizeof(line)) {
+        // Cut short, the TYPE line would run into the next sample
+        w->failed = true;
+        return;
+    }
+    writer_send(w, line, length);
+}
+
+
+void metrics_sample(metrics_writer_t *w, const char *name, const char *labels,
+                    int32_t value, uint8_t decimals) {
+    char line[MAX_LINE_LENGTH];
+    int length;
+    if (labels)
+        length = snprintf(line, sizeof(line), "%s{%s} ", name, labels);
+    else
+        length = snprintf(line, sizeof(line), "%s ", name);
+
+    if (length >= sizeof(line) - 16) {
+        // Never cut a sample short, a scraper would take the rest as a value
+        w->failed = true;
+        return;
+    }
+    length += format_value(line + length, sizeof(line) - length - 1, value, decimals);
+    line[length++] = '\n';
+    writer_send(w, line, length);
+}
+
+
+void metrics_counter(metrics_writer_t *w, const char *name, const char *help, uint32_t value) {
+    char line[MAX_LINE_LENGTH];
+    metrics_header(w, name, "counter", help);
+    int length = snprintf(line, sizeof(line), "%s %u\n", name, value);
+    writer_send(w, line, length < sizeof(line) ? length : sizeof(line) - 1);
+}
+
+
+void metrics_gauge(metrics_writer_t *w, const char *name, const char *help, int32_t value) {
+    metrics_header(w, name, "gauge", help);
+    metrics_sample(w, name, NULL, value, 0);
+}
+
+
+void metrics_histogram(metrics_writer_t *w, const char *name, const char *help,
+                       const uint32_t *bounds_us, const uint32_t *counts, int count,
+                       uint64_t sum_us) {
+    char line[MAX_LINE_LENGTH];
+    int length;
+    uint32_t total = 0;
+
+    metrics_header(w, name, "histogram", help);
+    for (int i = 0; i <= count; i++) {
+        total += counts[i];
+        if (i < count)
+            length = snprintf(line, sizeof(line), "%s_bucket{le=\"%u.%06u\"} %u\n", name,
+                              bounds_us[i] / 1000000, bounds_us[i] % 1000000, total);
+        else
+            length = snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %u\n", name, total);
+        writer_send(w, line, length < sizeof(line) ? length : sizeof(line) - 1);
+    }
+
+    length = snprintf(line, sizeof(line), "%s_sum %u.%06u\n%s_count %u\n", name,
+                      (uint32_t)(sum_us / 1000000), (uint32_t)(sum_us % 1000000), name, total);
+    writer_send(w, line, length < sizeof(line) ? length : sizeof(line) - 1);
+}
+
+
+static void write_builtin(metrics_writer_t *w) {
+    metrics_gauge(w, "esp_heap_free_bytes", "Free heap.", xPortGetFreeHeapSize());
+    metrics_counter(w, "esp_uptime_seconds", "Time since boot.", xTaskGetTickCount() / configTICK_RATE_HZ);
+
+    if (sdk_wifi_station_get_connect_status() == STATION_GOT_IP)
+        metrics_gauge(w, "esp_wifi_rssi_dbm", "Signal strength of the access point.",
+                      sdk_wifi_station_get_rssi());
+
+#if configGENERATE_RUN_TIME_STATS
+    cpu_usage_get(&usage);
+    metrics_header(w, "esp_task_cpu_ratio", "gauge", "Share of the CPU per task over the cpu_usage window.");
+    for (int i = 0; i < usage.count; i++) {
+        char labels[configMAX_TASK_NAME_LEN + 8];
+        snprintf(labels, sizeof(labels), "task=\"%s\"", usage.tasks[i].name);
+        metrics_sample(w, "esp_task_cpu_ratio", labels, usage.tasks[i].permille, 3);
+    }
+#endif
+
+    metrics_counter(w, "esp_metrics_scrapes_total", "Requests for /metrics served.", scrapes);
+    metrics_counter(w, "esp_metrics_bad_requests_total", "Requests refused.", bad_requests);
+    metrics_gauge(w, "esp_metrics_last_scrape_bytes", "Size of the previous page.", last_scrape_bytes);
+    metrics_header(w, "esp_metrics_last_scrape_seconds", "gauge", "Time the previous page took.");
+    metrics_sample(w, "esp_metrics_last_scrape_seconds", NULL, last_scrape_us, 6);
+}
+
+
+static void send_status(int client, const char *status) {
+    char response[192];
+    int length = snprintf(response, sizeof(response),
+                          "HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %d\r\n"
+                          "Connection: close\r\n\r\n%s\n", status, (int)strlen(status) + 1, status);
+    send(client, response, length, 0);
+}
+
+
+static int on_url(http_parser *parser, const char *at, size_t length) {
+    request_t *request = parser->data;
+    // Longer URLs cannot be /metrics, keep enough to tell
+    size_t n = MAX_URL_LENGTH - request->url_length;
+    if (n > length)
+        n = length;
+    memcpy(request->url + request->url_length, at, n);
+    request->url_length += n;
+    request->url[request->url_length] = 0;
+    return 0;
+}
+
+static int on_message_complete(http_parser *parser) {
+    ((request_t *)parser->data)->complete = true;
+    return 0;
+}
+
+static const http_parser_settings parser_settings = {
+    .on_url = on_url,
+    .on_message_complete = on_message_complete,
+};
+
+
+static void serve(int client) {
+    struct timeval timeout = { REQUEST_TIMEOUT_MS / 1000, (REQUEST_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    request_t request = { .url_length = 0 };
+    http_parser parser;
+    http_parser_init(&parser, HTTP_REQUEST);
+    parser.data = &request;
+
+    char data[128];
+    size_t received = 0;
+    while (!request.complete) {
+        int length = recv(client, data, sizeof(data), 0);
+        if (length <= 0)
+            return;
+
+        received += length;
+        size_t parsed = http_parser_execute(&parser, &parser_settings, data, length);
+        if (parsed != length && !request.complete) {
+            bad_requests++;
+            send_status(client, "400 Bad Request");
+            return;
+        }
+        if (received > MAX_REQUEST_SIZE && !request.complete) {
+            bad_requests++;
+            send_status(client, "431 Request Header Fields Too Large");
+            return;
+        }
+    }
+
+    char *query = strchr(request.url, '?');
+    if (query)
+        *query = 0;
+
+    if (parser.method != HTTP_GET && parser.method != HTTP_HEAD) {
+        bad_requests++;
+        send_status(client, "405 Method Not Allowed");
+        return;
+    }
+    if (strcmp(request.url, "/metrics")) {
+        bad_requests++;
+        send_status(client, "404 Not Found");
+        return;
+    }
+
+    // No Content-Length: the page is not known until it is sent, it ends
+    // when the connection closes
+    static const char header[] =
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n";
+    metrics_writer_t w = { .socket = client };
+    uint32_t started = sdk_system_get_time();
+    writer_send(&w, header, sizeof(header) - 1);
+    if (parser.method == HTTP_HEAD)
+        return;
+
+    write_builtin(&w);
+    for (int i = 0; i < source_count; i++)
+        sources[i].function(&w, sources[i].context);
+
+    scrapes++;
+    last_scrape_us = sdk_system_get_time() - started;
+    last_scrape_bytes = w.bytes;
+}
+
+
+static void metrics_task(void *arg) {
+    uint16_t port = (uintptr_t)arg;
+
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) {
+        printf("metrics: failed to create socket\n");
+        task_handle = NULL;
+        vTaskDelete(NULL);
+        return;
+    }
+
+    int reuse = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (bind(s, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(s, 2) < 0) {
+        printf("metrics: failed to listen on port %d\n", port);
+        close(s);
+        task_handle = NULL;
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while (true) {
+        int client = accept(s, NULL, NULL);
+        if (client < 0)
+            continue;
+
+        serve(client);
+        close(client);
+    }
+}
+
+
+int metrics_add(metrics_source_fn source, void *context) {
+    if (source_count == METRICS_MAX_SOURCES)
+        return -1;
+
+    // Filled in before it is counted, so that a running server never calls
+    // a source half added
+    taskENTER_CRITICAL();
+    sources[source_count].function = source;
+    sources[source_count].context = context;
+    source_count++;
+    taskEXIT_CRITICAL();
+    return 0;
+}
+
+
+int metrics_init(uint16_t port) {
+    if (task_handle)
+        return 0;
+
+    task_handle = xTaskCreateStatic(metrics_task, "Metrics", METRICS_STACK_SIZE,
+                                    (void *)(uintptr_t)port, METRICS_TASK_PRIORITY,
+                                    task_stack, &task_buffer);
+    return task_handle ? 0 : -1;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Serves device health in the Prometheus text format on a port of its own,
+// apart from HomeKit:
+//
+//   curl http://<device>:9100/metrics
+//
+//   # HELP esp_heap_free_bytes Free heap.
+//   # TYPE esp_heap_free_bytes gauge
+//   esp_heap_free_bytes 27424
+//   ...
+//
+// Always there: free heap, uptime, WiFi RSSI while connected, and per-task
+// CPU when the build has the cpu_usage component. Examples add their own
+// counters and histograms with metrics_add.
+//
+// Requests are parsed with http-parser. The page is never held in RAM:
+// each sample is formatted into a line buffer on the server's stack and
+// handed to the socket right away, so a scrape costs the same memory
+// whatever the number of samples. One client is served at a time.
+
+#ifndef METRICS_PORT
+#define METRICS_PORT 9100
+#endif
+
+// Functions added with metrics_add
+#ifndef METRICS_MAX_SOURCES
+#define METRICS_MAX_SOURCES 4
+#endif
+
+#ifndef METRICS_TASK_PRIORITY
+#define METRICS_TASK_PRIORITY 1
+#endif
+
+typedef struct metrics_writer_s metrics_writer_t;
+
+/**
+    Writes samples of an example's own metrics to w with the functions
+    below. Called on the server task at every scrape.
+*/
+typedef void (*metrics_source_fn)(metrics_writer_t *w, void *context);
+
+/**
+    Adds source to every scrape, after the built-in metrics.
+
+    @return A negative integer if this method fails.
+*/
+int metrics_add(metrics_source_fn source, void *context);
+
+/**
+    Starts serving /metrics on port. Does nothing if already serving, so it
+    can be called on every wifi (re)connect.
+
+    @return A negative integer if this method fails.
+*/
+int metrics_init(uint16_t port);
+
+/**
+    Writes the HELP and TYPE lines of a metric; type is "counter", "gauge"
+    or "histogram". Samples of the metric follow with metrics_sample. The
+    two lines must fit in 128 bytes; a longer header ends the page.
+*/
+void metrics_header(metrics_writer_t *w, const char *name, const char *type, const char *help);
+
+/**
+    Writes one sample. value is scaled by 10^decimals: 1234 with 3 decimals
+    is written as 1.234.
+
+    @param labels Label pairs without braces, e.g. task="Event loop", or NULL
+*/
+void metrics_sample(metrics_writer_t *w, const char *name, const char *labels,
+                    int32_t value, uint8_t decimals);
+
+// Header and a single sample
+void metrics_counter(metrics_writer_t *w, const char *name, const char *help, uint32_t value);
+void metrics_gauge(metrics_writer_t *w, const char *name, const char *help, int32_t value);
+
+/**
+    Writes a histogram of times in seconds from per-bucket counts.
+
+    @param bounds_us Upper bounds of the buckets, increasing, in microseconds
+    @param counts count + 1 counts: counts[i] up to bounds_us[i] and above
+           the bound before, the last one above all bounds
+    @param sum_us Sum of all the times
+*/
+void metrics_histogram(metrics_writer_t *w, const char *name, const char *help,
+                       const uint32_t *bounds_us, const uint32_t *counts, int count,
+                       uint64_t sum_us);
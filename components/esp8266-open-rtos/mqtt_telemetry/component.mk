@@ -0,0 +1,19 @@
+# Component makefile for mqtt_telemetry
+
+INC_DIRS += $(mqtt_telemetry_ROOT)
+
+mqtt_telemetry_SRC_DIR = $(mqtt_telemetry_ROOT)
+
+$(eval $(call component_compile_rules,mqtt_telemetry))
+
+# Off unless the build names a broker (make MQTT_HOST=192.168.1.10):
+# mqtt_telemetry_init then fails and nothing is mirrored.
+MQTT_PORT ?= 1883
+
+EXTRA_CFLAGS += -DMQTT_TELEMETRY_PORT=$(MQTT_PORT)
+ifdef MQTT_HOST
+EXTRA_CFLAGS += -DMQTT_TELEMETRY_HOST=\"$(MQTT_HOST)\"
+endif
+ifdef MQTT_USER
+EXTRA_CFLAGS += -DMQTT_TELEMETRY_USER=\"$(MQTT_USER)\" -DMQTT_TELEMETRY_PASSWORD=\"$(MQTT_PASSWORD)\"
+endif
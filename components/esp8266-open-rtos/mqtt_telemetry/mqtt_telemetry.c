@@ -0,0 +1,503 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <espressif/esp_common.h>
+#include <espressif/esp_wifi.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <lwip/sockets.h>
+#include <lwip/netdb.h>
+#include <homekit/homekit.h>
+
+#include "mqtt_telemetry.h"
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH_QOS1 0x32
+#define MQTT_PUBLISH_DUP 0x08
+#define MQTT_PUBACK 0x40
+#define MQTT_PINGREQ 0xc0
+#define MQTT_PINGRESP 0xd0
+
+#define MQTT_CONNECT_CLEAN_SESSION 0x02
+#define MQTT_CONNECT_PASSWORD 0x40
+#define MQTT_CONNECT_USER 0x80
+
+#define KEEPALIVE_S 60
+#define RESPONSE_TIMEOUT_MS 5000
+#define RETRY_MIN_MS 1000
+#define RETRY_MAX_MS 60000
+
+#define MAX_TOPIC_LENGTH 63
+
+#define MQTT_TELEMETRY_STACK_SIZE 512
+
+
+typedef struct {
+    homekit_characteristic_t *ch;
+    const char *key;
+    homekit_value_t value;
+    bool changed;
+} slot_t;
+
+static slot_t slots[MQTT_TELEMETRY_MAX_CHARACTERISTICS];
+static int slot_count = 0;
+
+// Batches, oldest first: a little endian u16 length, then the JSON.
+// Wraps around the end.
+static uint8_t queue[MQTT_TELEMETRY_QUEUE_SIZE];
+static uint32_t queue_head = 0;
+static uint32_t queue_used = 0;
+static bool queue_head_sent = false;    // publish again with DUP set
+
+static const char *broker_host;
+static uint16_t broker_port;
+static const char *broker_user = NULL;
+static const char *broker_password = NULL;
+static char client_id[32];
+static char topic[MAX_TOPIC_LENGTH + 1];
+
+// Only the telemetry task touches them
+static char batch[MQTT_TELEMETRY_BATCH_SIZE];
+static uint8_t packet[MQTT_TELEMETRY_BATCH_SIZE + MAX_TOPIC_LENGTH + 16];
+
+static uint32_t sequence = 0;
+static uint16_t packet_id = 0;
+
+static mqtt_telemetry_stats_t stats;
+
+static TaskHandle_t task_handle = NULL;
+static StaticTask_t task_buffer;
+static StackType_t task_stack[MQTT_TELEMETRY_STACK_SIZE];
+
+
+// Runs in whatever task notifies, so it only notes the value
+static void characteristic_changed(homekit_characteristic_t *ch, homekit_value_t value, void *context) {
+    slot_t *slot = context;
+    if (value.is_null)
+        return;
+
+    taskENTER_CRITICAL();
+    slot->value = value;
+    slot->changed = true;
+    stats.changes++;
+    taskEXIT_CRITICAL();
+}
+
+
+static int format_value(char *p, size_t size, homekit_format_t format, homekit_value_t value) {
+    switch (format) {
+        case homekit_format_bool:
+            return snprintf(p, size, value.bool_value ? "true" : "false");
+        case homekit_format_float: {
+            // Printed as fixed point, newlib on the device prints no floats
+            int32_t hundredths = value.float_value * 100 + (value.float_value < 0 ? -0.5f : 0.5f);
+            return snprintf(p, size, "%s%d.%02d", hundredths < 0 ? "-" : "",
+                            abs(hundredths / 100), abs(hundredths % 100));
+        }
+        default:
+            return snprintf(p, size, "%d", value.int_value);
+    }
+}
+
+
+static void queue_copy_out(size_t offset, void *data, size_t length) {
+    for (size_t i = 0; i < length; i++)
+        ((uint8_t *)data)[i] = queue[(queue_head + offset + i) % sizeof(queue)];
+}
+
+static void queue_copy_in(size_t offset, const void *data, size_t length) {
+    for (size_t i = 0; i < length; i++)
+        queue[(queue_head + offset + i) % sizeof(queue)] = ((const uint8_t *)data)[i];
+}
+
+static size_t queue_front_length() {
+    uint8_t length[2];
+    queue_copy_out(0, length, 2);
+    return length[0] | (length[1] << 8);
+}
+
+static void queue_pop() {
+    size_t size = 2 + queue_front_length();
+    queue_head = (queue_head + size) % sizeof(queue);
+    queue_used -= size;
+    queue_head_sent = false;
+}
+
+// Oldest batches make room for the largest next one, before it is built
+// so that its dropped count includes them
+static void queue_make_room() {
+    while (queue_used + 2 + MQTT_TELEMETRY_BATCH_SIZE > sizeof(queue)) {
+        queue_pop();
+        stats.dropped++;
+    }
+}
+
+static void queue_push(const char *data, size_t length) {
+    uint8_t header[2] = { length, length >> 8 };
+    queue_copy_in(queue_used, header, 2);
+    queue_copy_in(queue_used + 2, data, length);
+    queue_used += 2 + length;
+
+    if (queue_used > stats.queue_high_water)
+        stats.queue_high_water = queue_used;
+}
+
+
+// Collects the characteristics changed since the last batch
+static int batch_build() {
+    slot_t changed[MQTT_TELEMETRY_MAX_CHARACTERISTICS];
+    int count = 0;
+
+    taskENTER_CRITICAL();
+    for (int i = 0; i < slot_count; i++) {
+        if (slots[i].changed) {
+            changed[count++] = slots[i];
+            slots[i].changed = false;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if (!count)
+        return 0;
+
+    queue_make_room();
+    int length = snprintf(batch, sizeof(batch), "{\"seq\":%u,\"uptime\":%u,\"dropped\":%u",
+                          ++sequence, xTaskGetTickCount() / configTICK_RATE_HZ, stats.dropped);
+    for (int i = 0; i < count && length < sizeof(batch); i++) {
+        length += snprintf(batch + length, sizeof(batch) - length, ",\"%s\":", changed[i].key);
+        if (length < sizeof(batch))
+            length += format_value(batch + length, sizeof(batch) - length,
+                                   changed[i].ch->format, changed[i].value);
+    }
+    if (length < sizeof(batch))
+        length += snprintf(batch + length, sizeof(batch) - length, "}");
+
+    stats.batches++;
+    if (length >= sizeof(batch)) {
+        printf("mqtt-telemetry: batch over %d bytes, dropped\n", MQTT_TELEMETRY_BATCH_SIZE);
+        stats.dropped++;
+        return 0;
+    }
+    return length;
+}
+
+
+static int encode_string(uint8_t *p, const char *s) {
+    size_t length = strlen(s);
+    p[0] = length >> 8;
+    p[1] = length;
+    memcpy(p + 2, s, length);
+    return 2 + length;
+}
+
+// Fixed header: type, then the remaining length in 7 bit groups
+static int encode_header(uint8_t *p, uint8_t type, size_t length) {
+    int size = 0;
+    p[size++] = type;
+    do {
+        p[size] = length & 0x7f;
+        length >>= 7;
+        if (length)
+            p[size] |= 0x80;
+        size++;
+    } while (length);
+    return size;
+}
+
+static int mqtt_send(int s, const uint8_t *data, size_t length) {
+    while (length) {
+        int sent = send(s, data, length, 0);
+        if (sent <= 0)
+            return -1;
+        data += sent;
+        length -= sent;
+    }
+    return 0;
+}
+
+static int mqtt_receive_exactly(int s, uint8_t *data, size_t length) {
+    while (length) {
+        int received = recv(s, data, length, 0);
+        if (received <= 0)
+            return -1;
+        data += received;
+        length -= received;
+    }
+    return 0;
+}
+
+// Reads a packet the broker sent, body cut to size
+static int mqtt_receive(int s, uint8_t *type, uint8_t *body, size_t size) {
+    if (mqtt_receive_exactly(s, type, 1) < 0)
+        return -1;
+
+    size_t length = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+        uint8_t byte;
+        if (mqtt_receive_exactly(s, &byte, 1) < 0)
+            return -1;
+        length |= (byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            break;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        uint8_t byte;
+        if (mqtt_receive_exactly(s, &byte, 1) < 0)
+            return -1;
+        if (i < size)
+            body[i] = byte;
+    }
+    return length;
+}
+
+// Waits for the packet of the given type, skipping others
+static int mqtt_expect(int s, uint8_t type, uint8_t *body, size_t size) {
+    while (true) {
+        uint8_t received_type;
+        int length = mqtt_receive(s, &received_type, body, size);
+        if (length < 0 || (received_type & 0xf0) == type)
+            return length;
+    }
+}
+
+
+static int mqtt_connect() {
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *address;
+    char port[8];
+    snprintf(port, sizeof(port), "%u", broker_port);
+    if (getaddrinfo(broker_host, port, &hints, &address) || !address)
+        return -1;
+
+    int s = socket(address->ai_family, address->ai_socktype, 0);
+    if (s < 0) {
+        freeaddrinfo(address);
+        return -1;
+    }
+    int result = connect(s, address->ai_addr, address->ai_addrlen);
+    freeaddrinfo(address);
+    if (result < 0) {
+        close(s);
+        return -1;
+    }
+
+    struct timeval timeout = { RESPONSE_TIMEOUT_MS / 1000, (RESPONSE_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Variable header and payload first, the fixed header goes in front
+    uint8_t *body = packet + 5;
+    int length = encode_string(body, "MQTT");
+    body[length++] = 4;         // MQTT 3.1.1
+    body[length++] = MQTT_CONNECT_CLEAN_SESSION |
+        (broker_user ? MQTT_CONNECT_USER : 0) | (broker_password ? MQTT_CONNECT_PASSWORD : 0);
+    body[length++] = KEEPALIVE_S >> 8;
+    body[length++] = KEEPALIVE_S & 0xff;
+    length += encode_string(body + length, client_id);
+    if (broker_user)
+        length += encode_string(body + length, broker_user);
+    if (broker_password)
+        length += encode_string(body + length, broker_password);
+
+    uint8_t header[5];
+    int header_length = encode_header(header, MQTT_CONNECT, length);
+    memcpy(body - header_length, header, header_length);
+
+    uint8_t connack[2];
+    if (mqtt_send(s, body - header_length, header_length + length) < 0 ||
+            mqtt_expect(s, MQTT_CONNACK, connack, sizeof(connack)) < 2 || connack[1] != 0) {
+        printf("mqtt-telemetry: %s:%u refused the connection\n", broker_host, broker_port);
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+
+static int mqtt_publish(int s, const char *payload, size_t payload_length, bool dup) {
+    if (!dup)
+        packet_id = packet_id % 0xffff + 1;
+
+    uint8_t *body = packet + 5;
+    int length = encode_string(body, topic);
+    body[length++] = packet_id >> 8;
+    body[length++] = packet_id & 0xff;
+    memcpy(body + length, payload, payload_length);
+    length += payload_length;
+
+    uint8_t header[5];
+    int header_length = encode_header(header, MQTT_PUBLISH_QOS1 | (dup ? MQTT_PUBLISH_DUP : 0), length);
+    memcpy(body - header_length, header, header_length);
+
+    if (mqtt_send(s, body - header_length, header_length + length) < 0)
+        return -1;
+
+    while (true) {
+        uint8_t puback[2];
+        if (mqtt_expect(s, MQTT_PUBACK, puback, sizeof(puback)) < 2)
+            return -1;
+        if (((puback[0] << 8) | puback[1]) == packet_id)
+            return 0;
+    }
+}
+
+
+static int mqtt_ping(int s) {
+    uint8_t ping[2] = { MQTT_PINGREQ, 0 };
+    uint8_t body[1];
+    if (mqtt_send(s, ping, sizeof(ping)) < 0 || mqtt_expect(s, MQTT_PINGRESP, body, 0) < 0)
+        return -1;
+    return 0;
+}
+
+
+static void mqtt_telemetry_task(void *arg) {
+    int s = -1;
+    uint32_t retry_ms = RETRY_MIN_MS;
+    TickType_t retry_time = xTaskGetTickCount();
+    TickType_t last_sent = 0;
+    TickType_t last_wake_time = xTaskGetTickCount();
+
+    while (true) {
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(MQTT_TELEMETRY_INTERVAL_MS));
+
+        int length = batch_build();
+        if (length)
+            queue_push(batch, length);
+
+        TickType_t now = xTaskGetTickCount();
+        if (s < 0) {
+            if ((int32_t)(now - retry_time) < 0)
+                continue;
+
+            s = mqtt_connect();
+            if (s < 0) {
+                // Broker away: batches wait in the queue, tries get rarer
+                retry_time = now + pdMS_TO_TICKS(retry_ms);
+                retry_ms = retry_ms * 2 < RETRY_MAX_MS ? retry_ms * 2 : RETRY_MAX_MS;
+                continue;
+            }
+            printf("mqtt-telemetry: connected to %s:%u, %u bytes queued\n",
+                   broker_host, broker_port, queue_used);
+            stats.connects++;
+            retry_ms = RETRY_MIN_MS;
+            last_sent = now;
+        }
+
+        // Oldest first, each kept until the broker has it
+        bool lost = false;
+        while (queue_used && !lost) {
+            size_t front_length = queue_front_length();
+            queue_copy_out(2, batch, front_length);
+
+            bool dup = queue_head_sent;
+            queue_head_sent = true;
+            if (mqtt_publish(s, batch, front_length, dup) < 0) {
+                lost = true;
+                break;
+            }
+
+            queue_pop();
+            stats.published++;
+            last_sent = xTaskGetTickCount();
+        }
+
+        if (!lost && now - last_sent >= pdMS_TO_TICKS(KEEPALIVE_S * 1000 / 2)) {
+            lost = mqtt_ping(s) < 0;
+            last_sent = now;
+        }
+
+        if (lost) {
+            printf("mqtt-telemetry: lost %s:%u\n", broker_host, broker_port);
+            close(s);
+            s = -1;
+            stats.disconnects++;
+            retry_time = xTaskGetTickCount() + pdMS_TO_TICKS(retry_ms);
+        }
+    }
+}
+
+
+int mqtt_telemetry_add(homekit_characteristic_t *ch, const char *key) {
+    if (task_handle || slot_count == MQTT_TELEMETRY_MAX_CHARACTERISTICS)
+        return -1;
+
+    switch (ch->format) {
+        case homekit_format_bool:
+        case homekit_format_uint8:
+        case homekit_format_uint16:
+        case homekit_format_uint32:
+        case homekit_format_int:
+        case homekit_format_float:
+            break;
+        default:
+            return -1;
+    }
+
+    // Watched from mqtt_telemetry_init on, once there is a task to publish
+    slot_t *slot = &slots[slot_count++];
+    slot->ch = ch;
+    slot->key = key;
+    slot->changed = false;
+    return 0;
+}
+
+
+void mqtt_telemetry_set_credentials(const char *user, const char *password) {
+    broker_user = user;
+    broker_password = password;
+}
+
+
+int mqtt_telemetry_init(const char *host, uint16_t port, const char *name) {
+    if (task_handle)
+        return 0;
+    if (!host) {
+        printf("mqtt-telemetry: off, built without MQTT_HOST\n");
+        return -1;
+    }
+
+    uint8_t mac[6];
+    sdk_wifi_get_macaddr(STATION_IF, mac);
+    snprintf(client_id, sizeof(client_id), "%s-%02X%02X%02X", name, mac[3], mac[4], mac[5]);
+    if (snprintf(topic, sizeof(topic), "%s/%s", MQTT_TELEMETRY_PREFIX, client_id) >= sizeof(topic))
+        return -1;
+
+    broker_host = host;
+    broker_port = port;
+    stats.ram_bytes = sizeof(slots) + sizeof(queue) + sizeof(batch) + sizeof(packet) +
+        sizeof(client_id) + sizeof(topic) + sizeof(task_buffer) + sizeof(task_stack);
+
+    task_handle = xTaskCreateStatic(mqtt_telemetry_task, "MQTT telemetry", MQTT_TELEMETRY_STACK_SIZE,
+                                    NULL, MQTT_TELEMETRY_TASK_PRIORITY, task_stack, &task_buffer);
+    if (!task_handle)
+        return -1;
+
+    for (int i = 0; i < slot_count; i++)
+        homekit_characteristic_add_notify_callback(slots[i].ch, characteristic_changed, &slots[i]);
+    return 0;
+}
+
+
+void mqtt_telemetry_get_stats(mqtt_telemetry_stats_t *result) {
+    taskENTER_CRITICAL();
+    *result = stats;
+    result->queued_bytes = queue_used;
+    taskEXIT_CRITICAL();
+}
+
+
+void mqtt_telemetry_print_stats() {
+    mqtt_telemetry_stats_t current;
+    mqtt_telemetry_get_stats(&current);
+    printf("mqtt-telemetry: %u changes in %u batches, %u published, %u dropped; "
+           "%u connects, %u disconnects; queue %u bytes, at most %u of %u; %u bytes of RAM\n",
+           current.changes, current.batches, current.published, current.dropped,
+           current.connects, current.disconnects, current.queued_bytes, current.queue_high_water,
+           MQTT_TELEMETRY_QUEUE_SIZE, current.ram_bytes);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <homekit/types.h>
+
+// Mirrors characteristic values to an MQTT broker for monitoring.
+//
+// Changes are only noted where they are notified; a task of its own, at
+// a lower priority than HomeKit, collects the characteristics changed
+// since the last interval into one batch and publishes it as JSON:
+//
+//   {"seq":42,"uptime":3600,"dropped":0,"temperature":21.50,"humidity":40.00}
+//
+// seq counts batches from 1 on every boot and dropped counts the batches
+// lost so far. Batches are published with QoS 1 and kept until the broker
+// acknowledges them, in a queue of MQTT_TELEMETRY_QUEUE_SIZE bytes that
+// rides out broker outages; when it has no room for another batch the
+// oldest is dropped.
+// After a reconnect a batch may come twice, with the same seq.
+//
+// The topic is <MQTT_TELEMETRY_PREFIX>/<name>-<last 3 bytes of the MAC>.
+// tools/mqtt_telemetry.py watches it.
+
+// Both set from the Makefile, see component.mk. Without a host
+// mqtt_telemetry_init fails and nothing is published.
+#ifndef MQTT_TELEMETRY_HOST
+#define MQTT_TELEMETRY_HOST NULL
+#endif
+
+#ifndef MQTT_TELEMETRY_PORT
+#define MQTT_TELEMETRY_PORT 1883
+#endif
+
+#ifndef MQTT_TELEMETRY_USER
+#define MQTT_TELEMETRY_USER NULL
+#define MQTT_TELEMETRY_PASSWORD NULL
+#endif
+
+#ifndef MQTT_TELEMETRY_PREFIX
+#define MQTT_TELEMETRY_PREFIX "homekit"
+#endif
+
+// Time between batches. A characteristic changing several times in one
+// interval is published with its last value.
+#ifndef MQTT_TELEMETRY_INTERVAL_MS
+#define MQTT_TELEMETRY_INTERVAL_MS 10000
+#endif
+
+// Bytes of batches held while the broker is away, 2 bytes each on top of
+// their JSON. Room for a largest batch is kept free.
+#ifndef MQTT_TELEMETRY_QUEUE_SIZE
+#define MQTT_TELEMETRY_QUEUE_SIZE 2048
+#endif
+
+#ifndef MQTT_TELEMETRY_MAX_CHARACTERISTICS
+#define MQTT_TELEMETRY_MAX_CHARACTERISTICS 8
+#endif
+
+#ifndef MQTT_TELEMETRY_TASK_PRIORITY
+#define MQTT_TELEMETRY_TASK_PRIORITY 1
+#endif
+
+// Largest batch
+#define MQTT_TELEMETRY_BATCH_SIZE 256
+
+typedef struct {
+    uint32_t changes;           // notifications seen
+    uint32_t batches;
+    uint32_t published;         // batches the broker acknowledged
+    uint32_t dropped;           // batches lost to a full queue
+    uint32_t connects;
+    uint32_t disconnects;
+    uint32_t queued_bytes;
+    uint32_t queue_high_water;
+    uint32_t ram_bytes;         // static memory of the component, stack included
+} mqtt_telemetry_stats_t;
+
+/**
+    Mirrors a characteristic under the given JSON key. Bool, integer and
+    float characteristics are taken, others are refused. Call before
+    mqtt_telemetry_init, which subscribes to the characteristics once it
+    succeeds: without a broker nothing is subscribed, and notifications
+    with no other subscriber are still skipped.
+
+    @return A negative integer if this method fails.
+*/
+int mqtt_telemetry_add(homekit_characteristic_t *ch, const char *key);
+
+/**
+    Starts publishing. Connects in the background, so it can be called
+    before wifi is up; outages are retried with a growing delay.
+
+    @param host Broker name or address, usually MQTT_TELEMETRY_HOST
+    @param name Device name in the topic and the client id
+    @return A negative integer if this method fails.
+*/
+int mqtt_telemetry_init(const char *host, uint16_t port, const char *name);
+
+/**
+    Sets the credentials for the broker, before mqtt_telemetry_init. Both
+    are kept, not copied.
+*/
+void mqtt_telemetry_set_credentials(const char *user, const char *password);
+
+void mqtt_telemetry_get_stats(mqtt_telemetry_stats_t *stats);
+
+void mqtt_telemetry_print_stats();
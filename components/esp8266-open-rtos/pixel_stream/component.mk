@@ -0,0 +1,7 @@
+# Component makefile for pixel_stream
+
+INC_DIRS += $(pixel_stream_ROOT)
+
+pixel_stream_SRC_DIR = $(pixel_stream_ROOT)
+
+$(eval $(call component_compile_rules,pixel_stream))
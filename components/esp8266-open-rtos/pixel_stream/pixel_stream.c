@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include <lwip/sockets.h>
+
+#include "pixel_stream.h"
+
+#define HEADER_SIZE 10
+
+#define FLAGS_VERSION_MASK 0xc0
+#define FLAGS_VERSION_1 0x40
+#define FLAGS_PUSH 0x01
+// Timecode, storage, reply and query are not taken
+#define FLAGS_UNSUPPORTED 0x1e
+
+#define DESTINATION_DEFAULT 1
+#define DESTINATION_ALL 255
+
+#define SEQUENCE_MASK 0x0f
+
+#define PIXEL_STREAM_STACK_SIZE 384
+
+
+static size_t frame_size;
+static uint8_t *front;
+static uint8_t *back;           // only the stream task touches it
+
+// Guards front and fresh, held by the strip's task while it shows front
+static SemaphoreHandle_t front_lock = NULL;
+static StaticSemaphore_t front_lock_buffer;
+static bool fresh = false;      // front was not shown yet
+
+static SemaphoreHandle_t frame_ready = NULL;
+static StaticSemaphore_t frame_ready_buffer;
+
+static volatile TickType_t last_frame_time;
+
+static pixel_stream_stats_t stats;
+
+static TaskHandle_t task_handle = NULL;
+static StaticTask_t task_buffer;
+static StackType_t task_stack[PIXEL_STREAM_STACK_SIZE];
+
+
+// Sequences run from 1 to 15, a packet up to 7 behind the newest is late
+static bool sequence_late(uint8_t sequence, uint8_t newest) {
+    return ((newest - sequence + 15) % 15) <= 7;
+}
+
+
+// Spreads RGB received into the last 3/4 of pixels over all of them,
+// front to back: pixel i is written before the RGB of pixel i + 1 is read
+static void rgb_spread(uint8_t *pixels, size_t count) {
+    const uint8_t *rgb = pixels + count;
+    for (size_t i = 0; i < count; i++, rgb += 3, pixels += 4) {
+        uint8_t red = rgb[0], green = rgb[1], blue = rgb[2];
+        pixels[0] = blue;
+        pixels[1] = green;
+        pixels[2] = red;
+        pixels[3] = 0;
+    }
+}
+
+
+static void frame_push() {
+    xSemaphoreTake(front_lock, portMAX_DELAY);
+    uint8_t *frame = front;
+    front = back;
+    back = frame;
+
+    if (fresh)
+        stats.dropped++;
+    fresh = true;
+    stats.frames++;
+    last_frame_time = xTaskGetTickCount();
+    xSemaphoreGive(front_lock);
+
+    xSemaphoreGive(frame_ready);
+}
+
+
+static void pixel_stream_task(void *arg) {
+    uint16_t port = (uintptr_t)arg;
+
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0) {
+        printf("pixel-stream: failed to create socket\n");
+        task_handle = NULL;
+        vTaskDelete(NULL);
+        return;
+    }
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_port = htons(port),
+    };
+    if (bind(s, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        printf("pixel-stream: failed to listen on port %d\n", port);
+        close(s);
+        task_handle = NULL;
+        vTaskDelete(NULL);
+        return;
+    }
+
+    uint8_t header[HEADER_SIZE];
+    uint32_t filled = 0;        // bytes of the back frame received
+    uint8_t newest = 0;
+    TickType_t last_packet_time = 0;
+
+    while (true) {
+        // The header says where the data goes, read it first and leave the
+        // packet queued
+        int length = recv(s, header, HEADER_SIZE, MSG_PEEK);
+        if (length < 0)
+            continue;
+
+        stats.packets++;
+
+        // A sender starting over numbers its packets from 1 again
+        TickType_t now = xTaskGetTickCount();
+        if (now - last_packet_time > pdMS_TO_TICKS(PIXEL_STREAM_TIMEOUT_MS)) {
+            newest = 0;
+            filled = 0;
+        }
+        last_packet_time = now;
+
+        uint32_t offset = ((uint32_t)header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7];
+        uint16_t data_length = (header[8] << 8) | header[9];
+        uint8_t sequence = header[1] & SEQUENCE_MASK;
+
+        // RGB offsets and lengths are in 3 byte pixels, scaled to the frame's
+        bool rgb = header[2] == PIXEL_STREAM_TYPE_DEFAULT || header[2] == PIXEL_STREAM_TYPE_RGB;
+        uint32_t frame_offset = offset, frame_length = data_length;
+        if (rgb) {
+            frame_offset = offset / 3 * 4;
+            frame_length = data_length / 3 * 4;
+        }
+
+        if (length < HEADER_SIZE ||
+                (header[0] & FLAGS_VERSION_MASK) != FLAGS_VERSION_1 ||
+                (header[0] & FLAGS_UNSUPPORTED) ||
+                (!rgb && header[2] != PIXEL_STREAM_TYPE_STRIP) ||
+                (rgb && (offset % 3 || data_length % 3)) ||
+                (header[3] != DESTINATION_DEFAULT && header[3] != DESTINATION_ALL) ||
+                offset > frame_size ||      // before scaling overflows
+                frame_offset > frame_size || frame_length > frame_size - frame_offset) {
+            stats.bad++;
+            recv(s, header, HEADER_SIZE, 0);
+            continue;
+        }
+
+        if (sequence && newest) {
+            if (sequence_late(sequence, newest)) {
+                // The same sequence is a copy sent for redundancy
+                if (sequence != newest)
+                    stats.late++;
+                recv(s, header, HEADER_SIZE, 0);
+                continue;
+            }
+
+            // Skipped sequences were lost. A frame's packets go forward, so
+            // data not past the end of the frame being assembled is of the
+            // next frame, the push of this one lost: going on right at its
+            // end, it would complete the byte count. Past it, the count
+            // falls short at the push.
+            if (sequence != newest % 15 + 1 && filled && frame_offset <= filled) {
+                stats.incomplete++;
+                filled = 0;
+            }
+        }
+        if (sequence)
+            newest = sequence;
+
+        // Receive the packet right into the frame, the header landing on
+        // the bytes before its data. Those are the slack or data of
+        // earlier packets, put back afterwards. RGB data lands at the end
+        // of the pixels it covers.
+        uint8_t *pixels = back + PIXEL_STREAM_SLACK + frame_offset;
+        uint8_t *target = pixels + frame_length - data_length - HEADER_SIZE;
+        uint8_t saved[HEADER_SIZE];
+        memcpy(saved, target, HEADER_SIZE);
+        length = recv(s, target, HEADER_SIZE + data_length, 0);
+        memcpy(target, saved, HEADER_SIZE);
+
+        if (length != HEADER_SIZE + data_length) {
+            stats.bad++;
+            continue;
+        }
+        if (rgb)
+            rgb_spread(pixels, data_length / 3);
+
+        // A first packet before a push: the push of the frame before it
+        // was lost
+        if (frame_offset == 0 && filled) {
+            stats.incomplete++;
+            filled = 0;
+        }
+
+        filled += frame_length;
+        if (!(header[0] & FLAGS_PUSH))
+            continue;
+
+        // Packets cover the frame once each, so anything lost or late shows
+        // as a shortfall here
+        if (filled == frame_offset + frame_length)
+            frame_push();
+        else
+            stats.incomplete++;
+        filled = 0;
+    }
+}
+
+
+int pixel_stream_init(uint16_t port, uint8_t *buffers, size_t size) {
+    if (task_handle)
+        return 0;
+
+    frame_size = size;
+    front = buffers;
+    back = buffers + PIXEL_STREAM_BUFFER_SIZE(size);
+
+    front_lock = xSemaphoreCreateMutexStatic(&front_lock_buffer);
+    frame_ready = xSemaphoreCreateBinaryStatic(&frame_ready_buffer);
+
+    task_handle = xTaskCreateStatic(pixel_stream_task, "Pixel stream", PIXEL_STREAM_STACK_SIZE,
+                                    (void *)(uintptr_t)port, PIXEL_STREAM_TASK_PRIORITY,
+                                    task_stack, &task_buffer);
+    return task_handle ? 0 : -1;
+}
+
+
+void *pixel_stream_wait(uint32_t timeout_ms) {
+    if (!frame_ready || xSemaphoreTake(frame_ready, pdMS_TO_TICKS(timeout_ms)) != pdTRUE)
+        return NULL;
+
+    xSemaphoreTake(front_lock, portMAX_DELAY);
+    if (!fresh) {
+        // Already shown, the signal of a frame swapped in meanwhile
+        xSemaphoreGive(front_lock);
+        return NULL;
+    }
+    fresh = false;
+    stats.shown++;
+    return front + PIXEL_STREAM_SLACK;
+}
+
+
+void pixel_stream_release() {
+    xSemaphoreGive(front_lock);
+}
+
+
+bool pixel_stream_active() {
+    return stats.frames && xTaskGetTickCount() - last_frame_time < pdMS_TO_TICKS(PIXEL_STREAM_TIMEOUT_MS);
+}
+
+
+void pixel_stream_print_stats() {
+    pixel_stream_stats_t current;
+    pixel_stream_get_stats(&current);
+    printf("pixel-stream: %u packets, %u frames: %u shown, %u dropped, %u incomplete; "
+           "%u late, %u bad packets\n",
+           current.packets, current.frames, current.shown, current.dropped,
+           current.incomplete, current.late, current.bad);
+}
+
+
+void pixel_stream_get_stats(pixel_stream_stats_t *result) {
+    taskENTER_CRITICAL();
+    *result = stats;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Pixel streaming: frames computed on a PC, sent over UDP in DDP packets
+// and shown on the strip as they come.
+//
+// Each packet has the 10 byte DDP header:
+//
+//   0   flags: version 1 (0x40), 0x01 on the last packet of a frame (push)
+//   1   sequence, 1 to 15 then back to 1 on every packet, 0 if not used
+//   2   data type, PIXEL_STREAM_TYPE_*
+//   3   destination, 1
+//   4   offset of the data into the frame in bytes, big endian u32
+//   8   length of the data, big endian u16
+//   10  data
+//
+// Data of type PIXEL_STREAM_TYPE_STRIP is in the strip's own pixel
+// layout, ws2812_pixel_t: 4 bytes per pixel, blue, green, red and a byte
+// that is not shown. It is received straight into the frame being
+// assembled and never copied again; tools/pixel_stream.py packs frames
+// that way. DDP's usual 3 byte RGB, which is what senders mean by data
+// type 0, is received into the end of the pixels it covers and spread
+// out in place, so packets must hold whole pixels. Other types are
+// refused.
+//
+// Packets go into a back buffer. A push with every byte up to it received
+// swaps it with the front buffer, which the strip's task shows with
+// pixel_stream_wait. A packet with a sequence behind the newest seen is
+// late: it is dropped, and so is the frame it belonged to if that one is
+// still being assembled. So is that frame if a packet skipping sequences
+// does not go past where it ends: its push was among those lost.
+
+#define PIXEL_STREAM_PORT 4048          // the DDP port
+
+#define PIXEL_STREAM_TYPE_DEFAULT 0x00  // taken as RGB
+#define PIXEL_STREAM_TYPE_RGB 0x0b      // RGB, 8 bits each
+#define PIXEL_STREAM_TYPE_STRIP 0x9b    // custom: ws2812_pixel_t, 8 bits each
+
+// Stream is considered stopped with no frame for that long
+#ifndef PIXEL_STREAM_TIMEOUT_MS
+#define PIXEL_STREAM_TIMEOUT_MS 1000
+#endif
+
+#ifndef PIXEL_STREAM_TASK_PRIORITY
+#define PIXEL_STREAM_TASK_PRIORITY 2
+#endif
+
+// Room in front of each buffer for the header of a packet received into
+// place, kept at a multiple of 4 so that pixels stay aligned
+#define PIXEL_STREAM_SLACK 12
+#define PIXEL_STREAM_BUFFER_SIZE(size) (PIXEL_STREAM_SLACK + (((size) + 3) & ~3))
+
+/**
+    Reserves both buffers for frames of size bytes at file scope:
+
+        PIXEL_STREAM_BUFFERS(stream_buffers, sizeof(pixels));
+        ...
+        pixel_stream_init(PIXEL_STREAM_PORT, stream_buffers, sizeof(pixels));
+*/
+#define PIXEL_STREAM_BUFFERS(name, size) \
+    static uint8_t name[2 * PIXEL_STREAM_BUFFER_SIZE(size)] __attribute__((aligned(4)))
+
+typedef struct {
+    uint32_t packets;
+    uint32_t frames;            // complete frames received
+    uint32_t shown;             // frames taken by pixel_stream_wait
+    uint32_t dropped;           // complete frames replaced before they were shown
+    uint32_t incomplete;        // frames pushed with data missing, not shown
+    uint32_t late;              // packets behind the newest sequence, dropped
+    uint32_t bad;               // not DDP, of another type, or not fitting into the frame
+} pixel_stream_stats_t;
+
+/**
+    Starts receiving frames on the given UDP port.
+
+    @param buffers Reserved with PIXEL_STREAM_BUFFERS
+    @param size Bytes per frame
+    @return A negative integer if this method fails.
+*/
+int pixel_stream_init(uint16_t port, uint8_t *buffers, size_t size);
+
+/**
+    Waits up to timeout_ms for a frame that was not shown yet.
+
+    @return The frame, to be handed to ws2812_i2s_update and then given back
+            with pixel_stream_release; until then the stream does not write
+            into it. NULL if no new frame came.
+*/
+void *pixel_stream_wait(uint32_t timeout_ms);
+
+void pixel_stream_release();
+
+/**
+    @return true if a frame came within the last PIXEL_STREAM_TIMEOUT_MS:
+            the strip should show the stream rather than its own content.
+*/
+bool pixel_stream_active();
+
+void pixel_stream_get_stats(pixel_stream_stats_t *stats);
+
+/**
+    Prints the stats, e.g. when a stream stops.
+*/
+void pixel_stream_print_stats();
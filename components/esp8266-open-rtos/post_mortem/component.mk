@@ -0,0 +1,11 @@
+# Component makefile for post_mortem
+
+INC_DIRS += $(post_mortem_ROOT)
+
+post_mortem_SRC_DIR = $(post_mortem_ROOT)
+
+$(eval $(call component_compile_rules,post_mortem))
+
+# The fatal exception handler and abort() restart through
+# sdk_system_restart_in_nmi, post_mortem saves the fault on the way
+EXTRA_LDFLAGS += -Wl,--wrap=sdk_system_restart_in_nmi
@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <espressif/esp_common.h>
+#include <espressif/esp_system.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <lwip/sockets.h>
+
+#include "post_mortem.h"
+
+#define POST_MORTEM_MAGIC 0x504d3031  // "PM01"
+
+#define RTC_USER_END 0x60001300
+
+#define DRAM_START 0x3FFE8000
+#define DRAM_END 0x40000000
+
+// How far above the current stack pointer the exception frame is looked for
+#define FRAME_SEARCH_WORDS 128
+
+#define HEX_WORDS_PER_LINE 8
+
+// The microsecond counter sdk_system_get_time adds its sleep offset to,
+// read directly where flash code cannot run
+#define WDEV_TIME (*(volatile uint32_t *)0x3FF20C00)
+
+// Task name of events traced from interrupt handlers
+#define ISR_TASK_NAME 0x00727369  // "isr"
+
+_Static_assert(POST_MORTEM_RTC_ADDR % 4 == 0, "RTC memory needs word alignment");
+_Static_assert(POST_MORTEM_RTC_ADDR + sizeof(post_mortem_t) <= RTC_USER_END,
+               "post-mortem record does not fit into RTC user memory");
+
+#define rtc ((volatile post_mortem_t *)POST_MORTEM_RTC_ADDR)
+
+static post_mortem_t *previous = NULL;
+
+
+static uint32_t pack_name(const char *name, int offset) {
+    uint32_t word = 0;
+    for (int i = 0; i < 4 && name[offset + i]; i++)
+        word |= (uint32_t)(uint8_t)name[offset + i] << (8 * i);
+    return word;
+}
+
+
+static const char *current_task_name() {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    return task ? pcTaskGetName(task) : "";
+}
+
+
+bool post_mortem_init() {
+    struct sdk_rst_info *reset = sdk_system_get_rst_info();
+    uint32_t boot_count = 0;
+
+    if (rtc->magic == POST_MORTEM_MAGIC) {
+        boot_count = rtc->boot_count + 1;
+
+        previous = malloc(sizeof(post_mortem_t));
+        if (previous) {
+            // word by word, RTC memory does not take byte accesses
+            uint32_t *dst = (uint32_t *)previous;
+            for (int i = 0; i < sizeof(post_mortem_t) / 4; i++)
+                dst[i] = ((volatile uint32_t *)rtc)[i];
+
+            previous->reset_reason = reset->reason;
+            if (previous->fault == POST_MORTEM_FAULT_NONE) {
+                // watchdog resets leave no fault of our own, but the SDK
+                // knows where the CPU was
+                previous->exccause = reset->exccause;
+                previous->epc1 = reset->epc1;
+                previous->excvaddr = reset->excvaddr;
+                previous->depc = reset->depc;
+            }
+        }
+    }
+
+    for (int i = 0; i < sizeof(post_mortem_t) / 4; i++)
+        ((volatile uint32_t *)rtc)[i] = 0;
+    rtc->boot_count = boot_count;
+    rtc->magic = POST_MORTEM_MAGIC;
+
+    post_mortem_trace(POST_MORTEM_EVENT_BOOT, reset->reason);
+
+    return previous != NULL;
+}
+
+
+const post_mortem_t *post_mortem_previous() {
+    return previous;
+}
+
+
+// Called with interrupts disabled
+IRAM static void append_event(uint32_t now, uint32_t id, uint32_t task) {
+    uint32_t head = rtc->head;
+    if (head >= POST_MORTEM_EVENTS)
+        head = 0;
+
+    rtc->events[head].time = now;
+    rtc->events[head].id = id;
+    rtc->events[head].task = task;
+
+    rtc->head = head + 1 < POST_MORTEM_EVENTS ? head + 1 : 0;
+    if (rtc->count < POST_MORTEM_EVENTS)
+        rtc->count++;
+}
+
+
+void post_mortem_trace(uint16_t event, uint16_t arg) {
+    uint32_t now = sdk_system_get_time();
+    uint32_t task = pack_name(current_task_name(), 0);
+
+    taskENTER_CRITICAL();
+    append_event(now, (uint32_t)event << 16 | arg, task);
+    taskEXIT_CRITICAL();
+}
+
+
+IRAM void post_mortem_trace_from_isr(uint16_t event, uint16_t arg) {
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    append_event(WDEV_TIME, (uint32_t)event << 16 | arg, ISR_TASK_NAME);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+
+// The fatal exception handler and abort() restart through this after
+// dumping to the UART (linked with --wrap, see component.mk). Exception
+// registers still hold the values of the fault at this point.
+void __real_sdk_system_restart_in_nmi(void);
+
+IRAM void __wrap_sdk_system_restart_in_nmi(void) {
+    if (rtc->magic == POST_MORTEM_MAGIC && rtc->fault == POST_MORTEM_FAULT_NONE) {
+        uint32_t exccause, epc1, excvaddr, depc, sp;
+        __asm__ volatile ("rsr %0, exccause" : "=r"(exccause));
+        __asm__ volatile ("rsr %0, epc1" : "=r"(epc1));
+        __asm__ volatile ("rsr %0, excvaddr" : "=r"(excvaddr));
+        __asm__ volatile ("rsr %0, depc" : "=r"(depc));
+        __asm__ volatile ("mov %0, a1" : "=r"(sp));
+
+        // Skip the handler's own frames: start at the exception frame,
+        // which holds the faulting PC
+        uint32_t *stack = (uint32_t *)sp;
+        for (int i = 0; i < FRAME_SEARCH_WORDS && (uint32_t)&stack[i] < DRAM_END; i++) {
+            if (stack[i] == epc1) {
+                stack = &stack[i];
+                break;
+            }
+        }
+
+        rtc->fault = POST_MORTEM_FAULT_EXCEPTION;
+        rtc->exccause = exccause;
+        rtc->epc1 = epc1;
+        rtc->excvaddr = excvaddr;
+        rtc->depc = depc;
+        rtc->sp = (uint32_t)stack;
+
+        const char *name = current_task_name();
+        rtc->task[0] = pack_name(name, 0);
+        rtc->task[1] = (rtc->task[0] >> 24) ? pack_name(name, 4) : 0;
+
+        for (int i = 0; i < POST_MORTEM_STACK_WORDS; i++) {
+            uint32_t address = (uint32_t)&stack[i];
+            rtc->stack[i] = (address >= DRAM_START && address < DRAM_END) ? stack[i] : 0;
+        }
+    }
+
+    __real_sdk_system_restart_in_nmi();
+}
+
+
+static void unpack_name(const uint32_t *words, int count, char *name) {
+    for (int i = 0; i < count * 4; i++)
+        name[i] = (words[i / 4] >> (8 * (i % 4))) & 0xff;
+    name[count * 4] = 0;
+}
+
+
+static int format_hex_line(char *buffer, size_t size, int offset) {
+    const uint32_t *words = (const uint32_t *)previous;
+    int n = snprintf(buffer, size, "post-mortem %04x:", offset * 4);
+    for (int i = offset; i < offset + HEX_WORDS_PER_LINE && i < sizeof(post_mortem_t) / 4; i++)
+        n += snprintf(buffer + n, size - n, " %08x", words[i]);
+    n += snprintf(buffer + n, size - n, "\n");
+    return n;
+}
+
+
+void post_mortem_print() {
+    if (!previous)
+        return;
+
+    char name[9];
+    printf("Previous run (boot %u since power-on) ended with reset reason %u\n",
+           previous->boot_count, previous->reset_reason);
+    if (previous->fault == POST_MORTEM_FAULT_EXCEPTION) {
+        unpack_name(previous->task, 2, name);
+        printf("Exception %u in task '%s': epc1=0x%08x excvaddr=0x%08x depc=0x%08x\n",
+               previous->exccause, name, previous->epc1, previous->excvaddr, previous->depc);
+    } else if (previous->epc1) {
+        printf("CPU was at epc1=0x%08x\n", previous->epc1);
+    }
+
+    uint32_t last = previous->events[(previous->head + POST_MORTEM_EVENTS - 1) % POST_MORTEM_EVENTS].time;
+    for (int i = 0; i < previous->count; i++) {
+        const post_mortem_event_t *event = &previous->events[
+            (previous->head + POST_MORTEM_EVENTS - previous->count + i) % POST_MORTEM_EVENTS];
+        unpack_name(&event->task, 1, name);
+        printf("  %8d us  event 0x%04x arg %5u  %s\n",
+               (int32_t)(event->time - last), event->id >> 16, event->id & 0xffff, name);
+    }
+
+    char line[16 + HEX_WORDS_PER_LINE * 9 + 2];
+    for (int i = 0; i < sizeof(post_mortem_t) / 4; i += HEX_WORDS_PER_LINE) {
+        format_hex_line(line, sizeof(line), i);
+        printf("%s", line);
+    }
+}
+
+
+static void post_mortem_server_task(void *arg) {
+    uint16_t port = (uintptr_t)arg;
+
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) {
+        printf("post-mortem: failed to create socket\n");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (bind(s, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(s, 1) < 0) {
+        printf("post-mortem: failed to listen on port %d\n", port);
+        close(s);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    char line[16 + HEX_WORDS_PER_LINE * 9 + 2];
+    while (true) {
+        int client = accept(s, NULL, NULL);
+        if (client < 0)
+            continue;
+
+        for (int i = 0; i < sizeof(post_mortem_t) / 4; i += HEX_WORDS_PER_LINE) {
+            int n = format_hex_line(line, sizeof(line), i);
+            if (write(client, line, n) != n)
+                break;
+        }
+        close(client);
+    }
+}
+
+
+void post_mortem_serve(uint16_t port) {
+    static bool serving = false;
+    if (!previous || serving)
+        return;
+
+    serving = true;
+    xTaskCreate(post_mortem_server_task, "Post-mortem", 256, (void *)(uintptr_t)port, 1, NULL);
+}
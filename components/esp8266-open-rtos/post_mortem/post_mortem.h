@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// RTC user memory used for the record. It keeps its contents over soft
+// resets, exceptions and watchdog resets, not over power loss. The first
+// 64 bytes of user RTC memory are left to rboot.
+#ifndef POST_MORTEM_RTC_ADDR
+#define POST_MORTEM_RTC_ADDR 0x60001140
+#endif
+
+// Trace events kept in the ring
+#ifndef POST_MORTEM_EVENTS
+#define POST_MORTEM_EVENTS 16
+#endif
+
+// Words of stack saved from the faulting task
+#ifndef POST_MORTEM_STACK_WORDS
+#define POST_MORTEM_STACK_WORDS 40
+#endif
+
+// Events below 0x100 are reserved for this component
+#define POST_MORTEM_EVENT_BOOT 1        // arg: reset reason
+#define POST_MORTEM_EVENT_USER 0x100
+
+#define POST_MORTEM_FAULT_NONE 0
+#define POST_MORTEM_FAULT_EXCEPTION 1
+
+// Everything is a 32 bit word: RTC memory does not take narrower accesses
+typedef struct {
+    uint32_t time;          // sdk_system_get_time(), microseconds
+    uint32_t id;            // event << 16 | arg
+    uint32_t task;          // first 4 characters of the running task name
+} post_mortem_event_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t boot_count;
+    uint32_t reset_reason;  // reason for the reset that ended this record
+    uint32_t head;          // next slot in events
+    uint32_t count;
+
+    uint32_t fault;         // POST_MORTEM_FAULT_*
+    uint32_t exccause;
+    uint32_t epc1;
+    uint32_t excvaddr;
+    uint32_t depc;
+    uint32_t sp;
+    uint32_t task[2];       // first 8 characters of the faulting task name
+    uint32_t stack[POST_MORTEM_STACK_WORDS];
+
+    post_mortem_event_t events[POST_MORTEM_EVENTS];
+} post_mortem_t;
+
+/**
+    Takes over the record left by the previous run (if any) and starts a new
+    one. Call first thing in user_init.
+
+    @return true if the previous run left a record
+*/
+bool post_mortem_init();
+
+/**
+    Record of the previous run, NULL if there was none.
+*/
+const post_mortem_t *post_mortem_previous();
+
+/**
+    Appends an event to the ring, with the name of the running task. Must
+    not be called from an interrupt handler, see post_mortem_trace_from_isr.
+
+    @param event POST_MORTEM_EVENT_USER or above
+    @param arg Anything that helps to tell what happened
+*/
+void post_mortem_trace(uint16_t event, uint16_t arg);
+
+/**
+    Same as post_mortem_trace, for interrupt handlers. The event shows "isr"
+    in place of a task name.
+
+    @param event POST_MORTEM_EVENT_USER or above
+    @param arg Anything that helps to tell what happened
+*/
+void post_mortem_trace_from_isr(uint16_t event, uint16_t arg);
+
+/**
+    Prints the record of the previous run: a readable summary followed by
+    "post-mortem NNNN:" hex lines that tools/post_mortem.py decodes and
+    symbolizes against the ELF.
+*/
+void post_mortem_print();
+
+/**
+    Serves the hex lines of the previous record to every client connecting
+    to the given TCP port, for devices without a serial console:
+
+        nc <device> <port> | tools/post_mortem.py --elf build/program.out
+
+    Does nothing if there was no record or the port is already served, so
+    it can be called on every wifi (re)connect.
+*/
+void post_mortem_serve(uint16_t port);
@@ -0,0 +1,7 @@
+# Component makefile for relay_limiter
+
+INC_DIRS += $(relay_limiter_ROOT)
+
+relay_limiter_SRC_DIR = $(relay_limiter_ROOT)
+
+$(eval $(call component_compile_rules,relay_limiter))
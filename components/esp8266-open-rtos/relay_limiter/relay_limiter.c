@@ -0,0 +1,209 @@
+#include <string.h>
+#include <stdlib.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <timers.h>
+#include <common_macros.h>
+#include "relay_limiter.h"
+
+
+typedef struct _relay_limiter {
+    uint8_t gpio_num;
+    relay_limiter_callback_fn callback;
+
+    uint16_t min_dwell_time;
+    uint16_t coalesce_time;
+
+    bool state;     // what the relay is currently set to
+    bool target;    // what was requested last
+    bool pending;   // a write is waiting for the timer
+
+    uint32_t last_change_time;
+    uint32_t dropped;
+
+    TimerHandle_t timer;
+
+    struct _relay_limiter *next;
+} relay_limiter_t;
+
+
+static relay_limiter_t *relay_limiters = NULL;
+
+
+IRAM static relay_limiter_t *relay_limiter_find_by_gpio(const uint8_t gpio_num) {
+    relay_limiter_t *limiter = relay_limiters;
+    while (limiter && limiter->gpio_num != gpio_num)
+        limiter = limiter->next;
+
+    return limiter;
+}
+
+
+// Called with interrupts disabled. A pending transition is lost only when
+// a new request goes back on it; asking for it again leaves it pending.
+IRAM static void relay_limiter_request(relay_limiter_t *limiter, bool on) {
+    if (limiter->pending && limiter->target != limiter->state && on != limiter->target)
+        limiter->dropped++;
+    limiter->target = on;
+}
+
+
+// Called with interrupts disabled. Returns true if the relay has to be switched.
+static bool relay_limiter_commit(relay_limiter_t *limiter, uint32_t now) {
+    limiter->pending = false;
+    if (limiter->target == limiter->state)
+        return false;
+
+    limiter->state = limiter->target;
+    limiter->last_change_time = now;
+    return true;
+}
+
+
+static void relay_limiter_timer_callback(TimerHandle_t timer) {
+    relay_limiter_t *limiter = pvTimerGetTimerID(timer);
+
+    taskENTER_CRITICAL();
+    bool changed = relay_limiter_commit(limiter, xTaskGetTickCount());
+    bool state = limiter->state;
+    taskEXIT_CRITICAL();
+
+    if (changed)
+        limiter->callback(limiter->gpio_num, state);
+}
+
+
+int relay_limiter_create(const uint8_t gpio_num, bool initial_state,
+                         uint16_t min_dwell_ms, uint16_t coalesce_ms,
+                         relay_limiter_callback_fn callback) {
+    relay_limiter_t *limiter = relay_limiter_find_by_gpio(gpio_num);
+    if (limiter)
+        return -1;
+
+    limiter = malloc(sizeof(relay_limiter_t));
+    if (!limiter)
+        return -2;
+
+    memset(limiter, 0, sizeof(*limiter));
+    limiter->gpio_num = gpio_num;
+    limiter->callback = callback;
+    limiter->min_dwell_time = min_dwell_ms;
+    limiter->coalesce_time = coalesce_ms;
+    limiter->state = limiter->target = initial_state;
+    limiter->last_change_time = xTaskGetTickCount() - pdMS_TO_TICKS(min_dwell_ms);
+
+    limiter->timer = xTimerCreate("relay_limiter", 1, pdFALSE, limiter, relay_limiter_timer_callback);
+    if (!limiter->timer) {
+        free(limiter);
+        return -2;
+    }
+
+    limiter->next = relay_limiters;
+    relay_limiters = limiter;
+
+    return 0;
+}
+
+
+void relay_limiter_write(const uint8_t gpio_num, bool on) {
+    relay_limiter_t *limiter = relay_limiter_find_by_gpio(gpio_num);
+    if (!limiter)
+        return;
+
+    uint32_t now = xTaskGetTickCount();
+    TickType_t delay = pdMS_TO_TICKS(limiter->coalesce_time);
+
+    taskENTER_CRITICAL();
+    relay_limiter_request(limiter, on);
+
+    TickType_t dwell = now - limiter->last_change_time;
+    if (dwell < pdMS_TO_TICKS(limiter->min_dwell_time)) {
+        TickType_t remaining = pdMS_TO_TICKS(limiter->min_dwell_time) - dwell;
+        if (remaining > delay)
+            delay = remaining;
+    }
+
+    if (limiter->target == limiter->state || delay == 0) {
+        bool changed = relay_limiter_commit(limiter, now);
+        taskEXIT_CRITICAL();
+
+        xTimerStop(limiter->timer, 0);
+        if (changed)
+            limiter->callback(limiter->gpio_num, on);
+        return;
+    }
+    limiter->pending = true;
+    taskEXIT_CRITICAL();
+
+    // also (re)starts the timer
+    xTimerChangePeriod(limiter->timer, delay, 0);
+}
+
+
+void relay_limiter_override(const uint8_t gpio_num, bool on) {
+    relay_limiter_t *limiter = relay_limiter_find_by_gpio(gpio_num);
+    if (!limiter)
+        return;
+
+    taskENTER_CRITICAL();
+    // a timer that is still running will find nothing left to do
+    relay_limiter_request(limiter, on);
+    bool changed = relay_limiter_commit(limiter, xTaskGetTickCount());
+    taskEXIT_CRITICAL();
+
+    if (changed)
+        limiter->callback(limiter->gpio_num, on);
+}
+
+
+IRAM void relay_limiter_override_from_isr(const uint8_t gpio_num, bool on) {
+    relay_limiter_t *limiter = relay_limiter_find_by_gpio(gpio_num);
+    if (!limiter)
+        return;
+
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    // committed by the timer callback whatever the dwell time
+    relay_limiter_request(limiter, on);
+    limiter->pending = true;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+    BaseType_t woken = pdFALSE;
+    xTimerChangePeriodFromISR(limiter->timer, 1, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+
+uint32_t relay_limiter_dropped(const uint8_t gpio_num) {
+    relay_limiter_t *limiter = relay_limiter_find_by_gpio(gpio_num);
+    if (!limiter)
+        return 0;
+
+    return limiter->dropped;
+}
+
+
+void relay_limiter_delete(const uint8_t gpio_num) {
+    if (!relay_limiters)
+        return;
+
+    relay_limiter_t *limiter = NULL;
+    if (relay_limiters->gpio_num == gpio_num) {
+        limiter = relay_limiters;
+        relay_limiters = relay_limiters->next;
+    } else {
+        relay_limiter_t *l = relay_limiters;
+        while (l->next) {
+            if (l->next->gpio_num == gpio_num) {
+                limiter = l->next;
+                l->next = l->next->next;
+                break;
+            }
+            l = l->next;
+        }
+    }
+
+    if (limiter) {
+        xTimerDelete(limiter->timer, portMAX_DELAY);
+        free(limiter);
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void (*relay_limiter_callback_fn)(uint8_t gpio_num, bool on);
+
+/**
+    Starts rate limiting writes to the relay on the given GPIO pin. Writes are
+    coalesced: after a burst of writes only the last requested state is applied
+    to the relay, once the coalesce window has passed and the relay has held its
+    previous state for at least min_dwell_ms.
+
+    @param gpio_num The GPIO pin driving the relay
+    @param initial_state The state the relay is in right now
+    @param min_dwell_ms The minimum time the relay has to stay in a state, in miliseconds.
+    @param coalesce_ms How long to wait for further writes before applying one, in miliseconds.
+    @param callback The callback that actually switches the relay.
+    @return A negative integer if this method fails.
+*/
+int relay_limiter_create(uint8_t gpio_num, bool initial_state,
+                         uint16_t min_dwell_ms, uint16_t coalesce_ms,
+                         relay_limiter_callback_fn callback);
+
+/**
+    Requests a new relay state. Must not be called from an interrupt handler.
+
+    @param gpio_num The GPIO pin driving the relay
+    @param on The requested state
+*/
+void relay_limiter_write(uint8_t gpio_num, bool on);
+
+/**
+    Switches the relay right away, bypassing the limiter (e.g. for a physical
+    button press). Any pending write is cancelled. Must not be called from an
+    interrupt handler, see relay_limiter_override_from_isr.
+
+    @param gpio_num The GPIO pin driving the relay
+    @param on The new state
+*/
+void relay_limiter_override(uint8_t gpio_num, bool on);
+
+/**
+    Same as relay_limiter_override, for interrupt handlers. The relay is
+    switched by the timer task on the next tick rather than in the handler,
+    so that the callback is never run from an interrupt.
+
+    @param gpio_num The GPIO pin driving the relay
+    @param on The new state
+*/
+void relay_limiter_override_from_isr(uint8_t gpio_num, bool on);
+
+/**
+    @param gpio_num The GPIO pin driving the relay
+    @return The number of requested transitions that were called off by a
+            later request before they reached the relay. Asking again for
+            the state already pending does not count.
+*/
+uint32_t relay_limiter_dropped(uint8_t gpio_num);
+
+/**
+    Removes the given GPIO pin from rate limiting.
+
+    @param gpio_num The GPIO pin that should be removed
+*/
+void relay_limiter_delete(uint8_t gpio_num);
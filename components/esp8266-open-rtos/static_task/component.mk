@@ -0,0 +1,7 @@
+# Component makefile for static_task
+
+INC_DIRS += $(static_task_ROOT)
+
+static_task_SRC_DIR = $(static_task_ROOT)
+
+$(eval $(call component_compile_rules,static_task))
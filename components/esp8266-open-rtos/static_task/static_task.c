@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "static_task.h"
+
+
+static static_task_t *tasks = NULL;
+
+
+TaskHandle_t static_task_create(static_task_t *task, TaskFunction_t function,
+                                const char *name, void *arg, UBaseType_t priority) {
+    if (task->handle)
+        return NULL;
+
+    task->name = name;
+    task->handle = xTaskCreateStatic(function, name, task->stack_depth, arg, priority,
+                                     task->stack, &task->tcb);
+    if (!task->handle)
+        return NULL;
+
+    taskENTER_CRITICAL();
+    task->next = tasks;
+    tasks = task;
+    taskEXIT_CRITICAL();
+
+    return task->handle;
+}
+
+
+// Largest block malloc hands out right now, found by trying
+static size_t largest_free_block() {
+    size_t low = 0, high = xPortGetFreeHeapSize();
+    while (low < high) {
+        size_t size = (low + high + 1) / 2;
+        void *p = malloc(size);
+        if (p) {
+            free(p);
+            low = size;
+        } else {
+            high = size - 1;
+        }
+    }
+    return low;
+}
+
+
+void static_task_print_stack_usage() {
+    for (static_task_t *task = tasks; task; task = task->next) {
+        printf("%-16s stack %4d words, %4d never used\n",
+               task->name, task->stack_depth,
+               (int)uxTaskGetStackHighWaterMark(task->handle));
+    }
+    printf("Free heap: %d bytes, largest free block %d bytes\n",
+           (int)xPortGetFreeHeapSize(), (int)largest_free_block());
+}
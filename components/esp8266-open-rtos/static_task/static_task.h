@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+#if !configSUPPORT_STATIC_ALLOCATION
+#error "static_task needs configSUPPORT_STATIC_ALLOCATION enabled in FreeRTOSConfig.h"
+#endif
+
+typedef struct _static_task {
+    const char *name;
+    uint16_t stack_depth;       // in words
+    StackType_t *stack;
+    StaticTask_t tcb;
+    TaskHandle_t handle;
+
+    struct _static_task *next;
+} static_task_t;
+
+/**
+    Reserves a TCB and a stack of stack_depth words for a task in .bss, so that
+    creating the task takes nothing from the heap.
+
+    Use at file scope:
+
+        STATIC_TASK(fireplace_task_memory, 256);
+        ...
+        static_task_create(&fireplace_task_memory, fireplace_task, "Fireplace", NULL, 2);
+*/
+#define STATIC_TASK(var, _stack_depth) \
+    static StackType_t var##_stack[_stack_depth]; \
+    static static_task_t var = { \
+        .stack_depth = _stack_depth, \
+        .stack = var##_stack, \
+    }
+
+/**
+    Creates a task on memory reserved with STATIC_TASK. A static task can only
+    be created once; it must not delete itself.
+
+    @return Task handle, NULL if the task memory is already in use
+*/
+TaskHandle_t static_task_create(static_task_t *task, TaskFunction_t function,
+                                const char *name, void *arg, UBaseType_t priority);
+
+/**
+    Prints stack size and high-water mark (least free stack seen so far) of
+    every task created with static_task_create, along with free heap and the
+    largest block malloc can hand out. Use it after exercising the accessory
+    to size STATIC_TASK stacks. Finding the largest block takes a few
+    allocations, call it while nothing else allocates.
+*/
+void static_task_print_stack_usage();
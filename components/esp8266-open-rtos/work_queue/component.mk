@@ -0,0 +1,7 @@
+# Component makefile for work_queue
+
+INC_DIRS += $(work_queue_ROOT)
+
+work_queue_SRC_DIR = $(work_queue_ROOT)
+
+$(eval $(call component_compile_rules,work_queue))
@@ -0,0 +1,167 @@
+#include <string.h>
+#include <espressif/esp_common.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "work_queue.h"
+
+
+typedef struct _work_entry {
+    work_queue_fn function;
+    void *arg;
+    work_queue_priority_t priority;
+    uint32_t sequence;          // order of the first post, kept when raised
+    uint32_t posted_at;
+
+    struct _work_entry *next;
+} work_entry_t;
+
+
+static work_entry_t entries[WORK_QUEUE_SIZE];
+static work_entry_t *free_entries = NULL;
+// Pending work, highest priority first, oldest first within a priority
+static work_entry_t *pending = NULL;
+static uint32_t pending_count = 0;
+static uint32_t next_sequence = 0;
+
+static TaskHandle_t worker_task_handle = NULL;
+static StaticTask_t worker_task_buffer;
+static StackType_t worker_stack[WORK_QUEUE_STACK_SIZE];
+
+static work_queue_stats_t stats;
+
+
+// Call with interrupts disabled. A raised entry goes back among the
+// others of its new priority by when it was first posted.
+static void pending_insert(work_entry_t *entry) {
+    work_entry_t **e = &pending;
+    while (*e && ((*e)->priority > entry->priority ||
+                  ((*e)->priority == entry->priority &&
+                   (int32_t)((*e)->sequence - entry->sequence) < 0)))
+        e = &(*e)->next;
+    entry->next = *e;
+    *e = entry;
+}
+
+
+// Call with interrupts disabled
+static void pending_unlink(work_entry_t *entry) {
+    work_entry_t **e = &pending;
+    while (*e && *e != entry)
+        e = &(*e)->next;
+    if (*e)
+        *e = entry->next;
+    entry->next = NULL;
+}
+
+
+static void worker_task(void *_args) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (true) {
+            taskENTER_CRITICAL();
+            work_entry_t *entry = pending;
+            if (entry) {
+                pending = entry->next;
+                pending_count--;
+            }
+            taskEXIT_CRITICAL();
+
+            if (!entry)
+                break;
+
+            uint32_t started = sdk_system_get_time();
+            entry->function(entry->arg);
+            uint32_t finished = sdk_system_get_time();
+
+            taskENTER_CRITICAL();
+            if (started - entry->posted_at > stats.max_wait_us)
+                stats.max_wait_us = started - entry->posted_at;
+            if (finished - started > stats.max_run_us)
+                stats.max_run_us = finished - started;
+
+            entry->next = free_entries;
+            free_entries = entry;
+            taskEXIT_CRITICAL();
+        }
+    }
+}
+
+
+int work_queue_init() {
+    if (worker_task_handle)
+        return 0;
+
+    free_entries = NULL;
+    for (int i = WORK_QUEUE_SIZE-1; i >= 0; i--) {
+        entries[i].next = free_entries;
+        free_entries = &entries[i];
+    }
+
+    worker_task_handle = xTaskCreateStatic(worker_task, "Work queue", WORK_QUEUE_STACK_SIZE,
+                                           NULL, WORK_QUEUE_TASK_PRIORITY,
+                                           worker_stack, &worker_task_buffer);
+    return worker_task_handle ? 0 : -1;
+}
+
+
+bool work_queue_post(work_queue_fn function, void *arg, work_queue_priority_t priority) {
+    uint32_t started = sdk_system_get_time();
+    bool result = true;
+
+    taskENTER_CRITICAL();
+    stats.posted++;
+
+    work_entry_t *entry = pending;
+    while (entry && (entry->function != function || entry->arg != arg))
+        entry = entry->next;
+
+    if (entry) {
+        stats.coalesced++;
+        if (priority > entry->priority) {
+            pending_unlink(entry);
+            entry->priority = priority;
+            pending_insert(entry);
+        }
+    } else if (free_entries) {
+        entry = free_entries;
+        free_entries = entry->next;
+
+        entry->function = function;
+        entry->arg = arg;
+        entry->priority = priority;
+        entry->sequence = next_sequence++;
+        entry->posted_at = started;
+        pending_insert(entry);
+
+        if (++pending_count > stats.max_pending)
+            stats.max_pending = pending_count;
+    } else {
+        stats.dropped++;
+        result = false;
+    }
+    taskEXIT_CRITICAL();
+
+    if (result)
+        xTaskNotifyGive(worker_task_handle);
+
+    uint32_t elapsed = sdk_system_get_time() - started;
+    taskENTER_CRITICAL();
+    if (elapsed > stats.max_post_us)
+        stats.max_post_us = elapsed;
+    taskEXIT_CRITICAL();
+
+    return result;
+}
+
+
+void work_queue_get_stats(work_queue_stats_t *result, bool reset) {
+    taskENTER_CRITICAL();
+    *result = stats;
+    if (reset)
+        memset(&stats, 0, sizeof(stats));
+    taskEXIT_CRITICAL();
+
+    result->stack_free = worker_task_handle ? uxTaskGetStackHighWaterMark(worker_task_handle) : 0;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Number of entries in the pool, i.e. how much work can be pending at once
+#ifndef WORK_QUEUE_SIZE
+#define WORK_QUEUE_SIZE 8
+#endif
+
+// Stack of the worker task, in words. All work runs on it, so it has to
+// fit the deepest function posted. The default was not measured; an
+// accessory whose work calls printf or libm should start higher and check
+// stack_free of work_queue_get_stats on the device.
+#ifndef WORK_QUEUE_STACK_SIZE
+#define WORK_QUEUE_STACK_SIZE 384
+#endif
+
+// Same priority as the HomeKit server task, so that posting work does not
+// preempt the server before it has sent its response
+#ifndef WORK_QUEUE_TASK_PRIORITY
+#define WORK_QUEUE_TASK_PRIORITY 1
+#endif
+
+typedef void (*work_queue_fn)(void *arg);
+
+typedef enum {
+    WORK_QUEUE_PRIORITY_LOW = 0,
+    WORK_QUEUE_PRIORITY_NORMAL,
+    WORK_QUEUE_PRIORITY_HIGH,
+} work_queue_priority_t;
+
+typedef struct {
+    uint32_t posted;
+    uint32_t coalesced;         // posts merged into work already pending
+    uint32_t dropped;           // posts refused because the pool was empty
+    uint32_t max_pending;
+    uint32_t max_post_us;       // longest time spent in work_queue_post
+    uint32_t max_wait_us;       // longest time from post to start of work
+    uint32_t max_run_us;        // longest single piece of work
+    uint32_t stack_free;        // words of the worker's stack never used so far
+} work_queue_stats_t;
+
+/**
+    Starts the worker task. Task and pool are allocated statically. Call
+    once, e.g. from user_init.
+
+    @return A negative integer if this method fails.
+*/
+int work_queue_init();
+
+/**
+    Queues function(arg) to run on the worker and returns right away, so a
+    HomeKit setter can answer without waiting for the hardware. Work runs
+    highest priority first, in posting order within a priority.
+
+    If the same function and arg are already pending, nothing new is queued
+    (the pending entry is raised to priority if that is higher). Work should
+    therefore read the latest state when it runs rather than rely on what
+    was current at post time.
+
+    Must not be called from an interrupt handler.
+
+    @return false if the pool is exhausted and the work was dropped
+*/
+bool work_queue_post(work_queue_fn function, void *arg, work_queue_priority_t priority);
+
+/**
+    Copies the counters and optionally resets them. stack_free is not
+    reset.
+
+    @param stats Where to store the counters
+    @param reset Start counting from zero after the copy
+*/
+void work_queue_get_stats(work_queue_stats_t *stats, bool reset);
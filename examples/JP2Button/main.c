@@ -17,8 +17,12 @@
 //   + Double press to Off for the device under control (e.g. light, outlet, etc.)
 //   + Triple Press to any other desired scene
 // o Reseting the device: To remove pairings and wifi configuration, the device can be reset
-//   using a sequence of double presses on any button. At the moment, (3) double-presses in
-//   a row are required with no intervening button presses.
+//   using a sequence of double presses on any button. At the moment, (2) double-presses in
+//   a row are required with no intervening button presses. Multi-press sequences like this
+//   one are listed in the gestures table below.
+// o Chords: Pressing two buttons together (see ChordButtons below) acts as an additional
+//   Programmable Switch. A short chord press generates a "Single Press" event and a long one
+//   a "Double Press" event. The buttons of a chord don't generate their own events.
 //  
 //
 // Building:
@@ -42,7 +46,10 @@
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
 #include <wifi_config.h>
+#include <event_loop.h>
 #include <button.h>
+#include <gesture.h>
+#include <chord.h>
 
 
 /*------------------------------------------------------------------------------
@@ -51,6 +58,16 @@
  *
  *----------------------------------------------------------------------------*/
 
+#define CHORD_SERVICE(_INDEX, _NAME)                                          \
+            HOMEKIT_SERVICE(                                                  \
+                STATELESS_PROGRAMMABLE_SWITCH,                                \
+                .characteristics=(homekit_characteristic_t*[]) {              \
+                    HOMEKIT_CHARACTERISTIC(NAME, _NAME),                      \
+                    &chords[_INDEX],                                          \
+                    NULL                                                      \
+                },                                                            \
+            )
+
 #define SWITCH_SERVICE(_INDEX, _IS_PRIMARY)                                   \
             HOMEKIT_SERVICE(                                                  \
                 STATELESS_PROGRAMMABLE_SWITCH,                                \
@@ -91,10 +108,37 @@ homekit_characteristic_t buttons[] = {
   HOMEKIT_CHARACTERISTIC_(PROGRAMMABLE_SWITCH_EVENT, 0),
 };
 
+#define N_CHORDS (2)
+
+static const uint16_t ChordButtons[N_CHORDS] = {
+  CHORD_BUTTON(0) | CHORD_BUTTON(1),
+  CHORD_BUTTON(2) | CHORD_BUTTON(3)
+};
+
+homekit_characteristic_t chords[] = {
+  HOMEKIT_CHARACTERISTIC_(PROGRAMMABLE_SWITCH_EVENT, 0),
+  HOMEKIT_CHARACTERISTIC_(PROGRAMMABLE_SWITCH_EVENT, 0),
+};
+
+static const uint16_t ChordWindow = 150;
+  // Max time in ms between the presses of the buttons of a chord
+
 static const uint8_t Pin_LED = 15;          // D8
 
-static const uint8_t ResetSequenceThreshold = 2;
-  // Determines how many double-presses of a button are required to trigger a reset
+#define N_BUTTON_EVENTS (button_event_long_press + 1)
+
+enum {
+  GestureReset = 1,
+};
+
+static const gesture_sequence_t gestures[] = {
+  // Two double-presses in a row on any button(s) reset the device
+  GESTURE_SEQUENCE(GestureReset, 10000,
+    GESTURE_STEP(GESTURE_ANY_BUTTON, button_event_double_press),
+    GESTURE_STEP(GESTURE_ANY_BUTTON, button_event_double_press)),
+};
+
+gesture_recognizer_t *gestureRecognizer = NULL;
 
 void identifyDevice(homekit_value_t _value);
 void homekit_event_handler(homekit_event_t event);
@@ -126,6 +170,8 @@ homekit_accessory_t *accessories[] = {
             SWITCH_SERVICE(2, false),
             SWITCH_SERVICE(3, false),
             SWITCH_SERVICE(4, false),
+            CHORD_SERVICE(0, "C12"),
+            CHORD_SERVICE(1, "C34"),
             NULL
         },
     ),
@@ -161,6 +207,55 @@ void blinkIt(uint8_t cycles, uint32_t delayMillis) {
   }
 }
 
+struct BlinkParams {
+  uint8_t cycles;
+  uint32_t delayMillis;
+} blinkParams;
+
+void blinkItTask(event_loop_coroutine_t *co) {
+  static int i;
+  EVENT_LOOP_BEGIN(co);
+
+  for (i = 0; i < blinkParams.cycles; i++) {
+    setLED(true);
+    EVENT_LOOP_SLEEP(co, blinkParams.delayMillis);
+    setLED(false);
+    EVENT_LOOP_SLEEP(co, blinkParams.delayMillis);
+  }
+
+  EVENT_LOOP_END(co);
+}
+
+event_loop_coroutine_t blinkItCoroutine = EVENT_LOOP_COROUTINE(blinkItTask, NULL);
+
+// The next blink, copied into blinkParams on the event loop
+static struct BlinkParams nextBlinkParams;
+
+// Posted between the stop and the start: the queue runs it after the old
+// blink has stopped and before the new one reads blinkParams
+static void blinkApplyParams(void *_arg) {
+  setLED(false);
+  taskENTER_CRITICAL();
+  blinkParams = nextBlinkParams;
+  taskEXIT_CRITICAL();
+}
+
+// For the button and chord callbacks, which run on the timer task and must
+// not block it
+void blinkInBackground(uint8_t cycles, uint32_t delayMillis) {
+  // A new blink replaces the one in progress
+  if (!event_loop_stop(&blinkItCoroutine)) {
+    printf("Event loop full, blink dropped\n");
+    return;
+  }
+  taskENTER_CRITICAL();
+  nextBlinkParams.cycles = cycles;
+  nextBlinkParams.delayMillis = delayMillis;
+  taskEXIT_CRITICAL();
+  if (!event_loop_post(blinkApplyParams, NULL) || !event_loop_start(&blinkItCoroutine))
+    printf("Event loop full, blink dropped\n");
+}
+
 void identifyDeviceTask(void *_args) {
   for (int i = 0; i < 3; i++) {
     blinkIt(2, 200);
@@ -196,6 +291,9 @@ void indicateStationMode(bool on) {
 }
 
 void prepLED() {
+  if (event_loop_init() < 0) {
+    printf("Failed to start the event loop\n");
+  }
   gpio_enable(Pin_LED, GPIO_OUTPUT);
   setLED(false);
 }
@@ -231,35 +329,61 @@ void resetConfig() {
  *----------------------------------------------------------------------------*/
 
 
-// Think of a way to trigger a reset - maybe two triple presses in a row
+void handleGesture(uint8_t action) {
+  switch (action) {
+    case GestureReset:
+      resetConfig();
+      break;
+    default:
+      break;
+  }
+}
+
+void chordCallback(uint8_t chord, chord_event_t event, void *context) {
+  if (event == chord_event_press) {
+      printf("press of chord %d\n", chord);
+      homekit_characteristic_notify(&chords[chord], HOMEKIT_UINT8(0));
+      blinkInBackground(1, 150);
+  } else {
+      printf("long press of chord %d\n", chord);
+      homekit_characteristic_notify(&chords[chord], HOMEKIT_UINT8(1));
+      blinkInBackground(2, 150);
+  }
+  if (gestureRecognizer) {
+    gesture_recognizer_reset(gestureRecognizer);
+  }
+}
+
 void buttonCallback(button_event_t event, void *context) {
-  static uint8_t resetSequenceCount = 0;
   homekit_characteristic_t* button = (homekit_characteristic_t*)context;
+  if (chord_detector_claimed(button - buttons)) {
+      // Already reported as part of a chord
+      return;
+  }
+
   if (event == button_event_single_press) {
       printf("single press of on button\n");
-      resetSequenceCount = 0;
       homekit_characteristic_notify(button, HOMEKIT_UINT8(0));
-      blinkIt(1, 75);
+      blinkInBackground(1, 75);
   } else if (event == button_event_long_press) {
       printf("long press of on button\n");
-      resetSequenceCount = 0;
       homekit_characteristic_notify(button, HOMEKIT_UINT8(1));
-      blinkIt(2, 75);
+      blinkInBackground(2, 75);
   } else if (event == button_event_tripple_press) {
       printf("triple press of on button\n");
-      resetSequenceCount = 0;
       homekit_characteristic_notify(button, HOMEKIT_UINT8(2));
-      blinkIt(3, 75);
+      blinkInBackground(3, 75);
   } else if (event == button_event_double_press) {
       printf("double press of on button\n");
-      resetSequenceCount++;
-      if (resetSequenceCount == ResetSequenceThreshold) {
-        resetConfig();
-      }
   } else {
-      resetSequenceCount = 0;
       printf("Unused button event: %d\n", event);        
   }
+
+  if (gestureRecognizer) {
+    handleGesture(gesture_recognizer_feed(
+      gestureRecognizer, button - buttons, event,
+      xTaskGetTickCount() * portTICK_PERIOD_MS));
+  }
 }
 
 
@@ -342,6 +466,12 @@ void user_init(void) {
 
   wifi_config_init2(DeviceModel, NULL, handleWiFiEvent);
 
+  gestureRecognizer = gesture_recognizer_create(
+    gestures, sizeof(gestures)/sizeof(gestures[0]), N_BUTTONS, N_BUTTON_EVENTS);
+  if (!gestureRecognizer) {
+    printf("Failed to initialize gestures\n");
+  }
+
   button_config_t button_config = BUTTON_CONFIG(
       button_active_low, 
       .max_repeat_presses=3,
@@ -353,4 +483,9 @@ void user_init(void) {
     }
   }
 
+  chord_config_t chord_config = CHORD_CONFIG(false, .window=ChordWindow, .long_press_time=4500);
+  if (chord_detector_create(ButtonPins, N_BUTTONS, ChordButtons, N_CHORDS, chord_config, chordCallback, NULL)) {
+    printf("Failed to initialize chords\n");
+  }
+
 }
@@ -36,6 +36,7 @@
 #include <homekit/characteristics.h>
 #include <wifi_config.h>
 #include <button.h>
+#include <event_loop.h>
 
 
 extern void sdk_system_restart();   // TO DO: What is the right include file for this?
@@ -91,19 +92,29 @@ void led_init() {
     gpio_write(LED_PIN, 0);
 }
 
-void led_identify_task(void *_args) {
-    for (int i = 0; i < 3; i++) {
-        blinkIt(3, 100);
-        vTaskDelay(250 / portTICK_PERIOD_MS);
+void led_identify_task(event_loop_coroutine_t *co) {
+    static int i, j;
+    EVENT_LOOP_BEGIN(co);
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            gpio_write(LED_PIN, 1);
+            EVENT_LOOP_SLEEP(co, 100);
+            gpio_write(LED_PIN, 0);
+            EVENT_LOOP_SLEEP(co, 100);
+        }
+        EVENT_LOOP_SLEEP(co, 250);
     }
     gpio_write(LED_PIN, 0);
 
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t led_identify_coroutine = EVENT_LOOP_COROUTINE(led_identify_task, NULL);
+
 void led_identify(homekit_value_t _value) {
     printf("LED identify\n");
-    xTaskCreate(led_identify_task, "LED identify", 128, NULL, 2, NULL);
+    event_loop_start(&led_identify_coroutine);
 }
 
 
@@ -113,26 +124,36 @@ void led_identify(homekit_value_t _value) {
  *
  *----------------------------------------------------------------------------*/
 
-void reset_configuration_task() {
+void reset_configuration_task(event_loop_coroutine_t *co) {
+    static int i;
+    EVENT_LOOP_BEGIN(co);
+
     //Flash the LED first before we start the reset
-    blinkIt(5, 100);
+    for (i = 0; i < 5; i++) {
+        gpio_write(LED_PIN, 1);
+        EVENT_LOOP_SLEEP(co, 100);
+        gpio_write(LED_PIN, 0);
+        EVENT_LOOP_SLEEP(co, 100);
+    }
 
     printf("Resetting Wifi Config\n");
     wifi_config_reset();
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    EVENT_LOOP_SLEEP(co, 1000);
 
     printf("Resetting HomeKit Config\n");
     homekit_server_reset();
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    EVENT_LOOP_SLEEP(co, 1000);
 
     printf("Restarting\n");
     sdk_system_restart();
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t reset_configuration_coroutine = EVENT_LOOP_COROUTINE(reset_configuration_task, NULL);
+
 void reset_configuration() {
   printf("Resetting configuration\n");
-  xTaskCreate(reset_configuration_task, "Reset configuration", 256, NULL, 2, NULL);
+  event_loop_start(&reset_configuration_coroutine);
 }
 
 /*------------------------------------------------------------------------------
@@ -256,6 +277,8 @@ void on_wifi_ready() {
 void user_init(void) {
     uart_set_baud(0, 115200);
 
+    event_loop_init();
+
     printf("dev_setup_id = %s\n", dev_setup_id);
     printf("dev_password = %s\n", dev_password);
     printf("dev_serial = %s\n", dev_serial);
@@ -19,8 +19,12 @@
 //   + Double press to Off for the device under control (e.g. light, outlet, etc.)
 //   + Triple Press to any other desired scene
 // o Reseting the device: To remove pairings and wifi configuration, the device can be reset
-//   using a sequence of double presses on any button. At the moment, (3) double-presses in
-//   a row are required with no intervening button presses.
+//   using a sequence of double presses on any button. At the moment, (2) double-presses in
+//   a row are required with no intervening button presses. Multi-press sequences like this
+//   one are listed in the gestures table below.
+// o Chords: Pressing two buttons together (see chordInfo below) acts as an additional
+//   Programmable Switch. A short chord press generates a "Single Press" event and a long one
+//   a "Double Press" event. The buttons of a chord don't generate their own events.
 // o User Feedback
 //   + Power on, but not connected to wifi yet: Steady gray color
 //   + Device needs to be configured via wifi: A repeating pattern of 4 short orange pulses
@@ -44,6 +48,10 @@
 // Building:
 // o Sample make command:
 //   make -C examples/button all -DDEV_PASS="123-45-678" -DDEV_SERIAL="1200345" -DDEV_SETUP="J81Q"
+// o Or build once and provision each device through the config store:
+//   make config-store CONFIG="serial=1200345 password=123-45-678 setup_id=J81Q name=Desk"
+// o HomeKit is not started until the device has a serial, a password of the form
+//   XXX-XX-XXX and a four character setup ID, from the build or the config store
 // o Generating a qrcode
 //   esp-homekit-demo/components/common/homekit/tools/gen_qrcode 15 123-45-678 J81Q qrcode.png
 //
@@ -54,6 +62,8 @@
 #include <stdlib.h>
 // ----- Espressif
 #include <espressif/esp_wifi.h>
+#include <FreeRTOS.h>
+#include <task.h>
 // ----- HomeKit
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
@@ -61,6 +71,12 @@
 #include <wifi_config.h>
 // ----- esp-homekit-demo
 #include <button.h>
+#include <gesture.h>
+#include <chord.h>
+#include <post_mortem.h>
+#include <heap_profile.h>
+#include <config_store.h>
+#include <factory_reset.h>
 // ----- App-specific
 #include "utils.h"
 
@@ -71,8 +87,19 @@
  *
  *----------------------------------------------------------------------------*/
 
-#if !defined(DEV_SERIAL) || !defined(DEV_PASS) || !defined(DEV_SETUP)
-    #error The following must be defined: DEV_SERIAL, DEV_PASS, DEV_SETUP
+// The DEV_* values of the build only serve devices that have no serial,
+// password, setup_id or name in the config store
+#ifndef DEV_SERIAL
+    #define DEV_SERIAL
+#endif
+#ifndef DEV_PASS
+    #define DEV_PASS
+#endif
+#ifndef DEV_SETUP
+    #define DEV_SETUP
+#endif
+#ifndef DEV_NAME
+    #define DEV_NAME
 #endif
 
 
@@ -84,24 +111,70 @@
 
 #define NButtons (4)
 
-struct {
+typedef struct {
   uint8_t pin;
   char name[4];
   homekit_characteristic_t* event;
-} buttonInfo[NButtons] = {
+} ButtonInfo;
+
+ButtonInfo buttonInfo[NButtons] = {
   {  2 /*D4*/, "B01", NULL },
   {  4 /*D2*/, "B02", NULL },
   {  5 /*D1*/, "B03", NULL },
   { 14 /*D5*/, "B04", NULL }
 };
 
-static const uint8_t Pin_LED = 15;  // D1 Mini: D8
+#define NChords (2)
+
+// TCP port serving the post-mortem record of the previous run
+#define PostMortemPort (3333)
 
-static const uint8_t ResetSequenceThreshold = 2;
-  // Determines how many double-presses of a button are required to trigger a reset
+// Heap profile reports, only in builds made with HEAP_PROFILE=1
+#define HeapProfilePort (3335)
+#define HeapProfilePeriod (10 * 60 * 1000)
+
+// Trace events, see tools/post_mortem.py
+#define TraceButton (POST_MORTEM_EVENT_USER + 1)  // arg: button << 8 | event
+#define TraceChord (POST_MORTEM_EVENT_USER + 2)   // arg: chord << 8 | event
+#define TraceGesture (POST_MORTEM_EVENT_USER + 3) // arg: action
+
+struct {
+  uint16_t buttons;
+  char name[4];
+  homekit_characteristic_t* event;
+} chordInfo[NChords] = {
+  { CHORD_BUTTON(0) | CHORD_BUTTON(1), "C12", NULL },
+  { CHORD_BUTTON(2) | CHORD_BUTTON(3), "C34", NULL }
+};
+
+static const uint16_t ChordWindow = 150;
+  // Max time in ms between the presses of the buttons of a chord
+
+static const uint8_t Pin_LED = 15;  // D1 Mini: D8
 
 static const uint32_t LongPressTime = 4000;
 
+/*------------------------------------------------------------------------------
+ *
+ * Gestures: Sequences of button events that trigger an action
+ *
+ *----------------------------------------------------------------------------*/
+
+#define N_BUTTON_EVENTS (button_event_long_press + 1)
+
+enum {
+  GestureReset = 1,
+};
+
+static const gesture_sequence_t gestures[] = {
+  // Two double-presses in a row on any button(s) reset the device
+  GESTURE_SEQUENCE(GestureReset, 10000,
+    GESTURE_STEP(GESTURE_ANY_BUTTON, button_event_double_press),
+    GESTURE_STEP(GESTURE_ANY_BUTTON, button_event_double_press)),
+};
+
+gesture_recognizer_t *gestureRecognizer = NULL;
+
 /*------------------------------------------------------------------------------
  *
  * HomeKit Configuration
@@ -109,12 +182,17 @@ static const uint32_t LongPressTime = 4000;
  *----------------------------------------------------------------------------*/
 
 char DeviceModel[]    = "MultiB";
+char DeviceSerial[16];
+char DevicePassword[11];  // XXX-XX-XXX
+char DeviceSetupID[5];
+char DeviceName[33];      // Empty for DeviceModel-NNNNNN
+bool DeviceProvisioned = false;
 
 homekit_accessory_t *accessories[2];  // List w/ 1 accessory & NULL termination
 homekit_server_config_t config = {
     .accessories = accessories,
-    .password = QUOTE(DEV_PASS),
-    .setupId = QUOTE(DEV_SETUP),
+    .password = DevicePassword,
+    .setupId = DeviceSetupID,
     .on_event = homekitEventHandler
 };
 
@@ -125,43 +203,85 @@ homekit_server_config_t config = {
  *
  *----------------------------------------------------------------------------*/
 
+void handleGesture(uint8_t action) {
+  post_mortem_trace(TraceGesture, action);
+  switch (action) {
+    case GestureReset:
+      resetConfig();
+      break;
+    default:
+      break;
+  }
+}
+
+void chordCallback(uint8_t chord, chord_event_t event, void *context) {
+  post_mortem_trace(TraceChord, chord << 8 | event);
+  if (event == chord_event_press) {
+      blinkInBackground(LED_GREEN, 2, 300);
+      printf("press of chord %s\n", chordInfo[chord].name);
+      homekit_characteristic_notify(chordInfo[chord].event, HOMEKIT_UINT8(0));
+  } else {
+      blinkInBackground(LED_RED, 4, 150);
+      printf("long press of chord %s\n", chordInfo[chord].name);
+      homekit_characteristic_notify(chordInfo[chord].event, HOMEKIT_UINT8(1));
+  }
+  if (gestureRecognizer) {
+    gesture_recognizer_reset(gestureRecognizer);
+  }
+}
+
 void buttonCallback(button_event_t event, void *context) {
-  static uint8_t resetSequenceCount = 0;
-  homekit_characteristic_t* button = (homekit_characteristic_t*)context;
+  ButtonInfo* info = (ButtonInfo*)context;
+  homekit_characteristic_t* button = info->event;
+  if (chord_detector_claimed(info - buttonInfo)) {
+      // Already reported as part of a chord
+      return;
+  }
+  post_mortem_trace(TraceButton, (info - buttonInfo) << 8 | event);
+
   if (event == button_event_single_press) {
       blinkInBackground(LED_GREEN, 1, 600);
       printf("single press of on button\n");
-      resetSequenceCount = 0;
       homekit_characteristic_notify(button, HOMEKIT_UINT8(0));
   } else if (event == button_event_long_press) {
       blinkInBackground(LED_RED, 2, 300);
       printf("long press of on button\n");
-      resetSequenceCount = 0;
       homekit_characteristic_notify(button, HOMEKIT_UINT8(1));
   } else if (event == button_event_tripple_press) {
       blinkInBackground(LED_BLUE, 3, 200);
       printf("triple press of on button\n");
-      resetSequenceCount = 0;
       homekit_characteristic_notify(button, HOMEKIT_UINT8(2));
   } else if (event == button_event_double_press) {
       blinkInBackground(LED_GRAY, 1, 200);
       printf("double press of on button\n");
-      resetSequenceCount++;
-      if (resetSequenceCount == ResetSequenceThreshold) {
-        resetConfig();
-      }
   } else {
       blinkInBackground(LED_YELLOW, 5, 120);
-      resetSequenceCount = 0;
       printf("Unused button event: %d\n", event);        
   }
+
+  if (gestureRecognizer) {
+    handleGesture(gesture_recognizer_feed(
+      gestureRecognizer, info - buttonInfo, event,
+      xTaskGetTickCount() * portTICK_PERIOD_MS));
+  }
 }
 
 void handleWiFiEvent(wifi_config_event_t event) {
+  static bool serverStarted = false;
+
   logWiFiEvent(event);
   if (event == WIFI_CONFIG_CONNECTED) {
     blinkInBackground(LED_GREEN, 5, 200);
-    homekit_server_init(&config);
+    // CONNECTED comes again after every reconnect; a second server would
+    // leak its task, queue and buffers
+    if (!DeviceProvisioned) {
+      printf("Not provisioned, HomeKit not started\n");
+    } else if (!serverStarted) {
+      homekit_server_init(&config);
+      serverStarted = true;
+    }
+    post_mortem_serve(PostMortemPort);
+    heap_profile_serve(HeapProfilePort);
   }
 }
 
@@ -176,16 +296,20 @@ void buildAccessory() {
   uint8_t macaddr[6];
   sdk_wifi_get_macaddr(STATION_IF, macaddr);
 
-  // Accessory name is of the form: DeviceModel-NNNNNN\0
-  char *accName = malloc(strlen(DeviceModel) + 7 + 1);
-  sprintf(
-    accName, "%s-%02X%02X%02X",
-    DeviceModel, macaddr[3], macaddr[4], macaddr[5]);
+  // Accessory name is the stored one, or of the form: DeviceModel-NNNNNN\0
+  char *accName = DeviceName;
+  if (!DeviceName[0]) {
+    accName = malloc(strlen(DeviceModel) + 7 + 1);
+    sprintf(
+      accName, "%s-%02X%02X%02X",
+      DeviceModel, macaddr[3], macaddr[4], macaddr[5]);
+  }
   printf("Accessory Name = %s\n", accName);
 
-  homekit_service_t* services[1 + NButtons + 1];
+  homekit_service_t* services[1 + NButtons + NChords + 1];
     // 1 entry for the accessory information
     // NButtons entries for the buttons
+    // NChords entries for the chords
     // 1 entry for NULL termination of the list
   homekit_service_t** s = services;
 
@@ -194,7 +318,7 @@ void buildAccessory() {
     .characteristics=(homekit_characteristic_t*[]) {
       NEW_HOMEKIT_CHARACTERISTIC(NAME, accName),
       NEW_HOMEKIT_CHARACTERISTIC(MANUFACTURER, "BitsPlusAtoms"),
-      NEW_HOMEKIT_CHARACTERISTIC(SERIAL_NUMBER, QUOTE(DEV_SERIAL)),
+      NEW_HOMEKIT_CHARACTERISTIC(SERIAL_NUMBER, DeviceSerial),
       NEW_HOMEKIT_CHARACTERISTIC(MODEL, DeviceModel),
       NEW_HOMEKIT_CHARACTERISTIC(FIRMWARE_REVISION, "0.0.1"),
       NEW_HOMEKIT_CHARACTERISTIC(IDENTIFY, identifyDevice),
@@ -214,6 +338,17 @@ void buildAccessory() {
     );
   }
 
+  for (int i = 0; i < NChords; i++) {
+    *(s++) = NEW_HOMEKIT_SERVICE(
+      STATELESS_PROGRAMMABLE_SWITCH,
+      .characteristics=(homekit_characteristic_t*[]){
+        (chordInfo[i].event = NEW_HOMEKIT_CHARACTERISTIC(PROGRAMMABLE_SWITCH_EVENT, 0)),
+        NEW_HOMEKIT_CHARACTERISTIC(NAME, chordInfo[i].name),
+        NULL
+      }
+    );
+  }
+
   *(s++) = NULL;  // Terminate the list of services
 
   accessories[0] = NEW_HOMEKIT_ACCESSORY(
@@ -223,22 +358,82 @@ void buildAccessory() {
   accessories[1] = NULL;  // Terminate the list of accessories
 }
 
+static void loadSetting(const char *key, char *value, size_t size, const char *defaultValue) {
+  if (config_store_get_string(key, value, size) < 0) {
+    strncpy(value, defaultValue, size - 1);
+    value[size - 1] = 0;
+  }
+}
+
+// A serial, a password of the form XXX-XX-XXX and a setup ID of four
+// digits or upper case letters, without which pairing can't work
+static bool isProvisioned() {
+  static const char passwordForm[] = "ddd-dd-ddd";
+
+  if (!DeviceSerial[0]) return false;
+  if (strlen(DevicePassword) != strlen(passwordForm)) return false;
+  for (int i = 0; passwordForm[i]; i++) {
+    char c = DevicePassword[i];
+    if (passwordForm[i] == 'd' ? (c < '0' || c > '9') : c != passwordForm[i]) return false;
+  }
+  if (strlen(DeviceSetupID) != 4) return false;
+  for (int i = 0; i < 4; i++) {
+    char c = DeviceSetupID[i];
+    if ((c < '0' || c > '9') && (c < 'A' || c > 'Z')) return false;
+  }
+  return true;
+}
+
 void user_init(void) {
+  post_mortem_init();
   prepLogging();
+  post_mortem_print();
+  heap_profile_init(HeapProfilePeriod);
   prepLED(Pin_LED, false);
 
+  if (config_store_init() < 0) {
+    printf("Failed to read the configuration\n");
+  }
+  loadSetting("serial", DeviceSerial, sizeof(DeviceSerial), QUOTE(DEV_SERIAL));
+  loadSetting("password", DevicePassword, sizeof(DevicePassword), QUOTE(DEV_PASS));
+  loadSetting("setup_id", DeviceSetupID, sizeof(DeviceSetupID), QUOTE(DEV_SETUP));
+  loadSetting("name", DeviceName, sizeof(DeviceName), QUOTE(DEV_NAME));
+  DeviceProvisioned = isProvisioned();
+  if (!DeviceProvisioned) {
+    printf("No valid serial, password and setup ID, provision them with make config-store\n");
+  }
+
+  if (factory_reset_init(wifi_config_reset) < 0) {
+    printf("Failed to complete the factory reset\n");
+  }
+
   setLEDColor(LED_GRAY);
   printf("DeviceSetupID = %s\n", config.setupId);
   printf("DevicePassword = %s\n", config.password);
-  printf("DeviceSerial = %s\n", QUOTE(DEV_SERIAL));
+  printf("DeviceSerial = %s\n", DeviceSerial);
   buildAccessory();
 
+  gestureRecognizer = gesture_recognizer_create(
+    gestures, sizeof(gestures)/sizeof(gestures[0]), NButtons, N_BUTTON_EVENTS);
+  if (!gestureRecognizer) {
+    printf("Failed to initialize gestures\n");
+  }
+
   button_config_t button_config = BUTTON_CONFIG(button_active_low, .long_press_time=LongPressTime, .max_repeat_presses=3);
   for (int i = 0; i < NButtons; i++) {
-    if (button_create(buttonInfo[i].pin, button_config, buttonCallback, &buttonInfo[i].event[i])) {
+    if (button_create(buttonInfo[i].pin, button_config, buttonCallback, &buttonInfo[i])) {
         printf("Failed to initialize button %d\n", i);
     }
   }
 
+  uint8_t buttonPins[NButtons];
+  uint16_t chords[NChords];
+  for (int i = 0; i < NButtons; i++) buttonPins[i] = buttonInfo[i].pin;
+  for (int i = 0; i < NChords; i++) chords[i] = chordInfo[i].buttons;
+  chord_config_t chord_config = CHORD_CONFIG(false, .window=ChordWindow, .long_press_time=LongPressTime);
+  if (chord_detector_create(buttonPins, NButtons, chords, NChords, chord_config, chordCallback, NULL)) {
+    printf("Failed to initialize chords\n");
+  }
+
   wifi_config_init2(DeviceModel, NULL, handleWiFiEvent);
 }
@@ -17,6 +17,8 @@
 #include <wifi_config.h>
 #include <ws2812.h>
 #include <pwm.h>
+#include <event_loop.h>
+#include <factory_reset.h>
 // ----- App-specific
 #include "utils.h"
 
@@ -71,20 +73,48 @@ void blinkIt(uint32_t color, uint8_t cycles, uint32_t delayMillis) {
   }
 }
 
-void blinkItTask(void *_args) {
-  struct BlinkParams* blinkParams = _args;
-  blinkIt(blinkParams->color, blinkParams->cycles, blinkParams->delayMillis);
-  free(blinkParams);
-  vTaskDelete(NULL);
+void blinkItTask(event_loop_coroutine_t *co) {
+  static int i;
+  EVENT_LOOP_BEGIN(co);
+
+  for (i = 0; i < blinkParams.cycles; i++) {
+    if (i) { EVENT_LOOP_SLEEP(co, blinkParams.delayMillis); }
+    setLEDColor(ledIsNeoPixel ? blinkParams.color : LED_WHITE);
+    EVENT_LOOP_SLEEP(co, blinkParams.delayMillis);
+    setLEDColor(LED_BLACK);
+  }
+
+  EVENT_LOOP_END(co);
+}
+
+event_loop_coroutine_t blinkItCoroutine = EVENT_LOOP_COROUTINE(blinkItTask, NULL);
+
+// The next blink, copied into blinkParams on the event loop
+static struct BlinkParams nextBlinkParams;
+
+// Posted between the stop and the start: the queue runs it after the old
+// blink has stopped and before the new one reads blinkParams
+static void blinkApplyParams(void *_arg) {
+  setLEDColor(LED_BLACK);
+  taskENTER_CRITICAL();
+  blinkParams = nextBlinkParams;
+  taskEXIT_CRITICAL();
 }
 
 void blinkInBackground(uint32_t color, uint8_t cycles, uint32_t delayMillis) {
   // printf("blinkInBackground\n");
-  struct BlinkParams* blinkParams = malloc(sizeof(struct BlinkParams));
-  blinkParams->color = color;
-  blinkParams->cycles = cycles;
-  blinkParams->delayMillis = delayMillis;
-  xTaskCreate(blinkItTask, "BlinkIt", 256, blinkParams, 2, NULL);
+  // A new blink replaces the one in progress
+  if (!event_loop_stop(&blinkItCoroutine)) {
+    printf("Event loop full, blink dropped\n");
+    return;
+  }
+  taskENTER_CRITICAL();
+  nextBlinkParams.color = color;
+  nextBlinkParams.cycles = cycles;
+  nextBlinkParams.delayMillis = delayMillis;
+  taskEXIT_CRITICAL();
+  if (!event_loop_post(blinkApplyParams, NULL) || !event_loop_start(&blinkItCoroutine))
+    printf("Event loop full, blink dropped\n");
 }
 
 void identifyDeviceTask(void *_args) {
@@ -122,6 +152,7 @@ void indicateStationMode(bool on) {
 }
 
 void prepLED(uint8_t ledPin, bool isNeoPixel) {
+  event_loop_init();
   Utils_Pin_LED = ledPin;
   ledIsNeoPixel = isNeoPixel;
   gpio_enable(Utils_Pin_LED, GPIO_OUTPUT);
@@ -138,16 +169,9 @@ void resetConfigTask() {
   // Flash the LED first before we start the reset
   blinkIt(LED_RED, 5, 100);
 
-  printf("Resetting Wifi Config\n");
-  wifi_config_reset();
-  delayMS(1000);
-
-  printf("Resetting HomeKit Config\n");
-  homekit_server_reset();
-  delayMS(1000);
-
   printf("Restarting\n");
-  sdk_system_restart();
+  // Erases happen after the restart, see factory_reset_init
+  factory_reset();
   vTaskDelete(NULL);
 }
 
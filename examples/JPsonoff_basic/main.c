@@ -33,6 +33,8 @@
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
 #include <wifi_config.h>
+#include <factory_reset.h>
+#include <relay_limiter.h>
 
 #include "button.h"
 
@@ -60,6 +62,10 @@ static const uint8_t Pin_Relay = 12;
 static const uint8_t Pin_LED = 13;
 static const uint8_t Pin_Button = 0;
 
+// Protect the relay from HomeKit automations that chatter
+static const uint16_t RelayMinDwellTime = 1000;  // ms between relay transitions
+static const uint16_t RelayCoalesceTime = 200;   // ms to wait for further writes
+
 char DeviceModel[]    = "Basic";
 char DeviceSetupID[]  = QUOTE(DEV_SETUP);
 char DevicePassword[] = QUOTE(DEV_PASS);
@@ -145,10 +151,16 @@ void setState(bool on) {
   setRelay(on);
 }
 
+void limitedStateCallback(uint8_t gpio, bool on) { setState(on); }
+
 void prepIO() {
   gpio_enable(Pin_LED, GPIO_OUTPUT);
   gpio_enable(Pin_Relay, GPIO_OUTPUT);
   setState(switch_on.value.bool_value);
+  if (relay_limiter_create(Pin_Relay, switch_on.value.bool_value,
+                           RelayMinDwellTime, RelayCoalesceTime, limitedStateCallback)) {
+    printf("Failed to initialize relay limiter\n");
+  }
 }
 
 void blinkIt(uint8_t cycles, uint32_t delayMillis) {
@@ -204,16 +216,9 @@ void resetConfigTask() {
   // Flash the LED first before we start the reset
   blinkIt(5, 100);
 
-  printf("Resetting Wifi Config\n");
-  wifi_config_reset();
-  delayMS(1000);
-
-  printf("Resetting HomeKit Config\n");
-  homekit_server_reset();
-  delayMS(1000);
-
   printf("Restarting\n");
-  sdk_system_restart();
+  // Erases happen after the restart, see factory_reset_init
+  factory_reset();
   vTaskDelete(NULL);
 }
 
@@ -230,7 +235,7 @@ void resetConfig() {
  *----------------------------------------------------------------------------*/
 
 void switchOnCallback(homekit_characteristic_t *_ch, homekit_value_t on, void *context) {
-  setState(switch_on.value.bool_value);
+  relay_limiter_write(Pin_Relay, switch_on.value.bool_value);
 }
 
 void button_callback(uint8_t gpio, button_event_t event) {
@@ -238,7 +243,7 @@ void button_callback(uint8_t gpio, button_event_t event) {
   case button_event_single_press:
     printf("Toggling relay\n");
     switch_on.value.bool_value = !switch_on.value.bool_value;
-    setState(switch_on.value.bool_value);
+    relay_limiter_override_from_isr(Pin_Relay, switch_on.value.bool_value);
     homekit_characteristic_notify(&switch_on, switch_on.value);
     break;
   case button_event_long_press:
@@ -327,6 +332,9 @@ void user_init(void) {
   printf("deviceSerial = %s\n", DeviceSerial);
   printf("deviceName = %s\n", DeviceName);
 
+  if (factory_reset_init(wifi_config_reset) < 0) {
+    printf("Failed to complete the factory reset\n");
+  }
   wifi_config_init2(DeviceModel, NULL, handleWiFiEvent);
   prepIO();
 
@@ -20,6 +20,7 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <work_queue.h>
 #include "wifi.h"
 
 #include <math.h>  //requires LIBS ?= hal m to be added to Makefile
@@ -100,6 +101,11 @@ void lightSET(void) {
     }
 }
 
+// Runs on the work queue, off the HomeKit server task
+void light_update(void *_arg) {
+    lightSET();
+}
+
 void light_init() {
     mjpwm_cmd_t init_cmd = {
         .scatter = MJPWM_CMD_SCATTER_APDM,
@@ -123,7 +129,7 @@ void light_on_set(homekit_value_t value) {
         return;
     }
     on = value.bool_value;
-    lightSET();
+    work_queue_post(light_update, NULL, WORK_QUEUE_PRIORITY_NORMAL);
 }
 
 homekit_value_t light_bri_get() {
@@ -135,7 +141,7 @@ void light_bri_set(homekit_value_t value) {
         return;
     }
     bri = value.int_value;
-    lightSET();
+    work_queue_post(light_update, NULL, WORK_QUEUE_PRIORITY_NORMAL);
 }
 
 homekit_value_t light_hue_get() {
@@ -147,7 +153,7 @@ void light_hue_set(homekit_value_t value) {
         return;
     }
     hue = value.float_value;
-    lightSET();
+    work_queue_post(light_update, NULL, WORK_QUEUE_PRIORITY_NORMAL);
 }
 
 homekit_value_t light_sat_get() {
@@ -159,7 +165,7 @@ void light_sat_set(homekit_value_t value) {
         return;
     }
     sat = value.float_value;
-    lightSET();
+    work_queue_post(light_update, NULL, WORK_QUEUE_PRIORITY_NORMAL);
 }
 
 
@@ -179,6 +185,12 @@ void light_identify_task(void *_args) {
 
 void light_identify(homekit_value_t _value) {
     printf("Light Identify\n");
+
+    // How much of WORK_QUEUE_STACK_SIZE lightSET has left, see the Makefile
+    work_queue_stats_t stats;
+    work_queue_get_stats(&stats, false);
+    printf("Work queue: %u words of stack never used, longest update %u us\n",
+           stats.stack_free, stats.max_run_us);
     xTaskCreate(light_identify_task, "Light identify", 256, NULL, 2, NULL);
 }
 
@@ -235,6 +247,8 @@ homekit_server_config_t config = {
 void user_init(void) {
     uart_set_baud(0, 115200);
 
+    work_queue_init();
+
     wifi_init();
     light_init();
     homekit_server_init(&config);
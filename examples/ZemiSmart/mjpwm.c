@@ -55,7 +55,7 @@ IRAM void mjpwm_di_pulse(uint16_t times)
     }
 }
 
-void mjpwm_dcki_pulse(uint16_t times)
+IRAM void mjpwm_dcki_pulse(uint16_t times)
 {
     uint16_t i;
     for (i = 0; i < times; i++) {
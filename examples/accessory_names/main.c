@@ -13,6 +13,7 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_loop.h>
 #include "wifi.h"
 
 
@@ -39,26 +40,31 @@ void led_init() {
     led_write(led_on);
 }
 
-void led_identify_task(void *_args) {
-    for (int i=0; i<3; i++) {
-        for (int j=0; j<2; j++) {
+void led_identify_task(event_loop_coroutine_t *co) {
+    static int i, j;
+    EVENT_LOOP_BEGIN(co);
+
+    for (i=0; i<3; i++) {
+        for (j=0; j<2; j++) {
             led_write(true);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
             led_write(false);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
         }
 
-        vTaskDelay(250 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 250);
     }
 
     led_write(led_on);
 
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t led_identify_coroutine = EVENT_LOOP_COROUTINE(led_identify_task, NULL);
+
 void led_identify(homekit_value_t _value) {
     printf("LED identify\n");
-    xTaskCreate(led_identify_task, "LED identify", 128, NULL, 2, NULL);
+    event_loop_start(&led_identify_coroutine);
 }
 
 homekit_value_t led_on_get() {
@@ -112,6 +118,8 @@ homekit_server_config_t config = {
 void user_init(void) {
     uart_set_baud(0, 115200);
 
+    event_loop_init();
+
     uint8_t macaddr[6];
     sdk_wifi_get_macaddr(STATION_IF, macaddr);
 
@@ -16,6 +16,10 @@ Motorized blinds.  Crude approach simply constant time to open or close a blind.
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_loop.h>
+#include <static_task.h>
+#include <event_subscribers.h>
+#include <seqlock.h>
 #include "wifi.h"
 
 #define POSITION_STATIONARY 0
@@ -23,7 +27,23 @@ Motorized blinds.  Crude approach simply constant time to open or close a blind.
 #define POSITION_OSCILLATING 2
 
 
-int right_timer = 0, left_timer = 0;	// blind rotation timers
+// Blind rotation timers, only touched by main_task. A new target from
+// HomeKit reaches it as a notification bit, see timers_reset_request().
+static int right_timer = 0, left_timer = 0;
+
+#define TIMER_RESET_LEFT (1 << 0)
+#define TIMER_RESET_RIGHT (1 << 1)
+
+// Current and target positions are written by main_task and by the HomeKit
+// setters, and each side reads them together. Writes go through
+// position_write(), or position_update() when they are worked out from a
+// snapshot, reads of more than one position through positions_read().
+typedef struct {
+	int current_left, target_left;
+	int current_right, target_right;
+} blind_positions_t;
+
+seqlock_t positions_lock = SEQLOCK_INIT;
 
 
 homekit_value_t current_position_L_get();
@@ -79,6 +99,48 @@ homekit_characteristic_t position_state_right = HOMEKIT_CHARACTERISTIC_(
 );
 
 
+static void positions_read(blind_positions_t *positions)
+{
+	uint32_t sequence;
+	do {
+		sequence = seqlock_read_begin(&positions_lock);
+		positions->current_left = current_position_left.value.int_value;
+		positions->target_left = target_position_left.value.int_value;
+		positions->current_right = current_position_right.value.int_value;
+		positions->target_right = target_position_right.value.int_value;
+	} while (seqlock_read_retry(&positions_lock, sequence));
+}
+
+static void position_write(homekit_characteristic_t *ch, homekit_value_t value)
+{
+	taskENTER_CRITICAL();
+	SEQLOCK_WRITE(&positions_lock, ch->value, value);
+	taskEXIT_CRITICAL();
+}
+
+// Sets ch to position, unless a position changed since seen was read: a
+// HomeKit setter may have moved a target in the meantime. Then nothing is
+// written and false is returned, the next pass starts from a fresh snapshot.
+static bool position_update(const blind_positions_t *seen, homekit_characteristic_t *ch, int position)
+{
+	bool written = false;
+	taskENTER_CRITICAL();
+	// no write can be under way in here
+	if( seen->current_left == current_position_left.value.int_value &&
+	    seen->target_left == target_position_left.value.int_value &&
+	    seen->current_right == current_position_right.value.int_value &&
+	    seen->target_right == target_position_right.value.int_value )
+	{
+		homekit_value_t value = ch->value;
+		value.int_value = position;
+		SEQLOCK_WRITE(&positions_lock, ch->value, value);
+		written = true;
+	}
+	taskEXIT_CRITICAL();
+	return written;
+}
+
+
 static void wifi_init() {
     struct sdk_station_config wifi_config = {
         .ssid = WIFI_SSID,
@@ -127,6 +189,48 @@ void led_init() {
     led_write(led_on);
 }
 
+STATIC_TASK(main_task_memory, 512);
+
+// Sets the timers of the given sides to the travel time to their target
+static void timers_reset(uint32_t sides)
+{
+	blind_positions_t p;
+	positions_read(&p);
+
+	if( sides & TIMER_RESET_RIGHT )
+	{
+		int percent = p.current_right - p.target_right;
+
+		if( percent < 0 )
+			right_timer = right_blind_open_time * (-percent) / 100;
+		else
+			right_timer = right_blind_close_time * percent / 100;
+
+		printf("R:current: %d target: %d timer %d\n", p.current_right, p.target_right, right_timer);
+	}
+	if( sides & TIMER_RESET_LEFT )
+	{
+		int percent = p.current_left - p.target_left;
+
+		if( percent < 0 )
+			left_timer = left_blind_open_time * (-percent) / 100;
+		else
+			left_timer = left_blind_close_time * percent / 100;
+
+		printf("L:current: %d target: %d timer %d\n", p.current_left, p.target_left, left_timer);
+	}
+}
+
+// Target callbacks run on the HomeKit server task, or on main_task when the
+// remote moved a target. The former hand the reset over to main_task.
+static void timers_reset_request(uint32_t sides)
+{
+	if( xTaskGetCurrentTaskHandle() == main_task_memory.handle )
+		timers_reset(sides);
+	else if( main_task_memory.handle )
+		xTaskNotify(main_task_memory.handle, sides, eSetBits);
+}
+
 void main_task(void *_args) 
 {
 	gpio_enable(left_blind_close, GPIO_OUTPUT);
@@ -144,8 +248,16 @@ void main_task(void *_args)
 	while(1) 
 	{
 		led_write(false);
+
+		uint32_t sides = 0;
+		xTaskNotifyWait(0, ~0, &sides, 0);
+		if( sides )
+			timers_reset(sides);
+
+		blind_positions_t p;
+		positions_read(&p);
 		
-		if( current_position_right.value.int_value < target_position_right.value.int_value )
+		if( p.current_right < p.target_right )
 		{
 			gpio_write(right_blind_open, true);
 			gpio_write(right_blind_close, false);
@@ -155,12 +267,16 @@ void main_task(void *_args)
 				if( right_timer <= 0 )
 					right_timer = 0;
 				
-				if( target_position_right.value.int_value != current_position_right.value.int_value + TIMER_TO_PCT_R_OPEN(right_timer) )
+				if( p.target_right != p.current_right + TIMER_TO_PCT_R_OPEN(right_timer) )
 				{
-					current_position_right.value.int_value = target_position_right.value.int_value - TIMER_TO_PCT_R_OPEN(right_timer);
-					homekit_characteristic_notify(&current_position_right, current_position_right.value);
-					led_write(true);
-					printf("open R current: %d target: %d timer %d\n", current_position_right.value.int_value, target_position_right.value.int_value, right_timer);
+					int position = p.target_right - TIMER_TO_PCT_R_OPEN(right_timer);
+					if( position_update(&p, &current_position_right, position) )
+					{
+						p.current_right = position;
+						EVENT_SUBSCRIBERS_NOTIFY(&current_position_right, current_position_right.value);
+						led_write(true);
+						printf("open R current: %d target: %d timer %d\n", p.current_right, p.target_right, right_timer);
+					}
 				}			
 			}
 			else
@@ -168,7 +284,7 @@ void main_task(void *_args)
 				right_timer = poll_time;
 			}
 		}
-		else if( current_position_right.value.int_value > target_position_right.value.int_value )
+		else if( p.current_right > p.target_right )
 		{
 			gpio_write(right_blind_open, false);
 			gpio_write(right_blind_close, true);
@@ -178,12 +294,16 @@ void main_task(void *_args)
 				if( right_timer <= 0 )
 					right_timer = 0;
 				
-				if( target_position_right.value.int_value != current_position_right.value.int_value - TIMER_TO_PCT_R_CLOSE(right_timer) )
+				if( p.target_right != p.current_right - TIMER_TO_PCT_R_CLOSE(right_timer) )
 				{
-					current_position_right.value.int_value = target_position_right.value.int_value + TIMER_TO_PCT_R_CLOSE(right_timer);
-					homekit_characteristic_notify(&current_position_right, current_position_right.value);
-					led_write(true);
-					printf("close R current: %d target: %d timer %d\n", current_position_right.value.int_value, target_position_right.value.int_value, right_timer);
+					int position = p.target_right + TIMER_TO_PCT_R_CLOSE(right_timer);
+					if( position_update(&p, &current_position_right, position) )
+					{
+						p.current_right = position;
+						EVENT_SUBSCRIBERS_NOTIFY(&current_position_right, current_position_right.value);
+						led_write(true);
+						printf("close R current: %d target: %d timer %d\n", p.current_right, p.target_right, right_timer);
+					}
 				}			
 			}
 			else
@@ -197,7 +317,7 @@ void main_task(void *_args)
 			gpio_write(right_blind_close, false);
 		}
 
-		if( current_position_left.value.int_value < target_position_left.value.int_value )
+		if( p.current_left < p.target_left )
 		{
 			gpio_write(left_blind_open, true);
 			gpio_write(left_blind_close, false);
@@ -207,12 +327,16 @@ void main_task(void *_args)
 				if( left_timer <= 0 )
 					left_timer = 0;
 				
-				if( target_position_left.value.int_value != current_position_left.value.int_value + TIMER_TO_PCT_L_OPEN(left_timer) )
+				if( p.target_left != p.current_left + TIMER_TO_PCT_L_OPEN(left_timer) )
 				{
-					current_position_left.value.int_value = target_position_left.value.int_value - TIMER_TO_PCT_L_OPEN(left_timer);
-					homekit_characteristic_notify(&current_position_left, current_position_left.value);
-					led_write(true);
-					printf("open L current: %d target: %d timer %d\n", current_position_left.value.int_value, target_position_left.value.int_value, left_timer);
+					int position = p.target_left - TIMER_TO_PCT_L_OPEN(left_timer);
+					if( position_update(&p, &current_position_left, position) )
+					{
+						p.current_left = position;
+						EVENT_SUBSCRIBERS_NOTIFY(&current_position_left, current_position_left.value);
+						led_write(true);
+						printf("open L current: %d target: %d timer %d\n", p.current_left, p.target_left, left_timer);
+					}
 				}			
 			}
 			else
@@ -220,7 +344,7 @@ void main_task(void *_args)
 				left_timer = poll_time;
 			}
 		}
-		else if( current_position_left.value.int_value > target_position_left.value.int_value )
+		else if( p.current_left > p.target_left )
 		{
 			gpio_write(left_blind_open, false);
 			gpio_write(left_blind_close, true);
@@ -230,12 +354,16 @@ void main_task(void *_args)
 				if( left_timer <= 0 )
 					left_timer = 0;
 				
-				if( target_position_left.value.int_value != current_position_left.value.int_value - TIMER_TO_PCT_L_CLOSE(left_timer) )
+				if( p.target_left != p.current_left - TIMER_TO_PCT_L_CLOSE(left_timer) )
 				{
-					current_position_left.value.int_value = target_position_left.value.int_value + TIMER_TO_PCT_L_CLOSE(left_timer);
-					homekit_characteristic_notify(&current_position_left, current_position_left.value);
-					led_write(true);
-					printf("close L current: %d target: %d timer %d\n", current_position_left.value.int_value, target_position_left.value.int_value, left_timer);
+					int position = p.target_left + TIMER_TO_PCT_L_CLOSE(left_timer);
+					if( position_update(&p, &current_position_left, position) )
+					{
+						p.current_left = position;
+						EVENT_SUBSCRIBERS_NOTIFY(&current_position_left, current_position_left.value);
+						led_write(true);
+						printf("close L current: %d target: %d timer %d\n", p.current_left, p.target_left, left_timer);
+					}
 				}			
 			}
 			else
@@ -254,13 +382,16 @@ void main_task(void *_args)
 		//{
 			if( gpio_read(remote_left_close) )
 			{
-				if( target_position_left.value.int_value > target_position_left.min_value[0] )
+				if( p.target_left > target_position_left.min_value[0] )
 				{
-					if(target_position_left.value.int_value == current_position_left.value.int_value)
+					if(p.target_left == p.current_left)
 					{
-						target_position_left.value.int_value = current_position_left.value.int_value - 1;
-						homekit_characteristic_notify(&target_position_left, target_position_left.value);
-						left_timer += blind_one_pct_time;
+						if( position_update(&p, &target_position_left, p.current_left - 1) )
+						{
+							p.target_left = p.current_left - 1;
+							EVENT_SUBSCRIBERS_NOTIFY(&target_position_left, target_position_left.value);
+							left_timer += blind_one_pct_time;
+						}
 					}
 				}	
 				else	// allow remote to adjust close past limit
@@ -271,13 +402,16 @@ void main_task(void *_args)
 			}
 			else if( gpio_read(remote_left_open) )
 			{
-				if( target_position_left.value.int_value < target_position_left.max_value[0] )
+				if( p.target_left < target_position_left.max_value[0] )
 				{
-					if(target_position_left.value.int_value == current_position_left.value.int_value)
+					if(p.target_left == p.current_left)
 					{
-						target_position_left.value.int_value = current_position_left.value.int_value + 1;
-						homekit_characteristic_notify(&target_position_left, target_position_left.value);
-						left_timer += blind_one_pct_time;
+						if( position_update(&p, &target_position_left, p.current_left + 1) )
+						{
+							p.target_left = p.current_left + 1;
+							EVENT_SUBSCRIBERS_NOTIFY(&target_position_left, target_position_left.value);
+							left_timer += blind_one_pct_time;
+						}
 					}
 				}
 				else	// allow remote to adjust open past limit
@@ -288,13 +422,16 @@ void main_task(void *_args)
 			}
 			if( gpio_read(remote_right_close) )
 			{					
-				if( target_position_right.value.int_value > target_position_right.min_value[0] )
+				if( p.target_right > target_position_right.min_value[0] )
 				{
-					if(target_position_right.value.int_value == current_position_right.value.int_value )
+					if(p.target_right == p.current_right )
 					{
-						target_position_right.value.int_value = current_position_right.value.int_value - 1;
-						homekit_characteristic_notify(&target_position_right, target_position_right.value);
-						right_timer += blind_one_pct_time;
+						if( position_update(&p, &target_position_right, p.current_right - 1) )
+						{
+							p.target_right = p.current_right - 1;
+							EVENT_SUBSCRIBERS_NOTIFY(&target_position_right, target_position_right.value);
+							right_timer += blind_one_pct_time;
+						}
 					}
 				}
 				else	// allow remote to adjust close past limit
@@ -305,13 +442,16 @@ void main_task(void *_args)
 			}
 			else if( gpio_read(remote_right_open) )
 			{
-				if( target_position_right.value.int_value < target_position_right.max_value[0] )
+				if( p.target_right < target_position_right.max_value[0] )
 				{
-					if(target_position_right.value.int_value == current_position_right.value.int_value)
+					if(p.target_right == p.current_right)
 					{
-						target_position_right.value.int_value = current_position_right.value.int_value + 1;
-						homekit_characteristic_notify(&target_position_right, target_position_right.value);
-						right_timer += blind_one_pct_time;
+						if( position_update(&p, &target_position_right, p.current_right + 1) )
+						{
+							p.target_right = p.current_right + 1;
+							EVENT_SUBSCRIBERS_NOTIFY(&target_position_right, target_position_right.value);
+							right_timer += blind_one_pct_time;
+						}
 					}
 				}
 				else	// allow remote to adjust open past limit
@@ -331,49 +471,40 @@ void main_task(void *_args)
 
 void on_update_right(homekit_characteristic_t *ch, homekit_value_t value, void *context)
 {
-	int percent = current_position_right.value.int_value - target_position_right.value.int_value;
-	
-	if( percent < 0 ) 
-		right_timer = right_blind_open_time * (-percent) / 100;
-	else
-		right_timer = right_blind_close_time * percent / 100;
-	
-	printf("R:current: %d target: %d timer %d\n", current_position_right.value.int_value, target_position_right.value.int_value, right_timer);
+	timers_reset_request(TIMER_RESET_RIGHT);
 }
 
 void on_update_left(homekit_characteristic_t *ch, homekit_value_t value, void *context)
 {
-	int percent = current_position_left.value.int_value - target_position_left.value.int_value;
-	
-	if( percent < 0 ) 
-		left_timer = left_blind_open_time * (-percent) / 100;
-	else
-		left_timer = left_blind_close_time * percent / 100;
-	
-	printf("L:current: %d target: %d timer %d\n", current_position_left.value.int_value, target_position_left.value.int_value, left_timer);
+	timers_reset_request(TIMER_RESET_LEFT);
 }
 
 
-void led_identify_task(void *_args) {
-    for (int i=0; i<3; i++) {
-        for (int j=0; j<2; j++) {
+void led_identify_task(event_loop_coroutine_t *co) {
+    static int i, j;
+    EVENT_LOOP_BEGIN(co);
+
+    for (i=0; i<3; i++) {
+        for (j=0; j<2; j++) {
             led_write(true);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
             led_write(false);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
         }
 
-        vTaskDelay(250 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 250);
     }
 
     led_write(led_on);
 
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t led_identify_coroutine = EVENT_LOOP_COROUTINE(led_identify_task, NULL);
+
 void led_identify(homekit_value_t _value) {
     printf("LED identify\n");
-    xTaskCreate(led_identify_task, "LED identify", 128, NULL, 2, NULL);
+    event_loop_start(&led_identify_coroutine);
 }
 
 homekit_value_t led_on_get() {
@@ -412,11 +543,11 @@ homekit_value_t position_state_R_get() {
 
 void current_position_L_set(homekit_value_t value)
 {
-	current_position_left.value = value;
+	position_write(&current_position_left, value);
 }
 void target_position_L_set(homekit_value_t value)
 {
-	target_position_left.value = value;
+	position_write(&target_position_left, value);
 }
 void position_state_L_set(homekit_value_t value)
 {
@@ -424,11 +555,11 @@ void position_state_L_set(homekit_value_t value)
 }
 void current_position_R_set(homekit_value_t value)
 {
-	current_position_right.value = value;
+	position_write(&current_position_right, value);
 }
 void target_position_R_set(homekit_value_t value)
 {
-	target_position_right.value = value;
+	position_write(&target_position_right, value);
 }
 void position_state_R_set(homekit_value_t value)
 {
@@ -476,8 +607,11 @@ homekit_server_config_t config = {
 void user_init(void) {
     uart_set_baud(0, 115200);
 
+    event_loop_init();
+
     wifi_init();
     led_init();
+    // Before the server, whose target callbacks notify it
+    static_task_create(&main_task_memory, main_task, "Main", NULL, 2);
     homekit_server_init(&config);
-    xTaskCreate(main_task, "Main", 512, NULL, 2, NULL);
 }
@@ -8,6 +8,9 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <getter_cache.h>
+#include <config_store.h>
+#include <mqtt_telemetry.h>
 #include "wifi.h"
 #include "contact_sensor.h"
 
@@ -15,6 +18,13 @@
 #error REED_PIN is not specified
 #endif
 
+// GPIO of the reed switch: the "reed_pin" key of the config store, REED_PIN
+// on devices without it (make config-store CONFIG="reed_pin=5")
+static uint8_t reed_pin = REED_PIN;
+
+// Re-read the sensor at least this often in case an edge was missed
+#define DOOR_STATE_TTL 60000
+
 
 static void wifi_init() {
     struct sdk_station_config wifi_config = {
@@ -36,12 +46,23 @@ void door_identify(homekit_value_t _value) {
     // Nothing to do here.
 }
 
+/**
+ * Reads the door sensor state as a homekit value.
+ **/
+homekit_value_t door_state_read() {
+    return HOMEKIT_UINT8(contact_sensor_state_get(reed_pin) == CONTACT_OPEN ? 1 : 0);
+}
+
+/**
+ * The last known door state, kept current by the sensor callback.
+ **/
+getter_cache_t door_state_cache = GETTER_CACHE(door_state_read, DOOR_STATE_TTL);
+
 /**
  * Returns the door sensor state as a homekit value.
  **/
 homekit_value_t door_state_getter() {
-    printf("Door state was requested (%s).\n", contact_sensor_state_get(REED_PIN) == CONTACT_OPEN ? "open" : "closed");
-    return HOMEKIT_UINT8(contact_sensor_state_get(REED_PIN) == CONTACT_OPEN ? 1 : 0);
+    return getter_cache_get(&door_state_cache);
 }
 
 /**
@@ -59,10 +80,13 @@ homekit_characteristic_t door_open_characteristic = HOMEKIT_CHARACTERISTIC_(CONT
 void contact_sensor_callback(uint8_t gpio, contact_sensor_state_t state) {
     switch (state) {
         case CONTACT_OPEN:
-        case CONTACT_CLOSED:
+        case CONTACT_CLOSED: {
             printf("Pushing contact sensor state '%s'.\n", state == CONTACT_OPEN ? "open" : "closed");
-            homekit_characteristic_notify(&door_open_characteristic, door_state_getter());
+            homekit_value_t value = HOMEKIT_UINT8(state == CONTACT_OPEN ? 1 : 0);
+            getter_cache_set_from_isr(&door_state_cache, value);
+            homekit_characteristic_notify(&door_open_characteristic, value);
             break;
+        }
         default:
             printf("Unknown contact sensor event: %d\n", state);
     }
@@ -104,6 +128,16 @@ homekit_accessory_t *accessories[] = {
 };
 
 
+/**
+ * Mirrors the door state to the broker of the build (make MQTT_HOST=...).
+ **/
+void telemetry_init() {
+    mqtt_telemetry_add(&door_open_characteristic, "door_open");
+    mqtt_telemetry_set_credentials(MQTT_TELEMETRY_USER, MQTT_TELEMETRY_PASSWORD);
+    mqtt_telemetry_init(MQTT_TELEMETRY_HOST, MQTT_TELEMETRY_PORT, "door-sensor");
+}
+
+
 homekit_server_config_t config = {
     .accessories = accessories,
     .password = "111-11-111"
@@ -113,11 +147,17 @@ homekit_server_config_t config = {
 void user_init(void) {
     uart_set_baud(0, 9600);
 
+    if (config_store_init() < 0) {
+        printf("Failed to read the configuration\n");
+    }
+    reed_pin = config_store_get_int("reed_pin", REED_PIN);
+
     wifi_init();
-    printf("Using Sensor at GPIO%d.\n", REED_PIN);
-    if (contact_sensor_create(REED_PIN, contact_sensor_callback)) {
+    printf("Using Sensor at GPIO%d.\n", reed_pin);
+    if (contact_sensor_create(reed_pin, contact_sensor_callback)) {
         printf("Failed to initialize door\n");
     }
+    telemetry_init();
     homekit_server_init(&config);
 
     homekit_characteristic_notify(&door_open_characteristic, door_state_getter());
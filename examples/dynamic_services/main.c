@@ -10,12 +10,19 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_loop.h>
+#include <relay_limiter.h>
 
 #include "wifi.h"
 
 
 #define MAX_SERVICES 20
 
+// Minimum time a relay stays in a state and how long to wait for
+// further writes before switching it, in milliseconds
+#define RELAY_MIN_DWELL_TIME 1000
+#define RELAY_COALESCE_TIME 200
+
 
 static void wifi_init() {
     struct sdk_station_config wifi_config = {
@@ -36,8 +43,11 @@ const uint8_t relay_gpios[] = {
 };
 const size_t relay_count = sizeof(relay_gpios) / sizeof(*relay_gpios);
 
+// Relays whose limiter could be created, the others are written directly
+static bool relay_limited[sizeof(relay_gpios) / sizeof(*relay_gpios)];
+
 
-void relay_write(int relay, bool on) {
+void relay_write(uint8_t relay, bool on) {
     printf("Relay %d %s\n", relay, on ? "ON" : "OFF");
     gpio_write(relay, on ? 1 : 0);
 }
@@ -53,36 +63,49 @@ void gpio_init() {
     for (int i=0; i < relay_count; i++) {
         gpio_enable(relay_gpios[i], GPIO_OUTPUT);
         relay_write(relay_gpios[i], true);
+        relay_limited[i] = relay_limiter_create(relay_gpios[i], true,
+                                                RELAY_MIN_DWELL_TIME, RELAY_COALESCE_TIME,
+                                                relay_write) == 0;
+        if (!relay_limited[i])
+            printf("Failed to limit relay %d, switching it directly\n", relay_gpios[i]);
     }
 }
 
-void lamp_identify_task(void *_args) {
+void lamp_identify_task(event_loop_coroutine_t *co) {
+    static int i, j;
+    EVENT_LOOP_BEGIN(co);
+
     relay_write(relay_gpios[0], true);
 
-    for (int i=0; i<3; i++) {
-        for (int j=0; j<2; j++) {
+    for (i=0; i<3; i++) {
+        for (j=0; j<2; j++) {
             relay_write(relay_gpios[0], true);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
             relay_write(relay_gpios[0], false);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
         }
 
-        vTaskDelay(250 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 250);
     }
 
     relay_write(relay_gpios[0], true);
 
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t lamp_identify_coroutine = EVENT_LOOP_COROUTINE(lamp_identify_task, NULL);
+
 void lamp_identify(homekit_value_t _value) {
     printf("Lamp identify\n");
-    xTaskCreate(lamp_identify_task, "Lamp identify", 256, NULL, 2, NULL);
+    event_loop_start(&lamp_identify_coroutine);
 }
 
 void relay_callback(homekit_characteristic_t *ch, homekit_value_t value, void *context) {
-    uint8_t *gpio = context;
-    relay_write(*gpio, value.bool_value);
+    const uint8_t *gpio = context;
+    if (relay_limited[gpio - relay_gpios])
+        relay_limiter_write(*gpio, value.bool_value);
+    else
+        relay_write(*gpio, value.bool_value);
 }
 
 
@@ -147,6 +170,8 @@ void init_accessory() {
 void user_init(void) {
     uart_set_baud(0, 115200);
 
+    event_loop_init();
+
     init_accessory();
 
     gpio_init();
@@ -15,6 +15,15 @@
  * brightness setting.
  *
  * See demo.gif for demonstration.
+ *
+ * The fire gives way to frames streamed from a PC over DDP while a
+ * stream runs (tools/pixel_stream.py), the light still switching it on
+ * and off.
+ *
+ * Firmware updates go over TFTP, either as a full image or as a
+ * compressed delta against the running one (make delta-ota). Flash
+ * writes are fitted between animation frames, so the fire keeps its
+ * frame rate during an update.
  */
 #include <stdio.h>
 #include <string.h>
@@ -24,6 +33,12 @@
 #include <FreeRTOS.h>
 #include <task.h>
 #include <ota-tftp.h>
+#include <delta_ota.h>
+#include <flash_scheduler.h>
+#include <event_loop.h>
+#include <static_task.h>
+#include <cpu_usage.h>
+#include <pixel_stream.h>
 
 #include <homekit/homekit.h>
 #include <homekit/types.h>
@@ -33,6 +48,9 @@
 
 #include "wifi.h"
 
+// TCP port serving per-task CPU usage: nc <fireplace> 3334
+#define CPU_USAGE_PORT 3334
+
 static void wifi_init() {
     struct sdk_station_config wifi_config = {
         .ssid = WIFI_SSID,
@@ -55,7 +73,8 @@ homekit_characteristic_t brightness = HOMEKIT_CHARACTERISTIC_(BRIGHTNESS, 50);
 /* Refresh rate. Higher makes for flickerier
    Recommend small values for small displays */
 #define FPS 17
-#define FPS_DELAY (1000 / FPS / portTICK_PERIOD_MS)
+#define FPS_PERIOD (1000 / FPS)
+#define FPS_DELAY (FPS_PERIOD / portTICK_PERIOD_MS)
 
 /* Rate of cooling. Play with to change fire from
    roaring (larger values) to weak (smaller values) */
@@ -113,6 +132,8 @@ ws2812_pixel_t heat_color(uint8_t index) {
 ws2812_pixel_t pixels[NUM_LEDS];
 bool fireplace_on = false;
 
+PIXEL_STREAM_BUFFERS(stream_buffers, sizeof(pixels));
+
 void fireplace_update() {
     // Update fire animation
     static unsigned int stack[WIDTH][HEIGHT] = {};
@@ -158,6 +179,18 @@ void fireplace_update() {
     }
 
     ws2812_i2s_update(pixels, PIXEL_RGB);
+    flash_scheduler_frame_done();
+}
+
+// Shows the next streamed frame, waiting up to a frame period for it
+void fireplace_show_stream() {
+    ws2812_pixel_t *frame = pixel_stream_wait(FPS_PERIOD);
+    if (!frame)
+        return;
+
+    ws2812_i2s_update(frame, PIXEL_RGB);
+    pixel_stream_release();
+    flash_scheduler_frame_done();
 }
 
 void fireplace_clear() {
@@ -165,25 +198,50 @@ void fireplace_clear() {
     ws2812_i2s_update(pixels, PIXEL_RGB);
 }
 
+STATIC_TASK(fireplace_task_memory, 256);
+TaskHandle_t fireplace_task_handle = NULL;
+
 void fireplace_task(void *_arg) {
-    while (fireplace_on) {
-        fireplace_update();
+    while (true) {
+        // Sleep until fireplace_start()
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        TickType_t last_wake_time = xTaskGetTickCount();
+        bool streaming = false;
+        while (fireplace_on) {
+            if (pixel_stream_active()) {
+                // Streamed frames are shown as they come
+                streaming = true;
+                fireplace_show_stream();
+                last_wake_time = xTaskGetTickCount();
+                continue;
+            }
+            if (streaming) {
+                streaming = false;
+                pixel_stream_print_stats();
+            }
 
-        vTaskDelay(FPS_DELAY);
-    }
+            fireplace_update();
 
-    fireplace_clear();
-    vTaskDelete(NULL);
+            // Keep the frame rate even when a frame took longer than usual
+            vTaskDelayUntil(&last_wake_time, FPS_DELAY);
+        }
+
+        fireplace_clear();
+    }
 }
 
 void fireplace_init() {
     ws2812_i2s_init(NUM_LEDS, PIXEL_RGB);
     memset(pixels, 0, sizeof(pixels));
+    flash_scheduler_set_frame_period(FPS_PERIOD);
+    pixel_stream_init(PIXEL_STREAM_PORT, stream_buffers, sizeof(pixels));
+    fireplace_task_handle = static_task_create(&fireplace_task_memory, fireplace_task, "Fireplace", NULL, 2);
 }
 
 void fireplace_start() {
     fireplace_on = true;
-    xTaskCreate(fireplace_task, "Fireplace", 256, NULL, 2, NULL);
+    xTaskNotifyGive(fireplace_task_handle);
 }
 
 void _fill_column(int column, ws2812_pixel_t color) {
@@ -196,32 +254,35 @@ void _fill_column(int column, ws2812_pixel_t color) {
     }
 }
 
-void fireplace_identify_task(void *_args) {
-    bool old_on = fireplace_on;
-    fireplace_on = false;
-    vTaskDelay(2*FPS_DELAY);
+void fireplace_identify_task(event_loop_coroutine_t *co) {
+    static bool old_on;
+    static int x, i;
+    const ws2812_pixel_t black = { .color=0x000000 };
+    const ws2812_pixel_t red = { .color=0x990000 };
+    EVENT_LOOP_BEGIN(co);
 
-    ws2812_pixel_t black = { .color=0x000000 };
-    ws2812_pixel_t red = { .color=0x990000 };
+    old_on = fireplace_on;
+    fireplace_on = false;
+    EVENT_LOOP_SLEEP(co, 2*FPS_PERIOD);
 
     memset(pixels, 0, sizeof(pixels));
     ws2812_i2s_update(pixels, PIXEL_RGB);
-    vTaskDelay(100 / portTICK_PERIOD_MS);
+    EVENT_LOOP_SLEEP(co, 100);
 
-    for (int x = 0; x < 2; x++) {
-        for (int i = 0; i < WIDTH; i++) {
+    for (x = 0; x < 2; x++) {
+        for (i = 0; i < WIDTH; i++) {
             _fill_column(i, red);
             ws2812_i2s_update(pixels, PIXEL_RGB);
 
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
             _fill_column(i, black);
         }
 
-        for (int i = WIDTH-2; i > 0; i--) {
+        for (i = WIDTH-2; i > 0; i--) {
             _fill_column(i, red);
             ws2812_i2s_update(pixels, PIXEL_RGB);
 
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
             _fill_column(i, black);
         }
     }
@@ -231,12 +292,14 @@ void fireplace_identify_task(void *_args) {
     if (old_on)
         fireplace_start();
 
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t fireplace_identify_coroutine = EVENT_LOOP_COROUTINE(fireplace_identify_task, NULL);
+
 void fireplace_identify(homekit_value_t _value) {
     printf("Fireplace identify\n");
-    xTaskCreate(fireplace_identify_task, "Fireplace identify", 256, NULL, 2, NULL);
+    event_loop_start(&fireplace_identify_coroutine);
 }
 
 homekit_value_t fireplace_on_get() {
@@ -291,8 +354,13 @@ homekit_server_config_t config = {
 void user_init(void) {
     uart_set_baud(0, 115200);
 
+    event_loop_init();
+    cpu_usage_init();
+
     wifi_init();
+    delta_ota_init_server(TFTP_PORT);
     fireplace_init();
     fireplace_start();
     homekit_server_init(&config);
+    cpu_usage_serve(CPU_USAGE_PORT);
 }
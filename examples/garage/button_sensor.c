@@ -1,5 +1,6 @@
 #include <string.h>
 #include <esplibs/libmain.h>
+#include <common_macros.h>
 #include "button_sensor.h"
 
 static const unsigned button_class_id = 234245;
@@ -25,7 +26,7 @@ typedef struct _button {
 button_t *buttons = NULL;
 
 
-static button_t *button_find_by_gpio(const uint8_t gpio_num) {
+IRAM static button_t *button_find_by_gpio(const uint8_t gpio_num) {
     button_t *button = buttons;
     while (button && button->gpio_num != gpio_num)
         button = button->next;
@@ -34,7 +35,7 @@ static button_t *button_find_by_gpio(const uint8_t gpio_num) {
 }
 
 
-void button_intr_callback(uint8_t gpio) {
+IRAM void button_intr_callback(uint8_t gpio) {
     button_t *button = button_find_by_gpio(gpio);
     if (!button)
         return;
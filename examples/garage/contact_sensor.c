@@ -1,6 +1,7 @@
 #include <string.h>
 #include <etstimer.h>
 #include <esplibs/libmain.h>
+#include <common_macros.h>
 #include "contact_sensor.h"
 
 
@@ -15,7 +16,7 @@ typedef struct _contact_sensor {
 contact_sensor_t *sensors = NULL;
 
 
-static contact_sensor_t *contact_sensor_find_by_gpio(const uint8_t gpio_num) {
+IRAM static contact_sensor_t *contact_sensor_find_by_gpio(const uint8_t gpio_num) {
     contact_sensor_t *sensor = sensors;
     while (sensor && sensor->gpio_num != gpio_num)
         sensor = sensor->next;
@@ -23,12 +24,12 @@ static contact_sensor_t *contact_sensor_find_by_gpio(const uint8_t gpio_num) {
     return sensor;
 }
 
-contact_sensor_state_t contact_sensor_state_get(uint8_t gpio_num) {
+IRAM contact_sensor_state_t contact_sensor_state_get(uint8_t gpio_num) {
     return gpio_read(gpio_num);
 }
 
 
-void contact_sensor_intr_callback(uint8_t gpio) {
+IRAM void contact_sensor_intr_callback(uint8_t gpio) {
     contact_sensor_t *sensor = contact_sensor_find_by_gpio(gpio);
     if (!sensor)
         return;
@@ -11,6 +11,8 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <getter_cache.h>
+#include <work_queue.h>
 #include "wifi.h"
 #include "contact_sensor.h"
 
@@ -101,6 +103,10 @@ bool relay_on = false;
 uint8_t current_door_state = HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_UNKNOWN;
 ETSTimer update_timer; // used for delayed updating from contact sensor
 
+// Values served to controllers, updated whenever current_door_state changes:
+getter_cache_t current_state_cache = GETTER_CACHE(NULL, 0);
+getter_cache_t target_state_cache = GETTER_CACHE(NULL, 0);
+
 
 
 void relay_write(bool on) {
@@ -151,7 +157,7 @@ homekit_value_t gdo_obstruction_get() {
 
 void gdo_current_state_notify_homekit() {
 
-    homekit_value_t new_value = HOMEKIT_UINT8(current_door_state);
+    homekit_value_t new_value = gdo_current_state_get();
     printf("Notifying homekit that current door state is now '%s'\n", state_description(current_door_state));
 
     // Find the current door state characteristic c:
@@ -181,49 +187,62 @@ void gdo_target_state_notify_homekit() {
     homekit_characteristic_notify(c, new_value);
 }
 
+uint8_t target_state_for(uint8_t current_state) {
+    switch (current_state) {
+        case HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_OPEN:
+        case HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_OPENING:
+            return HOMEKIT_CHARACTERISTIC_TARGET_DOOR_STATE_OPEN;
+        case HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_CLOSED:
+        case HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_CLOSING:
+            return HOMEKIT_CHARACTERISTIC_TARGET_DOOR_STATE_CLOSED;
+        default:
+            return current_state;
+    }
+}
+
+// Also called from the contact sensor interrupt
+void door_state_cache_update() {
+    getter_cache_set_from_isr(&current_state_cache, HOMEKIT_UINT8(current_door_state));
+    getter_cache_set_from_isr(&target_state_cache, HOMEKIT_UINT8(target_state_for(current_door_state)));
+}
+
 void current_state_set(uint8_t new_state) {
     if (current_door_state != new_state) {
         current_door_state = new_state;
+        door_state_cache_update();
         gdo_target_state_notify_homekit();
         gdo_current_state_notify_homekit();
     }
 }
 
-void current_door_state_update_from_sensor() {
-    contact_sensor_state_t sensor_state = contact_sensor_state_get(REED_PIN);
-
+uint8_t door_state_from_sensor(contact_sensor_state_t sensor_state) {
     switch (sensor_state) {
         case CONTACT_CLOSED:
-            current_state_set(HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_OPEN);
-            break;
+            return HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_OPEN;
         case CONTACT_OPEN:
-            current_state_set(HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_CLOSED);
-            break;
+            return HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_CLOSED;
         default:
-            printf("Unknown contact sensor event: %d\n", sensor_state);
+            return HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_UNKNOWN;
     }
 }
 
-homekit_value_t gdo_current_state_get() {
-    if (current_door_state == HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_UNKNOWN) {
-	current_door_state_update_from_sensor();
+void current_door_state_update_from_sensor() {
+    contact_sensor_state_t sensor_state = contact_sensor_state_get(REED_PIN);
+    uint8_t new_state = door_state_from_sensor(sensor_state);
+
+    if (new_state == HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_UNKNOWN) {
+        printf("Unknown contact sensor event: %d\n", sensor_state);
+        return;
     }
-    printf("returning current door state '%s'.\n", state_description(current_door_state));
+    current_state_set(new_state);
+}
 
-    return HOMEKIT_UINT8(current_door_state);
+homekit_value_t gdo_current_state_get() {
+    return getter_cache_get(&current_state_cache);
 }
 
 homekit_value_t gdo_target_state_get() {
-    uint8_t result = gdo_current_state_get().int_value;
-    if (result == HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_OPENING) {
-	result = HOMEKIT_CHARACTERISTIC_TARGET_DOOR_STATE_OPEN;
-    } else if (result == HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_CLOSING) {
-        result = HOMEKIT_CHARACTERISTIC_TARGET_DOOR_STATE_CLOSED;  
-    }
-
-    printf("Returning target door state '%s'.\n", state_description(result));
-
-    return HOMEKIT_UINT8(result);
+    return getter_cache_get(&target_state_cache);
 }
 
 /**
@@ -243,6 +262,16 @@ void contact_sensor_state_changed(uint8_t gpio, contact_sensor_state_t state) {
 }
 
 
+// Toggles the garage door by toggling the relay connected to the GPIO (on - off)
+void relay_pulse(void *_arg) {
+    // Turn ON GPIO:
+    relay_write(true);
+    // Wait for some time:
+    vTaskDelay(400 / portTICK_PERIOD_MS);
+    // Turn OFF GPIO:
+    relay_write(false);
+}
+
 void gdo_target_state_set(homekit_value_t new_value) {
 
     if (new_value.format != homekit_format_uint8) {
@@ -261,13 +290,14 @@ void gdo_target_state_set(homekit_value_t new_value) {
         return;
     }
 
-    // Toggle the garage door by toggling the relay connected to the GPIO (on - off):
-    // Turn ON GPIO:
-    relay_write(true);
-    // Wait for some time:
-    vTaskDelay(400 / portTICK_PERIOD_MS);
-    // Turn OFF GPIO:
-    relay_write(false);
+    // Toggle the garage door on the work queue, so the response does not
+    // wait for the relay pulse:
+    if (!work_queue_post(relay_pulse, NULL, WORK_QUEUE_PRIORITY_HIGH)) {
+        printf("gdo_target_state_set() failed: work queue full, door not toggled (%s)\n", state_description(current_door_state));
+        // The controller took the new target, give it back the old one:
+        gdo_target_state_notify_homekit();
+        return;
+    }
     if (current_door_state == HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_CLOSED) {
         current_state_set(HOMEKIT_CHARACTERISTIC_CURRENT_DOOR_STATE_OPENING);
     } else {
@@ -297,6 +327,7 @@ void user_init(void) {
 
     wifi_init();
     relay_init();
+    work_queue_init();
 
     // Initialize Timer:
     sdk_os_timer_disarm(&update_timer);
@@ -308,6 +339,10 @@ void user_init(void) {
         printf("Failed to initialize door\n");
     }
 
+    // Controllers read the cached state, so it has to be known before they connect:
+    current_door_state = door_state_from_sensor(contact_sensor_state_get(REED_PIN));
+    door_state_cache_update();
+
     homekit_server_init(&config);
 
 }
@@ -8,6 +8,9 @@
 * Debugging printf statements are disabled below because of note (2) - you can uncomment
 * them if your hardware supports serial comms that do not conflict with I2S on GPIO3.
 *
+* Frames streamed from a PC over DDP (tools/pixel_stream.py) replace the
+* HomeKit color while the stream runs.
+*
 * Contributed March 2018 by https://github.com/Dave1001
 */
 #include <stdio.h>
@@ -18,10 +21,15 @@
 #include <esp8266.h>
 #include <FreeRTOS.h>
 #include <task.h>
+#include <semphr.h>
 #include <math.h>
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_loop.h>
+#include <local_control.h>
+#include <pixel_stream.h>
+#include <static_task.h>
 #include "wifi.h"
 #include "ws2812_i2s/ws2812_i2s.h"
 
@@ -37,6 +45,14 @@ float led_brightness = 100;     // brightness is scaled 0 to 100
 bool led_on = false;            // on is boolean on or off
 ws2812_pixel_t pixels[LED_COUNT];
 
+// HomeKit, local control, the stream and identify each write the strip from
+// a task of their own: the light state, pixels and the strip are only
+// changed with this held
+static SemaphoreHandle_t pixels_lock;
+static StaticSemaphore_t pixels_lock_buffer;
+
+PIXEL_STREAM_BUFFERS(stream_buffers, sizeof(pixels));
+
 //http://blog.saikoled.com/post/44677718712/how-to-convert-from-hsi-to-rgb-white
 static void hsi2rgb(float h, float s, float i, ws2812_pixel_t* rgb) {
     int r, g, b;
@@ -74,6 +90,7 @@ static void hsi2rgb(float h, float s, float i, ws2812_pixel_t* rgb) {
     rgb->white = (uint8_t) 0;           // white channel is not used
 }
 
+// Called with pixels_lock held
 void led_string_fill(ws2812_pixel_t rgb) {
 
     // write out the new color to each pixel
@@ -83,6 +100,7 @@ void led_string_fill(ws2812_pixel_t rgb) {
     ws2812_i2s_update(pixels, PIXEL_RGB);
 }
 
+// Called with pixels_lock held
 void led_string_set(void) {
     ws2812_pixel_t rgb = { { 0, 0, 0, 0 } };
 
@@ -104,6 +122,31 @@ void led_string_set(void) {
     led_string_fill(rgb);
 }
 
+STATIC_TASK(stream_task_memory, 256);
+
+// Shows streamed frames while the light is on, then goes back to the
+// HomeKit color once the stream stops
+void stream_task(void *_arg) {
+    bool streaming = false;
+
+    while (true) {
+        ws2812_pixel_t *frame = pixel_stream_wait(PIXEL_STREAM_TIMEOUT_MS);
+        if (frame) {
+            streaming = true;
+            xSemaphoreTake(pixels_lock, portMAX_DELAY);
+            if (led_on)
+                ws2812_i2s_update(frame, PIXEL_RGB);
+            xSemaphoreGive(pixels_lock);
+            pixel_stream_release();
+        } else if (streaming && !pixel_stream_active()) {
+            streaming = false;
+            xSemaphoreTake(pixels_lock, portMAX_DELAY);
+            led_string_set();
+            xSemaphoreGive(pixels_lock);
+        }
+    }
+}
+
 static void wifi_init() {
     struct sdk_station_config wifi_config = {
         .ssid = WIFI_SSID,
@@ -121,34 +164,48 @@ void led_init() {
 
     // initialise the LED strip
     ws2812_i2s_init(LED_COUNT, PIXEL_RGB);
+    pixels_lock = xSemaphoreCreateMutexStatic(&pixels_lock_buffer);
 
-    // set the initial state
+    // set the initial state, no other task runs yet
     led_string_set();
+
+    pixel_stream_init(PIXEL_STREAM_PORT, stream_buffers, sizeof(pixels));
+    static_task_create(&stream_task_memory, stream_task, "Stream", NULL, 2);
 }
 
-void led_identify_task(void *_args) {
+void led_identify_task(event_loop_coroutine_t *co) {
+    static int i, j;
     const ws2812_pixel_t COLOR_PINK = { { 255, 0, 127, 0 } };
     const ws2812_pixel_t COLOR_BLACK = { { 0, 0, 0, 0 } };
+    EVENT_LOOP_BEGIN(co);
 
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
             gpio_write(LED_INBUILT_GPIO, LED_ON);
+            xSemaphoreTake(pixels_lock, portMAX_DELAY);
             led_string_fill(COLOR_PINK);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            xSemaphoreGive(pixels_lock);
+            EVENT_LOOP_SLEEP(co, 100);
             gpio_write(LED_INBUILT_GPIO, 1 - LED_ON);
+            xSemaphoreTake(pixels_lock, portMAX_DELAY);
             led_string_fill(COLOR_BLACK);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            xSemaphoreGive(pixels_lock);
+            EVENT_LOOP_SLEEP(co, 100);
         }
-        vTaskDelay(250 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 250);
     }
 
+    xSemaphoreTake(pixels_lock, portMAX_DELAY);
     led_string_set();
-    vTaskDelete(NULL);
+    xSemaphoreGive(pixels_lock);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t led_identify_coroutine = EVENT_LOOP_COROUTINE(led_identify_task, NULL);
+
 void led_identify(homekit_value_t _value) {
     // printf("LED identify\n");
-    xTaskCreate(led_identify_task, "LED identify", 128, NULL, 2, NULL);
+    event_loop_start(&led_identify_coroutine);
 }
 
 homekit_value_t led_on_get() {
@@ -161,8 +218,10 @@ void led_on_set(homekit_value_t value) {
         return;
     }
 
+    xSemaphoreTake(pixels_lock, portMAX_DELAY);
     led_on = value.bool_value;
     led_string_set();
+    xSemaphoreGive(pixels_lock);
 }
 
 homekit_value_t led_brightness_get() {
@@ -173,8 +232,10 @@ void led_brightness_set(homekit_value_t value) {
         // printf("Invalid brightness-value format: %d\n", value.format);
         return;
     }
+    xSemaphoreTake(pixels_lock, portMAX_DELAY);
     led_brightness = value.int_value;
     led_string_set();
+    xSemaphoreGive(pixels_lock);
 }
 
 homekit_value_t led_hue_get() {
@@ -186,8 +247,10 @@ void led_hue_set(homekit_value_t value) {
         // printf("Invalid hue-value format: %d\n", value.format);
         return;
     }
+    xSemaphoreTake(pixels_lock, portMAX_DELAY);
     led_hue = value.float_value;
     led_string_set();
+    xSemaphoreGive(pixels_lock);
 }
 
 homekit_value_t led_saturation_get() {
@@ -199,11 +262,25 @@ void led_saturation_set(homekit_value_t value) {
         // printf("Invalid sat-value format: %d\n", value.format);
         return;
     }
+    xSemaphoreTake(pixels_lock, portMAX_DELAY);
     led_saturation = value.float_value;
     led_string_set();
+    xSemaphoreGive(pixels_lock);
 }
 
 homekit_characteristic_t name = HOMEKIT_CHARACTERISTIC_(NAME, "Sample LED Strip");
+homekit_characteristic_t lightbulb_on = HOMEKIT_CHARACTERISTIC_(
+    ON, true, .getter = led_on_get, .setter = led_on_set
+);
+homekit_characteristic_t lightbulb_brightness = HOMEKIT_CHARACTERISTIC_(
+    BRIGHTNESS, 100, .getter = led_brightness_get, .setter = led_brightness_set
+);
+homekit_characteristic_t lightbulb_hue = HOMEKIT_CHARACTERISTIC_(
+    HUE, 0, .getter = led_hue_get, .setter = led_hue_set
+);
+homekit_characteristic_t lightbulb_saturation = HOMEKIT_CHARACTERISTIC_(
+    SATURATION, 0, .getter = led_saturation_get, .setter = led_saturation_set
+);
 
 homekit_accessory_t *accessories[] = {
     HOMEKIT_ACCESSORY(.id = 1, .category = homekit_accessory_category_lightbulb, .services = (homekit_service_t*[]) {
@@ -218,26 +295,10 @@ homekit_accessory_t *accessories[] = {
         }),
         HOMEKIT_SERVICE(LIGHTBULB, .primary = true, .characteristics = (homekit_characteristic_t*[]) {
             HOMEKIT_CHARACTERISTIC(NAME, "Sample LED Strip"),
-            HOMEKIT_CHARACTERISTIC(
-                ON, true,
-                .getter = led_on_get,
-                .setter = led_on_set
-            ),
-            HOMEKIT_CHARACTERISTIC(
-                BRIGHTNESS, 100,
-                .getter = led_brightness_get,
-                .setter = led_brightness_set
-            ),
-            HOMEKIT_CHARACTERISTIC(
-                HUE, 0,
-                .getter = led_hue_get,
-                .setter = led_hue_set
-            ),
-            HOMEKIT_CHARACTERISTIC(
-                SATURATION, 0,
-                .getter = led_saturation_get,
-                .setter = led_saturation_set
-            ),
+            &lightbulb_on,
+            &lightbulb_brightness,
+            &lightbulb_hue,
+            &lightbulb_saturation,
             NULL
         }),
         NULL
@@ -250,9 +311,72 @@ homekit_server_config_t config = {
     .password = "111-11-111"
 };
 
+void local_control_get(local_control_state_t *state) {
+    xSemaphoreTake(pixels_lock, portMAX_DELAY);
+    state->hue = led_hue;
+    state->saturation = led_saturation;
+    state->brightness = led_brightness;
+    state->on = led_on;
+    xSemaphoreGive(pixels_lock);
+}
+
+// Same path as the HomeKit setters: the whole state changes at once, never
+// between a setter's change and its led_string_set
+void local_control_set(const local_control_state_t *state) {
+    xSemaphoreTake(pixels_lock, portMAX_DELAY);
+    led_hue = state->hue;
+    led_saturation = state->saturation;
+    led_brightness = state->brightness;
+    led_on = state->on;
+    led_string_set();
+    xSemaphoreGive(pixels_lock);
+}
+
+int local_control_effect(uint8_t effect, uint16_t argument) {
+    if (effect != LOCAL_CONTROL_EFFECT_IDENTIFY)
+        return -1;
+
+    event_loop_start(&led_identify_coroutine);
+    return 0;
+}
+
+// Shows the pixels as they are until the next state change
+int local_control_frame(uint16_t first, const uint8_t *rgb, uint16_t length) {
+    if (first + length / 3 > LED_COUNT)
+        return -1;
+
+    xSemaphoreTake(pixels_lock, portMAX_DELAY);
+    for (int i = 0; i < length / 3; i++) {
+        pixels[first + i].red = rgb[3 * i];
+        pixels[first + i].green = rgb[3 * i + 1];
+        pixels[first + i].blue = rgb[3 * i + 2];
+        pixels[first + i].white = 0;
+    }
+    ws2812_i2s_update(pixels, PIXEL_RGB);
+    xSemaphoreGive(pixels_lock);
+    return 0;
+}
+
+void local_control_settled() {
+    homekit_characteristic_notify(&lightbulb_on, led_on_get());
+    homekit_characteristic_notify(&lightbulb_brightness, led_brightness_get());
+    homekit_characteristic_notify(&lightbulb_hue, led_hue_get());
+    homekit_characteristic_notify(&lightbulb_saturation, led_saturation_get());
+}
+
+const local_control_handlers_t local_control_handlers = {
+    .get = local_control_get,
+    .set = local_control_set,
+    .effect = local_control_effect,
+    .frame = local_control_frame,
+    .settled = local_control_settled,
+};
+
 void user_init(void) {
     // uart_set_baud(0, 115200);
 
+    event_loop_init();
+
     // This example shows how to use same firmware for multiple similar accessories
     // without name conflicts. It uses the last 3 bytes of accessory's MAC address as
     // accessory name suffix.
@@ -266,4 +390,5 @@ void user_init(void) {
     wifi_init();
     led_init();
     homekit_server_init(&config);
+    local_control_init(LOCAL_CONTROL_PORT, LOCAL_CONTROL_KEY, &local_control_handlers);
 }
@@ -23,6 +23,8 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_loop.h>
+#include <work_queue.h>
 #include "wifi.h"
 
 #include "WS2812FX/WS2812FX.h"
@@ -92,28 +94,42 @@ static void wifi_init() {
 }
 
 
-void led_identify_task(void *_args) {
+void led_identify_task(event_loop_coroutine_t *co) {
+    static int i, j;
+    EVENT_LOOP_BEGIN(co);
+
     // initialise the onboard led as a secondary indicator (handy for testing)
     gpio_enable(LED_INBUILT_GPIO, GPIO_OUTPUT);
     
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
             gpio_write(LED_INBUILT_GPIO, (int)led_on_value);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
             gpio_write(LED_INBUILT_GPIO, 1 - (int)led_on_value);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
         }
-        vTaskDelay(250 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 250);
     }
 
     gpio_write(LED_INBUILT_GPIO, 1 - (int)led_on_value);
 
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t led_identify_coroutine = EVENT_LOOP_COROUTINE(led_identify_task, NULL);
+
 void led_identify(homekit_value_t _value) {
     // printf("LED identify\n");
-    xTaskCreate(led_identify_task, "LED identify", 128, NULL, 2, NULL);
+    event_loop_start(&led_identify_coroutine);
+}
+
+// Runs on the work queue, off the HomeKit server task
+void led_brightness_apply(void *_arg) {
+    if (led_on) {
+        WS2812FX_setBrightness((uint8_t)floor(led_brightness*2.55));
+    } else {
+        WS2812FX_setBrightness(0);
+    }
 }
 
 homekit_value_t led_on_get() {
@@ -127,13 +143,7 @@ void led_on_set(homekit_value_t value) {
     }
 
     led_on = value.bool_value;
-    
-    if (led_on) {
-        WS2812FX_setBrightness((uint8_t)floor(led_brightness*2.55));
-        
-    } else {
-        WS2812FX_setBrightness(0);
-    }
+    work_queue_post(led_brightness_apply, NULL, WORK_QUEUE_PRIORITY_NORMAL);
 }
 
 homekit_value_t led_brightness_get() {
@@ -146,8 +156,15 @@ void led_brightness_set(homekit_value_t value) {
         return;
     }
     led_brightness = value.int_value;
+    work_queue_post(led_brightness_apply, NULL, WORK_QUEUE_PRIORITY_NORMAL);
+}
+
+// Runs on the work queue, off the HomeKit server task
+void led_color_apply(void *_arg) {
+    ws2812_pixel_t rgb = { { 0, 0, 0, 0 } };
+    hsi2rgb(led_hue, led_saturation, 100, &rgb);
     
-    WS2812FX_setBrightness((uint8_t)floor(led_brightness*2.55));
+    WS2812FX_setColor(rgb.red, rgb.green, rgb.blue);
 }
 
 homekit_value_t led_hue_get() {
@@ -160,11 +177,7 @@ void led_hue_set(homekit_value_t value) {
         return;
     }
     led_hue = value.float_value;
-    
-    ws2812_pixel_t rgb = { { 0, 0, 0, 0 } };
-    hsi2rgb(led_hue, led_saturation, 100, &rgb);
-    
-    WS2812FX_setColor(rgb.red, rgb.green, rgb.blue);
+    work_queue_post(led_color_apply, NULL, WORK_QUEUE_PRIORITY_NORMAL);
 }
 
 homekit_value_t led_saturation_get() {
@@ -177,11 +190,7 @@ void led_saturation_set(homekit_value_t value) {
         return;
     }
     led_saturation = value.float_value;
-    
-    ws2812_pixel_t rgb = { { 0, 0, 0, 0 } };
-    hsi2rgb(led_hue, led_saturation, 100, &rgb);
-    
-    WS2812FX_setColor(rgb.red, rgb.green, rgb.blue);
+    work_queue_post(led_color_apply, NULL, WORK_QUEUE_PRIORITY_NORMAL);
 }
 
 homekit_value_t fx_on_get() {
@@ -324,6 +333,9 @@ homekit_server_config_t config = {
 void user_init(void) {
     // uart_set_baud(0, 115200);
 
+    event_loop_init();
+    work_queue_init();
+
     // This example shows how to use same firmware for multiple similar accessories
     // without name conflicts. It uses the last 3 bytes of accessory's MAC address as
     // accessory name suffix.
@@ -17,6 +17,7 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_loop.h>
 #include <wifi_config.h>
 
 #include "button.h"
@@ -46,37 +47,43 @@ void led_write(bool on) {
     gpio_write(led_gpio, on ? 0 : 1);
 }
 
-void reset_configuration_task() {
+void reset_configuration_task(event_loop_coroutine_t *co) {
+    static int i;
+    EVENT_LOOP_BEGIN(co);
+
     //Flash the LED first before we start the reset
-    for (int i=0; i<3; i++) {
+    for (i=0; i<3; i++) {
         led_write(true);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 100);
         led_write(false);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 100);
     }
 
     printf("Resetting Wifi Config\n");
 
     wifi_config_reset();
 
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    EVENT_LOOP_SLEEP(co, 1000);
 
     printf("Resetting HomeKit Config\n");
 
     homekit_server_reset();
 
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    EVENT_LOOP_SLEEP(co, 1000);
 
     printf("Restarting\n");
 
     sdk_system_restart();
 
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t reset_configuration_coroutine = EVENT_LOOP_COROUTINE(reset_configuration_task, NULL);
+
 void reset_configuration() {
     printf("Resetting configuration\n");
-    xTaskCreate(reset_configuration_task, "Reset configuration", 256, NULL, 2, NULL);
+    // called from the button interrupt
+    event_loop_start_from_isr(&reset_configuration_coroutine);
 }
 
 void gpio_init() {
@@ -262,6 +269,8 @@ void create_accessory_name() {
 void user_init(void) {
     uart_set_baud(0, 115200);
 
+    event_loop_init();
+
     create_accessory_name();
 
     wifi_config_init("lock", NULL, on_wifi_ready);
@@ -22,6 +22,10 @@
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
 #include <wifi_config.h>
+#include <seqlock.h>
+#include <event_loop.h>
+#include <static_task.h>
+#include <local_control.h>
 
 #include "multipwm.h"
 
@@ -47,11 +51,23 @@ typedef union {
 rgb_color_t current_color = { { 0, 0, 0, 0 } };
 rgb_color_t target_color = { { 0, 0, 0, 0 } };
 
-// Global variables
-float led_hue = 0;              // hue is scaled 0 to 360
-float led_saturation = 59;      // saturation is scaled 0 to 100
-float led_brightness = 100;     // brightness is scaled 0 to 100
-bool led_on = false;            // on is boolean on or off
+// Global variables, set by HomeKit and read together by multipwm_task
+typedef struct {
+    float hue;                  // hue is scaled 0 to 360
+    float saturation;           // saturation is scaled 0 to 100
+    float brightness;           // brightness is scaled 0 to 100
+    bool on;                    // on is boolean on or off
+} led_state_t;
+
+led_state_t led_state = { .hue = 0, .saturation = 59, .brightness = 100, .on = false };
+seqlock_t led_state_lock = SEQLOCK_INIT;
+
+#define LED_STATE_SET(field, value) \
+    do { \
+        taskENTER_CRITICAL(); \
+        SEQLOCK_WRITE(&led_state_lock, led_state.field, value); \
+        taskEXIT_CRITICAL(); \
+    } while (0)
 
 //http://blog.saikoled.com/post/44677718712/how-to-convert-from-hsi-to-rgb-white
 static void hsi2rgb(float h, float s, float i, rgb_color_t* rgb) {
@@ -89,36 +105,42 @@ static void hsi2rgb(float h, float s, float i, rgb_color_t* rgb) {
     rgb->blue = (uint8_t) b;
 }
 
-void led_identify_task(void *_args) {
+void led_identify_task(event_loop_coroutine_t *co) {
+    static rgb_color_t color;
+    static int i, j;
+    const rgb_color_t black_color = { { 0, 0, 0, 0 } };
+    const rgb_color_t white_color = { { 128, 128, 128, 128 } };
+    EVENT_LOOP_BEGIN(co);
+
     printf("LED identify\n");
     
-    rgb_color_t color = target_color;
-    rgb_color_t black_color = { { 0, 0, 0, 0 } };
-    rgb_color_t white_color = { { 128, 128, 128, 128 } };
+    color = target_color;
     
-    for (int i=0; i<3; i++) {
-        for (int j=0; j<2; j++) {
+    for (i=0; i<3; i++) {
+        for (j=0; j<2; j++) {
             target_color = white_color;
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
             
             target_color = black_color;
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
         }
 
-        vTaskDelay(250 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 250);
     }
 
     target_color = color;
 
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t led_identify_coroutine = EVENT_LOOP_COROUTINE(led_identify_task, NULL);
+
 void led_identify(homekit_value_t _value) {
-    xTaskCreate(led_identify_task, "LED identify", 128, NULL, 2, NULL);
+    event_loop_start(&led_identify_coroutine);
 }
 
 homekit_value_t led_on_get() {
-    return HOMEKIT_BOOL(led_on);
+    return HOMEKIT_BOOL(led_state.on);
 }
 
 void led_on_set(homekit_value_t value) {
@@ -127,11 +149,11 @@ void led_on_set(homekit_value_t value) {
         return;
     }
 
-    led_on = value.bool_value;
+    LED_STATE_SET(on, value.bool_value);
 }
 
 homekit_value_t led_brightness_get() {
-    return HOMEKIT_INT(led_brightness);
+    return HOMEKIT_INT(led_state.brightness);
 }
 
 void led_brightness_set(homekit_value_t value) {
@@ -139,11 +161,11 @@ void led_brightness_set(homekit_value_t value) {
         // printf("Invalid brightness-value format: %d\n", value.format);
         return;
     }
-    led_brightness = value.int_value;
+    LED_STATE_SET(brightness, value.int_value);
 }
 
 homekit_value_t led_hue_get() {
-    return HOMEKIT_FLOAT(led_hue);
+    return HOMEKIT_FLOAT(led_state.hue);
 }
 
 void led_hue_set(homekit_value_t value) {
@@ -151,11 +173,11 @@ void led_hue_set(homekit_value_t value) {
         // printf("Invalid hue-value format: %d\n", value.format);
         return;
     }
-    led_hue = value.float_value;
+    LED_STATE_SET(hue, value.float_value);
 }
 
 homekit_value_t led_saturation_get() {
-    return HOMEKIT_FLOAT(led_saturation);
+    return HOMEKIT_FLOAT(led_state.saturation);
 }
 
 void led_saturation_set(homekit_value_t value) {
@@ -163,10 +185,22 @@ void led_saturation_set(homekit_value_t value) {
         // printf("Invalid sat-value format: %d\n", value.format);
         return;
     }
-    led_saturation = value.float_value;
+    LED_STATE_SET(saturation, value.float_value);
 }
 
 homekit_characteristic_t name = HOMEKIT_CHARACTERISTIC_(NAME, "LED Strip");
+homekit_characteristic_t lightbulb_on = HOMEKIT_CHARACTERISTIC_(
+    ON, true, .getter = led_on_get, .setter = led_on_set
+);
+homekit_characteristic_t lightbulb_brightness = HOMEKIT_CHARACTERISTIC_(
+    BRIGHTNESS, 100, .getter = led_brightness_get, .setter = led_brightness_set
+);
+homekit_characteristic_t lightbulb_hue = HOMEKIT_CHARACTERISTIC_(
+    HUE, 0, .getter = led_hue_get, .setter = led_hue_set
+);
+homekit_characteristic_t lightbulb_saturation = HOMEKIT_CHARACTERISTIC_(
+    SATURATION, 0, .getter = led_saturation_get, .setter = led_saturation_set
+);
 
 homekit_accessory_t *accessories[] = {
     HOMEKIT_ACCESSORY(.id = 1, .category = homekit_accessory_category_lightbulb, .services = (homekit_service_t*[]) {
@@ -181,26 +215,10 @@ homekit_accessory_t *accessories[] = {
         }),
         HOMEKIT_SERVICE(LIGHTBULB, .primary = true, .characteristics = (homekit_characteristic_t*[]) {
             HOMEKIT_CHARACTERISTIC(NAME, "LED Strip"),
-            HOMEKIT_CHARACTERISTIC(
-                ON, true,
-                .getter = led_on_get,
-                .setter = led_on_set
-            ),
-            HOMEKIT_CHARACTERISTIC(
-                BRIGHTNESS, 100,
-                .getter = led_brightness_get,
-                .setter = led_brightness_set
-            ),
-            HOMEKIT_CHARACTERISTIC(
-                HUE, 0,
-                .getter = led_hue_get,
-                .setter = led_hue_set
-            ),
-            HOMEKIT_CHARACTERISTIC(
-                SATURATION, 0,
-                .getter = led_saturation_get,
-                .setter = led_saturation_set
-            ),
+            &lightbulb_on,
+            &lightbulb_brightness,
+            &lightbulb_hue,
+            &lightbulb_saturation,
             NULL
         }),
         NULL
@@ -213,6 +231,8 @@ homekit_server_config_t config = {
     .password = "190-11-978"    //changed tobe valid
 };
 
+STATIC_TASK(multipwm_task_memory, 256);
+
 IRAM void multipwm_task(void *pvParameters) {
     const TickType_t xPeriod = pdMS_TO_TICKS(LPF_INTERVAL);
     TickType_t xLastWakeTime = xTaskGetTickCount();
@@ -229,9 +249,12 @@ IRAM void multipwm_task(void *pvParameters) {
     }
 
     while(1) {
-        if (led_on) {
+        led_state_t state;
+        SEQLOCK_READ(&led_state_lock, state, led_state);
+
+        if (state.on) {
             // convert HSI to RGBW
-            hsi2rgb(led_hue, led_saturation, led_brightness, &target_color);
+            hsi2rgb(state.hue, state.saturation, state.brightness, &target_color);
         } else {
             target_color.red = 0;
             target_color.green = 0;
@@ -252,13 +275,65 @@ IRAM void multipwm_task(void *pvParameters) {
     }
 }
 
+// Local control writes the same state as HomeKit, so multipwm_task fades
+// to it as it does for HomeKit writes
+
+void local_control_get(local_control_state_t *state) {
+    led_state_t led;
+    SEQLOCK_READ(&led_state_lock, led, led_state);
+
+    state->hue = led.hue;
+    state->saturation = led.saturation;
+    state->brightness = led.brightness;
+    state->on = led.on;
+}
+
+void local_control_set(const local_control_state_t *state) {
+    led_state_t led = {
+        .hue = state->hue,
+        .saturation = state->saturation,
+        .brightness = state->brightness,
+        .on = state->on,
+    };
+
+    taskENTER_CRITICAL();
+    SEQLOCK_WRITE(&led_state_lock, led_state, led);
+    taskEXIT_CRITICAL();
+}
+
+int local_control_effect(uint8_t effect, uint16_t argument) {
+    if (effect != LOCAL_CONTROL_EFFECT_IDENTIFY)
+        return -1;
+
+    event_loop_start(&led_identify_coroutine);
+    return 0;
+}
+
+void local_control_settled() {
+    homekit_characteristic_notify(&lightbulb_on, led_on_get());
+    homekit_characteristic_notify(&lightbulb_brightness, led_brightness_get());
+    homekit_characteristic_notify(&lightbulb_hue, led_hue_get());
+    homekit_characteristic_notify(&lightbulb_saturation, led_saturation_get());
+}
+
+// No pixels to push frames to on a PWM strip
+const local_control_handlers_t local_control_handlers = {
+    .get = local_control_get,
+    .set = local_control_set,
+    .effect = local_control_effect,
+    .settled = local_control_settled,
+};
+
 void on_wifi_ready() {
     homekit_server_init(&config);
+    local_control_init(LOCAL_CONTROL_PORT, LOCAL_CONTROL_KEY, &local_control_handlers);
 }
 
 void user_init(void) {
     //uart_set_baud(0, 115200);
     
+    event_loop_init();
+
     // This example shows how to use same firmware for multiple similar accessories
     // without name conflicts. It uses the last 3 bytes of accessory's MAC address as
     // accessory name suffix.
@@ -271,5 +346,5 @@ void user_init(void) {
 
     wifi_config_init("MagicHome Led Strip", NULL, on_wifi_ready);
     
-    xTaskCreate(multipwm_task, "multipwm", 256, NULL, 2, NULL);
+    static_task_create(&multipwm_task_memory, multipwm_task, "multipwm", NULL, 2);
 }
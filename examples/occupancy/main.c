@@ -7,6 +7,9 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_subscribers.h>
+#include <config_store.h>
+#include <mqtt_telemetry.h>
 
 #include <toggle.h>
 #include <wifi_config.h>
@@ -16,6 +19,10 @@
 #error SENSOR_PIN is not specified
 #endif
 
+// GPIO of the sensor: the "sensor_pin" key of the config store, SENSOR_PIN
+// on devices without it
+static uint8_t sensor_pin = SENSOR_PIN;
+
 
 void occupancy_identify(homekit_value_t _value) {
     printf("Occupancy identify\n");
@@ -27,7 +34,7 @@ homekit_characteristic_t occupancy_detected = HOMEKIT_CHARACTERISTIC_(OCCUPANCY_
 
 void sensor_callback(bool high, void *context) {
     occupancy_detected.value = HOMEKIT_UINT8(high ? 1 : 0);
-    homekit_characteristic_notify(&occupancy_detected, occupancy_detected.value);
+    EVENT_SUBSCRIBERS_NOTIFY(&occupancy_detected, occupancy_detected.value);
 }
 
 
@@ -53,6 +60,14 @@ homekit_accessory_t *accessories[] = {
 };
 
 
+// Changes go to the broker of the build as well (make MQTT_HOST=...)
+void telemetry_init() {
+    mqtt_telemetry_add(&occupancy_detected, "occupancy");
+    mqtt_telemetry_set_credentials(MQTT_TELEMETRY_USER, MQTT_TELEMETRY_PASSWORD);
+    mqtt_telemetry_init(MQTT_TELEMETRY_HOST, MQTT_TELEMETRY_PORT, "occupancy-sensor");
+}
+
+
 static bool homekit_initialized = false;
 static homekit_server_config_t config = {
     .accessories = accessories,
@@ -73,9 +88,15 @@ void on_wifi_config_event(wifi_config_event_t event) {
 void user_init(void) {
     uart_set_baud(0, 115200);
 
+    if (config_store_init() < 0) {
+        printf("Failed to read the configuration\n");
+    }
+    sensor_pin = config_store_get_int("sensor_pin", SENSOR_PIN);
+
     wifi_config_init2("occupancy-sensor", NULL, on_wifi_config_event);
+    telemetry_init();
 
-    if (toggle_create(SENSOR_PIN, sensor_callback, NULL)) {
+    if (toggle_create(sensor_pin, sensor_callback, NULL)) {
         printf("Failed to initialize sensor\n");
     }
 }
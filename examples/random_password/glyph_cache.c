@@ -0,0 +1,78 @@
+#include <string.h>
+#include "glyph_cache.h"
+
+#define GLYPH_COUNT 11
+#define GLYPH_DASH 10
+
+// Pages the tallest glyph spans from the last row of a page
+#define GLYPH_MAX_PAGES ((7 + GLYPH_CACHE_MAX_HEIGHT + 7) / 8)
+
+static uint8_t glyphs[GLYPH_COUNT][GLYPH_MAX_PAGES][GLYPH_CACHE_MAX_WIDTH];
+static uint8_t glyph_widths[GLYPH_COUNT];
+static uint8_t glyph_spacing;
+static uint8_t first_page;
+static uint8_t page_count = 0;
+
+
+static int glyph_index(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    return c == '-' ? GLYPH_DASH : -1;
+}
+
+
+int glyph_cache_init(const ssd1306_t *dev, const font_info_t *font, uint8_t y) {
+    page_count = 0;
+    if (font->height > GLYPH_CACHE_MAX_HEIGHT || y + font->height > dev->height)
+        return -1;
+
+    memset(glyphs, 0, sizeof(glyphs));
+    for (int g = 0; g < GLYPH_COUNT; g++) {
+        const font_char_desc_t *d = font_get_char_desc(font, g == GLYPH_DASH ? '-' : '0' + g);
+        if (!d || d->width > GLYPH_CACHE_MAX_WIDTH)
+            return -1;
+
+        // Rows of the font bitmap, most significant bit first, become
+        // bits of the columns of each page, row 0 in the least significant
+        const uint8_t *bitmap = font->bitmap + d->offset;
+        uint8_t stride = (d->width + 7) / 8;
+        for (int j = 0; j < font->height; j++) {
+            uint8_t row = y % 8 + j;
+            for (int i = 0; i < d->width; i++) {
+                if (bitmap[stride * j + i / 8] & (0x80 >> (i % 8)))
+                    glyphs[g][row / 8][i] |= 1 << (row % 8);
+            }
+        }
+        glyph_widths[g] = d->width;
+    }
+
+    glyph_spacing = font->c;
+    first_page = y / 8;
+    page_count = (y % 8 + font->height + 7) / 8;
+    return 0;
+}
+
+
+int glyph_cache_draw_string(const ssd1306_t *dev, uint8_t *fb, uint8_t x, const char *str) {
+    if (!page_count)
+        return -1;
+
+    // All or nothing, so that the caller can draw it the slow way instead
+    int width = 0;
+    for (const char *c = str; *c; c++) {
+        int g = glyph_index(*c);
+        if (g < 0)
+            return -1;
+        width += glyph_widths[g] + (c[1] ? glyph_spacing : 0);
+    }
+    if (x + width > dev->width)
+        return -1;
+
+    for (const char *c = str; *c; c++) {
+        int g = glyph_index(*c);
+        for (int p = 0; p < page_count; p++)
+            memcpy(fb + (first_page + p) * dev->width + x, glyphs[g][p], glyph_widths[g]);
+        x += glyph_widths[g] + glyph_spacing;
+    }
+    return width;
+}
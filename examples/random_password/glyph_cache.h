@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <ssd1306/ssd1306.h>
+#include <fonts/fonts.h>
+
+// Glyphs of a password (digits and '-') kept in the layout of the SSD1306
+// frame buffer: one byte per column of 8 rows, already shifted to the row
+// the text is drawn at. Drawing a password is then a few memcpy's per
+// character instead of a ssd1306_draw_pixel call for every pixel of it.
+//
+// White on a buffer cleared to black only, as display_password draws.
+
+#define GLYPH_CACHE_MAX_WIDTH 12
+#define GLYPH_CACHE_MAX_HEIGHT 24
+
+/**
+    Transposes the digits and '-' of font for text with its top at row y.
+
+    @return A negative integer if this method fails: a glyph is missing or
+            larger than the cache, or the text would not fit on the display.
+*/
+int glyph_cache_init(const ssd1306_t *dev, const font_info_t *font, uint8_t y);
+
+/**
+    Draws str as ssd1306_draw_string would with the font and row given to
+    glyph_cache_init, from column x, into fb cleared to black.
+
+    @return The width drawn, or a negative integer if the cache is not
+            ready, str has other characters or does not fit. Nothing is
+            drawn then.
+*/
+int glyph_cache_draw_string(const ssd1306_t *dev, uint8_t *fb, uint8_t x, const char *str);
@@ -11,6 +11,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <espressif/esp_wifi.h>
 #include <espressif/esp_sta.h>
 #include <espressif/esp_common.h>
@@ -27,7 +28,9 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_loop.h>
 #include "wifi.h"
+#include "glyph_cache.h"
 
 
 #define QRCODE_VERSION 2
@@ -41,6 +44,9 @@
 #define DEFAULT_FONT FONT_FACE_TERMINUS_BOLD_12X24_ISO8859_1
 // #define DEFAULT_FONT FONTS_TERMINUS_6X12_ISO8859_1
 
+#define PASSWORD_X 4
+#define PASSWORD_Y 20
+
 static const ssd1306_t display = {
     .protocol = SSD1306_PROTO_I2C,
     .screen = SSD1306_SCREEN,
@@ -61,14 +67,18 @@ void display_init() {
     ssd1306_set_whole_display_lighting(&display, false);
     ssd1306_set_scan_direction_fwd(&display, false);
     ssd1306_set_segment_remapping_enabled(&display, true);
+
+    if (glyph_cache_init(&display, font_builtin_fonts[DEFAULT_FONT], PASSWORD_Y))
+        printf("Failed to cache password glyphs, drawing them pixel by pixel\n");
 }
 
 bool password_displayed = false;
 void display_password(const char *password) {
     ssd1306_display_on(&display, true);
 
-    ssd1306_fill_rectangle(&display, display_buffer, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, OLED_COLOR_BLACK);
-    ssd1306_draw_string(&display, display_buffer, font_builtin_fonts[DEFAULT_FONT], 4, 20, (char*)password, OLED_COLOR_WHITE, OLED_COLOR_BLACK);
+    memset(display_buffer, 0, sizeof(display_buffer));
+    if (glyph_cache_draw_string(&display, display_buffer, PASSWORD_X, password) < 0)
+        ssd1306_draw_string(&display, display_buffer, font_builtin_fonts[DEFAULT_FONT], PASSWORD_X, PASSWORD_Y, (char*)password, OLED_COLOR_WHITE, OLED_COLOR_BLACK);
 
     ssd1306_load_frame_buffer(&display, display_buffer);
 
@@ -108,26 +118,31 @@ void led_init() {
     led_write(led_on);
 }
 
-void led_identify_task(void *_args) {
-    for (int i=0; i<3; i++) {
-        for (int j=0; j<2; j++) {
+void led_identify_task(event_loop_coroutine_t *co) {
+    static int i, j;
+    EVENT_LOOP_BEGIN(co);
+
+    for (i=0; i<3; i++) {
+        for (j=0; j<2; j++) {
             led_write(true);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
             led_write(false);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
         }
 
-        vTaskDelay(250 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 250);
     }
 
     led_write(led_on);
 
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t led_identify_coroutine = EVENT_LOOP_COROUTINE(led_identify_task, NULL);
+
 void led_identify(homekit_value_t _value) {
     printf("LED identify\n");
-    xTaskCreate(led_identify_task, "LED identify", 128, NULL, 2, NULL);
+    event_loop_start(&led_identify_coroutine);
 }
 
 homekit_value_t led_on_get() {
@@ -190,6 +205,8 @@ homekit_server_config_t config = {
 void user_init(void) {
     uart_set_baud(0, 115200);
 
+    event_loop_init();
+
     display_init();
 
     wifi_init();
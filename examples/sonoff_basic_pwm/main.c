@@ -33,6 +33,8 @@ modified to do pulse-width-modulation (PWM) of LED
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_loop.h>
+#include <factory_reset.h>
 #include <wifi_config.h>
 #include "wifi.h"
 
@@ -64,29 +66,29 @@ void led_write(bool on) {
 }
 
 
-void reset_configuration_task() {
+void reset_configuration_task(event_loop_coroutine_t *co) {
+    static int i;
+    EVENT_LOOP_BEGIN(co);
+
     //Flash the LED first before we start the reset
-    for (int i=0; i<3; i++) {
+    for (i=0; i<3; i++) {
         led_write(true);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 100);
         led_write(false);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 100);
     }
-    printf("Resetting Wifi Config\n");
-    wifi_config_reset();
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-    printf("Resetting HomeKit Config\n");
-    homekit_server_reset();
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-     
     printf("Restarting\n");
-    sdk_system_restart();
-    vTaskDelete(NULL);
+    // Erases happen after the restart, see factory_reset_init
+    factory_reset();
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t reset_configuration_coroutine = EVENT_LOOP_COROUTINE(reset_configuration_task, NULL);
+
 void reset_configuration() {
     printf("Resetting Sonoff configuration\n");
-    xTaskCreate(reset_configuration_task, "Reset configuration", 256, NULL, 2, NULL);
+    // called from the button interrupt
+    event_loop_start_from_isr(&reset_configuration_coroutine);
 }
 
 
@@ -109,7 +111,12 @@ void gpio_init() {
 }
 
 
-void lightSET_task(void *pvParameters) {
+// Set while a lightSET_task is queued, it reads on and bri when it runs
+static volatile bool light_set_pending = false;
+
+void lightSET_task(void *_args) {
+    light_set_pending = false;
+
     int w;
     if (on) {
         w = (UINT16_MAX - UINT16_MAX*bri/100);
@@ -119,12 +126,24 @@ void lightSET_task(void *pvParameters) {
         printf("OFF\n");
         pwm_set_duty(UINT16_MAX);
     }
-    vTaskDelete(NULL);
 }
 
 
 void lightSET() {
-    xTaskCreate(lightSET_task, "Light Set", 256, NULL, 2, NULL);
+    if (light_set_pending)
+        return;
+    light_set_pending = true;
+    if (!event_loop_post(lightSET_task, NULL))
+        light_set_pending = false;
+}
+
+
+void lightSET_from_isr() {
+    if (light_set_pending)
+        return;
+    light_set_pending = true;
+    if (!event_loop_post_from_isr(lightSET_task, NULL))
+        light_set_pending = false;
 }
 
 
@@ -206,7 +225,7 @@ void button_callback(uint8_t gpio, button_event_t event) {
             printf("Toggling lightbulb due to button at GPIO %2d\n", gpio);
             lightbulb_on.value.bool_value = !lightbulb_on.value.bool_value;
             on = lightbulb_on.value.bool_value;
-            lightSET();
+            lightSET_from_isr();
             homekit_characteristic_notify(&lightbulb_on, lightbulb_on.value);
             break;
         case button_event_long_press:
@@ -223,7 +242,7 @@ void toggle_callback(uint8_t gpio) {
     printf("Toggling lightbulb due to switch at GPIO %2d\n", gpio);
     lightbulb_on.value.bool_value = !lightbulb_on.value.bool_value;
     on = lightbulb_on.value.bool_value;
-    lightSET();
+    lightSET_from_isr();
     homekit_characteristic_notify(&lightbulb_on, lightbulb_on.value);
 }
 
@@ -282,8 +301,14 @@ void create_accessory_name() {
 
 void user_init(void) {
     uart_set_baud(0, 115200);
+
+    event_loop_init();
     create_accessory_name();
 
+    if (factory_reset_init(wifi_config_reset) < 0) {
+        printf("Failed to complete the factory reset\n");
+    }
+
 /*
     wifi_init();                                                   //testing
     homekit_server_init(&config);                                  //testing
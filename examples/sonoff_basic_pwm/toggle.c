@@ -1,5 +1,6 @@
 #include <string.h>
 #include <esplibs/libmain.h>
+#include <common_macros.h>
 #include "toggle.h"
 
 
@@ -18,7 +19,7 @@ typedef struct _toggle {
 toggle_t *toggles = NULL;
 
 
-static toggle_t *toggle_find_by_gpio(const uint8_t gpio_num) {
+IRAM static toggle_t *toggle_find_by_gpio(const uint8_t gpio_num) {
     toggle_t *toggle = toggles;
     while (toggle && toggle->gpio_num != gpio_num)
         toggle = toggle->next;
@@ -30,7 +31,7 @@ static toggle_t *toggle_find_by_gpio(const uint8_t gpio_num) {
 
 
 
-void toggle_intr_callback(uint8_t gpio) {
+IRAM void toggle_intr_callback(uint8_t gpio) {
     toggle_t *toggle = toggle_find_by_gpio(gpio);
     if (!toggle)
         return;
@@ -38,7 +38,13 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_loop.h>
+#include <event_subscribers.h>
+#include <factory_reset.h>
 #include <wifi_config.h>
+#include <relay_limiter.h>
+#include <cpu_usage.h>
+#include <metrics.h>
 
 #include "button.h"
 
@@ -49,6 +55,16 @@ const int led_gpio = 13;
 // The GPIO pin that is connected to the button on the Sonoff Basic.
 const int button_gpio = 0;
 
+// Minimum time the relay stays in a state and how long to wait for
+// further writes from HomeKit before switching it, in milliseconds.
+const uint16_t relay_min_dwell_time = 1000;
+const uint16_t relay_coalesce_time = 200;
+
+// TCP port serving per-task CPU usage: nc <sonoff> 3334
+const uint16_t cpu_usage_port = 3334;
+
+// HTTP port serving Prometheus metrics: curl http://<sonoff>:9100/metrics
+const uint16_t metrics_port = METRICS_PORT;
 
 // NEW
 #include "toggle.h"
@@ -65,32 +81,40 @@ void relay_write(bool on) {
     gpio_write(relay_gpio, on ? 1 : 0);
 }
 
+void relay_limiter_callback(uint8_t gpio, bool on) {
+    relay_write(on);
+}
+
+// Without a limiter the relay is written directly
+static bool relay_limited = false;
+
 void led_write(bool on) {
     gpio_write(led_gpio, on ? 0 : 1);
 }
 
-void reset_configuration_task() {
+void reset_configuration_task(event_loop_coroutine_t *co) {
+    static int i;
+    EVENT_LOOP_BEGIN(co);
+
     //Flash the LED first before we start the reset
-    for (int i=0; i<3; i++) {
+    for (i=0; i<3; i++) {
         led_write(true);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 100);
         led_write(false);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 100);
     }
-    printf("Resetting Wifi Config\n");
-    wifi_config_reset();
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-    printf("Resetting HomeKit Config\n");
-    homekit_server_reset();
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
     printf("Restarting\n");
-    sdk_system_restart();
-    vTaskDelete(NULL);
+    // Erases happen after the restart, see factory_reset_init
+    factory_reset();
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t reset_configuration_coroutine = EVENT_LOOP_COROUTINE(reset_configuration_task, NULL);
+
 void reset_configuration() {
     printf("Resetting Sonoff configuration\n");
-    xTaskCreate(reset_configuration_task, "Reset configuration", 256, NULL, 2, NULL);
+    // called from the button interrupt
+    event_loop_start_from_isr(&reset_configuration_coroutine);
 }
 
 homekit_characteristic_t switch_on = HOMEKIT_CHARACTERISTIC_(
@@ -102,13 +126,25 @@ void gpio_init() {
     led_write(false);
     gpio_enable(relay_gpio, GPIO_OUTPUT);
     relay_write(switch_on.value.bool_value);
+    relay_limited = relay_limiter_create(relay_gpio, switch_on.value.bool_value, relay_min_dwell_time,
+                                         relay_coalesce_time, relay_limiter_callback) == 0;
+    if (!relay_limited)
+        printf("Failed to limit the relay, switching it directly\n");
     // NEW
     gpio_enable(toggle_gpio, GPIO_INPUT);
     //
 }
 
 void switch_on_callback(homekit_characteristic_t *_ch, homekit_value_t on, void *context) {
-    relay_write(switch_on.value.bool_value);
+    if (relay_limited)
+        relay_limiter_write(relay_gpio, switch_on.value.bool_value);
+    else
+        relay_write(switch_on.value.bool_value);
+}
+
+// Posted by the button interrupt and the toggle task, notifies on the event loop
+void switch_notify(void *arg) {
+    EVENT_SUBSCRIBERS_NOTIFY(&switch_on, switch_on.value);
 }
 
 void button_callback(uint8_t gpio, button_event_t event) {
@@ -116,8 +152,11 @@ void button_callback(uint8_t gpio, button_event_t event) {
         case button_event_single_press:
             printf("Toggling relay due to button at GPIO %2d\n", gpio);
             switch_on.value.bool_value = !switch_on.value.bool_value;
-            relay_write(switch_on.value.bool_value);
-            homekit_characteristic_notify(&switch_on, switch_on.value);
+            if (relay_limited)
+                relay_limiter_override_from_isr(relay_gpio, switch_on.value.bool_value);
+            else
+                relay_write(switch_on.value.bool_value);
+            event_loop_post_from_isr(switch_notify, NULL);
             break;
         case button_event_long_press:
             reset_configuration();
@@ -132,8 +171,12 @@ void button_callback(uint8_t gpio, button_event_t event) {
 void toggle_callback(uint8_t gpio) {
             printf("Toggling relay due to switch at GPIO %2d\n", gpio);
             switch_on.value.bool_value = !switch_on.value.bool_value;
-            relay_write(switch_on.value.bool_value);
-            homekit_characteristic_notify(&switch_on, switch_on.value);
+            // On the toggle task, not in an interrupt
+            if (relay_limited)
+                relay_limiter_override(relay_gpio, switch_on.value.bool_value);
+            else
+                relay_write(switch_on.value.bool_value);
+            event_loop_post(switch_notify, NULL);
 }
 //
 
@@ -187,8 +230,34 @@ homekit_server_config_t config = {
 //    .password = "111-11-111"    //default easy
 };
 
+void write_switch_metrics(metrics_writer_t *w, void *context) {
+    uint32_t sent, skipped;
+    event_subscribers_stats(&sent, &skipped);
+    metrics_header(w, "esp_homekit_notifies_total", "counter", "Characteristic changes notified or skipped.");
+    metrics_sample(w, "esp_homekit_notifies_total", "result=\"sent\"", sent, 0);
+    metrics_sample(w, "esp_homekit_notifies_total", "result=\"skipped\"", skipped, 0);
+    metrics_gauge(w, "esp_switch_on", "State of the relay.", switch_on.value.bool_value);
+    metrics_counter(w, "esp_relay_dropped_total", "Relay changes superseded before they were applied.",
+                    relay_limiter_dropped(relay_gpio));
+}
+
+void write_event_loop_metrics(metrics_writer_t *w, void *context) {
+    event_loop_stats_t stats;
+    event_loop_get_stats(&stats);
+    metrics_histogram(w, "esp_event_loop_wait_seconds", "Time from a post to its callback.",
+                      event_loop_latency_bounds_us, stats.wait_buckets, EVENT_LOOP_LATENCY_BUCKETS,
+                      stats.wait_sum_us);
+    metrics_histogram(w, "esp_event_loop_run_seconds", "Time a posted callback took.",
+                      event_loop_latency_bounds_us, stats.run_buckets, EVENT_LOOP_LATENCY_BUCKETS,
+                      stats.run_sum_us);
+    metrics_gauge(w, "esp_event_loop_stack_free_words", "Stack of the event loop never used so far.",
+                  stats.stack_free);
+}
+
 void on_wifi_ready() {
     homekit_server_init(&config);
+    cpu_usage_serve(cpu_usage_port);
+    metrics_init(metrics_port);
 }
 
 void create_accessory_name() {
@@ -207,7 +276,15 @@ void create_accessory_name() {
 
 void user_init(void) {
     uart_set_baud(0, 115200);
+
+    event_loop_init();
+    cpu_usage_init();
+    metrics_add(write_switch_metrics, NULL);
+    metrics_add(write_event_loop_metrics, NULL);
     create_accessory_name();
+    if (factory_reset_init(wifi_config_reset) < 0) {
+        printf("Failed to complete the factory reset\n");
+    }
     wifi_config_init("Sonoff Basic", NULL, on_wifi_ready);
     gpio_init();
 
@@ -1,5 +1,6 @@
 #include <string.h>
 #include <esplibs/libmain.h>
+#include <static_task.h>
 #include "toggle.h"
 
 #define LPF_SHIFT 3  // divide by 8
@@ -30,6 +31,8 @@ static toggle_t *toggle_find_by_gpio(const uint8_t gpio_num) {
     return toggle;
 }
 
+STATIC_TASK(toggle_task_memory, 255);
+
 void toggleService(void *_args) {
     const TickType_t xPeriod = pdMS_TO_TICKS(LPF_INTERVAL);
     TickType_t xLastWakeTime = xTaskGetTickCount();
@@ -56,11 +59,9 @@ void toggleService(void *_args) {
 
 int toggle_create(const uint8_t gpio_num, toggle_callback_fn callback) {
     if (task_handle == NULL) {
-        BaseType_t created = xTaskCreate(toggleService, "toggleService", 255, NULL, 2, &task_handle);
-        if (created != pdPASS) {
-            task_handle = NULL;   
+        task_handle = static_task_create(&toggle_task_memory, toggleService, "toggleService", NULL, 2);
+        if (!task_handle)
             return -1;
-        }
     }
     
     toggle_t *toggle = toggle_find_by_gpio(gpio_num);
@@ -14,6 +14,9 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <static_task.h>
+#include <event_loop.h>
+#include <factory_reset.h>
 #include <wifi_config.h>
 
 #include "button.h"
@@ -82,37 +85,31 @@ void relays_write(int state) {
     }
 }
 
-void reset_configuration_task() {
+void reset_configuration_task(event_loop_coroutine_t *co) {
+    static int i;
+    EVENT_LOOP_BEGIN(co);
+
     //Flash the LED first before we start the reset
-    for (int i=0; i<3; i++) {
+    for (i=0; i<3; i++) {
         led_write(true);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 100);
         led_write(false);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 100);
     }
 
-    printf("Resetting Wifi Config\n");
-
-    wifi_config_reset();
-
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-
-    printf("Resetting HomeKit Config\n");
-
-    homekit_server_reset();
-
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-
     printf("Restarting\n");
+    // Erases happen after the restart, see factory_reset_init
+    factory_reset();
 
-    sdk_system_restart();
-
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t reset_configuration_coroutine = EVENT_LOOP_COROUTINE(reset_configuration_task, NULL);
+
 void reset_configuration() {
     printf("Resetting Sonoff configuration\n");
-    xTaskCreate(reset_configuration_task, "Reset configuration", 256, NULL, 2, NULL);
+    // called from the button interrupt
+    event_loop_start_from_isr(&reset_configuration_coroutine);
 }
 
 void gpio_init() {
@@ -168,6 +165,8 @@ void button_down_callback(uint8_t gpio_num, button_event_t event) {
     }
 }
 
+STATIC_TASK(update_state_task_memory, 256);
+
 void update_state() {
     while (true) {
 printf("update_state\n");
@@ -194,7 +193,7 @@ printf("update_state\n");
 }
 
 void update_state_init() {
-    xTaskCreate(update_state, "UpdateState", 256, NULL, tskIDLE_PRIORITY, &updateStateTask);
+    updateStateTask = static_task_create(&update_state_task_memory, update_state, "UpdateState", NULL, tskIDLE_PRIORITY);
     vTaskSuspend(updateStateTask);
 }
 
@@ -274,8 +273,13 @@ void on_wifi_ready() {
 void user_init(void) {
     uart_set_baud(0, 115200);
 
+    event_loop_init();
+
     gpio_init();
 
+    if (factory_reset_init(wifi_config_reset) < 0) {
+        printf("Failed to complete the factory reset\n");
+    }
     wifi_config_init("blinds", NULL, on_wifi_ready);
     update_state_init();
 
@@ -28,6 +28,8 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_loop.h>
+#include <factory_reset.h>
 // #include <wifi_config.h>
 
 #include "toggle.h"
@@ -62,37 +64,30 @@ void led_write(bool on) {
     gpio_write(led_gpio, on ? 0 : 1);
 }
 
-void reset_configuration_task() {
+void reset_configuration_task(event_loop_coroutine_t *co) {
+    static int i;
+    EVENT_LOOP_BEGIN(co);
+
     //Flash the LED first before we start the reset
-    for (int i=0; i<3; i++) {
+    for (i=0; i<3; i++) {
         led_write(true);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 100);
         led_write(false);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 100);
     }
 
-    // printf("Resetting Wifi Config\n");
-
-    // wifi_config_reset();
-
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-
-    printf("Resetting HomeKit Config\n");
-
-    homekit_server_reset();
-
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-
     printf("Restarting\n");
+    // Erases happen after the restart, see factory_reset_init
+    factory_reset();
 
-    sdk_system_restart();
-
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t reset_configuration_coroutine = EVENT_LOOP_COROUTINE(reset_configuration_task, NULL);
+
 void reset_configuration() {
     printf("Resetting Sonoff configuration\n");
-    xTaskCreate(reset_configuration_task, "Reset configuration", 256, NULL, 2, NULL);
+    event_loop_start(&reset_configuration_coroutine);
 }
 
 
@@ -166,30 +161,35 @@ void toggle_callback(uint8_t gpio) {
     lamp_state_set(lamp_state+1);
 }
 
-void lamp_identify_task(void *_args) {
+void lamp_identify_task(event_loop_coroutine_t *co) {
+    static int i, j;
+    EVENT_LOOP_BEGIN(co);
+
     // We identify the Sonoff by turning top light on
     // and flashing with bottom light
     relay_write(relay0_gpio, true);
 
-    for (int i=0; i<3; i++) {
-        for (int j=0; j<2; j++) {
+    for (i=0; i<3; i++) {
+        for (j=0; j<2; j++) {
             relay_write(relay1_gpio, true);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
             relay_write(relay1_gpio, false);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+            EVENT_LOOP_SLEEP(co, 100);
         }
 
-        vTaskDelay(250 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 250);
     }
 
     relay_write(relay1_gpio, true);
 
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t lamp_identify_coroutine = EVENT_LOOP_COROUTINE(lamp_identify_task, NULL);
+
 void lamp_identify(homekit_value_t _value) {
     printf("Lamp identify\n");
-    xTaskCreate(lamp_identify_task, "Lamp identify", 128, NULL, 2, NULL);
+    event_loop_start(&lamp_identify_coroutine);
 }
 
 homekit_characteristic_t name = HOMEKIT_CHARACTERISTIC_(NAME, "Dual Lamp");
@@ -245,10 +245,15 @@ void create_accessory_name() {
 void user_init(void) {
     uart_set_baud(0, 115200);
 
+    event_loop_init();
+
     create_accessory_name();
 
     gpio_init();
 
+    if (factory_reset_init(NULL) < 0) {
+        printf("Failed to complete the factory reset\n");
+    }
     // wifi_config_init("dual lamp", NULL, on_wifi_ready);
     wifi_init();
     on_wifi_ready();
@@ -31,7 +31,10 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_loop.h>
+#include <factory_reset.h>
 #include <wifi_config.h>
+#include <relay_limiter.h>
 
 #include "button.h"
 
@@ -42,6 +45,11 @@ const int led_gpio = 13;
 // The GPIO pin that is connected to the button on the Sonoff Basic.
 const int button_gpio = 0;
 
+// Minimum time the relay stays in a state and how long to wait for
+// further writes from HomeKit before switching it, in milliseconds.
+const uint16_t relay_min_dwell_time = 1000;
+const uint16_t relay_coalesce_time = 200;
+
 void switch_on_callback(homekit_characteristic_t *_ch, homekit_value_t on, void *context);
 void button_callback(uint8_t gpio, button_event_t event);
 
@@ -49,41 +57,39 @@ void relay_write(bool on) {
     gpio_write(relay_gpio, on ? 1 : 0);
 }
 
+void relay_limiter_callback(uint8_t gpio, bool on) {
+    relay_write(on);
+}
+
 void led_write(bool on) {
     gpio_write(led_gpio, on ? 0 : 1);
 }
 
-void reset_configuration_task() {
+void reset_configuration_task(event_loop_coroutine_t *co) {
+    static int i;
+    EVENT_LOOP_BEGIN(co);
+
     //Flash the LED first before we start the reset
-    for (int i=0; i<3; i++) {
+    for (i=0; i<3; i++) {
         led_write(true);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 100);
         led_write(false);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        EVENT_LOOP_SLEEP(co, 100);
     }
     
-    printf("Resetting Wifi Config\n");
-    
-    wifi_config_reset();
-    
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-    
-    printf("Resetting HomeKit Config\n");
-    
-    homekit_server_reset();
-    
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-    
     printf("Restarting\n");
+    // Erases happen after the restart, see factory_reset_init
+    factory_reset();
     
-    sdk_system_restart();
-    
-    vTaskDelete(NULL);
+    EVENT_LOOP_END(co);
 }
 
+event_loop_coroutine_t reset_configuration_coroutine = EVENT_LOOP_COROUTINE(reset_configuration_task, NULL);
+
 void reset_configuration() {
     printf("Resetting Sonoff configuration\n");
-    xTaskCreate(reset_configuration_task, "Reset configuration", 256, NULL, 2, NULL);
+    // called from the button interrupt
+    event_loop_start_from_isr(&reset_configuration_coroutine);
 }
 
 homekit_characteristic_t switch_on = HOMEKIT_CHARACTERISTIC_(
@@ -95,10 +101,12 @@ void gpio_init() {
     led_write(false);
     gpio_enable(relay_gpio, GPIO_OUTPUT);
     relay_write(switch_on.value.bool_value);
+    relay_limiter_create(relay_gpio, switch_on.value.bool_value,
+                         relay_min_dwell_time, relay_coalesce_time, relay_limiter_callback);
 }
 
 void switch_on_callback(homekit_characteristic_t *_ch, homekit_value_t on, void *context) {
-    relay_write(switch_on.value.bool_value);
+    relay_limiter_write(relay_gpio, switch_on.value.bool_value);
 }
 
 void button_callback(uint8_t gpio, button_event_t event) {
@@ -106,7 +114,7 @@ void button_callback(uint8_t gpio, button_event_t event) {
         case button_event_single_press:
             printf("Toggling relay\n");
             switch_on.value.bool_value = !switch_on.value.bool_value;
-            relay_write(switch_on.value.bool_value);
+            relay_limiter_override_from_isr(relay_gpio, switch_on.value.bool_value);
             homekit_characteristic_notify(&switch_on, switch_on.value);
             break;
         case button_event_long_press:
@@ -189,8 +197,13 @@ void create_accessory_name() {
 void user_init(void) {
     uart_set_baud(0, 115200);
 
+    event_loop_init();
+
     create_accessory_name();
     
+    if (factory_reset_init(wifi_config_reset) < 0) {
+        printf("Failed to complete the factory reset\n");
+    }
     wifi_config_init("sonoff-outlet", NULL, on_wifi_ready);
     gpio_init();
 
@@ -8,6 +8,9 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_subscribers.h>
+#include <static_task.h>
+#include <mqtt_telemetry.h>
 #include "wifi.h"
 
 #include <dht/dht.h>
@@ -38,6 +41,8 @@ homekit_characteristic_t temperature = HOMEKIT_CHARACTERISTIC_(CURRENT_TEMPERATU
 homekit_characteristic_t humidity    = HOMEKIT_CHARACTERISTIC_(CURRENT_RELATIVE_HUMIDITY, 0);
 
 
+STATIC_TASK(temperature_sensor_task_memory, 256);
+
 void temperature_sensor_task(void *_args) {
     gpio_set_pullup(SENSOR_PIN, false, false);
 
@@ -51,8 +56,8 @@ void temperature_sensor_task(void *_args) {
             temperature.value.float_value = temperature_value;
             humidity.value.float_value = humidity_value;
 
-            homekit_characteristic_notify(&temperature, HOMEKIT_FLOAT(temperature_value));
-            homekit_characteristic_notify(&humidity, HOMEKIT_FLOAT(humidity_value));
+            EVENT_SUBSCRIBERS_NOTIFY(&temperature, HOMEKIT_FLOAT(temperature_value));
+            EVENT_SUBSCRIBERS_NOTIFY(&humidity, HOMEKIT_FLOAT(humidity_value));
         } else {
             printf("Couldnt read data from sensor\n");
         }
@@ -62,7 +67,15 @@ void temperature_sensor_task(void *_args) {
 }
 
 void temperature_sensor_init() {
-    xTaskCreate(temperature_sensor_task, "Temperatore Sensor", 256, NULL, 2, NULL);
+    static_task_create(&temperature_sensor_task_memory, temperature_sensor_task, "Temperatore Sensor", NULL, 2);
+}
+
+// Readings go to the broker of the build as well (make MQTT_HOST=...)
+void telemetry_init() {
+    mqtt_telemetry_add(&temperature, "temperature");
+    mqtt_telemetry_add(&humidity, "humidity");
+    mqtt_telemetry_set_credentials(MQTT_TELEMETRY_USER, MQTT_TELEMETRY_PASSWORD);
+    mqtt_telemetry_init(MQTT_TELEMETRY_HOST, MQTT_TELEMETRY_PORT, "temperature-sensor");
 }
 
 
@@ -102,6 +115,7 @@ void user_init(void) {
 
     wifi_init();
     temperature_sensor_init();
+    telemetry_init();
     homekit_server_init(&config);
 }
 
@@ -33,6 +33,7 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <static_task.h>
 #include "wifi.h"
 
 #include <dht/dht.h>
@@ -174,6 +175,8 @@ void update_state() {
 }
 
 
+STATIC_TASK(temperature_sensor_task_memory, 256);
+
 void temperature_sensor_task(void *_args) {
     sdk_os_timer_setfn(&fan_timer, fan_alarm, NULL);
 
@@ -211,7 +214,7 @@ void temperature_sensor_task(void *_args) {
 }
 
 void thermostat_init() {
-    xTaskCreate(temperature_sensor_task, "Thermostat", 256, NULL, 2, NULL);
+    static_task_create(&temperature_sensor_task_memory, temperature_sensor_task, "Thermostat", NULL, 2);
 }
 
 
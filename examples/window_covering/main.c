@@ -11,6 +11,8 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <event_subscribers.h>
+#include <static_task.h>
 #include "wifi.h"
 
 #include <dht/dht.h>
@@ -41,6 +43,8 @@ static void wifi_init() {
     sdk_wifi_station_connect();
 }
 
+STATIC_TASK(update_state_task_memory, 256);
+
 void update_state() {
     while (true) {
         uint8_t position = current_position.value.int_value;
@@ -50,12 +54,12 @@ void update_state() {
         printf("position %u, target %u\n", newPosition, target_position.value.int_value);
 
         current_position.value.int_value = newPosition;
-        homekit_characteristic_notify(&current_position, current_position.value);
+        EVENT_SUBSCRIBERS_NOTIFY(&current_position, current_position.value);
 
         if (newPosition == target_position.value.int_value) {
             printf("reached destination %u\n", newPosition);
             position_state.value.int_value = POSITION_STATE_STOPPED;
-            homekit_characteristic_notify(&position_state, position_state.value);
+            EVENT_SUBSCRIBERS_NOTIFY(&position_state, position_state.value);
             vTaskSuspend(updateStateTask);
         }
 
@@ -64,7 +68,7 @@ void update_state() {
 }
 
 void update_state_init() {
-    xTaskCreate(update_state, "UpdateState", 256, NULL, tskIDLE_PRIORITY, &updateStateTask);
+    updateStateTask = static_task_create(&update_state_task_memory, update_state, "UpdateState", NULL, tskIDLE_PRIORITY);
     vTaskSuspend(updateStateTask);
 }
 
@@ -115,14 +119,14 @@ void on_update_target_position(homekit_characteristic_t *ch, homekit_value_t val
     if (target_position.value.int_value == current_position.value.int_value) {
         printf("Current position equal to target. Stopping.\n");
         position_state.value.int_value = POSITION_STATE_STOPPED;
-        homekit_characteristic_notify(&position_state, position_state.value);
+        EVENT_SUBSCRIBERS_NOTIFY(&position_state, position_state.value);
         vTaskSuspend(updateStateTask);
     } else {
         position_state.value.int_value = target_position.value.int_value > current_position.value.int_value
             ? POSITION_STATE_OPENING
             : POSITION_STATE_CLOSING;
 
-        homekit_characteristic_notify(&position_state, position_state.value);
+        EVENT_SUBSCRIBERS_NOTIFY(&position_state, position_state.value);
         vTaskResume(updateStateTask);
     }
 }
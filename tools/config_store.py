@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+#
+# Reads and writes the flash region of the config_store component.
+#
+# image: builds the region holding the given keys, to provision a device
+#        with esptool write_flash at CONFIG_STORE_BASE_ADDR
+# dump:  lists the keys in a region read back with esptool read_flash
+#
+# Usage:
+#   tools/config_store.py image -o config.bin serial=123-45-678 reed_pin=4
+#   tools/config_store.py image -o config.bin --file device.conf
+#   tools/config_store.py dump config.bin
+#
+# From an example directory: make config-store CONFIG="serial=123-45-678 reed_pin=4"
+#
+
+import argparse
+import struct
+import sys
+import zlib
+
+
+SECTOR_SIZE = 4096
+SECTOR_MAGIC = 0x31305343
+SECTOR_HEADER = struct.Struct('<IIII')
+RECORD_HEADER = struct.Struct('<BBHI')
+RECORD_DELETED = 0x01
+MAX_KEY_LENGTH = 15
+MAX_VALUE_LENGTH = 256
+
+
+def align4(n):
+    return (n + 3) & ~3
+
+
+def sector_header(sequence):
+    fields = struct.pack('<III', SECTOR_MAGIC, sequence, 0)
+    return fields + struct.pack('<I', zlib.crc32(fields))
+
+
+def record(key, value):
+    fields = struct.pack('<BBH', len(key), 0, len(value))
+    data = key + value
+    raw = fields + struct.pack('<I', zlib.crc32(fields + data)) + data
+    return raw + b'\xff' * (align4(len(raw)) - len(raw))
+
+
+def image(pairs, sectors):
+    # All records go into the first sector, the others stay erased
+    body = b''
+    for key, value in pairs.items():
+        body += record(key, value)
+
+    sector = sector_header(1) + body
+    if len(sector) > SECTOR_SIZE:
+        raise ValueError('%d bytes of records do not fit into a sector' % len(body))
+    return sector + b'\xff' * (SECTOR_SIZE * sectors - len(sector))
+
+
+def parse_pair(pair):
+    key, sep, value = pair.partition('=')
+    key = key.strip().encode()
+    value = value.encode()
+    if not sep or not key or len(key) > MAX_KEY_LENGTH:
+        raise ValueError('%r: expected key=value, keys up to %d characters' % (pair, MAX_KEY_LENGTH))
+    if len(value) > MAX_VALUE_LENGTH:
+        raise ValueError('%r: values are up to %d bytes' % (pair, MAX_VALUE_LENGTH))
+    return key, value
+
+
+def dump(region):
+    sectors = []
+    for start in range(0, len(region) - SECTOR_SIZE + 1, SECTOR_SIZE):
+        magic, sequence, erase_count, crc = SECTOR_HEADER.unpack_from(region, start)
+        if magic == SECTOR_MAGIC and crc == zlib.crc32(region[start:start + 12]):
+            sectors.append((sequence, start, erase_count))
+            print('sector 0x%04x: sequence %d, erased %d times' % (start, sequence, erase_count))
+        else:
+            print('sector 0x%04x: free' % start)
+
+    # Replays the log as the component does at boot
+    keys = {}
+    for sequence, start, erase_count in sorted(sectors):
+        offset = start + SECTOR_HEADER.size
+        while offset + RECORD_HEADER.size <= start + SECTOR_SIZE:
+            key_length, flags, value_length, crc = RECORD_HEADER.unpack_from(region, offset)
+            if region[offset:offset + RECORD_HEADER.size] == b'\xff' * RECORD_HEADER.size:
+                break
+            end = offset + RECORD_HEADER.size + key_length + value_length
+            data = region[offset + RECORD_HEADER.size:end]
+            if (not 0 < key_length <= MAX_KEY_LENGTH or value_length > MAX_VALUE_LENGTH or
+                    end > start + SECTOR_SIZE or zlib.crc32(region[offset:offset + 4] + data) != crc):
+                print('torn record at 0x%04x' % offset)
+                break
+            key = data[:key_length]
+            if flags & RECORD_DELETED:
+                keys.pop(key, None)
+            else:
+                keys[key] = data[key_length:]
+            offset = start + align4(end - start)
+
+    for key in sorted(keys):
+        print('%s=%s' % (key.decode(errors='replace'), keys[key].decode(errors='backslashreplace')))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build or list config_store regions')
+    commands = parser.add_subparsers(dest='command')
+    commands.required = True
+
+    image_parser = commands.add_parser('image', help='build a region holding the given keys')
+    image_parser.add_argument('pairs', nargs='*', metavar='key=value')
+    image_parser.add_argument('--file', help='more key=value pairs, one per line, # for comments')
+    image_parser.add_argument('--sectors', type=int, default=4, help='CONFIG_STORE_SECTORS (default: %(default)s)')
+    image_parser.add_argument('-o', '--output', required=True)
+
+    dump_parser = commands.add_parser('dump', help='list the keys in a region')
+    dump_parser.add_argument('region')
+
+    args = parser.parse_args()
+
+    if args.command == 'dump':
+        with open(args.region, 'rb') as f:
+            dump(f.read())
+        return 0
+
+    lines = list(args.pairs)
+    if args.file:
+        with open(args.file) as f:
+            lines += [line.strip() for line in f if line.strip() and not line.lstrip().startswith('#')]
+
+    try:
+        pairs = dict(parse_pair(line) for line in lines)
+        data = image(pairs, args.sectors)
+    except ValueError as e:
+        print(e)
+        return 1
+
+    with open(args.output, 'wb') as f:
+        f.write(data)
+    print('%d keys, %d bytes of records, %d sectors' % (len(pairs), sum(len(record(k, v)) for k, v in pairs.items()), args.sectors))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
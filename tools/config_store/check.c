@@ -0,0 +1,263 @@
+// Host checker for the config_store component
+//
+// power-cut: runs random sets and deletes against the flash model and cuts
+// the power at a random word or erase during a quarter of them. After each
+// cut the store boots again from what is left in flash, and every key must
+// read back what it held before, except the key being written, which may
+// hold either its old or its new value.
+//
+// wear: writes a set of static keys once, then updates a counter key over
+// and over, and reports the write amplification and the erases per sector.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+// The store itself, so that a reboot can reset its state. What it prints
+// on boot, torn records included, is expected here.
+#define printf(...) do {} while (0)
+#include "config_store.c"
+#undef printf
+
+#include "flash.h"
+
+#define STATIC_KEYS 12
+#define TEMP_KEYS 8
+
+typedef struct {
+    char key[CONFIG_STORE_MAX_KEY_LENGTH + 1];
+    int length;                 // -1: not set
+    uint8_t value[CONFIG_STORE_MAX_VALUE_LENGTH];
+} entry_t;
+
+static entry_t model[STATIC_KEYS + 2 + TEMP_KEYS];
+static const int model_size = sizeof(model) / sizeof(*model);
+
+static int failures = 0;
+
+
+static void reboot() {
+    lock = NULL;
+    int result = config_store_init();
+    if (result < 0) {
+        printf("FAIL: config_store_init returned %d\n", result);
+        exit(1);
+    }
+}
+
+
+static bool holds(const entry_t *entry, const uint8_t *value, int length) {
+    return entry->length == length && (length < 0 || !memcmp(entry->value, value, length));
+}
+
+
+static int read_key(const char *key, uint8_t *value) {
+    int length = config_store_get(key, value, CONFIG_STORE_MAX_VALUE_LENGTH);
+    return length == CONFIG_STORE_NOT_FOUND ? -1 : length;
+}
+
+
+static void verify(const char *when, int skip) {
+    uint8_t value[CONFIG_STORE_MAX_VALUE_LENGTH];
+    uint32_t keys = 0;
+
+    for (int i = 0; i < model_size; i++) {
+        int length = read_key(model[i].key, value);
+        if (model[i].length >= 0)
+            keys++;
+        if (i != skip && !holds(&model[i], value, length)) {
+            printf("FAIL %s: %s reads %d bytes, expected %d\n", when, model[i].key, length, model[i].length);
+            failures++;
+        }
+    }
+
+    config_store_stats_t stats;
+    config_store_get_stats(&stats);
+    if (stats.keys != keys) {
+        printf("FAIL %s: %u keys in the index, expected %u\n", when, stats.keys, keys);
+        failures++;
+    }
+}
+
+
+static void random_value(entry_t *entry, int min, int max) {
+    entry->length = min + flash_random() % (max - min + 1);
+    for (int i = 0; i < entry->length; i++)
+        entry->value[i] = flash_random();
+}
+
+
+static void init_model() {
+    for (int i = 0; i < STATIC_KEYS; i++)
+        snprintf(model[i].key, sizeof(model[i].key), "static%d", i);
+    strcpy(model[STATIC_KEYS].key, "counter");
+    strcpy(model[STATIC_KEYS + 1].key, "blob");
+    for (int i = 0; i < TEMP_KEYS; i++)
+        snprintf(model[STATIC_KEYS + 2 + i].key, sizeof(model[0].key), "temp%d", i);
+    for (int i = 0; i < model_size; i++)
+        model[i].length = -1;
+}
+
+
+static int power_cut(uint32_t operations) {
+    uint32_t cuts = 0, lost = 0;
+
+    flash_format();
+    init_model();
+    reboot();
+
+    for (int i = 0; i < STATIC_KEYS; i++) {
+        random_value(&model[i], 1, 64);
+        config_store_set(model[i].key, model[i].value, model[i].length);
+    }
+
+    // Most operations write a few words, the power stays on for a few
+    // dozen of them, and some cuts land in an erase or a collection
+    flash_arm_cut(1 + flash_random() % 1000);
+
+    for (uint32_t n = 0; n < operations; n++) {
+        // Mostly the counter, sometimes the blob, temporary keys come and go
+        int target;
+        uint32_t dice = flash_random() % 100;
+        if (dice < 60)
+            target = STATIC_KEYS;
+        else if (dice < 70)
+            target = STATIC_KEYS + 1;
+        else if (dice < 75)
+            target = flash_random() % STATIC_KEYS;
+        else
+            target = STATIC_KEYS + 2 + flash_random() % TEMP_KEYS;
+
+        entry_t next = model[target];
+        bool delete = target >= STATIC_KEYS + 2 && next.length >= 0 && flash_random() % 2;
+        if (delete)
+            next.length = -1;
+        else if (target == STATIC_KEYS + 1)
+            random_value(&next, 100, CONFIG_STORE_MAX_VALUE_LENGTH);
+        else
+            random_value(&next, 0, 16);
+
+        if (!setjmp(flash_power_cut)) {
+            int result = delete ? config_store_delete(next.key) : config_store_set(next.key, next.value, next.length);
+            if (result < 0) {
+                printf("FAIL: operation %u on %s returned %d\n", n, next.key, result);
+                return 1;
+            }
+            model[target] = next;
+        } else {
+            cuts++;
+            reboot();
+
+            uint8_t value[CONFIG_STORE_MAX_VALUE_LENGTH];
+            int length = read_key(next.key, value);
+            if (holds(&next, value, length)) {
+                model[target] = next;
+            } else if (holds(&model[target], value, length)) {
+                lost++;
+            } else {
+                printf("FAIL after cut %u: %s holds neither its old nor its new value\n", cuts, next.key);
+                failures++;
+            }
+            verify("after a power cut", target);
+            flash_arm_cut(1 + flash_random() % 1000);
+        }
+
+        if (failures)
+            return 1;
+    }
+
+    flash_arm_cut(0);
+    reboot();
+    verify("at the end", -1);
+
+    const flash_stats_t *flash = flash_get_stats();
+    printf("power-cut: %u operations, %u power cuts, %u during an erase, %u lost the write in flight: %s\n",
+           operations, cuts, flash->cuts_in_erase, lost, failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
+
+
+static int wear(uint32_t updates) {
+    flash_format();
+    init_model();
+    reboot();
+
+    for (int i = 0; i < STATIC_KEYS; i++) {
+        random_value(&model[i], 16, 32);
+        config_store_set(model[i].key, model[i].value, model[i].length);
+    }
+
+    for (uint32_t n = 0; n < updates; n++) {
+        int result = config_store_set_int("counter", n);
+        if (result < 0) {
+            printf("FAIL: update %u returned %d\n", n, result);
+            return 1;
+        }
+    }
+
+    reboot();
+    if (config_store_get_int("counter", -1) != (int32_t)updates - 1) {
+        printf("FAIL: counter reads %d after a reboot\n", config_store_get_int("counter", -1));
+        return 1;
+    }
+
+    config_store_stats_t stats;
+    config_store_get_stats(&stats);
+    const flash_stats_t *flash = flash_get_stats();
+
+    // The store counts what it wrote since the last boot, the model since
+    // the start
+    uint64_t payload = 0;
+    for (int i = 0; i < STATIC_KEYS; i++)
+        payload += strlen(model[i].key) + model[i].length;
+    for (uint32_t n = 0; n < updates; n++)
+        payload += strlen("counter") + snprintf(NULL, 0, "%u", n);
+
+    uint32_t min = UINT32_MAX, max = 0;
+    for (int i = 0; i < CONFIG_STORE_SECTORS; i++) {
+        if (flash->sector_erases[i] < min)
+            min = flash->sector_erases[i];
+        if (flash->sector_erases[i] > max)
+            max = flash->sector_erases[i];
+    }
+
+    printf("wear: %u updates of a counter next to %d static keys, %d sectors\n",
+           updates, STATIC_KEYS, CONFIG_STORE_SECTORS);
+    printf("  payload %llu bytes, programmed %llu bytes: write amplification %.2f\n",
+           (unsigned long long)payload, (unsigned long long)flash->programmed_bytes,
+           (double)flash->programmed_bytes / payload);
+    printf("  %u erases, one per %.0f updates (rewriting a sector per update: %u)\n",
+           flash->erases, flash->erases ? (double)updates / flash->erases : 0.0, updates);
+    printf("  erases per sector min %u max %u, %u bytes of %u live\n",
+           min, max, stats.live_bytes, (uint32_t)CAPACITY);
+    return 0;
+}
+
+
+int main(int argc, char **argv) {
+    uint32_t operations = 20000, updates = 100000, seed = 1;
+
+    static const struct option options[] = {
+        { "operations", required_argument, NULL, 'o' },
+        { "updates", required_argument, NULL, 'u' },
+        { "seed", required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'o': operations = strtoul(optarg, NULL, 0); break;
+            case 'u': updates = strtoul(optarg, NULL, 0); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [--operations N] [--updates N] [--seed N]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    flash_seed(seed);
+    if (power_cut(operations))
+        return 1;
+    return wear(updates);
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <spiflash.h>
+#include <flash_scheduler.h>
+
+#include <config_store.h>
+#include "flash.h"
+
+// NOR flash as config_store sees it: erasing sets a whole sector to 0xFF,
+// programming can only clear bits. A cut during an erase leaves each bit of
+// the sector either as it was or set; a cut while programming a word leaves
+// each bit to clear either cleared or not. Words after it stay untouched.
+
+#define SECTOR_SIZE 4096
+#define REGION_SIZE (CONFIG_STORE_SECTORS * SECTOR_SIZE)
+
+jmp_buf flash_power_cut;
+
+static uint8_t region[REGION_SIZE];
+static uint32_t cut_countdown = 0;
+static uint32_t random_state = 1;
+static flash_stats_t stats;
+
+
+void flash_seed(uint32_t seed) {
+    random_state = seed ? seed : 1;
+}
+
+
+uint32_t flash_random() {
+    // xorshift32
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+
+void flash_format() {
+    memset(region, 0xFF, sizeof(region));
+    memset(&stats, 0, sizeof(stats));
+    cut_countdown = 0;
+}
+
+
+void flash_arm_cut(uint32_t operations) {
+    cut_countdown = operations;
+}
+
+
+const flash_stats_t *flash_get_stats() {
+    return &stats;
+}
+
+
+static bool cut_now() {
+    return cut_countdown && !--cut_countdown;
+}
+
+
+static uint8_t *map(uint32_t address, uint32_t size) {
+    if (address < CONFIG_STORE_BASE_ADDR || address + size > CONFIG_STORE_BASE_ADDR + REGION_SIZE) {
+        fprintf(stderr, "flash access at 0x%x, %u bytes, outside the store\n", address, size);
+        abort();
+    }
+    return region + address - CONFIG_STORE_BASE_ADDR;
+}
+
+
+bool spiflash_read(uint32_t address, uint8_t *buffer, uint32_t size) {
+    memcpy(buffer, map(address, size), size);
+    return true;
+}
+
+
+bool flash_scheduler_erase_sector(uint32_t address) {
+    if (address % SECTOR_SIZE) {
+        fprintf(stderr, "erase at 0x%x, not sector aligned\n", address);
+        abort();
+    }
+    uint8_t *sector = map(address, SECTOR_SIZE);
+
+    if (cut_now()) {
+        for (int i = 0; i < SECTOR_SIZE; i++)
+            sector[i] |= flash_random();
+        stats.cuts_in_erase++;
+        longjmp(flash_power_cut, 1);
+    }
+
+    memset(sector, 0xFF, SECTOR_SIZE);
+    stats.erases++;
+    stats.sector_erases[(address - CONFIG_STORE_BASE_ADDR) / SECTOR_SIZE]++;
+    return true;
+}
+
+
+bool flash_scheduler_write(uint32_t address, const uint8_t *data, uint32_t length) {
+    if (address % 4 || length % 4) {
+        fprintf(stderr, "write at 0x%x, %u bytes, not word aligned\n", address, length);
+        abort();
+    }
+    uint8_t *flash = map(address, length);
+
+    for (uint32_t i = 0; i < length; i += 4) {
+        if (cut_now()) {
+            uint32_t torn = flash_random();
+            for (int j = 0; j < 4; j++)
+                flash[i + j] &= data[i + j] | (uint8_t)(torn >> (8 * j));
+            longjmp(flash_power_cut, 1);
+        }
+        for (int j = 0; j < 4; j++)
+            flash[i + j] &= data[i + j];
+    }
+
+    stats.programmed_bytes += length;
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// Model of the flash region of the store, with power cuts
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <setjmp.h>
+
+typedef struct {
+    uint64_t programmed_bytes;
+    uint32_t erases;
+    uint32_t sector_erases[CONFIG_STORE_SECTORS];
+    uint32_t cuts_in_erase;
+} flash_stats_t;
+
+// Where a power cut lands, set before arming one
+extern jmp_buf flash_power_cut;
+
+void flash_seed(uint32_t seed);
+uint32_t flash_random();
+
+// Erases the region and clears the statistics
+void flash_format();
+
+// Cuts the power during the given word programmed or sector erased from
+// now on, 1 being the next one. 0 disarms.
+void flash_arm_cut(uint32_t operations);
+
+const flash_stats_t *flash_get_stats();
@@ -0,0 +1,8 @@
+#pragma once
+
+// Reads from the flash model, see flash.c
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool spiflash_read(uint32_t address, uint8_t *buffer, uint32_t size);
@@ -0,0 +1,344 @@
+#!/usr/bin/env python3
+#
+# Delta OTA images for the delta_ota component.
+#
+# Builds a compressed delta between the firmware running on a device and a
+# new build, pushes it to the device over TFTP, and can stand in for a device
+# to check a delta end to end (transfer size, time and the rebuilt image).
+# The format is described in components/esp8266-open-rtos/delta_ota/delta_patch.h.
+#
+# Usage:
+#   tools/delta_ota.py diff old.bin new.bin firmware.delta
+#   tools/delta_ota.py apply old.bin firmware.delta rebuilt.bin
+#   tools/delta_ota.py send 192.168.1.50 firmware.delta
+#   tools/delta_ota.py serve --source old.bin --expect new.bin --port 6969
+#   tools/delta_ota.py send 127.0.0.1 firmware.delta --port 6969
+#
+
+import argparse
+import socket
+import struct
+import sys
+import time
+import zlib
+
+
+MAGIC = b'HKD1'
+WINDOW_BITS = 11
+WINDOW_SIZE = 1 << WINDOW_BITS
+
+OP_LITERAL, OP_COPY_SOURCE, OP_COPY_WINDOW, OP_END = range(4)
+
+KEY = 8                 # bytes hashed to find match candidates
+MIN_SOURCE_MATCH = 8
+MIN_WINDOW_MATCH = 5
+
+TFTP_PORT = 69
+TFTP_BLOCK = 512
+TFTP_RRQ, TFTP_WRQ, TFTP_DATA, TFTP_ACK, TFTP_ERROR = range(1, 6)
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return (value << 1) if value >= 0 else ((-value << 1) - 1)
+
+
+def command(op, length):
+    if length < 64:
+        return bytes([op | ((length - 1) << 2)])
+    return bytes([op | (63 << 2)]) + varint(length - 64)
+
+
+def match_length(a, a_pos, b, b_pos, limit):
+    n = 0
+    while n < limit and a[a_pos + n] == b[b_pos + n]:
+        n += 1
+    return n
+
+
+def diff(source, target):
+    out = bytearray(MAGIC)
+    out += struct.pack('<IIIIB', len(source), zlib.crc32(source) & 0xFFFFFFFF,
+                       len(target), zlib.crc32(target) & 0xFFFFFFFF, WINDOW_BITS)
+
+    source_index = {}
+    for i in range(len(source) - KEY, -1, -1):
+        source_index[source[i:i + KEY]] = i
+    window_index = {}
+
+    literal = bytearray()
+    source_end = 0      # end of the previous source copy
+    i = 0
+
+    def flush_literal():
+        for start in range(0, len(literal), 1 << 16):
+            chunk = literal[start:start + (1 << 16)]
+            out.extend(command(OP_LITERAL, len(chunk)) + chunk)
+        literal.clear()
+
+    while i < len(target):
+        best_length, best_op, best_arg = 0, None, None
+        limit = len(target) - i
+
+        # 1. continuing where the previous source copy ended (common for shifted code)
+        if source_end < len(source):
+            n = match_length(source, source_end, target, i, min(limit, len(source) - source_end))
+            if n >= MIN_SOURCE_MATCH:
+                best_length, best_op, best_arg = n, OP_COPY_SOURCE, source_end
+
+        key = target[i:i + KEY]
+        if len(key) == KEY:
+            # 2. anywhere in the source
+            j = source_index.get(key)
+            if j is not None:
+                n = match_length(source, j, target, i, min(limit, len(source) - j))
+                if n >= MIN_SOURCE_MATCH and n > best_length:
+                    best_length, best_op, best_arg = n, OP_COPY_SOURCE, j
+
+            # 3. recently written output
+            j = window_index.get(key)
+            if j is not None and i - j <= WINDOW_SIZE:
+                n = match_length(target, j, target, i, limit)
+                if n >= MIN_WINDOW_MATCH and n > best_length + 2:
+                    best_length, best_op, best_arg = n, OP_COPY_WINDOW, i - j
+
+        if best_op is None:
+            literal.append(target[i])
+            step = 1
+        else:
+            flush_literal()
+            out += command(best_op, best_length)
+            if best_op == OP_COPY_SOURCE:
+                out += varint(zigzag(best_arg - source_end))
+                source_end = best_arg + best_length
+            else:
+                out += varint(best_arg)
+            step = best_length
+
+        for k in range(i, min(i + step, len(target) - KEY + 1)):
+            window_index[target[k:k + KEY]] = k
+        i += step
+
+    flush_literal()
+    out.append(OP_END)
+    return bytes(out)
+
+
+def read_varint(data, pos):
+    value, shift = 0, 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def apply(source, delta):
+    if delta[:4] != MAGIC:
+        raise ValueError('not a delta image')
+    source_size, source_crc, target_size, target_crc, window_bits = struct.unpack_from('<IIIIB', delta, 4)
+    if source_size != len(source) or source_crc != zlib.crc32(source) & 0xFFFFFFFF:
+        raise ValueError('delta was built against a different source image')
+    if window_bits > WINDOW_BITS:
+        raise ValueError('window too large')
+
+    out = bytearray()
+    source_end = 0
+    pos = 21
+    while True:
+        byte = delta[pos]
+        pos += 1
+        op, length = byte & 3, (byte >> 2) + 1
+        if op == OP_END:
+            break
+        if length == 64:
+            extra, pos = read_varint(delta, pos)
+            length += extra
+        if op == OP_LITERAL:
+            out += delta[pos:pos + length]
+            pos += length
+        elif op == OP_COPY_SOURCE:
+            value, pos = read_varint(delta, pos)
+            offset = (value >> 1) ^ -(value & 1)
+            start = source_end + offset
+            out += source[start:start + length]
+            source_end = start + length
+        else:
+            distance, pos = read_varint(delta, pos)
+            if not 0 < distance <= min(1 << window_bits, len(out)):
+                raise ValueError('bad window distance')
+            for _ in range(length):
+                out.append(out[-distance])
+
+    if len(out) != target_size or zlib.crc32(out) & 0xFFFFFFFF != target_crc:
+        raise ValueError('rebuilt image does not match')
+    return bytes(out)
+
+
+def tftp_send(host, port, file_name, data, timeout=5.0, retries=5):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(timeout)
+    request = struct.pack('!H', TFTP_WRQ) + file_name.encode() + b'\0octet\0'
+    peer = (host, port)
+
+    def exchange(packet, block):
+        nonlocal peer
+        for _ in range(retries):
+            sock.sendto(packet, peer)
+            try:
+                while True:
+                    reply, address = sock.recvfrom(516)
+                    opcode, number = struct.unpack('!HH', reply[:4])
+                    if opcode == TFTP_ERROR:
+                        raise IOError('device error %d: %s' % (number, reply[4:].rstrip(b'\0').decode()))
+                    if opcode == TFTP_ACK and number == block:
+                        peer = address
+                        return
+            except socket.timeout:
+                continue
+        raise IOError('no ACK for block %d' % block)
+
+    started = time.time()
+    exchange(request, 0)
+    block = 1
+    offset = 0
+    while True:
+        chunk = data[offset:offset + TFTP_BLOCK]
+        exchange(struct.pack('!HH', TFTP_DATA, block & 0xFFFF) + chunk, block & 0xFFFF)
+        offset += len(chunk)
+        block += 1
+        if len(chunk) < TFTP_BLOCK:
+            break
+    return time.time() - started
+
+
+def tftp_receive(port, timeout=10.0):
+    """Accepts a single WRQ and returns (file name, data, seconds)."""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(('', port))
+
+    while True:
+        packet, peer = sock.recvfrom(516)
+        if struct.unpack('!H', packet[:2])[0] == TFTP_WRQ:
+            break
+    file_name = packet[2:].split(b'\0')[0].decode()
+    started = time.time()
+    sock.settimeout(timeout)
+    sock.sendto(struct.pack('!HH', TFTP_ACK, 0), peer)
+
+    data = bytearray()
+    expected = 1
+    while True:
+        packet, address = sock.recvfrom(516)
+        if address != peer:
+            continue
+        opcode, block = struct.unpack('!HH', packet[:4])
+        if opcode != TFTP_DATA:
+            continue
+        if block == expected & 0xFFFF:
+            data += packet[4:]
+            expected += 1
+        sock.sendto(struct.pack('!HH', TFTP_ACK, block), peer)
+        if block == (expected - 1) & 0xFFFF and len(packet) - 4 < TFTP_BLOCK:
+            break
+    return file_name, bytes(data), time.time() - started
+
+
+def read(path):
+    with open(path, 'rb') as f:
+        return f.read()
+
+
+def command_diff(args):
+    source, target = read(args.source), read(args.target)
+    started = time.time()
+    delta = diff(source, target)
+    with open(args.delta, 'wb') as f:
+        f.write(delta)
+    print('%s: %d bytes, %.1f%% of the %d byte image (built in %.1fs)' % (
+        args.delta, len(delta), 100.0 * len(delta) / max(len(target), 1), len(target),
+        time.time() - started))
+
+
+def command_apply(args):
+    target = apply(read(args.source), read(args.delta))
+    with open(args.target, 'wb') as f:
+        f.write(target)
+    print('%s: %d bytes' % (args.target, len(target)))
+
+
+def command_send(args):
+    data = read(args.file)
+    name = args.name or ('firmware.delta' if data[:4] == MAGIC else 'firmware.bin')
+    seconds = tftp_send(args.host, args.port, name, data)
+    print('Sent %s as %s: %d bytes in %.2fs (%.1f KB/s)' % (
+        args.file, name, len(data), seconds, len(data) / 1024.0 / max(seconds, 1e-6)))
+
+
+def command_serve(args):
+    source = read(args.source)
+    expected = read(args.expect) if args.expect else None
+    print('Waiting for an image on UDP port %d' % args.port)
+    name, data, seconds = tftp_receive(args.port)
+    print('Received %s: %d bytes in %.2fs' % (name, len(data), seconds))
+
+    image = apply(source, data) if data[:4] == MAGIC else data
+    if expected is not None:
+        if image != expected:
+            print('FAIL: rebuilt image differs from %s' % args.expect)
+            return 1
+        print('OK: image matches %s, transferred %.1f%% of its size' % (
+            args.expect, 100.0 * len(data) / max(len(expected), 1)))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Delta OTA images over TFTP')
+    commands = parser.add_subparsers(dest='command')
+    commands.required = True
+
+    p = commands.add_parser('diff', help='build a delta from the running image to a new one')
+    p.add_argument('source')
+    p.add_argument('target')
+    p.add_argument('delta')
+    p.set_defaults(func=command_diff)
+
+    p = commands.add_parser('apply', help='rebuild an image from a delta, like the device does')
+    p.add_argument('source')
+    p.add_argument('delta')
+    p.add_argument('target')
+    p.set_defaults(func=command_apply)
+
+    p = commands.add_parser('send', help='upload a delta or a full image to a device')
+    p.add_argument('host')
+    p.add_argument('file')
+    p.add_argument('--port', type=int, default=TFTP_PORT)
+    p.add_argument('--name', help='remote file name (default: firmware.delta or firmware.bin)')
+    p.set_defaults(func=command_send)
+
+    p = commands.add_parser('serve', help='stand in for a device and check an upload end to end')
+    p.add_argument('--source', required=True, help='image the device is running')
+    p.add_argument('--expect', help='image the upload should produce')
+    p.add_argument('--port', type=int, default=TFTP_PORT)
+    p.set_defaults(func=command_serve)
+
+    args = parser.parse_args()
+    return args.func(args) or 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
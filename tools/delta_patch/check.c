@@ -0,0 +1,445 @@
+// Host check of the delta_patch decoder of the delta_ota component,
+// against deltas made by tools/delta_ota.py.
+//
+//   build/delta_patch_check images --size 65536 --seed 1 old.bin new.bin
+//   tools/delta_ota.py diff old.bin new.bin new.delta
+//   build/delta_patch_check check old.bin new.bin new.delta
+//
+// images writes a made up firmware and a new build of it: the same code
+// with functions inserted, removed and edited, so that the delta has
+// literals, source copies at moving offsets and window copies.
+//
+// check applies the delta in one go and in chunks of every size a TFTP
+// block can have, and the image must come out whole. Then it feeds cut
+// and corrupted copies: a cut delta must never finish, a corrupted one
+// must be refused or rebuild the same image. Crafted deltas cover what a
+// flipped byte hardly ever reaches: a source copy whose end wraps, a varint
+// wider than 32 bits, a bad magic and a window too large. A delta for
+// another source must be turned down by the header callback, as delta_ota
+// does. No read may fall outside the source image and no write past the
+// target size.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "delta_patch.h"
+
+#define MAX_CHUNK 512
+#define CUTS 200
+#define CORRUPTIONS 1000
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} image_t;
+
+typedef struct {
+    const image_t *source;
+    uint8_t *target;
+    size_t target_size;
+    size_t written;
+    int bad_reads;
+    int bad_writes;
+} apply_t;
+
+static int failures = 0;
+
+
+static void fail(const char *name, const char *message) {
+    printf("FAIL: %s: %s\n", name, message);
+    failures++;
+}
+
+
+static uint32_t random_state;
+
+static uint32_t random_next() {
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 8;
+}
+
+
+static int read_image(const char *path, image_t *image) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    image->size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    image->data = malloc(image->size + 1);
+    size_t n = fread(image->data, 1, image->size, f);
+    fclose(f);
+    if (n != image->size) {
+        fprintf(stderr, "%s: short read\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int write_image(const char *path, const uint8_t *data, size_t size) {
+    FILE *f = fopen(path, "wb");
+    if (!f || fwrite(data, 1, size, f) != size) {
+        perror(path);
+        if (f)
+            fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+
+// Functions of a few dozen instructions out of a small set, as code is
+static size_t make_function(uint8_t *p, size_t room) {
+    static const uint8_t instructions[][3] = {
+        { 0x12, 0xc1, 0xf0 }, { 0x09, 0x31, 0x00 }, { 0x0d, 0xf0, 0x00 }, { 0x21, 0x00, 0x00 },
+        { 0x01, 0x00, 0x00 }, { 0xc0, 0x00, 0x00 }, { 0x06, 0x00, 0x00 }, { 0x22, 0xa0, 0x00 },
+    };
+    size_t size = 0;
+    int count = 8 + random_next() % 40;
+    for (int i = 0; i < count && size + 3 <= room; i++) {
+        const uint8_t *instruction = instructions[random_next() % 8];
+        memcpy(p + size, instruction, 3);
+        // Registers and immediates differ
+        p[size + 1] ^= random_next() & 0x0f;
+        if (instruction[0] == 0x01 || instruction[0] == 0x21)
+            p[size + 2] = random_next();
+        size += 3;
+    }
+    return size;
+}
+
+static int command_images(size_t size, const char *old_path, const char *new_path) {
+    uint8_t *old = malloc(size), *new = malloc(size * 2);
+    size_t old_size = 0, new_size = 0;
+
+    while (size - old_size >= 3)
+        old_size += make_function(old + old_size, size - old_size);
+
+    // The new build walks the functions of the old one
+    size_t position = 0;
+    while (position < old_size && new_size < size * 2 - 256) {
+        size_t length = 24 + random_next() % 200;
+        if (length > old_size - position)
+            length = old_size - position;
+
+        switch (random_next() % 16) {
+            case 0:     // inserted
+                new_size += make_function(new + new_size, size * 2 - new_size);
+                break;
+            case 1:     // removed
+                position += length;
+                continue;
+            case 2:     // edited
+                memcpy(new + new_size, old + position, length);
+                for (int i = 0; i < 4; i++)
+                    new[new_size + random_next() % length] = random_next();
+                new_size += length;
+                position += length;
+                continue;
+        }
+        if (length > size * 2 - new_size)
+            length = size * 2 - new_size;
+        memcpy(new + new_size, old + position, length);
+        new_size += length;
+        position += length;
+    }
+
+    int r = write_image(old_path, old, old_size) || write_image(new_path, new, new_size) ? 1 : 0;
+    if (!r)
+        printf("%s: %zu bytes, %s: %zu bytes\n", old_path, old_size, new_path, new_size);
+    free(old);
+    free(new);
+    return r;
+}
+
+
+static int check_header(void *context, const delta_header_t *header) {
+    apply_t *apply = context;
+    if (header->source_size != apply->source->size ||
+            header->source_crc != delta_crc32(0, apply->source->data, apply->source->size))
+        return -1;
+    return 0;
+}
+
+static int read_source(void *context, uint32_t offset, uint8_t *buffer, size_t length) {
+    apply_t *apply = context;
+    if (offset > apply->source->size || length > apply->source->size - offset) {
+        apply->bad_reads++;
+        return -1;
+    }
+    memcpy(buffer, apply->source->data + offset, length);
+    return 0;
+}
+
+static int write_target(void *context, const uint8_t *buffer, size_t length) {
+    apply_t *apply = context;
+    if (length > apply->target_size - apply->written) {
+        apply->bad_writes++;
+        return -1;
+    }
+    memcpy(apply->target + apply->written, buffer, length);
+    apply->written += length;
+    return 0;
+}
+
+
+static delta_patch_t patch;
+
+// Feeds delta in chunks of chunk bytes, or of random sizes up to
+// MAX_CHUNK if chunk is 0. Returns the last result of delta_patch_feed.
+static int apply_delta(const image_t *source, const uint8_t *delta, size_t delta_size, size_t chunk,
+                       apply_t *apply, size_t target_size) {
+    memset(apply, 0, sizeof(*apply));
+    apply->source = source;
+    apply->target = malloc(target_size + 1);
+    apply->target_size = target_size;
+
+    delta_patch_init(&patch, check_header, read_source, write_target, apply);
+    int r = DELTA_OK;
+    size_t position = 0;
+    while (position < delta_size && r == DELTA_OK) {
+        size_t n = chunk ? chunk : 1 + random_next() % MAX_CHUNK;
+        if (n > delta_size - position)
+            n = delta_size - position;
+        r = delta_patch_feed(&patch, delta + position, n);
+        position += n;
+    }
+    return r;
+}
+
+static bool out_of_bounds(const char *name, const apply_t *apply) {
+    if (apply->bad_reads || apply->bad_writes) {
+        char message[96];
+        snprintf(message, sizeof(message), "%d reads outside the source, %d writes past the target",
+                 apply->bad_reads, apply->bad_writes);
+        fail(name, message);
+        return true;
+    }
+    return false;
+}
+
+
+static void check_whole(const char *name, const image_t *old, const image_t *new,
+                        const image_t *delta, size_t chunk) {
+    apply_t apply;
+    int r = apply_delta(old, delta->data, delta->size, chunk, &apply, new->size);
+    if (!out_of_bounds(name, &apply)) {
+        if (r != DELTA_DONE) {
+            char message[64];
+            snprintf(message, sizeof(message), "ended with %d", r);
+            fail(name, message);
+        } else if (apply.written != new->size || memcmp(apply.target, new->data, new->size)) {
+            fail(name, "rebuilt image differs");
+        }
+    }
+    free(apply.target);
+}
+
+
+static void check_cut(const image_t *old, const image_t *new, const image_t *delta) {
+    int refused = 0, waiting = 0;
+    for (int i = 0; i < CUTS; i++) {
+        // Every cut in the header, then anywhere
+        size_t cut = i < 22 ? i : random_next() % delta->size;
+        if (i == CUTS - 1)
+            cut = delta->size - 1;
+
+        apply_t apply;
+        int r = apply_delta(old, delta->data, cut, 0, &apply, new->size);
+        free(apply.target);
+        if (out_of_bounds("cut delta", &apply))
+            return;
+        if (r == DELTA_DONE) {
+            char message[64];
+            snprintf(message, sizeof(message), "finished when cut at %zu of %zu bytes", cut, delta->size);
+            fail("cut delta", message);
+            return;
+        }
+        if (r < 0)
+            refused++;
+        else
+            waiting++;
+    }
+    printf("%-40s %d waiting for more, %d refused\n", "cut delta never finishes", waiting, refused);
+}
+
+
+static void check_corrupt(const image_t *old, const image_t *new, const image_t *delta) {
+    uint8_t *corrupt = malloc(delta->size);
+    int refused = 0, same = 0, unfinished = 0;
+    for (int i = 0; i < CORRUPTIONS; i++) {
+        memcpy(corrupt, delta->data, delta->size);
+        size_t at = random_next() % delta->size;
+        corrupt[at] ^= 1 + random_next() % 255;
+
+        apply_t apply;
+        int r = apply_delta(old, corrupt, delta->size, 0, &apply, new->size);
+        bool whole = r == DELTA_DONE && apply.written == new->size &&
+                     !memcmp(apply.target, new->data, new->size);
+        free(apply.target);
+        if (out_of_bounds("corrupt delta", &apply))
+            break;
+        if (r == DELTA_DONE && !whole) {
+            char message[64];
+            snprintf(message, sizeof(message), "byte %zu changed, wrong image accepted", at);
+            fail("corrupt delta", message);
+            break;
+        }
+        if (whole)
+            same++;
+        else if (r < 0)
+            refused++;
+        else
+            unfinished++;
+    }
+    free(corrupt);
+    printf("%-40s %d refused, %d unfinished, %d same image\n", "corrupt delta never accepted",
+           refused, unfinished, same);
+}
+
+
+static size_t put_u32(uint8_t *p, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        p[i] = value >> (8 * i);
+    return 4;
+}
+
+static size_t put_varint(uint8_t *p, uint64_t value) {
+    size_t n = 0;
+    do {
+        p[n] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+        value >>= 7;
+        n++;
+    } while (value);
+    return n;
+}
+
+static size_t put_header(uint8_t *p, const image_t *old, uint32_t target_size, uint8_t window_bits) {
+    memcpy(p, DELTA_MAGIC, 4);
+    size_t n = 4;
+    n += put_u32(p + n, old->size);
+    n += put_u32(p + n, delta_crc32(0, old->data, old->size));
+    n += put_u32(p + n, target_size);
+    n += put_u32(p + n, 0);
+    p[n++] = window_bits;
+    return n;
+}
+
+static void expect_refused(const char *name, const image_t *old, const uint8_t *delta, size_t size,
+                           int expected) {
+    apply_t apply;
+    int r = apply_delta(old, delta, size, 0, &apply, old->size * 2);
+    free(apply.target);
+    if (out_of_bounds(name, &apply))
+        return;
+    if (r != expected) {
+        char message[64];
+        snprintf(message, sizeof(message), "ended with %d, expected %d", r, expected);
+        fail(name, message);
+        return;
+    }
+    printf("%-40s %d\n", name, r);
+}
+
+static void check_crafted(const image_t *old) {
+    uint8_t delta[64];
+    size_t n;
+
+    // Starts 16 bytes in, the length wraps the end back inside the source
+    n = put_header(delta, old, old->size * 2, DELTA_WINDOW_BITS);
+    delta[n++] = 1 | (63 << 2);
+    n += put_varint(delta + n, 0x100000000ull - 8 - 64);
+    n += put_varint(delta + n, 16 << 1);
+    delta[n++] = 3;
+    expect_refused("source copy wrapping around", old, delta, n, DELTA_ERROR_FORMAT);
+
+    // A literal of 2^32 + 1 bytes, cut to 1 if the top bits are dropped
+    n = put_header(delta, old, old->size * 2, DELTA_WINDOW_BITS);
+    delta[n++] = 0 | (63 << 2);
+    n += put_varint(delta + n, 0x100000001ull - 64);
+    delta[n++] = 0x55;
+    delta[n++] = 3;
+    expect_refused("varint wider than 32 bits", old, delta, n, DELTA_ERROR_FORMAT);
+
+    // A literal of 2^32 + 1 bytes again, the top bits lost adding 64
+    n = put_header(delta, old, old->size * 2, DELTA_WINDOW_BITS);
+    delta[n++] = 0 | (63 << 2);
+    n += put_varint(delta + n, 0xffffffffull - 62);
+    delta[n++] = 0x55;
+    delta[n++] = 3;
+    expect_refused("length wrapping past 32 bits", old, delta, n, DELTA_ERROR_FORMAT);
+
+    n = put_header(delta, old, 16, DELTA_WINDOW_BITS);
+    delta[0] = 'X';
+    expect_refused("bad magic", old, delta, n, DELTA_ERROR_FORMAT);
+
+    n = put_header(delta, old, 16, DELTA_WINDOW_BITS + 1);
+    expect_refused("window larger than kept", old, delta, n, DELTA_ERROR_FORMAT);
+}
+
+
+static int command_check(const char *old_path, const char *new_path, const char *delta_path) {
+    image_t old, new, delta;
+    if (read_image(old_path, &old) || read_image(new_path, &new) || read_image(delta_path, &delta))
+        return 2;
+
+    printf("%zu byte image from %zu, delta %zu bytes (%.1f%%)\n", new.size, old.size, delta.size,
+           100.0 * delta.size / new.size);
+
+    check_whole("delta in one go", &old, &new, &delta, delta.size);
+    for (size_t chunk = 1; chunk <= MAX_CHUNK && !failures; chunk++)
+        check_whole("delta in chunks", &old, &new, &delta, chunk);
+    if (!failures)
+        printf("%-40s whole\n", "in one go and in chunks of 1 to 512");
+
+    check_cut(&old, &new, &delta);
+    check_corrupt(&old, &new, &delta);
+    check_crafted(&old);
+
+    // The running image is not the one the delta was made for
+    image_t other = { malloc(old.size), old.size };
+    memcpy(other.data, old.data, old.size);
+    other.data[old.size / 2] ^= 0xff;
+    expect_refused("delta for another source", &other, delta.data, delta.size, DELTA_ERROR_ABORTED);
+    free(other.data);
+
+    if (failures)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
+
+
+int main(int argc, char **argv) {
+    size_t size = 65536;
+    random_state = 1;
+
+    static const struct option options[] = {
+        { "size", required_argument, NULL, 's' },
+        { "seed", required_argument, NULL, 'r' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 's': size = strtoul(optarg, NULL, 0); break;
+            case 'r': random_state = strtoul(optarg, NULL, 0); break;
+            default: return 2;
+        }
+    }
+
+    if (argc - optind == 3 && !strcmp(argv[optind], "images") && size >= 1024)
+        return command_images(size, argv[optind + 1], argv[optind + 2]);
+    if (argc - optind == 4 && !strcmp(argv[optind], "check"))
+        return command_check(argv[optind + 1], argv[optind + 2], argv[optind + 3]);
+
+    fprintf(stderr, "usage: %s images [--size N] [--seed N] old.bin new.bin\n"
+                    "       %s check [--seed N] old.bin new.bin new.delta\n", argv[0], argv[0]);
+    return 2;
+}
@@ -0,0 +1,346 @@
+// Host bench of the flash_scheduler component: how many frames of an
+// animation a flash update delays, with erases and writes started anywhere
+// and with them kept between frames.
+//
+//   build/flash_scheduler_bench --period-ms 58 --sectors 8 --erase-us 45000 --write-us 700
+//
+// An animation task shows a frame every --period-ms, as fireplace does at
+// 17 fps, and calls flash_scheduler_frame_done after each. Meanwhile
+// sectors are erased and written through the scheduler, 4KB each. The
+// flash is a model in memory: an erase takes --erase-us and a page write
+// --write-us, the datasheet's typical times of the flash chips these
+// boards carry. On the device the instruction cache is off meanwhile and
+// the animation stalls; here its thread runs on, so a frame due while the
+// flash is busy is counted as late, by as long as the flash stayed busy.
+//
+// Each frame made late with the scheduler must be explained: the chunk
+// was forced after waiting MAX_DEFERRED_FRAMES frames, or took longer than
+// the scheduler's estimate when it let it start. Any other is a failure.
+//
+// Before the bench: writes are split at page boundaries, a failed chunk
+// ends the write, operations do not wait once frames stop and a chunk too
+// long to ever fit runs after MAX_DEFERRED_FRAMES frames.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+
+// The scheduler itself, so that its estimates can be looked at and reset
+#include "flash_scheduler.c"
+
+#define PAGE_SIZE 256
+#define MAX_SECTORS 32
+#define REGION_SIZE (MAX_SECTORS * SECTOR_SIZE)
+#define MAX_OPERATIONS (MAX_SECTORS * (1 + SECTOR_SIZE / PAGE_SIZE) + 64)
+#define MAX_FRAMES 10000
+
+typedef struct {
+    uint32_t address;
+    uint32_t size;              // 0 for an erase
+    uint32_t started_us;
+    uint32_t ended_us;
+    uint32_t estimate_us;       // the scheduler's when it let it start
+    bool forced;
+} operation_t;
+
+static int failures = 0;
+
+static uint32_t erase_us = 45000;
+static uint32_t write_us = 700;
+
+static uint8_t region[REGION_SIZE];
+static int fail_write = 0;      // write chunk to fail, counting from 1
+
+static operation_t operations[MAX_OPERATIONS];
+static int operation_count = 0;
+static uint32_t forced_seen = 0;
+
+static volatile bool animating = false;
+static volatile uint32_t period_ms = 58;
+static volatile bool recording = false;
+static uint32_t frames_us[MAX_FRAMES];
+static volatile int frame_count = 0;
+
+
+size_t xPortGetFreeHeapSize() {
+    return 0;
+}
+
+
+static void fail(const char *message) {
+    printf("FAIL: %s\n", message);
+    failures++;
+}
+
+
+// The flash model
+
+static void busy(uint32_t us) {
+    uint32_t until = sdk_system_get_time() + us;
+    while ((int32_t)(sdk_system_get_time() - until) < 0);
+}
+
+static operation_t *operation_start(uint32_t address, uint32_t size, uint32_t estimate_us) {
+    operation_t *operation = &operations[operation_count < MAX_OPERATIONS ? operation_count++ : 0];
+    *operation = (operation_t) {
+        .address = address,
+        .size = size,
+        .estimate_us = estimate_us,
+        .forced = stats.forced != forced_seen,
+    };
+    forced_seen = stats.forced;
+    operation->started_us = sdk_system_get_time();
+    return operation;
+}
+
+bool spiflash_erase_sector(uint32_t address) {
+    if (address % SECTOR_SIZE || address >= REGION_SIZE) {
+        fail("erase of an address not starting a sector");
+        return false;
+    }
+    operation_t *operation = operation_start(address, 0, erase_estimate_us);
+    busy(erase_us);
+    memset(region + address, 0xff, SECTOR_SIZE);
+    operation->ended_us = sdk_system_get_time();
+    return true;
+}
+
+bool spiflash_write(uint32_t address, uint8_t *buffer, uint32_t size) {
+    if (address > REGION_SIZE || size > REGION_SIZE - address) {
+        fail("write outside the flash");
+        return false;
+    }
+    if (address / PAGE_SIZE != (address + size - 1) / PAGE_SIZE) {
+        fail("write chunk across a page boundary");
+        return false;
+    }
+    operation_t *operation = operation_start(address, size, write_estimate_us);
+    busy(write_us);
+    // Programming can only clear bits
+    for (uint32_t i = 0; i < size; i++)
+        region[address + i] &= buffer[i];
+    operation->ended_us = sdk_system_get_time();
+    return fail_write == 0 || --fail_write != 0;
+}
+
+
+// The animation
+
+static void animation_task(void *arg) {
+    TickType_t wake = xTaskGetTickCount();
+    while (true) {
+        if (!animating) {
+            vTaskDelay(1);
+            wake = xTaskGetTickCount();
+            continue;
+        }
+        vTaskDelayUntil(&wake, period_ms);
+        if (recording && frame_count < MAX_FRAMES)
+            frames_us[frame_count++] = sdk_system_get_time();
+        flash_scheduler_frame_done();
+    }
+}
+
+// Frames every period if animated, the scheduler told of them if scheduled
+static void start(uint32_t period, bool animated, bool scheduled) {
+    period_ms = period;
+    animating = animated;
+    flash_scheduler_set_frame_period(scheduled ? period : 0);
+
+    // Each run learns its durations from the initial guesses
+    erase_estimate_us = ERASE_ESTIMATE_US;
+    write_estimate_us = WRITE_ESTIMATE_US;
+    flash_scheduler_stats_t discarded;
+    flash_scheduler_get_stats(&discarded, true);
+    forced_seen = 0;
+    operation_count = 0;
+    frame_count = 0;
+}
+
+
+// The checks
+
+static void check_chunks() {
+    start(period_ms, false, false);
+    memset(region, 0xff, sizeof(region));
+
+    // From 16 bytes before a page boundary to 16 bytes past the fourth one
+    uint8_t data[0x420];
+    for (int i = 0; i < sizeof(data); i++)
+        data[i] = i * 7;
+    bool written = flash_scheduler_write(0x1f0, data, sizeof(data));
+
+    static const uint32_t expected[] = { 16, 256, 256, 256, 256, 16 };
+    bool split = written && operation_count == 6;
+    for (int i = 0; split && i < 6; i++)
+        split = operations[i].size == expected[i];
+    if (!split)
+        fail("write across pages: not split at the page boundaries");
+    else if (memcmp(region + 0x1f0, data, sizeof(data)))
+        fail("write across pages: data differs");
+    else
+        printf("%-46s %d chunks\n", "write split at page boundaries", operation_count);
+
+    start(period_ms, false, false);
+    memset(region, 0xff, sizeof(region));
+    fail_write = 2;
+    written = flash_scheduler_write(0x1f0, data, sizeof(data));
+    fail_write = 0;
+    if (written || operation_count != 2 || region[0x300] != 0xff)
+        fail("failed chunk: write went on");
+    else
+        printf("%-46s after %d chunks\n", "failed chunk ends the write", operation_count);
+}
+
+static void check_stopped(uint32_t period) {
+    // Frames came, then stopped for more than two periods
+    start(period, true, true);
+    usleep(3 * period * 1000);
+    animating = false;
+    usleep(3 * period * 1000);
+
+    uint32_t started = sdk_system_get_time();
+    flash_scheduler_erase_sector(0);
+    uint32_t took = sdk_system_get_time() - started;
+
+    flash_scheduler_stats_t current;
+    flash_scheduler_get_stats(&current, true);
+    if (current.deferred || took > erase_us + period * 1000 / 2)
+        fail("frames stopped: erase waited");
+    else
+        printf("%-46s %.1f ms\n", "frames stopped, erase runs at once", took / 1000.0);
+}
+
+static void check_forced() {
+    // No gap between frames holds an erase
+    uint32_t period = (erase_us + MARGIN_US) / 1000 / 2;
+    if (period < 2)
+        period = 2;
+    start(period, true, true);
+    usleep(period * 1000);
+
+    flash_scheduler_erase_sector(0);
+    flash_scheduler_stats_t current;
+    flash_scheduler_get_stats(&current, true);
+    animating = false;
+
+    if (current.forced != 1 || current.deferred != MAX_DEFERRED_FRAMES) {
+        char message[96];
+        snprintf(message, sizeof(message), "erase longer than a frame: %u deferred, %u forced",
+                 current.deferred, current.forced);
+        fail(message);
+    } else {
+        printf("%-46s after %u frames\n", "erase longer than a frame forced", current.deferred);
+    }
+}
+
+
+// The bench
+
+static void bench(uint32_t period, int sectors, bool scheduled) {
+    start(period, true, scheduled);
+    usleep(2 * period_ms * 1000);
+    recording = true;
+
+    uint8_t data[SECTOR_SIZE];
+    uint32_t started = sdk_system_get_time();
+    for (int i = 0; i < sectors; i++) {
+        for (int j = 0; j < SECTOR_SIZE; j++)
+            data[j] = i + j;
+        uint32_t address = i * SECTOR_SIZE;
+        if (!flash_scheduler_erase_sector(address) || !flash_scheduler_write(address, data, SECTOR_SIZE) ||
+                memcmp(region + address, data, SECTOR_SIZE))
+            fail("sector not written");
+    }
+    uint32_t took = sdk_system_get_time() - started;
+
+    // The frame that would have come when the flash was done
+    usleep(2 * period_ms * 1000);
+    recording = false;
+    animating = false;
+
+    flash_scheduler_stats_t current;
+    flash_scheduler_get_stats(&current, true);
+
+    int late = 0, forced = 0, underestimated = 0, unexplained = 0;
+    uint32_t worst_us = 0;
+    for (int i = 0; i < frame_count; i++) {
+        for (int j = 0; j < operation_count; j++) {
+            const operation_t *operation = &operations[j];
+            if ((int32_t)(frames_us[i] - operation->started_us) < 0 ||
+                    (int32_t)(frames_us[i] - operation->ended_us) >= 0)
+                continue;
+
+            late++;
+            if (operation->ended_us - frames_us[i] > worst_us)
+                worst_us = operation->ended_us - frames_us[i];
+            if (operation->forced)
+                forced++;
+            else if (operation->ended_us - operation->started_us > operation->estimate_us)
+                underestimated++;
+            else
+                unexplained++;
+            break;
+        }
+    }
+
+    printf("%-14s %5d %5d %8.1f ms %8.1f ms %6u %6u\n", scheduled ? "scheduled" : "anywhere",
+           frame_count, late, worst_us / 1000.0, took / 1000.0, current.deferred, current.forced);
+    if (scheduled) {
+        printf("%-14s late by a forced chunk %d, by one over its estimate %d\n", "", forced, underestimated);
+        if (unexplained) {
+            char message[96];
+            snprintf(message, sizeof(message), "%d frames late by chunks expected to fit", unexplained);
+            fail(message);
+        }
+    }
+}
+
+
+int main(int argc, char **argv) {
+    int sectors = 8;
+    uint32_t period = 58;
+
+    static const struct option options[] = {
+        { "period-ms", required_argument, NULL, 'p' },
+        { "sectors", required_argument, NULL, 's' },
+        { "erase-us", required_argument, NULL, 'e' },
+        { "write-us", required_argument, NULL, 'w' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'p': period = atoi(optarg); break;
+            case 's': sectors = atoi(optarg); break;
+            case 'e': erase_us = atoi(optarg); break;
+            case 'w': write_us = atoi(optarg); break;
+            default: return 2;
+        }
+    }
+    if (period < 1 || period > 1000 || sectors < 1 || sectors > MAX_SECTORS ||
+            erase_us < 1 || erase_us > 1000000 || write_us < 1 || write_us > 100000) {
+        fprintf(stderr, "--period-ms takes 1 to 1000, --sectors 1 to %d\n", MAX_SECTORS);
+        return 2;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    xTaskCreate(animation_task, "Animation", 0, NULL, 2, NULL);
+
+    check_chunks();
+    check_stopped(period);
+    check_forced();
+
+    printf("%d sectors, a frame every %u ms, erase %u us, page write %u us\n",
+           sectors, period, erase_us, write_us);
+    printf("flash ops      frames  late    worst late     update  deferred forced\n");
+    bench(period, sectors, false);
+    bench(period, sectors, true);
+
+    if (failures)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// The flash model of the flash_scheduler bench, see bench.c
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool spiflash_erase_sector(uint32_t address);
+bool spiflash_write(uint32_t address, uint8_t *buffer, uint32_t size);
@@ -0,0 +1,122 @@
+// Host check of the gesture component.
+//
+//   build/check_gesture
+//
+// Each case builds a recognizer from a small table and feeds it button
+// events, then compares the actions reported, one digit per event, with
+// what the table means. Tables where one sequence sits inside another
+// must be refused: the shorter sequence would fire halfway through the
+// longer one and reset the recognizer, so the longer one could never
+// fire.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gesture.h"
+
+enum { A, B, C, BUTTONS };
+enum { SINGLE, DOUBLE, LONG, EVENTS };
+
+#define TIMEOUT 500
+
+typedef struct {
+    uint8_t button;
+    uint8_t event;
+    uint32_t time;
+} feed_t;
+
+static int failures = 0;
+
+
+#define TABLE(...) ((const gesture_sequence_t[]){ __VA_ARGS__ }), \
+    sizeof((const gesture_sequence_t[]){ __VA_ARGS__ }) / sizeof(gesture_sequence_t)
+
+#define PRESSES(_action, ...) \
+    GESTURE_SEQUENCE(_action, TIMEOUT, __VA_ARGS__)
+
+#define PRESS(_button) GESTURE_STEP(_button, SINGLE)
+
+
+static void expect_refused(const char *name, const gesture_sequence_t *table, size_t count) {
+    gesture_recognizer_t *r = gesture_recognizer_create(table, count, BUTTONS, EVENTS);
+    if (r) {
+        printf("FAIL: %s: table accepted\n", name);
+        failures++;
+        gesture_recognizer_destroy(r);
+        return;
+    }
+    printf("%-44s refused\n", name);
+}
+
+
+static void expect_actions(const char *name, const gesture_sequence_t *table, size_t count,
+                           const feed_t *feeds, int feed_count, const char *expected) {
+    gesture_recognizer_t *r = gesture_recognizer_create(table, count, BUTTONS, EVENTS);
+    if (!r) {
+        printf("FAIL: %s: table refused\n", name);
+        failures++;
+        return;
+    }
+
+    char actions[32];
+    for (int i = 0; i < feed_count; i++)
+        actions[i] = '0' + gesture_recognizer_feed(r, feeds[i].button, feeds[i].event, feeds[i].time);
+    actions[feed_count] = 0;
+    gesture_recognizer_destroy(r);
+
+    if (strcmp(actions, expected)) {
+        printf("FAIL: %s: actions %s, expected %s\n", name, actions, expected);
+        failures++;
+        return;
+    }
+    printf("%-44s %s\n", name, actions);
+}
+
+#define EXPECT_ACTIONS(_name, _table, _expected, ...) \
+    expect_actions(_name, _table, (const feed_t[]){ __VA_ARGS__ }, \
+                   sizeof((const feed_t[]){ __VA_ARGS__ }) / sizeof(feed_t), _expected)
+
+
+int main() {
+    expect_refused("sequence inside a longer one",
+                   TABLE(PRESSES(1, PRESS(A), PRESS(B), PRESS(C)),
+                         PRESSES(2, PRESS(B))));
+    expect_refused("sequence inside one with a wildcard",
+                   TABLE(PRESSES(1, PRESS(A), PRESS(GESTURE_ANY_BUTTON), PRESS(C)),
+                         PRESSES(2, PRESS(B))));
+    expect_refused("longer sequence listed first, then inside",
+                   TABLE(PRESSES(1, PRESS(A), PRESS(B), PRESS(B), PRESS(C)),
+                         PRESSES(2, PRESS(B), PRESS(B))));
+    expect_refused("sequence that starts a longer one",
+                   TABLE(PRESSES(1, PRESS(A), PRESS(B)),
+                         PRESSES(2, PRESS(A))));
+
+    EXPECT_ACTIONS("three presses fire on the third",
+                   TABLE(PRESSES(1, PRESS(A), PRESS(B), PRESS(C))), "001",
+                   { A, SINGLE, 0 }, { B, SINGLE, 100 }, { C, SINGLE, 200 });
+    EXPECT_ACTIONS("sequence that ends a longer one",
+                   TABLE(PRESSES(1, PRESS(A), PRESS(B)),
+                         PRESSES(2, PRESS(B))), "012",
+                   { A, SINGLE, 0 }, { B, SINGLE, 100 }, { B, SINGLE, 200 });
+    EXPECT_ACTIONS("a pause longer than the timeout restarts",
+                   TABLE(PRESSES(1, PRESS(A), PRESS(B), PRESS(C))), "000001",
+                   { A, SINGLE, 0 }, { B, SINGLE, 100 }, { C, SINGLE, 100 + TIMEOUT + 1 },
+                   { A, SINGLE, 1000 }, { B, SINGLE, 1100 }, { C, SINGLE, 1200 });
+    EXPECT_ACTIONS("a repeated first step starts over",
+                   TABLE(PRESSES(1, PRESS(A), PRESS(A), PRESS(B))), "0001",
+                   { A, SINGLE, 0 }, { A, SINGLE, 100 }, { A, SINGLE, 200 }, { B, SINGLE, 300 });
+    EXPECT_ACTIONS("the first listed wins on the same events",
+                   TABLE(PRESSES(1, PRESS(A), PRESS(B)),
+                         PRESSES(2, PRESS(GESTURE_ANY_BUTTON), PRESS(B))), "0102",
+                   { A, SINGLE, 0 }, { B, SINGLE, 100 }, { C, SINGLE, 200 }, { B, SINGLE, 300 });
+    EXPECT_ACTIONS("two double presses on any buttons",
+                   TABLE(GESTURE_SEQUENCE(1, 10000,
+                                          GESTURE_STEP(GESTURE_ANY_BUTTON, DOUBLE),
+                                          GESTURE_STEP(GESTURE_ANY_BUTTON, DOUBLE))), "0001",
+                   { A, DOUBLE, 0 }, { B, SINGLE, 100 }, { B, DOUBLE, 200 }, { C, DOUBLE, 300 });
+
+    if (failures)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,183 @@
+// Host benchmark of the glyph cache of the random_password example against
+// the ssd1306_draw_string path it replaces.
+//
+//   build/glyph_cache_bench --count 100000 --seed 1
+//
+// Both draw the same random passwords (XXX-XX-XXX) as display_password
+// does, at the same place on a 128x64 buffer; every frame must come out
+// byte for byte the same. Then each way is timed over --count passwords.
+// Host time only says how the two compare; the calls counted next to it
+// are what the ESP8266 runs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <ssd1306/ssd1306.h>
+#include <fonts/fonts.h>
+
+#include "glyph_cache.h"
+
+// As in examples/random_password/main.c
+#define DISPLAY_WIDTH 128
+#define DISPLAY_HEIGHT 64
+#define DEFAULT_FONT FONT_FACE_TERMINUS_BOLD_12X24_ISO8859_1
+#define PASSWORD_X 4
+#define PASSWORD_Y 20
+
+#define CHECKED_PASSWORDS 10000
+
+static const ssd1306_t display = {
+    .width = DISPLAY_WIDTH,
+    .height = DISPLAY_HEIGHT,
+};
+
+
+static void random_password(char *password) {
+    for (int i = 0; i < 10; i++)
+        password[i] = (i == 3 || i == 6) ? '-' : '0' + rand() % 10;
+    password[10] = 0;
+}
+
+
+static void draw_with_pixels(uint8_t *fb, const char *password) {
+    ssd1306_fill_rectangle(&display, fb, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, OLED_COLOR_BLACK);
+    ssd1306_draw_string(&display, fb, font_builtin_fonts[DEFAULT_FONT], PASSWORD_X, PASSWORD_Y,
+                        password, OLED_COLOR_WHITE, OLED_COLOR_BLACK);
+}
+
+
+static int draw_with_cache(uint8_t *fb, const char *password) {
+    memset(fb, 0, DISPLAY_WIDTH * DISPLAY_HEIGHT / 8);
+    return glyph_cache_draw_string(&display, fb, PASSWORD_X, password);
+}
+
+
+static int check_frame(const char *password) {
+    static uint8_t expected[DISPLAY_WIDTH * DISPLAY_HEIGHT / 8];
+    static uint8_t drawn[DISPLAY_WIDTH * DISPLAY_HEIGHT / 8];
+
+    draw_with_pixels(expected, password);
+    if (draw_with_cache(drawn, password) < 0) {
+        printf("FAIL: \"%s\" not drawn from the cache\n", password);
+        return -1;
+    }
+    for (int i = 0; i < sizeof(drawn); i++) {
+        if (drawn[i] != expected[i]) {
+            printf("FAIL: \"%s\": page %d column %d is %02x, not %02x\n", password,
+                   i / DISPLAY_WIDTH, i % DISPLAY_WIDTH, drawn[i], expected[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+static double seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+int main(int argc, char **argv) {
+    int count = 100000;
+    unsigned seed = 1;
+
+    static const struct option options[] = {
+        { "count", required_argument, NULL, 'c' },
+        { "seed", required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'c': count = atoi(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default: return 2;
+        }
+    }
+    if (count < 1) {
+        fprintf(stderr, "--count takes a positive number\n");
+        return 2;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    srand(seed);
+
+    const font_info_t *font = font_builtin_fonts[DEFAULT_FONT];
+    double started = seconds();
+    if (glyph_cache_init(&display, font, PASSWORD_Y) < 0) {
+        printf("FAIL: glyph_cache_init\n");
+        return 1;
+    }
+    printf("glyph cache: built in %.1f us\n", (seconds() - started) * 1e6);
+
+    // Every glyph, then random passwords
+    int failures = 0;
+    failures += check_frame("0123456789") < 0;
+    failures += check_frame("-----") < 0;
+    char password[11];
+    for (int i = 0; i < CHECKED_PASSWORDS; i++) {
+        random_password(password);
+        failures += check_frame(password) < 0;
+    }
+
+    // Left to the pixel path: other characters, and text running off the display
+    static uint8_t fb[DISPLAY_WIDTH * DISPLAY_HEIGHT / 8];
+    static const char *refused[] = { "123-AB-678", "123 45 678", "1234567890-" };
+    for (int i = 0; i < sizeof(refused) / sizeof(*refused); i++) {
+        memset(fb, 0, sizeof(fb));
+        if (glyph_cache_draw_string(&display, fb, PASSWORD_X, refused[i]) >= 0) {
+            printf("FAIL: \"%s\" drawn from the cache\n", refused[i]);
+            failures++;
+        }
+        for (int j = 0; j < sizeof(fb); j++) {
+            if (fb[j]) {
+                printf("FAIL: \"%s\" drawn in part\n", refused[i]);
+                failures++;
+                break;
+            }
+        }
+    }
+    if (failures)
+        return 1;
+    printf("%d passwords drawn the same both ways\n", CHECKED_PASSWORDS + 2);
+
+    // The same passwords for both, made beforehand
+    char (*passwords)[11] = malloc(count * sizeof(*passwords));
+    for (int i = 0; i < count; i++)
+        random_password(passwords[i]);
+
+    uint32_t sum = 0;
+    started = seconds();
+    for (int i = 0; i < count; i++) {
+        draw_with_pixels(fb, passwords[i]);
+        sum += fb[(PASSWORD_Y / 8 + 1) * DISPLAY_WIDTH + PASSWORD_X + i % 120];
+    }
+    double pixels = (seconds() - started) / count;
+
+    started = seconds();
+    for (int i = 0; i < count; i++) {
+        draw_with_cache(fb, passwords[i]);
+        sum -= fb[(PASSWORD_Y / 8 + 1) * DISPLAY_WIDTH + PASSWORD_X + i % 120];
+    }
+    double cached = (seconds() - started) / count;
+    free(passwords);
+
+    const font_char_desc_t *d = font_get_char_desc(font, '0');
+    int pages = (PASSWORD_Y % 8 + font->height + 7) / 8;
+    printf("ssd1306_draw_string: %.2f us a password, %d ssd1306_draw_pixel calls with the clearing\n",
+           pixels * 1e6, DISPLAY_WIDTH * DISPLAY_HEIGHT + 10 * d->width * font->height);
+    printf("glyph cache:         %.2f us a password, %d memcpy's of %d bytes and a memset, %.0fx faster\n",
+           cached * 1e6, 10 * pages, d->width, pixels / cached);
+    printf("checksum difference %u (0 expected)\n", sum);
+    if (sum) {
+        printf("FAIL: the frames differ\n");
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
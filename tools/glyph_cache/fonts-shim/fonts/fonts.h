@@ -0,0 +1,35 @@
+#pragma once
+
+// Stand-in for extras/fonts/fonts.h when no esp-open-rtos tree is at hand:
+// the same types and a single face of the size of Terminus Bold 12x24,
+// with made up glyphs, see fonts.c.
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+    uint8_t width;
+    uint16_t offset;
+} font_char_desc_t;
+
+typedef struct {
+    uint8_t height;
+    uint8_t c;              // space between characters
+    char char_start;
+    char char_end;
+    const font_char_desc_t *char_descriptors;
+    const uint8_t *bitmap;
+} font_info_t;
+
+typedef enum {
+    FONT_FACE_TERMINUS_BOLD_12X24_ISO8859_1 = 0,
+} font_face_t;
+
+extern const font_info_t *font_builtin_fonts[];
+
+static inline const font_char_desc_t *font_get_char_desc(const font_info_t *font, char c) {
+    if (c < font->char_start || c > font->char_end)
+        return NULL;
+    const font_char_desc_t *d = &font->char_descriptors[c - font->char_start];
+    return d->width ? d : NULL;
+}
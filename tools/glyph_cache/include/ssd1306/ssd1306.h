@@ -0,0 +1,27 @@
+#pragma once
+
+// The frame buffer drawing of extras/ssd1306 for the host, see ssd1306.c.
+// Only what draws into a buffer: nothing is sent to a display.
+
+#include <stdint.h>
+#include <fonts/fonts.h>
+
+typedef enum {
+    OLED_COLOR_TRANSPARENT = -1,
+    OLED_COLOR_BLACK = 0,
+    OLED_COLOR_WHITE = 1,
+    OLED_COLOR_INVERT = 2,
+} ssd1306_color_t;
+
+typedef struct {
+    uint8_t width;
+    uint8_t height;
+} ssd1306_t;
+
+int ssd1306_draw_pixel(const ssd1306_t *dev, uint8_t *fb, int8_t x, int8_t y, ssd1306_color_t color);
+int ssd1306_fill_rectangle(const ssd1306_t *dev, uint8_t *fb, int8_t x, int8_t y, uint8_t w, uint8_t h,
+                           ssd1306_color_t color);
+int ssd1306_draw_char(const ssd1306_t *dev, uint8_t *fb, const font_info_t *font, uint8_t x, uint8_t y,
+                      char c, ssd1306_color_t foreground, ssd1306_color_t background);
+int ssd1306_draw_string(const ssd1306_t *dev, uint8_t *fb, const font_info_t *font, uint8_t x, uint8_t y,
+                        const char *str, ssd1306_color_t foreground, ssd1306_color_t background);
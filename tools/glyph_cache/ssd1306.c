@@ -0,0 +1,97 @@
+// The drawing path of extras/ssd1306/ssd1306.c as it is on the device, for
+// the host: the frame buffer holds pages of 8 rows, a byte per column, and
+// every pixel of a character or rectangle goes through ssd1306_draw_pixel.
+
+#include <errno.h>
+#include <ssd1306/ssd1306.h>
+
+
+int ssd1306_draw_pixel(const ssd1306_t *dev, uint8_t *fb, int8_t x, int8_t y, ssd1306_color_t color) {
+    if (x >= dev->width || x < 0 || y >= dev->height || y < 0)
+        return -EINVAL;
+
+    uint16_t index = x + (y / 8) * dev->width;
+    switch (color) {
+        case OLED_COLOR_WHITE:
+            fb[index] |= 1 << (y & 7);
+            break;
+        case OLED_COLOR_BLACK:
+            fb[index] &= ~(1 << (y & 7));
+            break;
+        case OLED_COLOR_INVERT:
+            fb[index] ^= 1 << (y & 7);
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+
+static int draw_hline(const ssd1306_t *dev, uint8_t *fb, int8_t x, int8_t y, uint8_t w, ssd1306_color_t color) {
+    for (int i = 0; i < w; i++) {
+        int err = ssd1306_draw_pixel(dev, fb, x + i, y, color);
+        if (err)
+            return err;
+    }
+    return 0;
+}
+
+
+int ssd1306_fill_rectangle(const ssd1306_t *dev, uint8_t *fb, int8_t x, int8_t y, uint8_t w, uint8_t h,
+                           ssd1306_color_t color) {
+    for (int i = y; i < y + h; i++) {
+        int err = draw_hline(dev, fb, x, i, w, color);
+        if (err)
+            return err;
+    }
+    return 0;
+}
+
+
+int ssd1306_draw_char(const ssd1306_t *dev, uint8_t *fb, const font_info_t *font, uint8_t x, uint8_t y,
+                      char c, ssd1306_color_t foreground, ssd1306_color_t background) {
+    if (!font)
+        return 0;
+    const font_char_desc_t *d = font_get_char_desc(font, c);
+    if (!d)
+        return 0;
+
+    const uint8_t *bitmap = font->bitmap + d->offset;
+    uint8_t line = 0;
+    for (int j = 0; j < font->height; j++) {
+        for (int i = 0; i < d->width; i++) {
+            if (i % 8 == 0)
+                line = bitmap[(d->width + 7) / 8 * j + i / 8];
+
+            int err = 0;
+            if (line & 0x80)
+                err = ssd1306_draw_pixel(dev, fb, x + i, y + j, foreground);
+            else if (background == OLED_COLOR_WHITE || background == OLED_COLOR_BLACK)
+                err = ssd1306_draw_pixel(dev, fb, x + i, y + j, background);
+            if (err)
+                return -ERANGE;
+            line <<= 1;
+        }
+    }
+    return d->width;
+}
+
+
+int ssd1306_draw_string(const ssd1306_t *dev, uint8_t *fb, const font_info_t *font, uint8_t x, uint8_t y,
+                        const char *str, ssd1306_color_t foreground, ssd1306_color_t background) {
+    if (!font || !str)
+        return 0;
+
+    uint8_t start = x;
+    while (*str) {
+        int width = ssd1306_draw_char(dev, fb, font, x, y, *str, foreground, background);
+        if (width < 0)
+            return width;
+        x += width;
+        str++;
+        if (*str)
+            x += font->c;
+    }
+    return x - start;
+}
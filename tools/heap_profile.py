@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+#
+# Symbolizer for the reports of the heap_profile component.
+#
+# Reads the "heap-profile" lines a device prints (or serves over TCP with
+# heap_profile_serve) and puts the function and source line next to each
+# call site address, resolved against the example's ELF. Other lines are
+# dropped.
+#
+# Usage:
+#   tools/heap_profile.py --elf build/JPmbutton.out serial.log
+#   nc 192.168.1.50 3335 | tools/heap_profile.py --elf build/JPmbutton.out
+#
+# From an example directory: make heap-profile DUMP=serial.log
+#                        or: make heap-profile DUMP_HOST=192.168.1.50
+#
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+
+ADDRESS_RE = re.compile(r'0x(40[12][0-9a-f]{5})')
+
+
+def symbolize(addr2line, elf, addresses):
+    if not addresses:
+        return {}
+
+    # Return addresses point past the call instruction, look one byte back
+    # so that the line of the call itself is reported
+    output = subprocess.run([addr2line, '-fC', '-e', elf] + ['0x%08x' % (a - 1) for a in addresses],
+                            check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+    lines = output.splitlines()
+    symbols = {}
+    for i, address in enumerate(addresses):
+        function, location = lines[2 * i], lines[2 * i + 1]
+        symbols[address] = '%s (%s)' % (function, os.path.basename(location.split(' ')[0]))
+    return symbols
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Symbolize heap_profile reports')
+    parser.add_argument('log', nargs='?', help='serial log or TCP dump (default: stdin)')
+    parser.add_argument('--elf', required=True, help='linked program the device was running (build/<program>.out)')
+    parser.add_argument('--cross', default=os.environ.get('CROSS', 'xtensa-lx106-elf-'),
+                        help='toolchain prefix (default: %(default)s)')
+    args = parser.parse_args()
+
+    if args.log:
+        with open(args.log, errors='replace') as f:
+            lines = [line.rstrip('\n') for line in f if 'heap-profile' in line]
+    else:
+        lines = [line.rstrip('\n') for line in sys.stdin if 'heap-profile' in line]
+
+    if not lines:
+        print('No heap-profile report found')
+        return 1
+
+    addresses = sorted({int(a, 16) for line in lines for a in ADDRESS_RE.findall(line)})
+    symbols = symbolize(args.cross + 'addr2line', args.elf, addresses)
+
+    for line in lines:
+        line = line[line.index('heap-profile'):]
+        match = ADDRESS_RE.search(line)
+        if match:
+            line += '  ' + symbols[int(match.group(1), 16)]
+        print(line)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
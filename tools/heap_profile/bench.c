@@ -0,0 +1,269 @@
+// Host bench of the heap_profile component: what it adds to each malloc,
+// realloc and free, and how long the probes of its tables get.
+//
+//   build/heap_profile_bench --operations 200000 --live 100 --sites 24
+//
+// The same random run of allocations and frees is timed twice, once
+// straight through the C library and once through the profiler's
+// wrappers. Allocations come from --sites distinct call sites, reallocs
+// from one more, and about --live of them are held at once. Before
+// everything is freed, the probe lengths of the live table and of the
+// call site hash are measured, and the counts of the tables are checked
+// against what the bench holds; after, they must all be back to zero.
+//
+// The times are those of the host, where a critical section is an
+// uncontended mutex: they show the share of the profiler, not what a call
+// takes on the device.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+// The profiler itself, so that its tables can be looked at
+#include "heap_profile.c"
+
+#define MAX_SITES 32
+#define MAX_LIVE (HEAP_PROFILE_LIVE / 4 * 3)
+
+static bool profiled;
+static uint32_t site_failures[MAX_SITES + 1];
+
+static int failures = 0;
+
+
+static void fail(const char *message) {
+    printf("FAIL: %s\n", message);
+    failures++;
+}
+
+
+size_t xPortGetFreeHeapSize() {
+    return 0;
+}
+
+
+// One function per call site: the bodies differ, so that the compiler
+// neither merges them nor turns the call into a jump
+#define SITE(n) \
+    static void *site_##n(size_t size) { \
+        void *ptr = profiled ? malloc(size) : __real_malloc(size); \
+        if (!ptr) \
+            site_failures[n]++; \
+        return ptr; \
+    }
+
+SITE(0) SITE(1) SITE(2) SITE(3) SITE(4) SITE(5) SITE(6) SITE(7)
+SITE(8) SITE(9) SITE(10) SITE(11) SITE(12) SITE(13) SITE(14) SITE(15)
+SITE(16) SITE(17) SITE(18) SITE(19) SITE(20) SITE(21) SITE(22) SITE(23)
+SITE(24) SITE(25) SITE(26) SITE(27) SITE(28) SITE(29) SITE(30) SITE(31)
+
+static void *(*const site_functions[MAX_SITES])(size_t) = {
+    site_0, site_1, site_2, site_3, site_4, site_5, site_6, site_7,
+    site_8, site_9, site_10, site_11, site_12, site_13, site_14, site_15,
+    site_16, site_17, site_18, site_19, site_20, site_21, site_22, site_23,
+    site_24, site_25, site_26, site_27, site_28, site_29, site_30, site_31,
+};
+
+static void *realloc_site(void *ptr, size_t size) {
+    void *moved = profiled ? realloc(ptr, size) : __real_realloc(ptr, size);
+    if (!moved)
+        site_failures[MAX_SITES]++;
+    return moved;
+}
+
+static void free_now(void *ptr) {
+    if (profiled)
+        free(ptr);
+    else
+        __real_free(ptr);
+}
+
+
+// Mostly small, as HomeKit and lwIP allocate, now and then a buffer
+static size_t random_size() {
+    return rand() % 16 ? 8 + rand() % 120 : 256 + rand() % 768;
+}
+
+
+typedef struct {
+    int operations;
+    int live;
+    int sites;
+    unsigned seed;
+} options_t;
+
+static void *held[MAX_LIVE];
+static int held_count;
+static bool reallocated;
+
+
+// Returns the nanoseconds per call, leaving what it allocated held
+static double run(const options_t *options) {
+    srand(options->seed);
+    held_count = 0;
+    reallocated = false;
+
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    for (int i = 0; i < options->operations; i++) {
+        if (!held_count || (held_count < options->live && rand() % 2)) {
+            held[held_count++] = site_functions[rand() % options->sites](random_size());
+            continue;
+        }
+
+        int n = rand() % held_count;
+        if (rand() % 8 == 0) {
+            void *moved = realloc_site(held[n], random_size());
+            if (moved)
+                held[n] = moved;
+            reallocated = true;
+        } else {
+            free_now(held[n]);
+            held[n] = held[--held_count];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+
+    return ((finished.tv_sec - started.tv_sec) * 1e9 + (finished.tv_nsec - started.tv_nsec)) /
+           options->operations;
+}
+
+static void free_held() {
+    while (held_count)
+        free_now(held[--held_count]);
+}
+
+
+// Slots an entry sits past its home slot, the probes a lookup takes less one
+static void live_probes(double *mean, int *longest) {
+    int entries = 0, total = 0;
+    *longest = 0;
+    for (int i = 0; i < HEAP_PROFILE_LIVE; i++) {
+        if (!live[i].ptr)
+            continue;
+        uint32_t home = hash((uint32_t)(uintptr_t)live[i].ptr >> 3) & (HEAP_PROFILE_LIVE - 1);
+        int distance = (i - home) & (HEAP_PROFILE_LIVE - 1);
+        total += distance;
+        entries++;
+        if (distance > *longest)
+            *longest = distance;
+    }
+    *mean = entries ? (double)total / entries : 0;
+}
+
+static void site_probes(double *mean, int *longest) {
+    int total = 0;
+    *longest = 0;
+    for (int i = 0; i < SITE_HASH_SIZE; i++) {
+        if (!site_hash[i])
+            continue;
+        uint32_t home = hash(sites[site_hash[i] - 1].pc >> 2) & (SITE_HASH_SIZE - 1);
+        int distance = (i - home) & (SITE_HASH_SIZE - 1);
+        total += distance;
+        if (distance > *longest)
+            *longest = distance;
+    }
+    *mean = site_count ? (double)total / site_count : 0;
+}
+
+
+static void check_tables() {
+    char message[128];
+
+    if (live_count != held_count) {
+        snprintf(message, sizeof(message), "%u allocations live, %d held", live_count, held_count);
+        fail(message);
+    }
+    if (untracked || unattributed) {
+        snprintf(message, sizeof(message), "%u untracked, %u unattributed", untracked, unattributed);
+        fail(message);
+    }
+
+    uint32_t site_live_count = 0, site_live_bytes = 0;
+    for (int i = 0; i < site_count; i++) {
+        site_live_count += sites[i].live_count;
+        site_live_bytes += sites[i].live_bytes;
+    }
+    if (site_live_count != live_count || site_live_bytes != live_bytes)
+        fail("the sites do not add up to the live table");
+}
+
+
+int main(int argc, char **argv) {
+    options_t options = {
+        .operations = 200000,
+        .live = 100,
+        .sites = 24,
+        .seed = time(NULL),
+    };
+
+    static const struct option long_options[] = {
+        { "operations", required_argument, NULL, 'o' },
+        { "live", required_argument, NULL, 'l' },
+        { "sites", required_argument, NULL, 's' },
+        { "seed", required_argument, NULL, 'r' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'o': options.operations = atoi(optarg); break;
+            case 'l': options.live = atoi(optarg); break;
+            case 's': options.sites = atoi(optarg); break;
+            case 'r': options.seed = strtoul(optarg, NULL, 0); break;
+            default: return 2;
+        }
+    }
+    if (options.operations < 1 || options.live < 1 || options.live > MAX_LIVE ||
+            options.sites < 1 || options.sites > MAX_SITES) {
+        fprintf(stderr, "--live is 1 to %d, --sites 1 to %d\n", MAX_LIVE, MAX_SITES);
+        return 2;
+    }
+
+    printf("%d operations, about %d allocations held, %d call sites, seed %u\n",
+           options.operations, options.live, options.sites, options.seed);
+
+    // A first run to warm the caches and the C library's heap
+    profiled = false;
+    run(&options);
+    free_held();
+    double bare = run(&options);
+    free_held();
+
+    profiled = true;
+    double with_profiler = run(&options);
+
+    int live_at_end = live_count;
+    double live_mean, site_mean;
+    int live_longest, site_longest;
+    live_probes(&live_mean, &live_longest);
+    site_probes(&site_mean, &site_longest);
+
+    check_tables();
+    if (site_count != options.sites + reallocated)
+        fail("call sites not told apart");
+    free_held();
+    check_tables();
+    if (live_bytes)
+        fail("bytes left live once everything is freed");
+
+    for (int i = 0; i <= MAX_SITES; i++) {
+        if (site_failures[i])
+            fail("out of memory");
+    }
+
+    printf("without the profiler %7.1f ns per call\n", bare);
+    printf("with the profiler    %7.1f ns per call, %.1f ns added\n",
+           with_profiler, with_profiler - bare);
+    printf("live table  %3d of %d slots at the end, probes past the first: mean %.2f, longest %d\n",
+           live_at_end, HEAP_PROFILE_LIVE, live_mean, live_longest);
+    printf("site hash   %3d of %d slots, probes past the first: mean %.2f, longest %d\n",
+           site_count, SITE_HASH_SIZE, site_mean, site_longest);
+
+    if (failures)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,245 @@
+// The FreeRTOS and SDK calls the host harnesses in tools/ share: tasks are
+// detached threads, ticks are milliseconds of CLOCK_MONOTONIC, queues and
+// semaphores are a mutex and a condition variable each.
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <semphr.h>
+#include <espressif/esp_common.h>
+#include <esp/hwrand.h>
+
+#include "host_shim.h"
+
+pthread_mutex_t critical_section = PTHREAD_MUTEX_INITIALIZER;
+
+TaskHandle_t host_shim_tasks[HOST_SHIM_MAX_TASKS];
+int host_shim_task_count = 0;
+
+static __thread TaskHandle_t current_task = NULL;
+
+
+// The absolute time timeout ticks from now, for pthread_cond_timedwait
+static struct timespec deadline_after(TickType_t timeout) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+}
+
+
+static void *task_main(void *arg) {
+    TaskHandle_t task = arg;
+    current_task = task;
+    task->function(task->parameters);
+    return NULL;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                               void *parameters, UBaseType_t priority,
+                               StackType_t *stack, StaticTask_t *task) {
+    memset(task, 0, sizeof(*task));
+    task->name = name;
+    task->function = function;
+    task->parameters = parameters;
+    pthread_mutex_init(&task->mutex, NULL);
+    pthread_cond_init(&task->notified, NULL);
+
+    taskENTER_CRITICAL();
+    if (host_shim_task_count < HOST_SHIM_MAX_TASKS)
+        host_shim_tasks[host_shim_task_count++] = task;
+    taskEXIT_CRITICAL();
+
+    if (pthread_create(&task->thread, NULL, task_main, task))
+        return NULL;
+    pthread_detach(task->thread);
+    return task;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                       void *parameters, UBaseType_t priority, TaskHandle_t *created) {
+    StaticTask_t *task = malloc(sizeof(StaticTask_t));
+    if (!task || !xTaskCreateStatic(function, name, stack_depth, parameters, priority, NULL, task)) {
+        free(task);
+        return pdFALSE;
+    }
+    if (created)
+        *created = task;
+    return pdTRUE;
+}
+
+void vTaskSuspendAll() {
+    taskENTER_CRITICAL();
+}
+
+BaseType_t xTaskResumeAll() {
+    taskEXIT_CRITICAL();
+    return pdFALSE;
+}
+
+TickType_t xTaskGetTickCount() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    usleep(ticks * 1000);
+}
+
+void vTaskDelayUntil(TickType_t *previous_wake_time, TickType_t increment) {
+    *previous_wake_time += increment;
+    int32_t wait = *previous_wake_time - xTaskGetTickCount();
+    if (wait > 0)
+        usleep(wait * 1000);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout) {
+    TaskHandle_t task = current_task;
+    if (!task)
+        abort();
+    struct timespec deadline = deadline_after(timeout);
+
+    pthread_mutex_lock(&task->mutex);
+    while (!task->notifications) {
+        if (timeout == portMAX_DELAY)
+            pthread_cond_wait(&task->notified, &task->mutex);
+        else if (!timeout || pthread_cond_timedwait(&task->notified, &task->mutex, &deadline))
+            break;
+    }
+    uint32_t count = task->notifications;
+    if (count)
+        task->notifications = clear ? 0 : count - 1;
+    pthread_mutex_unlock(&task->mutex);
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->mutex);
+    task->notifications++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->mutex);
+    return pdTRUE;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return 0;
+}
+
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage,
+                                 StaticQueue_t *queue) {
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    queue->storage = storage;
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->head = queue->count = 0;
+    return queue;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t timeout) {
+    pthread_mutex_lock(&queue->mutex);
+    BaseType_t sent = queue->count < queue->length;
+    if (sent) {
+        UBaseType_t tail = (queue->head + queue->count++) % queue->length;
+        memcpy(queue->storage + tail * queue->item_size, item, queue->item_size);
+        pthread_cond_signal(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return sent;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout) {
+    struct timespec deadline = deadline_after(timeout);
+
+    pthread_mutex_lock(&queue->mutex);
+    while (!queue->count) {
+        if (timeout == portMAX_DELAY)
+            pthread_cond_wait(&queue->changed, &queue->mutex);
+        else if (pthread_cond_timedwait(&queue->changed, &queue->mutex, &deadline))
+            break;
+    }
+    BaseType_t received = queue->count > 0;
+    if (received) {
+        memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return received;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    pthread_cond_destroy(&queue->changed);
+    pthread_mutex_destroy(&queue->mutex);
+}
+
+
+static SemaphoreHandle_t semaphore_init(StaticSemaphore_t *buffer, int count) {
+    pthread_mutex_init(&buffer->mutex, NULL);
+    pthread_cond_init(&buffer->changed, NULL);
+    buffer->count = count;
+    return buffer;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) {
+    return semaphore_init(buffer, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer) {
+    return semaphore_init(buffer, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout) {
+    struct timespec deadline = deadline_after(timeout);
+
+    pthread_mutex_lock(&semaphore->mutex);
+    while (!semaphore->count) {
+        if (timeout == portMAX_DELAY)
+            pthread_cond_wait(&semaphore->changed, &semaphore->mutex);
+        else if (pthread_cond_timedwait(&semaphore->changed, &semaphore->mutex, &deadline))
+            break;
+    }
+    BaseType_t taken = semaphore->count ? pdTRUE : pdFALSE;
+    if (taken)
+        semaphore->count = 0;
+    pthread_mutex_unlock(&semaphore->mutex);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    pthread_mutex_lock(&semaphore->mutex);
+    BaseType_t given = semaphore->count ? pdFALSE : pdTRUE;
+    semaphore->count = 1;
+    pthread_cond_signal(&semaphore->changed);
+    pthread_mutex_unlock(&semaphore->mutex);
+    return given;
+}
+
+
+uint32_t sdk_system_get_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+bool sdk_wifi_get_macaddr(uint8_t if_index, uint8_t *macaddr) {
+    static const uint8_t mac[6] = { 0x5c, 0xcf, 0x7f, 0x12, 0x34, 0x56 };
+    memcpy(macaddr, mac, sizeof(mac));
+    return true;
+}
+
+uint32_t hwrand() {
+    return random();
+}
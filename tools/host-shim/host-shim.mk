@@ -0,0 +1,9 @@
+# FreeRTOS and SDK stand-ins shared by the host harnesses in tools/, see
+# freertos.c. A harness Makefile includes this, builds with
+# HOST_SHIM_CFLAGS after its own -I (so that its headers come first) and
+# links HOST_SHIM_SRC and -lpthread.
+
+HOST_SHIM_DIR := $(dir $(abspath $(lastword $(MAKEFILE_LIST))))
+HOST_SHIM_CFLAGS = -I$(HOST_SHIM_DIR)include
+HOST_SHIM_SRC = $(HOST_SHIM_DIR)freertos.c
+HOST_SHIM_HEADERS = $(wildcard $(HOST_SHIM_DIR)include/*.h $(HOST_SHIM_DIR)include/*/*.h)
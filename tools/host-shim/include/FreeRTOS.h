@@ -0,0 +1,51 @@
+#pragma once
+
+// What the components built by the host harnesses in tools/ need of
+// FreeRTOS, on POSIX threads, with 1ms ticks. See freertos.c.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#ifndef configGENERATE_RUN_TIME_STATS
+#define configGENERATE_RUN_TIME_STATS 0
+#endif
+#define configMAX_TASK_NAME_LEN 16
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#define pdTRUE 1
+#define pdFALSE 0
+
+typedef uint32_t StackType_t;
+typedef uint32_t UBaseType_t;
+typedef int32_t BaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+
+// A thread with its own notification count, see task.h
+typedef struct host_task {
+    pthread_t thread;
+    const char *name;
+    TaskFunction_t function;
+    void *parameters;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t notified;
+    uint32_t notifications;
+} StaticTask_t;
+
+typedef StaticTask_t *TaskHandle_t;
+
+// One lock for every critical section, interrupts are threads too
+extern pthread_mutex_t critical_section;
+
+#define taskENTER_CRITICAL() pthread_mutex_lock(&critical_section)
+#define taskEXIT_CRITICAL() pthread_mutex_unlock(&critical_section)
+#define portYIELD_FROM_ISR(woken) (void)(woken)
+
+// Defined by each harness, which knows what it takes from the heap
+size_t xPortGetFreeHeapSize();
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_wifi.h"
+
+// Microseconds since the program started
+uint32_t sdk_system_get_time();
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The station API of the SDK, answered by the harnesses that need it
+
+#define STATION_GOT_IP 5
+
+uint8_t sdk_wifi_station_get_connect_status();
+int8_t sdk_wifi_station_get_rssi();
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define STATION_IF 0
+
+// Always the same made up address
+bool sdk_wifi_get_macaddr(uint8_t if_index, uint8_t *macaddr);
@@ -0,0 +1,11 @@
+#pragma once
+
+// What the harnesses see of the shim beyond the FreeRTOS API
+
+#include "FreeRTOS.h"
+
+#define HOST_SHIM_MAX_TASKS 16
+
+// Every task made by xTaskCreateStatic, in creation order
+extern TaskHandle_t host_shim_tasks[HOST_SHIM_MAX_TASKS];
+extern int host_shim_task_count;
@@ -0,0 +1,9 @@
+#pragma once
+
+// The host's own sockets have the same API, MSG_MORE included
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
@@ -0,0 +1,25 @@
+#pragma once
+
+// A FreeRTOS queue on a mutex and a condition variable
+
+#include "FreeRTOS.h"
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    uint8_t *storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+} StaticQueue_t;
+
+typedef StaticQueue_t *QueueHandle_t;
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage,
+                                 StaticQueue_t *queue);
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t timeout);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout);
+void vQueueDelete(QueueHandle_t queue);
+
+#define xQueueSendToBackFromISR(queue, item, woken) xQueueSendToBack((queue), (item), 0)
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+// A counter under a mutex: 1 free, 0 taken for mutexes, given or not for
+// binary semaphores
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    int count;
+} StaticSemaphore_t;
+
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer);
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+// The stack buffer is not used, the thread gets one of its own
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                               void *parameters, UBaseType_t priority,
+                               StackType_t *stack, StaticTask_t *task);
+
+// On the heap, never freed: a harness makes a handful
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                       void *parameters, UBaseType_t priority, TaskHandle_t *created);
+
+#define vTaskDelete(task) pthread_exit(NULL)
+
+// Take the one critical section: no other task runs what it guards
+void vTaskSuspendAll();
+BaseType_t xTaskResumeAll();
+
+TickType_t xTaskGetTickCount();
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previous_wake_time, TickType_t increment);
+
+// Only tasks made by xTaskCreateStatic take notifications
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+// Always 0, threads have no stack to watch
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
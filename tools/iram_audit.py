@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+#
+# IRAM placement audit for esp-open-rtos examples.
+#
+# Walks the static call graph of a linked example starting at its interrupt
+# handlers and reports every reachable function that executes from flash.
+# Such functions stall on cache misses and crash if the interrupt fires while
+# the flash is being written.
+#
+# Usage:
+#   tools/iram_audit.py build/light.out --map build/light.map
+#   tools/iram_audit.py build/light.out --isr my_handler --annotate examples/ZemiSmart
+#
+# From an example directory: make iram-audit
+#
+
+import argparse
+import collections
+import os
+import re
+import subprocess
+import sys
+
+
+IRAM_START, IRAM_END = 0x40100000, 0x40108000
+FLASH_START, FLASH_END = 0x40200000, 0x40300000
+ROM_START, ROM_END = 0x40000000, 0x40100000
+
+# Functions registered with gpio_set_interrupt() and friends follow these names
+ISR_PATTERN = re.compile(r'(_isr|_intr_callback|_intr_handler|_interrupt_handler)$')
+
+FUNCTION_RE = re.compile(r'^([0-9a-f]+) <([^>]+)>:$')
+CALL_RE = re.compile(r'\b(call0|call4|call8|call12|j)\s+(?:0x)?([0-9a-f]+)\s+<([^>+]+)(?:\+0x[0-9a-f]+)?>')
+INDIRECT_CALL_RE = re.compile(r'\b(callx0|callx4|callx8|callx12)\b')
+
+
+def region(address):
+    if IRAM_START <= address < IRAM_END:
+        return 'iram'
+    if FLASH_START <= address < FLASH_END:
+        return 'flash'
+    if ROM_START <= address < ROM_END:
+        return 'rom'
+    return 'other'
+
+
+def run(command):
+    return subprocess.run(command, check=True, stdout=subprocess.PIPE,
+                          universal_newlines=True).stdout
+
+
+def read_symbols(nm, elf):
+    symbols = {}
+    for line in run([nm, '-S', '--defined-only', elf]).splitlines():
+        parts = line.split()
+        if len(parts) != 4 or parts[2] not in 'tTwW':
+            continue
+        address, size, _, name = parts
+        symbols[name] = (int(address, 16), int(size, 16))
+    return symbols
+
+
+def read_call_graph(objdump, elf):
+    calls = collections.defaultdict(set)
+    indirect = set()
+    function = None
+    for line in run([objdump, '-d', elf]).splitlines():
+        m = FUNCTION_RE.match(line)
+        if m:
+            function = m.group(2)
+            continue
+        if function is None:
+            continue
+        m = CALL_RE.search(line)
+        if m:
+            if m.group(3) != function:
+                calls[function].add(m.group(3))
+        elif INDIRECT_CALL_RE.search(line):
+            indirect.add(function)
+    return calls, indirect
+
+
+def read_sections(objdump, elf):
+    sections = {}
+    for line in run([objdump, '-h', elf]).splitlines():
+        parts = line.split()
+        if len(parts) >= 6 and parts[0].isdigit():
+            sections[parts[1]] = (int(parts[3], 16), int(parts[2], 16))
+    return sections
+
+
+def read_map_owners(map_file):
+    """Maps input section names (.text.<function>) to the object they came from."""
+    owners = {}
+    pending = None
+    section_re = re.compile(r'^ (\.\S+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S+))?$')
+    continuation_re = re.compile(r'^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S+)$')
+    with open(map_file) as f:
+        for line in f:
+            line = line.rstrip('\n')
+            if pending:
+                m = continuation_re.match(line)
+                if m:
+                    owners[pending] = m.group(3)
+                pending = None
+                continue
+            m = section_re.match(line)
+            if not m:
+                continue
+            if m.group(4):
+                owners[m.group(1)] = m.group(4)
+            else:
+                pending = m.group(1)
+
+    by_function = {}
+    for section, owner in owners.items():
+        for prefix in ('.text.', '.irom0.text.', '.iram1.text.'):
+            if section.startswith(prefix):
+                by_function[section[len(prefix):]] = os.path.basename(owner)
+    return by_function
+
+
+def iram_used(sections):
+    used = 0
+    for address, size in sections.values():
+        if IRAM_START <= address < IRAM_END:
+            used += size
+    return used
+
+
+def walk(entries, calls):
+    parents = {entry: None for entry in entries}
+    queue = collections.deque(entries)
+    while queue:
+        function = queue.popleft()
+        for callee in sorted(calls.get(function, ())):
+            if callee not in parents:
+                parents[callee] = function
+                queue.append(callee)
+    return parents
+
+
+def call_path(parents, function):
+    path = [function]
+    while parents[path[-1]] is not None:
+        path.append(parents[path[-1]])
+    return ' <- '.join(path)
+
+
+def find_definitions(source_dir, names):
+    definitions = {}
+    patterns = {name: re.compile(r'^(?!\s)(?!IRAM\b)[^;#/]*\b%s\s*\(' % re.escape(name)) for name in names}
+    for root, _, files in os.walk(source_dir):
+        for file_name in files:
+            if not file_name.endswith('.c'):
+                continue
+            path = os.path.join(root, file_name)
+            with open(path, errors='replace') as f:
+                for number, line in enumerate(f, 1):
+                    for name, pattern in patterns.items():
+                        if pattern.match(line) and not line.rstrip().endswith(';'):
+                            definitions.setdefault(name, []).append((path, number, line.rstrip()))
+    return definitions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Report ISR-reachable functions that live in flash')
+    parser.add_argument('elf', help='linked program (build/<program>.out)')
+    parser.add_argument('--map', help='linker map file, used to attribute functions to objects')
+    parser.add_argument('--isr', action='append', default=[],
+                        help='additional interrupt entry point (can be repeated)')
+    parser.add_argument('--annotate', metavar='SOURCE_DIR',
+                        help='list the IRAM annotations to add to the sources in SOURCE_DIR')
+    parser.add_argument('--cross', default=os.environ.get('CROSS', 'xtensa-lx106-elf-'),
+                        help='toolchain prefix (default: %(default)s)')
+    parser.add_argument('--iram-size', type=lambda x: int(x, 0), default=IRAM_END - IRAM_START)
+    args = parser.parse_args()
+
+    symbols = read_symbols(args.cross + 'nm', args.elf)
+    calls, indirect = read_call_graph(args.cross + 'objdump', args.elf)
+    sections = read_sections(args.cross + 'objdump', args.elf)
+    owners = read_map_owners(args.map) if args.map else {}
+
+    entries = sorted(name for name in symbols if ISR_PATTERN.search(name))
+    for name in args.isr:
+        if name not in symbols:
+            print('warning: ISR entry point %s not found' % name, file=sys.stderr)
+        elif name not in entries:
+            entries.append(name)
+
+    if not entries:
+        print('No interrupt entry points found')
+        return 0
+
+    parents = walk(entries, calls)
+
+    flash = []
+    for function in parents:
+        if function not in symbols:
+            continue
+        address, size = symbols[function]
+        if region(address) == 'flash':
+            flash.append((function, size))
+
+    print('Interrupt entry points:')
+    for entry in entries:
+        print('  %-40s %s' % (entry, region(symbols[entry][0])))
+
+    print()
+    if flash:
+        print('ISR-reachable functions in flash:')
+        for function, size in sorted(flash, key=lambda f: -f[1]):
+            print('  %-40s %6d  %-24s %s' % (
+                function, size, owners.get(function, ''), call_path(parents, function)))
+    else:
+        print('All ISR-reachable functions are in IRAM or ROM')
+
+    callers = sorted(f for f in parents if f in indirect)
+    if callers:
+        print()
+        print('Indirect calls (targets must be checked by hand):')
+        for function in callers:
+            print('  %s' % function)
+
+    used = iram_used(sections)
+    needed = sum(size for _, size in flash)
+    print()
+    print('IRAM used: %d of %d bytes, %d free' % (used, args.iram_size, args.iram_size - used))
+    print('IRAM free after pinning the functions above: %d bytes' % (args.iram_size - used - needed))
+
+    if args.annotate:
+        print()
+        print('Annotations:')
+        definitions = find_definitions(args.annotate, [function for function, _ in flash])
+        for function, _ in sorted(flash):
+            for path, number, line in definitions.get(function, []):
+                print('  %s:%d: IRAM %s' % (path, number, line))
+            if function not in definitions:
+                print('  %s: not defined in %s (library code)' % (function, args.annotate))
+
+    return 1 if flash else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
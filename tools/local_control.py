@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+#
+# Client for the local_control component.
+#
+# Sends authenticated light commands over UDP, checks a device's handling
+# of bad, replayed and stale packets, and measures the round trip of a
+# command next to the time the device reports spending on it. The wire
+# format is described in components/esp8266-open-rtos/local_control/local_control.h.
+#
+# Usage:
+#   tools/local_control.py --host 192.168.1.50 --key <32 hex digits> hsv 240 100 60
+#   tools/local_control.py --host 192.168.1.50 --key ... effect 1 --argument 3
+#   tools/local_control.py --host 192.168.1.50 --key ... frame ff0000 00ff00 0000ff
+#   tools/local_control.py --host 192.168.1.50 --key ... check
+#   tools/local_control.py --host 192.168.1.50 --key ... bench --count 1000 \
+#       --compare-cmd 'hap-write ... Brightness 50'
+#
+# --compare-cmd times a shell command doing the same change another way,
+# such as a HAP write through a paired controller, for the comparison.
+# make -C tools/local_control runs check and bench against a host server.
+#
+
+import argparse
+import os
+import socket
+import statistics
+import struct
+import subprocess
+import sys
+import time
+
+
+VERSION = 1
+HEADER = struct.Struct('<ccBBII')
+REPLY = struct.Struct('<IHBBB3x')
+MAC_SIZE = 8
+
+HELLO, SET, EFFECT, FRAME = range(1, 5)
+OK, STALE, UNSUPPORTED, BAD_REQUEST = range(4)
+STATUS_NAMES = ['ok', 'stale', 'unsupported', 'bad request']
+
+MASK = (1 << 64) - 1
+
+
+def rotl(x, b):
+    return ((x << b) | (x >> (64 - b))) & MASK
+
+
+def siphash(key, data):
+    k0, k1 = struct.unpack('<QQ', key)
+    v = [0x736f6d6570736575 ^ k0, 0x646f72616e646f6d ^ k1,
+         0x6c7967656e657261 ^ k0, 0x7465646279746573 ^ k1]
+
+    def rounds(n):
+        for _ in range(n):
+            v[0] = (v[0] + v[1]) & MASK; v[1] = rotl(v[1], 13) ^ v[0]; v[0] = rotl(v[0], 32)
+            v[2] = (v[2] + v[3]) & MASK; v[3] = rotl(v[3], 16) ^ v[2]
+            v[0] = (v[0] + v[3]) & MASK; v[3] = rotl(v[3], 21) ^ v[0]
+            v[2] = (v[2] + v[1]) & MASK; v[1] = rotl(v[1], 17) ^ v[2]; v[2] = rotl(v[2], 32)
+
+    tail = len(data) % 8
+    for (m,) in struct.iter_unpack('<Q', data[:len(data) - tail]):
+        v[3] ^= m
+        rounds(2)
+        v[0] ^= m
+
+    m = int.from_bytes(data[len(data) - tail:], 'little') | ((len(data) & 0xff) << 56)
+    v[3] ^= m
+    rounds(2)
+    v[0] ^= m
+
+    v[2] ^= 0xff
+    rounds(4)
+    return struct.pack('<Q', v[0] ^ v[1] ^ v[2] ^ v[3])
+
+
+class Reply:
+    def __init__(self, command, status, session, sequence, apply_us, hue, saturation, brightness, on):
+        self.command = command
+        self.status = status
+        self.session = session
+        self.sequence = sequence
+        self.apply_us = apply_us
+        self.hue = hue / 10.0
+        self.saturation = saturation
+        self.brightness = brightness
+        self.on = bool(on)
+
+    def __str__(self):
+        return '%s: hue %.1f saturation %d brightness %d %s, applied in %d us' % (
+            STATUS_NAMES[self.status] if self.status < len(STATUS_NAMES) else self.status,
+            self.hue, self.saturation, self.brightness, 'on' if self.on else 'off', self.apply_us)
+
+
+class Device:
+    def __init__(self, host, port, key, timeout=1.0):
+        self.address = (socket.gethostbyname(host), port)
+        self.key = key
+        self.socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.socket.settimeout(timeout)
+        self.session = 0
+        self.sequence = 0
+
+    def packet(self, command, payload=b'', session=None, sequence=None):
+        data = HEADER.pack(b'L', bytes([VERSION]), command, 0,
+                           self.session if session is None else session,
+                           self.sequence if sequence is None else sequence) + payload
+        return data + siphash(self.key, data)
+
+    def exchange(self, data):
+        """Sends a packet, returns the reply or None if there was none."""
+        self.socket.sendto(data, self.address)
+        while True:
+            try:
+                reply, address = self.socket.recvfrom(2048)
+            except socket.timeout:
+                return None
+            if address != self.address or len(reply) != HEADER.size + REPLY.size + MAC_SIZE:
+                continue
+            if siphash(self.key, reply[:-MAC_SIZE]) != reply[-MAC_SIZE:]:
+                raise RuntimeError('reply with a bad MAC, is the key right?')
+            magic, version, command, status, session, sequence = HEADER.unpack_from(reply)
+            if magic != b'L' or version[0] != VERSION or command != data[2] | 0x80:
+                continue
+            return Reply(command, status, session, sequence, *REPLY.unpack_from(reply, HEADER.size))
+
+    def hello(self):
+        reply = self.exchange(self.packet(HELLO))
+        if reply is None:
+            raise RuntimeError('no reply from %s:%d' % self.address)
+        self.session = reply.session
+        self.sequence = reply.sequence
+        return reply
+
+    def command(self, command, payload=b''):
+        """Sends a command, saying HELLO first and again if it is stale."""
+        if not self.session:
+            self.hello()
+        for _ in range(2):
+            self.sequence += 1
+            reply = self.exchange(self.packet(command, payload))
+            if reply is None:
+                raise RuntimeError('no reply from %s:%d' % self.address)
+            if reply.status != STALE:
+                return reply
+            self.hello()
+        return reply
+
+
+def hsv_payload(hue, saturation, brightness, on=True):
+    return struct.pack('<HBBB3x', int(round(hue * 10)) % 3600, saturation, brightness, on)
+
+
+def percentiles(values):
+    values = sorted(values)
+    pick = lambda p: values[min(len(values) - 1, int(p * len(values)))]
+    return 'p50 %7.3f  p90 %7.3f  p99 %7.3f  max %7.3f ms' % (
+        pick(0.5), pick(0.9), pick(0.99), values[-1])
+
+
+def command_hello(device, args):
+    print(device.hello())
+
+
+def command_hsv(device, args):
+    print(device.command(SET, hsv_payload(args.hue, args.saturation, args.brightness, not args.off)))
+
+
+def command_effect(device, args):
+    print(device.command(EFFECT, struct.pack('<BH', args.effect, args.argument)))
+
+
+def command_frame(device, args):
+    rgb = b''.join(bytes.fromhex(pixel) for pixel in args.pixels)
+    print(device.command(FRAME, struct.pack('<H', args.first) + rgb))
+
+
+def command_check(device, args):
+    failures = []
+
+    def expect(name, condition):
+        print('%-48s %s' % (name, 'ok' if condition else 'FAIL'))
+        if not condition:
+            failures.append(name)
+
+    hello = device.hello()
+    expect('hello returns a session', hello.status == OK and hello.session != 0)
+
+    reply = device.command(SET, hsv_payload(120.5, 80, 40))
+    expect('set is applied', reply.status == OK and (reply.hue, reply.saturation, reply.brightness, reply.on)
+           == (120.5, 80, 40, True))
+
+    device.sequence += 1
+    replayed = device.packet(SET, hsv_payload(10, 10, 10))
+    device.exchange(replayed)
+    reply = device.exchange(replayed)
+    expect('replayed packet is refused as stale', reply is not None and reply.status == STALE
+           and reply.brightness == 10)
+
+    device.sequence += 1
+    reply = device.exchange(device.packet(SET, hsv_payload(0, 0, 0), session=device.session ^ 1))
+    expect('wrong session is refused as stale', reply is not None and reply.status == STALE
+           and reply.brightness == 10)
+
+    device.sequence += 1
+    forged = bytearray(device.packet(SET, hsv_payload(0, 0, 0, False)))
+    forged[-1] ^= 1
+    expect('bad MAC is dropped without a reply', device.exchange(bytes(forged)) is None)
+
+    wrong_key = Device(args.host, args.port, bytes(16), timeout=0.3)
+    wrong_key.session, wrong_key.sequence = device.session, device.sequence + 1
+    expect('wrong key is dropped without a reply', wrong_key.exchange(wrong_key.packet(SET, hsv_payload(0, 0, 0))) is None)
+
+    reply = device.command(HELLO)
+    expect('state survives the refused packets', reply.on and reply.brightness == 10)
+
+    reply = device.command(EFFECT, struct.pack('<BH', 1, 2))
+    expect('identify effect', reply.status in (OK, UNSUPPORTED))
+    reply = device.command(EFFECT, struct.pack('<BH', 200, 0))
+    expect('unknown effect is a bad request', reply.status in (BAD_REQUEST, UNSUPPORTED))
+
+    reply = device.command(FRAME, struct.pack('<H', 0) + bytes([255, 0, 0] * 4))
+    expect('frame', reply.status in (OK, UNSUPPORTED))
+    reply = device.command(FRAME, struct.pack('<H', 0) + bytes(4))
+    expect('frame of partial pixels is a bad request', reply.status in (BAD_REQUEST, UNSUPPORTED))
+
+    if failures:
+        print('FAIL: %d checks' % len(failures))
+        return 1
+    print('OK')
+    return 0
+
+
+def command_bench(device, args):
+    device.hello()
+    round_trips, applies = [], []
+    lost = 0
+    for i in range(args.count):
+        started = time.perf_counter()
+        try:
+            reply = device.command(SET, hsv_payload(i * 7 % 360, 100, 1 + i % 100))
+        except RuntimeError:
+            lost += 1
+            continue
+        round_trips.append((time.perf_counter() - started) * 1000)
+        applies.append(reply.apply_us / 1000.0)
+        if args.interval:
+            time.sleep(args.interval / 1000.0)
+
+    print('local control, %d commands, %d lost' % (args.count, lost))
+    print('  round trip  %s' % percentiles(round_trips))
+    print('  on device   %s' % percentiles(applies))
+
+    if args.compare_cmd:
+        times = []
+        for i in range(args.compare_count):
+            started = time.perf_counter()
+            subprocess.run(args.compare_cmd, shell=True, check=True, stdout=subprocess.DEVNULL)
+            times.append((time.perf_counter() - started) * 1000)
+        print('compare command, %d runs' % args.compare_count)
+        print('  round trip  %s' % percentiles(times))
+        print('local control is %.1fx faster at the median' % (
+            statistics.median(times) / statistics.median(round_trips)))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Authenticated UDP local control of lights')
+    parser.add_argument('--host', required=True)
+    parser.add_argument('--port', type=int, default=4210)
+    parser.add_argument('--key', default=os.environ.get('LOCAL_CONTROL_KEY'),
+                        help='pre-shared key, 32 hex digits (default: $LOCAL_CONTROL_KEY)')
+    commands = parser.add_subparsers(dest='command')
+    commands.required = True
+
+    p = commands.add_parser('hello', help='print the session and the state')
+    p.set_defaults(func=command_hello)
+
+    p = commands.add_parser('hsv', help='set hue, saturation and brightness')
+    p.add_argument('hue', type=float)
+    p.add_argument('saturation', type=int)
+    p.add_argument('brightness', type=int)
+    p.add_argument('--off', action='store_true', help='turn the light off instead')
+    p.set_defaults(func=command_hsv)
+
+    p = commands.add_parser('effect', help='run an effect, 1 is identify')
+    p.add_argument('effect', type=int)
+    p.add_argument('--argument', type=int, default=0)
+    p.set_defaults(func=command_effect)
+
+    p = commands.add_parser('frame', help='show pixels, given as RRGGBB hex')
+    p.add_argument('pixels', nargs='+')
+    p.add_argument('--first', type=int, default=0)
+    p.set_defaults(func=command_frame)
+
+    p = commands.add_parser('check', help='check the handling of good, bad, replayed and stale packets')
+    p.set_defaults(func=command_check)
+
+    p = commands.add_parser('bench', help='measure the round trip of SET commands')
+    p.add_argument('--count', type=int, default=1000)
+    p.add_argument('--interval', type=float, default=0, help='milliseconds between commands')
+    p.add_argument('--compare-cmd', help='shell command doing the same change another way, e.g. a HAP write')
+    p.add_argument('--compare-count', type=int, default=20)
+    p.set_defaults(func=command_bench)
+
+    args = parser.parse_args()
+    if not args.key or len(args.key) != 32:
+        parser.error('--key takes 32 hex digits')
+
+    device = Device(args.host, args.port, bytes.fromhex(args.key))
+    try:
+        return args.func(device, args) or 0
+    except RuntimeError as e:
+        print('Error: %s' % e)
+        return 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
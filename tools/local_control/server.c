@@ -0,0 +1,116 @@
+// Host server for the local_control component: a light on localhost with
+// the component's own task behind it, for tools/local_control.py to check
+// and benchmark against.
+//
+//   build/local_control_server --port 4210 --key <32 hex digits>
+//
+// It prints every state change and settle, and the stats on SIGINT or
+// SIGTERM.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "local_control.h"
+
+#define PIXELS 60
+
+static local_control_state_t light = { 0, 0, 100, false };
+static uint8_t pixels[PIXELS * 3];
+static volatile sig_atomic_t stopping = 0;
+
+
+static void light_get(local_control_state_t *state) {
+    taskENTER_CRITICAL();
+    *state = light;
+    taskEXIT_CRITICAL();
+}
+
+static void light_set(const local_control_state_t *state) {
+    taskENTER_CRITICAL();
+    light = *state;
+    taskEXIT_CRITICAL();
+}
+
+static int light_effect(uint8_t effect, uint16_t argument) {
+    if (effect != LOCAL_CONTROL_EFFECT_IDENTIFY)
+        return -1;
+    printf("effect: identify %d\n", argument);
+    return 0;
+}
+
+static int light_frame(uint16_t first, const uint8_t *rgb, uint16_t length) {
+    if (first * 3 + length > sizeof(pixels))
+        return -1;
+    memcpy(pixels + first * 3, rgb, length);
+    printf("frame: %d pixels from %d\n", length / 3, first);
+    return 0;
+}
+
+static void light_settled() {
+    local_control_state_t state;
+    light_get(&state);
+    printf("settled: hue %.1f saturation %.0f brightness %.0f %s\n",
+           state.hue, state.saturation, state.brightness, state.on ? "on" : "off");
+    fflush(stdout);
+}
+
+static const local_control_handlers_t handlers = {
+    .get = light_get,
+    .set = light_set,
+    .effect = light_effect,
+    .frame = light_frame,
+    .settled = light_settled,
+};
+
+
+static void stop(int signal) {
+    stopping = 1;
+}
+
+
+int main(int argc, char **argv) {
+    int port = 4210;
+    const char *key = NULL;
+
+    static const struct option options[] = {
+        { "port", required_argument, NULL, 'p' },
+        { "key", required_argument, NULL, 'k' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'p': port = atoi(optarg); break;
+            case 'k': key = optarg; break;
+            default: return 2;
+        }
+    }
+
+    srandom(time(NULL) ^ getpid());
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    if (local_control_init(port, key, &handlers) < 0) {
+        fprintf(stderr, "local_control_init failed, --key takes 32 hex digits\n");
+        return 1;
+    }
+    printf("local-control: light on udp/%d\n", port);
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    while (!stopping)
+        pause();
+
+    local_control_stats_t stats;
+    local_control_get_stats(&stats);
+    printf("stats: received %u applied %u bad MAC %u stale %u worst apply %u us\n",
+           stats.received, stats.applied, stats.bad_mac, stats.stale, stats.worst_apply_us);
+    return 0;
+}
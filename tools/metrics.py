@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+#
+# Client for the metrics component.
+#
+# check scrapes /metrics once or twice and validates the page against the
+# Prometheus text format: every sample belongs to a declared family,
+# values parse, histogram buckets add up, counters do not go backwards.
+# It also makes sure other paths and methods are refused. bench times
+# scrapes one after the other: time to the first byte, time to the whole
+# page and its size.
+#
+# Usage:
+#   tools/metrics.py check --url http://192.168.1.50:9100/metrics
+#   tools/metrics.py bench --url http://192.168.1.50:9100/metrics --count 100
+#
+# make -C tools/metrics runs both against a host build of the component.
+#
+
+import argparse
+import http.client
+import re
+import sys
+import time
+import urllib.parse
+
+
+SAMPLE_RE = re.compile(r'^([a-zA-Z_:][a-zA-Z0-9_:]*)(\{[^}]*\})? (\S+)$')
+LABEL_RE = re.compile(r'([a-zA-Z_][a-zA-Z0-9_]*)="((?:[^"\\]|\\.)*)"')
+TYPES = ('counter', 'gauge', 'histogram', 'summary', 'untyped')
+
+BUILTIN = ('esp_heap_free_bytes', 'esp_uptime_seconds', 'esp_metrics_scrapes_total')
+
+
+def request(url, method='GET'):
+    """Returns status, headers, body, seconds to the first byte and to the end."""
+    parts = urllib.parse.urlsplit(url)
+    started = time.monotonic()
+    connection = http.client.HTTPConnection(parts.hostname, parts.port or 80, timeout=10)
+    connection.request(method, parts.path + ('?' + parts.query if parts.query else ''))
+    response = connection.getresponse()
+    first_byte = time.monotonic() - started
+    body = response.read()
+    total = time.monotonic() - started
+    connection.close()
+    return response.status, response.getheader('Content-Type', ''), body, first_byte, total
+
+
+def parse(page):
+    """Returns {family: type} and {(name, labels): value}, raising ValueError."""
+    types = {}
+    samples = {}
+    for number, line in enumerate(page.splitlines(), 1):
+        if not line:
+            continue
+        if line.startswith('#'):
+            words = line.split(None, 3)
+            if len(words) >= 3 and words[1] == 'TYPE':
+                if words[2] in types:
+                    raise ValueError('line %d: second TYPE for %s' % (number, words[2]))
+                if len(words) < 4 or words[3] not in TYPES:
+                    raise ValueError('line %d: bad type' % number)
+                types[words[2]] = words[3]
+            continue
+
+        match = SAMPLE_RE.match(line)
+        if not match:
+            raise ValueError('line %d: not a sample: %r' % (number, line))
+        name, labels, value = match.groups()
+        family = name
+        for suffix in ('_bucket', '_sum', '_count'):
+            if name.endswith(suffix) and types.get(name[:-len(suffix)]) == 'histogram':
+                family = name[:-len(suffix)]
+        if family not in types:
+            raise ValueError('line %d: %s has no TYPE before it' % (number, name))
+        labels = tuple(LABEL_RE.findall(labels or ''))
+        if (name, labels) in samples:
+            raise ValueError('line %d: %s%s repeated' % (number, name, labels))
+        samples[(name, labels)] = float(value)
+    return types, samples
+
+
+def check_histogram(name, samples):
+    buckets = sorted((float('inf') if dict(labels)['le'] == '+Inf' else float(dict(labels)['le']), value)
+                     for (sample, labels), value in samples.items() if sample == name + '_bucket')
+    if not buckets or buckets[-1][0] != float('inf'):
+        raise ValueError('%s: no +Inf bucket' % name)
+    counts = [count for _, count in buckets]
+    if counts != sorted(counts):
+        raise ValueError('%s: buckets not cumulative' % name)
+    if samples.get((name + '_count', ())) != counts[-1]:
+        raise ValueError('%s: _count is not the +Inf bucket' % name)
+    if (name + '_sum', ()) not in samples:
+        raise ValueError('%s: no _sum' % name)
+    return int(counts[-1])
+
+
+def check(args):
+    failures = 0
+
+    def fail(message):
+        nonlocal failures
+        print('FAIL: ' + message)
+        failures += 1
+
+    status, content_type, body, first_byte, total = request(args.url)
+    if status != 200:
+        fail('GET returned %d' % status)
+        return 1
+    if not content_type.startswith('text/plain'):
+        fail('Content-Type is %r' % content_type)
+
+    try:
+        types, samples = parse(body.decode())
+    except ValueError as e:
+        fail(str(e))
+        return 1
+    print('%d bytes, %d families, %d samples in %.1f ms'
+          % (len(body), len(types), len(samples), total * 1000))
+
+    for name in BUILTIN + tuple(args.expect):
+        if name not in types:
+            fail('%s missing' % name)
+
+    for name, type in sorted(types.items()):
+        if type == 'histogram':
+            try:
+                print('%s: %d observations' % (name, check_histogram(name, samples)))
+            except ValueError as e:
+                fail(str(e))
+
+    # Counters only grow
+    _, _, body, _, _ = request(args.url)
+    _, later = parse(body.decode())
+    for (name, labels), value in samples.items():
+        family = re.sub(r'_(bucket|sum|count)$', '', name)
+        if types.get(name) == 'counter' or types.get(family) == 'histogram':
+            if later.get((name, labels), value) < value:
+                fail('%s%s went from %g to %g' % (name, labels, value, later[(name, labels)]))
+    scrapes = ('esp_metrics_scrapes_total', ())
+    if scrapes in samples and later.get(scrapes) != samples[scrapes] + 1:
+        fail('scrapes went from %g to %g' % (samples[scrapes], later.get(scrapes, 0)))
+
+    parts = urllib.parse.urlsplit(args.url)
+    other = urllib.parse.urlunsplit(parts._replace(path='/nothing'))
+    for url, method, expected in ((other, 'GET', 404), (args.url, 'POST', 405)):
+        status = request(url, method)[0]
+        if status != expected:
+            fail('%s %s returned %d, not %d' % (method, url, status, expected))
+
+    if not failures:
+        print('OK')
+    return 1 if failures else 0
+
+
+def bench(args):
+    first_bytes, totals, sizes = [], [], []
+    started = time.monotonic()
+    for _ in range(args.count):
+        status, _, body, first_byte, total = request(args.url)
+        if status != 200:
+            print('FAIL: GET returned %d' % status)
+            return 1
+        first_bytes.append(first_byte)
+        totals.append(total)
+        sizes.append(len(body))
+    elapsed = time.monotonic() - started
+
+    def percentiles(times):
+        times = sorted(times)
+        return '%.2f / %.2f / %.2f ms' % (times[len(times) // 2] * 1000,
+                                          times[len(times) * 99 // 100] * 1000, times[-1] * 1000)
+
+    print('%d scrapes in %.2f s, %.1f a second, %d bytes each on average'
+          % (args.count, elapsed, args.count / elapsed, sum(sizes) // len(sizes)))
+    print('first byte p50 / p99 / max: %s' % percentiles(first_bytes))
+    print('whole page p50 / p99 / max: %s' % percentiles(totals))
+
+    _, samples = parse(request(args.url)[2].decode())
+    seconds = samples.get(('esp_metrics_last_scrape_seconds', ()))
+    if seconds is not None:
+        print('device side, last scrape: %.2f ms' % (seconds * 1000))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Check and benchmark the metrics endpoint')
+    commands = parser.add_subparsers(dest='command', metavar='command')
+    commands.required = True
+
+    command = commands.add_parser('check', help='validate the page and the refusals')
+    command.add_argument('--url', required=True, help='e.g. http://192.168.1.50:9100/metrics')
+    command.add_argument('--expect', action='append', default=[], metavar='FAMILY',
+                         help='metric family that must be there, besides the built-in ones')
+    command.set_defaults(func=check)
+
+    command = commands.add_parser('bench', help='time scrapes')
+    command.add_argument('--url', required=True)
+    command.add_argument('--count', type=int, default=100, help='(default: %(default)s)')
+    command.set_defaults(func=bench)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,26 @@
+#pragma once
+
+// The cpu_usage types; the host server makes up a few tasks
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+
+#define CPU_USAGE_MAX_TASKS 16
+
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t number;
+    bool deleted;
+    uint32_t run_us;
+    uint16_t permille;
+} cpu_usage_task_t;
+
+typedef struct {
+    uint32_t window_us;
+    uint32_t overhead_us;
+    uint8_t count;
+    cpu_usage_task_t tasks[CPU_USAGE_MAX_TASKS];
+} cpu_usage_t;
+
+void cpu_usage_get(cpu_usage_t *usage);
@@ -0,0 +1,189 @@
+// Host server for the metrics component: /metrics on localhost with the
+// component's own task behind it, for curl and tools/metrics.py.
+//
+//   build/metrics_server --port 9100 --rate 200
+//
+// The event_loop component runs next to it. A thread standing in for a
+// button posts --rate callbacks a second to the loop, each taking up to a
+// millisecond, so that its latency histograms fill; the callbacks notify
+// through event_subscribers like an example would, on a characteristic with
+// a subscriber and on one without. Per-task CPU comes from the threads' own
+// CPU clocks. Runs until killed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <espressif/esp_common.h>
+#include <espressif/esp_sta.h>
+#include <cpu_usage.h>
+#include <event_loop.h>
+#include <event_subscribers.h>
+#include <homekit/homekit.h>
+#include <host_shim.h>
+
+#include "metrics.h"
+
+static volatile sig_atomic_t stopping = 0;
+
+// A controller is subscribed to the first
+static homekit_characteristic_t switch_on = { .description = "On", .format = homekit_format_bool };
+static homekit_characteristic_t switch_name = { .description = "Name", .format = homekit_format_string };
+static uint32_t delivered = 0;
+
+
+size_t xPortGetFreeHeapSize() {
+    return 32768;
+}
+
+uint8_t sdk_wifi_station_get_connect_status() {
+    return STATION_GOT_IP;
+}
+
+int8_t sdk_wifi_station_get_rssi() {
+    return -60 - (int8_t)(sdk_system_get_time() / 1000000 % 8);
+}
+
+
+// CPU time of each task since it started, against the time since boot
+void cpu_usage_get(cpu_usage_t *usage) {
+    static uint32_t boot_us = 0;
+    if (!boot_us)
+        boot_us = sdk_system_get_time();
+
+    memset(usage, 0, sizeof(*usage));
+    usage->window_us = sdk_system_get_time() - boot_us;
+    for (int i = 0; i < host_shim_task_count && usage->count < CPU_USAGE_MAX_TASKS; i++) {
+        clockid_t clock;
+        struct timespec cpu;
+        if (pthread_getcpuclockid(host_shim_tasks[i]->thread, &clock) || clock_gettime(clock, &cpu))
+            continue;
+
+        cpu_usage_task_t *task = &usage->tasks[usage->count++];
+        strncpy(task->name, host_shim_tasks[i]->name, sizeof(task->name) - 1);
+        task->number = i + 1;
+        task->run_us = cpu.tv_sec * 1000000 + cpu.tv_nsec / 1000;
+        if (usage->window_us)
+            task->permille = (uint64_t)task->run_us * 1000 / usage->window_us;
+    }
+}
+
+
+void homekit_characteristic_notify(homekit_characteristic_t *ch, const homekit_value_t value) {
+    for (homekit_characteristic_change_callback_t *callback = ch->callback; callback;
+            callback = callback->next)
+        callback->function(ch, value, callback->context);
+}
+
+static void controller_notified(homekit_characteristic_t *ch, homekit_value_t value, void *context) {
+    // Some work, as sending the event would be
+    uint32_t until = sdk_system_get_time() + rand() % 1000;
+    while ((int32_t)(sdk_system_get_time() - until) < 0);
+    delivered++;
+}
+
+
+static void button_pressed(void *arg) {
+    switch_on.value.bool_value = !switch_on.value.bool_value;
+    EVENT_SUBSCRIBERS_NOTIFY(&switch_on, switch_on.value);
+    EVENT_SUBSCRIBERS_NOTIFY(&switch_name, switch_name.value);
+}
+
+static void *button_thread(void *arg) {
+    int rate = *(int *)arg;
+    while (!stopping) {
+        event_loop_post(button_pressed, NULL);
+        usleep(1000000 / rate);
+    }
+    return NULL;
+}
+
+
+// The sources an example adds
+static void write_notifies(metrics_writer_t *w, void *context) {
+    uint32_t sent, skipped;
+    event_subscribers_stats(&sent, &skipped);
+    metrics_header(w, "esp_homekit_notifies_total", "counter", "Characteristic changes notified or skipped.");
+    metrics_sample(w, "esp_homekit_notifies_total", "result=\"sent\"", sent, 0);
+    metrics_sample(w, "esp_homekit_notifies_total", "result=\"skipped\"", skipped, 0);
+}
+
+static void write_event_loop(metrics_writer_t *w, void *context) {
+    event_loop_stats_t stats;
+    event_loop_get_stats(&stats);
+    metrics_histogram(w, "esp_event_loop_wait_seconds", "Time from a post to its callback.",
+                      event_loop_latency_bounds_us, stats.wait_buckets, EVENT_LOOP_LATENCY_BUCKETS,
+                      stats.wait_sum_us);
+    metrics_histogram(w, "esp_event_loop_run_seconds", "Time a posted callback took.",
+                      event_loop_latency_bounds_us, stats.run_buckets, EVENT_LOOP_LATENCY_BUCKETS,
+                      stats.run_sum_us);
+}
+
+
+static void stop(int signal) {
+    stopping = 1;
+}
+
+
+int main(int argc, char **argv) {
+    int port = METRICS_PORT;
+    int rate = 100;
+
+    static const struct option options[] = {
+        { "port", required_argument, NULL, 'p' },
+        { "rate", required_argument, NULL, 'r' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'p': port = atoi(optarg); break;
+            case 'r': rate = atoi(optarg); break;
+            default: return 2;
+        }
+    }
+    if (rate < 1 || rate > 10000) {
+        fprintf(stderr, "--rate takes 1 to 10000\n");
+        return 2;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    signal(SIGTERM, stop);
+    signal(SIGINT, stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    static homekit_characteristic_change_callback_t controller = { .function = controller_notified };
+    switch_on.callback = &controller;
+
+    cpu_usage_t usage;
+    cpu_usage_get(&usage);
+    event_loop_init();
+    metrics_add(write_notifies, NULL);
+    metrics_add(write_event_loop, NULL);
+    if (metrics_init(port) < 0) {
+        fprintf(stderr, "metrics_init failed\n");
+        return 1;
+    }
+    printf("metrics: http://127.0.0.1:%d/metrics, %d posts a second to the event loop\n", port, rate);
+
+    pthread_t button;
+    pthread_create(&button, NULL, button_thread, &rate);
+    while (!stopping)
+        pause();
+    pthread_join(button, NULL);
+
+    event_loop_stats_t stats;
+    event_loop_get_stats(&stats);
+    uint32_t sent, skipped;
+    event_subscribers_stats(&sent, &skipped);
+    printf("metrics: %u callbacks run, %u notifies sent (%u delivered), %u skipped\n",
+           stats.callbacks, sent, delivered, skipped);
+    return 0;
+}
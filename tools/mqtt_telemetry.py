@@ -0,0 +1,350 @@
+#!/usr/bin/env python3
+#
+# Tools for the mqtt_telemetry component.
+#
+# watch subscribes to the telemetry topics on a broker such as mosquitto
+# and prints each batch as it comes, with the publish rate. broker is a
+# minimal stand-in for one on loopback, for hosts without mosquitto: it
+# takes QoS 0 and 1 publishes from any number of clients and passes them
+# on to every subscriber, can go away now and then to exercise the
+# device's queue, and on exit reports the publish rate and checks that
+# every batch arrived or was counted dropped (see
+# components/esp8266-open-rtos/mqtt_telemetry/mqtt_telemetry.h).
+#
+# Usage:
+#   tools/mqtt_telemetry.py --host 192.168.1.10 watch
+#   tools/mqtt_telemetry.py --host 127.0.0.1 --port 1883 broker --outage-every 8 --outage-for 3
+#
+# make -C tools/mqtt_telemetry runs a host sensor against the broker.
+#
+
+import argparse
+import json
+import select
+import signal
+import socket
+import struct
+import sys
+import threading
+import time
+
+
+CONNECT = 1
+CONNACK = 2
+PUBLISH = 3
+PUBACK = 4
+SUBSCRIBE = 8
+SUBACK = 9
+PINGREQ = 12
+PINGRESP = 13
+DISCONNECT = 14
+
+PUBLISH_DUP = 0x08
+
+
+def encode_length(length):
+    encoded = bytearray()
+    while True:
+        byte = length & 0x7f
+        length >>= 7
+        encoded.append(byte | (0x80 if length else 0))
+        if not length:
+            return bytes(encoded)
+
+
+def encode_string(s):
+    s = s.encode()
+    return struct.pack('>H', len(s)) + s
+
+
+def packet(type, flags, body):
+    return bytes([type << 4 | flags]) + encode_length(len(body)) + body
+
+
+def receive_exactly(s, length):
+    data = b''
+    while len(data) < length:
+        chunk = s.recv(length - len(data))
+        if not chunk:
+            raise ConnectionError('connection closed')
+        data += chunk
+    return data
+
+
+def receive_packet(s):
+    first = receive_exactly(s, 1)[0]
+    length, shift = 0, 0
+    while True:
+        byte = receive_exactly(s, 1)[0]
+        length |= (byte & 0x7f) << shift
+        shift += 7
+        if not byte & 0x80:
+            break
+    return first >> 4, first & 0x0f, receive_exactly(s, length)
+
+
+def parse_publish(flags, body):
+    topic_length = struct.unpack_from('>H', body)[0]
+    topic = body[2:2 + topic_length].decode(errors='replace')
+    offset = 2 + topic_length
+    packet_id = None
+    if flags & 0x06:
+        packet_id = struct.unpack_from('>H', body, offset)[0]
+        offset += 2
+    return topic, packet_id, body[offset:]
+
+
+class Report:
+    """Publish rate and the accounting of the batches of each topic."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.start = None
+        self.last = None
+        self.publishes = 0
+        self.duplicates = 0
+        self.changes = 0
+        self.bytes = 0
+        self.topics = {}
+
+    def add(self, topic, payload):
+        try:
+            batch = json.loads(payload)
+        except ValueError:
+            batch = {}
+        with self.lock:
+            now = time.monotonic()
+            if self.start is None:
+                self.start = now
+            self.last = now
+            self.publishes += 1
+            self.bytes += len(payload)
+            seen = self.topics.setdefault(topic, {'seqs': set(), 'last': None})
+            seq = batch.get('seq')
+            if seq in seen['seqs']:
+                self.duplicates += 1
+                return batch
+            if seq is not None:
+                seen['seqs'].add(seq)
+                if seen['last'] is None or seq > seen['last']['seq']:
+                    seen['last'] = batch
+            self.changes += len([key for key in batch if key not in ('seq', 'uptime', 'dropped')])
+        return batch
+
+    def print(self):
+        with self.lock:
+            elapsed = (self.last - self.start) if self.publishes > 1 else 0
+            print('%d publishes (%d duplicates), %d bytes in %.1f s: %.2f publishes a second, '
+                  '%.2f changes per batch'
+                  % (self.publishes, self.duplicates, self.bytes, elapsed,
+                     self.publishes / elapsed if elapsed else 0,
+                     self.changes / max(self.publishes - self.duplicates, 1)))
+            failures = 0
+            for topic, seen in sorted(self.topics.items()):
+                last = seen['last']
+                if last is None:
+                    continue
+                received = len(seen['seqs'])
+                print('%s: %d batches received, %d dropped on the device, last seq %d'
+                      % (topic, received, last['dropped'], last['seq']))
+                if received + last['dropped'] != last['seq']:
+                    print('FAIL: %s: %d batches unaccounted for'
+                          % (topic, last['seq'] - received - last['dropped']))
+                    failures += 1
+            return failures
+
+
+class Broker:
+    def __init__(self, host, port, report, verbose):
+        self.address = (host, port)
+        self.report = report
+        self.verbose = verbose
+        self.lock = threading.Lock()
+        self.clients = set()
+        self.subscribers = set()
+        self.listener = None
+
+    def listen(self):
+        listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        listener.bind(self.address)
+        listener.listen(4)
+        with self.lock:
+            self.listener = listener
+        threading.Thread(target=self.accept, args=(listener,), daemon=True).start()
+
+    def accept(self, listener):
+        while True:
+            try:
+                client, address = listener.accept()
+            except OSError:
+                return
+            with self.lock:
+                self.clients.add(client)
+            threading.Thread(target=self.serve, args=(client,), daemon=True).start()
+
+    def go_away(self):
+        """Closes every connection and refuses new ones until listen."""
+        with self.lock:
+            listener, self.listener = self.listener, None
+            clients, self.clients = self.clients, set()
+        if listener:
+            # Wakes the accept thread, close alone leaves it listening
+            try:
+                listener.shutdown(socket.SHUT_RDWR)
+            except OSError:
+                pass
+            listener.close()
+        for client in clients:
+            try:
+                client.shutdown(socket.SHUT_RDWR)
+            except OSError:
+                pass
+            client.close()
+
+    def serve(self, client):
+        try:
+            while True:
+                type, flags, body = receive_packet(client)
+                if type == CONNECT:
+                    client_id = body[12:12 + struct.unpack_from('>H', body, 10)[0]].decode(errors='replace')
+                    print('broker: %s connected' % client_id)
+                    client.sendall(packet(CONNACK, 0, b'\x00\x00'))
+                elif type == PUBLISH:
+                    topic, packet_id, payload = parse_publish(flags, body)
+                    self.report.add(topic, payload)
+                    if self.verbose:
+                        print('%s%s %s' % (topic, ' (dup)' if flags & PUBLISH_DUP else '',
+                                           payload.decode(errors='replace')))
+                    if packet_id is not None:
+                        client.sendall(packet(PUBACK, 0, struct.pack('>H', packet_id)))
+                    self.forward(topic, payload)
+                elif type == SUBSCRIBE:
+                    # Every publish goes to every subscriber, at QoS 0
+                    with self.lock:
+                        self.subscribers.add(client)
+                    client.sendall(packet(SUBACK, 0, body[:2] + b'\x00'))
+                elif type == PINGREQ:
+                    client.sendall(packet(PINGRESP, 0, b''))
+                elif type == DISCONNECT:
+                    break
+        except (ConnectionError, OSError):
+            pass
+        finally:
+            with self.lock:
+                self.clients.discard(client)
+                self.subscribers.discard(client)
+            client.close()
+
+    def forward(self, topic, payload):
+        with self.lock:
+            subscribers = list(self.subscribers)
+        for subscriber in subscribers:
+            try:
+                subscriber.sendall(packet(PUBLISH, 0, encode_string(topic) + payload))
+            except OSError:
+                pass
+
+
+def broker(args):
+    report = Report()
+    server = Broker(args.host, args.port, report, args.verbose)
+    server.listen()
+    print('broker: listening on %s:%d' % (args.host, args.port))
+
+    stopping = threading.Event()
+    signal.signal(signal.SIGTERM, lambda *_: stopping.set())
+    signal.signal(signal.SIGINT, lambda *_: stopping.set())
+
+    start = time.monotonic()
+    next_outage = start + args.outage_every if args.outage_every else None
+    while not stopping.wait(0.1):
+        now = time.monotonic()
+        if args.duration and now - start > args.duration:
+            break
+        if next_outage and now >= next_outage:
+            print('broker: away for %g s' % args.outage_for)
+            server.go_away()
+            if stopping.wait(args.outage_for):
+                break
+            print('broker: back')
+            server.listen()
+            next_outage = time.monotonic() + args.outage_every
+
+    server.go_away()
+    return 1 if report.print() else 0
+
+
+def watch(args):
+    s = socket.create_connection((args.host, args.port), timeout=10)
+    flags = 0x02
+    payload = encode_string('mqtt-telemetry-watch')
+    if args.user:
+        flags |= 0x80
+        payload += encode_string(args.user)
+    if args.password:
+        flags |= 0x40
+        payload += encode_string(args.password)
+    s.sendall(packet(CONNECT, 0, encode_string('MQTT') + bytes([4, flags]) + struct.pack('>H', 60) + payload))
+    type, _, body = receive_packet(s)
+    if type != CONNACK or body[1] != 0:
+        print('Broker refused the connection')
+        return 1
+
+    topic = args.topic or args.prefix + '/#'
+    s.sendall(packet(SUBSCRIBE, 2, struct.pack('>H', 1) + encode_string(topic) + b'\x01'))
+    print('Watching %s on %s:%d' % (topic, args.host, args.port))
+
+    report = Report()
+    last_ping = time.monotonic()
+    try:
+        while True:
+            if time.monotonic() - last_ping > 30:
+                s.sendall(packet(PINGREQ, 0, b''))
+                last_ping = time.monotonic()
+            if not select.select([s], [], [], 1)[0]:
+                continue
+            type, flags, body = receive_packet(s)
+            if type != PUBLISH:
+                continue
+            topic, packet_id, payload = parse_publish(flags, body)
+            if packet_id is not None:
+                s.sendall(packet(PUBACK, 0, struct.pack('>H', packet_id)))
+            report.add(topic, payload)
+            print('%s %s %s' % (time.strftime('%H:%M:%S'), topic, payload.decode(errors='replace')))
+    except KeyboardInterrupt:
+        pass
+    except ConnectionError:
+        print('Broker closed the connection')
+    finally:
+        s.close()
+    return 1 if report.print() else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Watch the mqtt_telemetry batches or stand in for a broker')
+    parser.add_argument('--host', default='127.0.0.1', help='broker, or address to listen on (default: %(default)s)')
+    parser.add_argument('--port', type=int, default=1883, help='(default: %(default)s)')
+    commands = parser.add_subparsers(dest='command', metavar='command')
+    commands.required = True
+
+    command = commands.add_parser('watch', help='subscribe and print the batches')
+    command.add_argument('--prefix', default='homekit', help='MQTT_TELEMETRY_PREFIX of the devices (default: %(default)s)')
+    command.add_argument('--topic', help='one topic or filter instead of <prefix>/#')
+    command.add_argument('--user')
+    command.add_argument('--password')
+    command.set_defaults(func=watch)
+
+    command = commands.add_parser('broker', help='stand in for a broker until killed, then report')
+    command.add_argument('--duration', type=float, default=0, help='seconds to run, 0 until killed')
+    command.add_argument('--outage-every', type=float, default=0, help='go away every so many seconds')
+    command.add_argument('--outage-for', type=float, default=3, help='seconds away (default: %(default)s)')
+    command.add_argument('--verbose', action='store_true', help='print every publish')
+    command.set_defaults(func=broker)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
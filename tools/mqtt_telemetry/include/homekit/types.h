@@ -0,0 +1,57 @@
+#pragma once
+
+// The part of the esp-homekit types that mqtt_telemetry uses
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    homekit_format_bool,
+    homekit_format_uint8,
+    homekit_format_uint16,
+    homekit_format_uint32,
+    homekit_format_uint64,
+    homekit_format_int,
+    homekit_format_float,
+    homekit_format_string,
+    homekit_format_tlv,
+    homekit_format_data,
+} homekit_format_t;
+
+typedef struct {
+    bool is_null;
+    homekit_format_t format;
+    union {
+        bool bool_value;
+        int int_value;
+        float float_value;
+        char *string_value;
+    };
+} homekit_value_t;
+
+#define HOMEKIT_BOOL(value) ((homekit_value_t) { .format = homekit_format_bool, .bool_value = (value) })
+#define HOMEKIT_UINT8(value) ((homekit_value_t) { .format = homekit_format_uint8, .int_value = (value) })
+#define HOMEKIT_FLOAT(value) ((homekit_value_t) { .format = homekit_format_float, .float_value = (value) })
+
+typedef struct _homekit_characteristic homekit_characteristic_t;
+
+typedef void (*homekit_characteristic_change_callback_fn)(homekit_characteristic_t *ch,
+                                                          homekit_value_t value, void *context);
+
+typedef struct _homekit_characteristic_change_callback {
+    homekit_characteristic_change_callback_fn function;
+    void *context;
+    struct _homekit_characteristic_change_callback *next;
+} homekit_characteristic_change_callback_t;
+
+struct _homekit_characteristic {
+    const char *description;
+    homekit_format_t format;
+    homekit_value_t value;
+
+    homekit_characteristic_change_callback_t *callback;
+};
+
+void homekit_characteristic_add_notify_callback(homekit_characteristic_t *ch,
+                                                homekit_characteristic_change_callback_fn function,
+                                                void *context);
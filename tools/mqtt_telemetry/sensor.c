@@ -0,0 +1,190 @@
+// Host sensor for the mqtt_telemetry component: the characteristics of
+// temperature_sensor, occupancy and door-sensor on localhost, mirrored by
+// the component's own task to a broker on loopback (mosquitto, or
+// tools/mqtt_telemetry.py broker).
+//
+//   build/mqtt_telemetry_sensor --port 1883 --rate 20 --seconds 20
+//
+// A thread standing in for the sensors notifies --rate changes a second,
+// spread over the characteristics, for --seconds, timing each notify the
+// way the HomeKit server would pay for it. It then waits for the queue to
+// drain, for at most a minute, and prints the stats, the notify latency
+// and the memory the component takes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <espressif/esp_wifi.h>
+#include <homekit/homekit.h>
+
+#include "mqtt_telemetry.h"
+
+#define MAX_SAMPLES 100000
+
+static homekit_characteristic_t temperature = { .description = "temperature", .format = homekit_format_float };
+static homekit_characteristic_t humidity = { .description = "humidity", .format = homekit_format_float };
+static homekit_characteristic_t occupancy = { .description = "occupancy", .format = homekit_format_uint8 };
+static homekit_characteristic_t door_open = { .description = "door open", .format = homekit_format_bool };
+
+static uint32_t latency_ns[MAX_SAMPLES];
+
+
+void homekit_characteristic_add_notify_callback(homekit_characteristic_t *ch,
+                                                homekit_characteristic_change_callback_fn function,
+                                                void *context) {
+    homekit_characteristic_change_callback_t *callback = calloc(1, sizeof(*callback));
+    callback->function = function;
+    callback->context = context;
+    callback->next = ch->callback;
+    ch->callback = callback;
+}
+
+void homekit_characteristic_notify(homekit_characteristic_t *ch, const homekit_value_t value) {
+    for (homekit_characteristic_change_callback_t *callback = ch->callback; callback;
+            callback = callback->next)
+        callback->function(ch, value, callback->context);
+}
+
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static int compare_latency(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+
+static homekit_value_t next_value(int change) {
+    switch (change % 4) {
+        case 0:
+            temperature.value = HOMEKIT_FLOAT(20 + (change % 100) / 8.0f);
+            return temperature.value;
+        case 1:
+            humidity.value = HOMEKIT_FLOAT(40 - (change % 60) / 4.0f);
+            return humidity.value;
+        case 2:
+            occupancy.value = HOMEKIT_UINT8(change / 4 % 2);
+            return occupancy.value;
+        default:
+            door_open.value = HOMEKIT_BOOL(change / 4 % 3 == 0);
+            return door_open.value;
+    }
+}
+
+
+int main(int argc, char **argv) {
+    int port = MQTT_TELEMETRY_PORT;
+    int rate = 20;
+    int seconds = 20;
+
+    static const struct option options[] = {
+        { "port", required_argument, NULL, 'p' },
+        { "rate", required_argument, NULL, 'r' },
+        { "seconds", required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'p': port = atoi(optarg); break;
+            case 'r': rate = atoi(optarg); break;
+            case 's': seconds = atoi(optarg); break;
+            default: return 2;
+        }
+    }
+    if (rate < 1 || rate > 1000 || seconds < 1 || rate * seconds > MAX_SAMPLES) {
+        fprintf(stderr, "--rate takes 1 to 1000, --seconds at least 1, %d changes at most\n", MAX_SAMPLES);
+        return 2;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    homekit_characteristic_t *characteristics[] = { &temperature, &humidity, &occupancy, &door_open };
+    const char *keys[] = { "temperature", "humidity", "occupancy", "door_open" };
+    for (int i = 0; i < 4; i++) {
+        if (mqtt_telemetry_add(characteristics[i], keys[i]) < 0) {
+            fprintf(stderr, "mqtt_telemetry_add %s failed\n", keys[i]);
+            return 1;
+        }
+    }
+    // As built without MQTT_HOST: the characteristics must stay without
+    // subscribers, or EVENT_SUBSCRIBERS_NOTIFY could never skip them
+    if (mqtt_telemetry_init(NULL, port, "sensor") == 0) {
+        printf("FAIL: mqtt_telemetry_init started without a broker\n");
+        return 1;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (characteristics[i]->callback) {
+            printf("FAIL: %s subscribed without a broker\n", keys[i]);
+            return 1;
+        }
+    }
+
+    if (mqtt_telemetry_init("127.0.0.1", port, "sensor") < 0) {
+        fprintf(stderr, "mqtt_telemetry_init failed\n");
+        return 1;
+    }
+    printf("sensor: %d changes a second for %d s, batches every %d ms to 127.0.0.1:%d\n",
+           rate, seconds, MQTT_TELEMETRY_INTERVAL_MS, port);
+
+    int changes = rate * seconds;
+    uint64_t start = now_ns();
+    for (int i = 0; i < changes; i++) {
+        int64_t wait = start + (uint64_t)i * 1000000000 / rate - now_ns();
+        if (wait > 0)
+            usleep(wait / 1000);
+
+        homekit_characteristic_t *ch = characteristics[i % 4];
+        homekit_value_t value = next_value(i);
+        uint64_t before = now_ns();
+        homekit_characteristic_notify(ch, value);
+        latency_ns[i] = now_ns() - before;
+    }
+
+    // The last changes go out with the next batch
+    usleep((MQTT_TELEMETRY_INTERVAL_MS + 100) * 1000);
+    mqtt_telemetry_stats_t stats;
+    TickType_t drain_start = xTaskGetTickCount();
+    do {
+        usleep(100000);
+        mqtt_telemetry_get_stats(&stats);
+    } while (stats.queued_bytes && xTaskGetTickCount() - drain_start < 60000);
+
+    mqtt_telemetry_print_stats();
+
+    qsort(latency_ns, changes, sizeof(latency_ns[0]), compare_latency);
+    printf("sensor: notify took %u ns at the median, %u ns at p99, %u ns at most\n",
+           latency_ns[changes / 2], latency_ns[changes * 99 / 100], latency_ns[changes - 1]);
+    printf("sensor: %.2f changes per batch, %.2f batches published a second\n",
+           stats.batches ? (double)stats.changes / stats.batches : 0.0,
+           (double)stats.published / (seconds + MQTT_TELEMETRY_INTERVAL_MS / 1000.0));
+    printf("sensor: memory %u bytes static, queue %u bytes of which at most %u used\n",
+           stats.ram_bytes, MQTT_TELEMETRY_QUEUE_SIZE, stats.queue_high_water);
+
+    int failures = 0;
+    if (stats.changes != changes) {
+        printf("FAIL: %d changes notified, %u seen\n", changes, stats.changes);
+        failures++;
+    }
+    if (stats.queued_bytes) {
+        printf("FAIL: %u bytes still queued\n", stats.queued_bytes);
+        failures++;
+    }
+    if (stats.published + stats.dropped != stats.batches) {
+        printf("FAIL: %u batches, %u published and %u dropped\n",
+               stats.batches, stats.published, stats.dropped);
+        failures++;
+    }
+    if (!failures)
+        printf("OK\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+#
+# Sender for the pixel_stream component.
+#
+# Streams frames computed here to a WS2812 strip over UDP, in DDP packets
+# carrying the strip's own pixel layout, or 3 byte RGB with --rgb as other
+# DDP senders do (see
+# components/esp8266-open-rtos/pixel_stream/pixel_stream.h). The test
+# command sends numbered frames the host receiver checks, losing and
+# reordering packets on purpose to exercise the counters.
+#
+# Usage:
+#   tools/pixel_stream.py --host 192.168.1.50 --pixels 60 fill ff4000
+#   tools/pixel_stream.py --host 192.168.1.50 --pixels 60 rainbow --fps 30 --seconds 60
+#   tools/pixel_stream.py --host 127.0.0.1 --pixels 300 test --frames 2000 --damage 0.05
+#   tools/pixel_stream.py --host 127.0.0.1 --pixels 300 --rgb test --frames 2000
+#
+# make -C tools/pixel_stream runs the test against a host receiver.
+#
+
+import argparse
+import colorsys
+import random
+import socket
+import struct
+import sys
+import time
+
+
+DDP_PORT = 4048
+DDP_HEADER = struct.Struct('>BBBBIH')
+DDP_VERSION_1 = 0x40
+DDP_PUSH = 0x01
+DDP_TYPE_RGB = 0x0b             # red, green, blue
+DDP_TYPE_STRIP = 0x9b           # custom, ws2812_pixel_t: blue, green, red, unused
+DDP_DESTINATION = 1
+
+MAX_DATA = 1440                 # DDP's usual, 360 strip or 480 RGB pixels
+
+
+class Strip:
+    def __init__(self, host, port, pixels, packet_size=MAX_DATA, rgb=False):
+        self.address = (socket.gethostbyname(host), port)
+        self.pixels = pixels
+        self.rgb = rgb
+        self.data_type = DDP_TYPE_RGB if rgb else DDP_TYPE_STRIP
+        pixel_size = 3 if rgb else 4
+        self.packet_size = packet_size - packet_size % pixel_size
+        self.socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sequence = 0
+
+    def pixel(self, red, green, blue, extra=0):
+        """Packs a pixel, extra only going out in the strip's layout."""
+        if self.rgb:
+            return bytes((red, green, blue))
+        return bytes((blue, green, red, extra))
+
+    def packets(self, frame):
+        """Splits a frame into DDP packets, the last one pushing it."""
+        packets = []
+        for offset in range(0, len(frame), self.packet_size):
+            data = frame[offset:offset + self.packet_size]
+            self.sequence = self.sequence % 15 + 1
+            flags = DDP_VERSION_1 | (DDP_PUSH if offset + len(data) == len(frame) else 0)
+            packets.append(DDP_HEADER.pack(flags, self.sequence, self.data_type, DDP_DESTINATION,
+                                           offset, len(data)) + data)
+        return packets
+
+    def send(self, packets):
+        for packet in packets:
+            self.socket.sendto(packet, self.address)
+
+
+def paced(fps, count):
+    """Yields frame numbers at fps, skipping none if the sender falls behind."""
+    started = time.perf_counter()
+    for n in range(count):
+        delay = started + n / fps - time.perf_counter()
+        if delay > 0:
+            time.sleep(delay)
+        yield n
+
+
+def command_fill(strip, args):
+    color = bytes.fromhex(args.color)
+    strip.send(strip.packets(strip.pixel(*color) * strip.pixels))
+
+
+def command_rainbow(strip, args):
+    scale = args.brightness / 100.0
+    for n in paced(args.fps, int(args.fps * args.seconds)):
+        frame = b''
+        for i in range(strip.pixels):
+            r, g, b = colorsys.hsv_to_rgb((i / strip.pixels + n / args.fps / 5) % 1.0, 1, scale)
+            frame += strip.pixel(int(r * 255), int(g * 255), int(b * 255))
+        strip.send(strip.packets(frame))
+
+
+def test_frame(strip, n):
+    return b''.join(strip.pixel(i & 0xff, (n >> 8) & 0xff, n & 0xff, (n * 31 + i) & 0xff)
+                    for i in range(strip.pixels))
+
+
+def command_test(strip, args):
+    rng = random.Random(args.seed)
+    lost = reordered = 0
+    started = time.perf_counter()
+
+    for n in paced(args.fps, args.frames):
+        packets = strip.packets(test_frame(strip, n))
+
+        # One fault at most per frame, never in its first packet nor in the
+        # last frame, so that each damaged frame shows up once as incomplete
+        if len(packets) > 1 and n < args.frames - 1 and rng.random() < args.damage:
+            if rng.random() < 0.5:
+                del packets[rng.randrange(1, len(packets))]
+                lost += 1
+            else:
+                i = rng.randrange(len(packets) - 1)
+                packets[i], packets[i + 1] = packets[i + 1], packets[i]
+                reordered += 1
+        strip.send(packets)
+
+    elapsed = time.perf_counter() - started
+    print('sent %d frames of %d packets in %.1f s (%.0f fps): %d with a packet lost, %d reordered' % (
+        args.frames, len(strip.packets(test_frame(strip, 0))), elapsed, args.frames / elapsed,
+        lost, reordered))
+    print('expect incomplete %d late %d' % (lost + reordered, reordered))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Stream pixels to a WS2812 strip over DDP')
+    parser.add_argument('--host', required=True)
+    parser.add_argument('--port', type=int, default=DDP_PORT)
+    parser.add_argument('--pixels', type=int, required=True, help='pixels on the strip')
+    parser.add_argument('--packet-size', type=int, default=MAX_DATA, help='data bytes per packet (default: %(default)s)')
+    parser.add_argument('--rgb', action='store_true', help='send 3 byte RGB rather than the strip\'s layout')
+    commands = parser.add_subparsers(dest='command')
+    commands.required = True
+
+    p = commands.add_parser('fill', help='show one color, given as RRGGBB hex')
+    p.add_argument('color')
+    p.set_defaults(func=command_fill)
+
+    p = commands.add_parser('rainbow', help='stream a moving rainbow')
+    p.add_argument('--fps', type=float, default=30)
+    p.add_argument('--seconds', type=float, default=10)
+    p.add_argument('--brightness', type=float, default=30, help='percent (default: %(default)s)')
+    p.set_defaults(func=command_rainbow)
+
+    p = commands.add_parser('test', help='send numbered frames for the host receiver to check')
+    p.add_argument('--frames', type=int, default=1000)
+    p.add_argument('--fps', type=float, default=100)
+    p.add_argument('--damage', type=float, default=0.05, help='share of frames to lose or reorder a packet of')
+    p.add_argument('--seed', type=int)
+    p.set_defaults(func=command_test)
+
+    args = parser.parse_args()
+    if args.packet_size < 4 or args.packet_size > MAX_DATA:
+        parser.error('--packet-size takes 4 to %d' % MAX_DATA)
+
+    strip = Strip(args.host, args.port, args.pixels, args.packet_size, args.rgb)
+    return args.func(strip, args) or 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,146 @@
+// Host receiver for the pixel_stream component: a strip on localhost with
+// the component's own task behind it, for tools/pixel_stream.py to stream
+// test frames to.
+//
+//   build/pixel_stream_receiver --port 4048 --pixels 300 --fps 40 --frames 2000 [--rgb]
+//
+// With --rgb the frames come as 3 byte RGB and the byte not shown must be
+// 0 rather than the test pattern.
+//
+// A task standing in for the strip shows frames at up to --fps, holding
+// each for as long as ws2812_i2s_update would take. Every frame must be
+// whole (all its pixels from the same sent frame, each in its place) and
+// shown in order. Once no packet came for a second after the first one,
+// it prints the stats and checks them against --frames, the number of
+// frames sent: each is either received complete or counted incomplete,
+// and each complete one is either shown or dropped.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+
+#include "pixel_stream.h"
+
+#define MAX_PIXELS 1024
+#define PIXEL_US 30             // WS2812 time per pixel
+
+PIXEL_STREAM_BUFFERS(stream_buffers, MAX_PIXELS * 4);
+
+
+// Test frames from tools/pixel_stream.py: pixel i of frame n holds n in
+// blue and green, i in red and both mixed in the byte not shown
+static int frame_number(const uint8_t *frame, int pixels, bool rgb) {
+    int number = frame[0] | (frame[1] << 8);
+    for (int i = 0; i < pixels; i++) {
+        const uint8_t *pixel = frame + 4 * i;
+        if ((pixel[0] | (pixel[1] << 8)) != number || pixel[2] != (i & 0xff) ||
+                pixel[3] != (rgb ? 0 : ((number * 31 + i) & 0xff)))
+            return -1;
+    }
+    return number;
+}
+
+
+int main(int argc, char **argv) {
+    int port = PIXEL_STREAM_PORT;
+    int pixels = 60;
+    int fps = 40;
+    int frames = -1;
+    bool rgb = false;
+
+    static const struct option options[] = {
+        { "port", required_argument, NULL, 'p' },
+        { "pixels", required_argument, NULL, 'n' },
+        { "fps", required_argument, NULL, 'f' },
+        { "frames", required_argument, NULL, 'c' },
+        { "rgb", no_argument, NULL, 'r' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'p': port = atoi(optarg); break;
+            case 'n': pixels = atoi(optarg); break;
+            case 'f': fps = atoi(optarg); break;
+            case 'c': frames = atoi(optarg); break;
+            case 'r': rgb = true; break;
+            default: return 2;
+        }
+    }
+    if (pixels < 1 || pixels > MAX_PIXELS || fps < 1) {
+        fprintf(stderr, "--pixels takes 1 to %d, --fps at least 1\n", MAX_PIXELS);
+        return 2;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    if (pixel_stream_init(port, stream_buffers, pixels * 4) < 0) {
+        fprintf(stderr, "pixel_stream_init failed\n");
+        return 1;
+    }
+    printf("pixel-stream: %d pixels on udp/%d, shown at up to %d fps%s\n", pixels, port, fps,
+           rgb ? ", sent as RGB" : "");
+
+    int torn = 0, backwards = 0, last = -1;
+    TickType_t last_activity = xTaskGetTickCount();
+    uint32_t last_packets = 0;
+
+    while (true) {
+        uint8_t *frame = pixel_stream_wait(100);
+        if (frame) {
+            int number = frame_number(frame, pixels, rgb);
+            usleep(pixels * PIXEL_US);
+            pixel_stream_release();
+
+            if (number < 0)
+                torn++;
+            else if (number <= last)
+                backwards++;
+            else
+                last = number;
+            usleep(1000000 / fps);
+        }
+
+        pixel_stream_stats_t stats;
+        pixel_stream_get_stats(&stats);
+        if (stats.packets != last_packets) {
+            last_packets = stats.packets;
+            last_activity = xTaskGetTickCount();
+        } else if (stats.packets && xTaskGetTickCount() - last_activity > 1000) {
+            break;
+        }
+    }
+
+    pixel_stream_stats_t stats;
+    pixel_stream_get_stats(&stats);
+    printf("stats: packets %u frames %u shown %u dropped %u incomplete %u late %u bad %u\n",
+           stats.packets, stats.frames, stats.shown, stats.dropped, stats.incomplete,
+           stats.late, stats.bad);
+
+    int failures = 0;
+    if (torn) {
+        printf("FAIL: %d frames shown torn or misplaced\n", torn);
+        failures++;
+    }
+    if (backwards) {
+        printf("FAIL: %d frames shown out of order\n", backwards);
+        failures++;
+    }
+    if (stats.shown + stats.dropped != stats.frames) {
+        printf("FAIL: %u frames neither shown nor dropped\n", stats.frames - stats.shown - stats.dropped);
+        failures++;
+    }
+    if (frames >= 0 && stats.frames + stats.incomplete != frames) {
+        printf("FAIL: %d frames sent, %u accounted for\n", frames, stats.frames + stats.incomplete);
+        failures++;
+    }
+    if (!failures)
+        printf("OK\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+#
+# Decoder for records left by the post_mortem component.
+#
+# Reads the "post-mortem NNNN: ..." hex lines a device prints on boot (or
+# serves over TCP with post_mortem_serve), decodes the record and symbolizes
+# the faulting PC and the saved stack against the example's ELF.
+#
+# Usage:
+#   tools/post_mortem.py --elf build/sonoff_basic.out serial.log
+#   nc 192.168.1.50 3333 | tools/post_mortem.py --elf build/JPmbutton.out
+#
+# From an example directory: make post-mortem DUMP=serial.log
+#                        or: make post-mortem DUMP_HOST=192.168.1.50
+#
+
+import argparse
+import os
+import re
+import struct
+import subprocess
+import sys
+
+
+IRAM_START, IRAM_END = 0x40100000, 0x40108000
+FLASH_START, FLASH_END = 0x40200000, 0x40300000
+
+MAGIC = 0x504d3031
+
+# Must match post_mortem.h
+HEADER_WORDS = 5
+FAULT_WORDS = 8
+EVENT_WORDS = 3
+
+LINE_RE = re.compile(r'post-mortem ([0-9a-f]{4}):((?: [0-9a-f]{8})+)')
+
+RESET_REASONS = {
+    0: 'power on',
+    1: 'hardware watchdog',
+    2: 'exception',
+    3: 'software watchdog',
+    4: 'software restart',
+    5: 'deep sleep wake',
+    6: 'external reset',
+}
+
+EXCEPTION_CAUSES = {
+    0: 'IllegalInstruction',
+    2: 'InstructionFetchError',
+    3: 'LoadStoreError',
+    4: 'Level1Interrupt',
+    6: 'IntegerDivideByZero',
+    9: 'LoadStoreAlignment',
+    20: 'InstFetchProhibited',
+    28: 'LoadProhibited',
+    29: 'StoreProhibited',
+}
+
+EVENT_NAMES = {
+    1: 'boot',
+}
+
+
+def read_words(lines):
+    words = {}
+    for line in lines:
+        match = LINE_RE.search(line)
+        if not match:
+            continue
+        offset = int(match.group(1), 16) // 4
+        for i, word in enumerate(match.group(2).split()):
+            words[offset + i] = int(word, 16)
+
+    if not words:
+        return []
+    count = max(words) + 1
+    missing = [i for i in range(count) if i not in words]
+    if missing:
+        print('warning: %d words missing from the dump' % len(missing), file=sys.stderr)
+    return [words.get(i, 0) for i in range(count)]
+
+
+def is_code(address):
+    return IRAM_START <= address < IRAM_END or FLASH_START <= address < FLASH_END
+
+
+def name(word, length):
+    return struct.pack('<%dI' % length, *word).split(b'\0')[0].decode('ascii', 'replace')
+
+
+class Symbolizer:
+    def __init__(self, addr2line, elf):
+        self.addr2line = addr2line
+        self.elf = elf
+        self.cache = {}
+
+    def __call__(self, address):
+        if not self.elf:
+            return ''
+        if address not in self.cache:
+            output = subprocess.run([self.addr2line, '-pfiaC', '-e', self.elf, '0x%08x' % address],
+                                    check=True, stdout=subprocess.PIPE,
+                                    universal_newlines=True).stdout
+            # drop the address addr2line repeats at the start
+            self.cache[address] = output.strip().split(': ', 1)[-1].replace('\n', '\n' + ' ' * 16)
+        return self.cache[address]
+
+
+def decode(words, events, stack_words, symbolize):
+    expected = HEADER_WORDS + FAULT_WORDS + stack_words + events * EVENT_WORDS
+    if len(words) < expected:
+        raise SystemExit('dump has %d words, expected %d; check --events and --stack-words'
+                         % (len(words), expected))
+
+    magic, boot_count, reset_reason, head, count = words[:HEADER_WORDS]
+    if magic != MAGIC:
+        raise SystemExit('not a post-mortem record (magic 0x%08x)' % magic)
+
+    fault, exccause, epc1, excvaddr, depc, sp = words[HEADER_WORDS:HEADER_WORDS + 6]
+    task = name(words[HEADER_WORDS + 6:HEADER_WORDS + 8], 2)
+    stack_start = HEADER_WORDS + FAULT_WORDS
+    stack = words[stack_start:stack_start + stack_words]
+    ring = words[stack_start + stack_words:expected]
+
+    print('Boot %d since power-on, ended by %s (reset reason %d)'
+          % (boot_count, RESET_REASONS.get(reset_reason, 'unknown'), reset_reason))
+
+    if fault:
+        print('Exception %d (%s) in task %r' % (exccause, EXCEPTION_CAUSES.get(exccause, 'unknown'), task))
+        print('  excvaddr 0x%08x  depc 0x%08x' % (excvaddr, depc))
+    if epc1:
+        print('  epc1     0x%08x  %s' % (epc1, symbolize(epc1)))
+
+    if fault:
+        # call0 ABI: no frame chain, so report every saved word that points
+        # into code, innermost first
+        print('\nBacktrace (code addresses found on the stack from 0x%08x):' % sp)
+        for i, word in enumerate(stack):
+            if is_code(word):
+                print('  sp+%-4d 0x%08x  %s' % (i * 4, word, symbolize(word)))
+
+    count = min(count, events)
+    print('\nLast %d events, oldest first:' % count)
+    entries = [ring[i * EVENT_WORDS:(i + 1) * EVENT_WORDS] for i in range(events)]
+    order = [(head + events - count + i) % events for i in range(count)]
+    last = entries[order[-1]][0] if order else 0
+    for i in order:
+        time, id, task_word = entries[i]
+        event, arg = id >> 16, id & 0xffff
+        delta = (time - last + 2**31) % 2**32 - 2**31
+        print('  %10d us  %-8s  event %s arg %d'
+              % (delta, name([task_word], 1), EVENT_NAMES.get(event, '0x%04x' % event), arg))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode and symbolize a post-mortem record')
+    parser.add_argument('log', nargs='?', help='serial log or TCP dump (default: stdin)')
+    parser.add_argument('--elf', help='linked program the device was running (build/<program>.out)')
+    parser.add_argument('--events', type=int, default=16, help='POST_MORTEM_EVENTS of the build')
+    parser.add_argument('--stack-words', type=int, default=40, help='POST_MORTEM_STACK_WORDS of the build')
+    parser.add_argument('--cross', default=os.environ.get('CROSS', 'xtensa-lx106-elf-'),
+                        help='toolchain prefix (default: %(default)s)')
+    args = parser.parse_args()
+
+    if args.log:
+        with open(args.log, errors='replace') as f:
+            words = read_words(f)
+    else:
+        words = read_words(sys.stdin)
+
+    if not words:
+        print('No post-mortem record found')
+        return 1
+
+    decode(words, args.events, args.stack_words, Symbolizer(args.cross + 'addr2line', args.elf))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
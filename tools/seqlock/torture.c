@@ -0,0 +1,218 @@
+// Torture test of components/common/seqlock on host threads.
+//
+//   build/seqlock_torture --seconds 3 --readers 3 --writers 2
+//
+// Shaped like the blinds example: four positions that writers change
+// together and readers copy together. Writers are serialized by a mutex,
+// as taskENTER_CRITICAL serializes them on the device. Every write stores
+// one number in a form that only holds if all four fields come from the
+// same write, so a torn snapshot is caught on the reader side. Both sides
+// pause between fields so that reads and writes overlap as often as
+// possible.
+//
+// With --unlocked the readers copy the fields without the seqlock. Torn
+// snapshots are expected then, --expect-torn fails the run if none were
+// seen: the pauses are not long enough to make the test mean anything.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "seqlock.h"
+
+#define MAX_THREADS 64
+#define WRITE_GAP_SPINS 100000
+
+typedef struct {
+    int current_left, target_left;
+    int current_right, target_right;
+} positions_t;
+
+static seqlock_t lock = SEQLOCK_INIT;
+static volatile positions_t positions;
+static pthread_mutex_t writers = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile bool stopping = false;
+static bool unlocked = false;
+
+typedef struct {
+    pthread_t thread;
+    int id;
+    uint64_t operations;
+    uint64_t retries;
+    uint64_t torn;
+    positions_t first_torn;
+} worker_t;
+
+
+// A few hundred nanoseconds, the time a task takes to get from one field to
+// the next when it is preempted there now and then
+static void pause_between_fields(unsigned *seed) {
+    int spins = rand_r(seed) % 64;
+    for (volatile int i = 0; i < spins; i++);
+    if (rand_r(seed) % 256 == 0)
+        sched_yield();
+}
+
+
+static bool consistent(const positions_t *p) {
+    return p->target_left == p->current_left * 3 &&
+           p->current_right == ~p->current_left &&
+           p->target_right == p->current_left + 7;
+}
+
+
+static void *writer(void *arg) {
+    worker_t *worker = arg;
+    unsigned seed = worker->id;
+    int value = worker->id << 20;
+
+    while (!stopping) {
+        value++;
+        pthread_mutex_lock(&writers);
+        seqlock_write_begin(&lock);
+        positions.current_left = value;
+        pause_between_fields(&seed);
+        positions.target_left = value * 3;
+        pause_between_fields(&seed);
+        positions.current_right = ~value;
+        pause_between_fields(&seed);
+        positions.target_right = value + 7;
+        seqlock_write_end(&lock);
+        pthread_mutex_unlock(&writers);
+        worker->operations++;
+
+        // Writes come far less often than reads on the device; without a
+        // gap readers would only ever retry
+        for (volatile int i = rand_r(&seed) % WRITE_GAP_SPINS; i > 0; i--);
+    }
+    return NULL;
+}
+
+
+static void read_fields(positions_t *p, unsigned *seed) {
+    p->current_left = positions.current_left;
+    pause_between_fields(seed);
+    p->target_left = positions.target_left;
+    pause_between_fields(seed);
+    p->current_right = positions.current_right;
+    pause_between_fields(seed);
+    p->target_right = positions.target_right;
+}
+
+
+static void *reader(void *arg) {
+    worker_t *worker = arg;
+    unsigned seed = worker->id;
+
+    while (!stopping) {
+        positions_t p;
+        if (unlocked) {
+            read_fields(&p, &seed);
+        } else {
+            uint32_t sequence;
+            while (true) {
+                sequence = seqlock_read_begin(&lock);
+                read_fields(&p, &seed);
+                if (!seqlock_read_retry(&lock, sequence))
+                    break;
+                worker->retries++;
+            }
+        }
+
+        if (!consistent(&p)) {
+            if (!worker->torn)
+                worker->first_torn = p;
+            worker->torn++;
+        }
+        worker->operations++;
+    }
+    return NULL;
+}
+
+
+int main(int argc, char **argv) {
+    int seconds = 3;
+    int reader_count = 3;
+    int writer_count = 2;
+    bool expect_torn = false;
+
+    static const struct option options[] = {
+        { "seconds", required_argument, NULL, 's' },
+        { "readers", required_argument, NULL, 'r' },
+        { "writers", required_argument, NULL, 'w' },
+        { "unlocked", no_argument, NULL, 'u' },
+        { "expect-torn", no_argument, NULL, 'e' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 's': seconds = atoi(optarg); break;
+            case 'r': reader_count = atoi(optarg); break;
+            case 'w': writer_count = atoi(optarg); break;
+            case 'u': unlocked = true; break;
+            case 'e': expect_torn = true; break;
+            default: return 2;
+        }
+    }
+    if (reader_count < 1 || writer_count < 1 || reader_count + writer_count > MAX_THREADS) {
+        fprintf(stderr, "seqlock_torture: 1 to %d threads of each kind\n", MAX_THREADS - 1);
+        return 2;
+    }
+
+    positions_t initial = { 0, 0, ~0, 7 };
+    positions = initial;
+
+    static worker_t workers[MAX_THREADS];
+    int count = reader_count + writer_count;
+    for (int i = 0; i < count; i++) {
+        workers[i].id = i + 1;
+        if (pthread_create(&workers[i].thread, NULL, i < writer_count ? writer : reader, &workers[i])) {
+            fprintf(stderr, "seqlock_torture: failed to start thread %d\n", i);
+            return 1;
+        }
+    }
+
+    struct timespec duration = { .tv_sec = seconds };
+    nanosleep(&duration, NULL);
+    stopping = true;
+
+    uint64_t writes = 0, reads = 0, retries = 0, torn = 0;
+    for (int i = 0; i < count; i++) {
+        pthread_join(workers[i].thread, NULL);
+        if (i < writer_count) {
+            writes += workers[i].operations;
+            continue;
+        }
+        reads += workers[i].operations;
+        retries += workers[i].retries;
+        torn += workers[i].torn;
+        if (workers[i].torn && !expect_torn) {
+            positions_t *p = &workers[i].first_torn;
+            printf("FAIL: reader %d returned %d %d %d %d\n", workers[i].id,
+                   p->current_left, p->target_left, p->current_right, p->target_right);
+        }
+    }
+
+    printf("%s: %d writers, %d readers, %d s: %llu writes, %llu snapshots, "
+           "%llu retried, %llu torn\n", unlocked ? "unlocked" : "seqlock",
+           writer_count, reader_count, seconds, (unsigned long long)writes,
+           (unsigned long long)reads, (unsigned long long)retries, (unsigned long long)torn);
+
+    if (expect_torn) {
+        if (!torn) {
+            printf("FAIL: no torn snapshot without the lock, the test does not overlap reads and writes\n");
+            return 1;
+        }
+    } else if (torn) {
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
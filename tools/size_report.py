@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+#
+# Flash and RAM budget report for esp-open-rtos examples.
+#
+# Breaks the linked image down by section kind (flash code, rodata, data,
+# bss, IRAM) and by component (homekit, wolfssl, cJSON, app, ...), shows
+# how much of the flash budget is left and the largest symbols, and
+# compares everything against a stored baseline.
+#
+# Usage:
+#   tools/size_report.py build/light.out --map build/light.map --flash-size 8
+#   tools/size_report.py ... --baseline size-baseline.json [--update-baseline]
+#
+# From an example directory: make size-report / make size-baseline
+#
+
+import argparse
+import collections
+import json
+import os
+import re
+import subprocess
+import sys
+
+
+IRAM = (0x40100000, 0x40108000)
+FLASH = (0x40200000, 0x40300000)
+DRAM = (0x3FFE8000, 0x40000000)
+
+IRAM_SIZE = IRAM[1] - IRAM[0]
+DRAM_SIZE = DRAM[1] - DRAM[0]
+
+KINDS = ('text', 'rodata', 'data', 'bss', 'iram')
+
+# Archive names as built by esp-open-rtos, mapped to report components
+COMPONENTS = {
+    'program': 'app',
+    'homekit': 'homekit',
+    'wolfssl': 'wolfssl',
+    'cJSON': 'cJSON',
+    'lwip': 'sdk',
+    'freertos': 'sdk',
+    'core': 'sdk',
+    'open_esplibs': 'sdk',
+}
+
+SECTION_RE = re.compile(r'^ (\.\S+|COMMON)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S+))?\s*$')
+CONTINUATION_RE = re.compile(r'^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S+)\s*$')
+ARCHIVE_RE = re.compile(r'(?:^|/)(?:lib)?([^/()]+?)\.a\(')
+
+
+def within(address, region):
+    return region[0] <= address < region[1]
+
+
+def component_of(owner):
+    m = ARCHIVE_RE.search(owner)
+    if m:
+        name = m.group(1)
+    else:
+        # loose object files are the application's own
+        return 'app'
+    if name in COMPONENTS:
+        return COMPONENTS[name]
+    if owner.find('/sdklib/') >= 0 or owner.find('/xtensa-lx106-elf/') >= 0:
+        return 'sdk'
+    return name
+
+
+def kind_of(section, address):
+    if section.startswith(('.bss', 'COMMON')):
+        return 'bss'
+    if section.startswith('.data'):
+        return 'data'
+    if within(address, IRAM):
+        return 'iram'
+    if section.startswith('.rodata') or within(address, DRAM):
+        return 'rodata'
+    return 'text'
+
+
+def read_map(map_file):
+    """Yields (section, address, size, owner) for every input section that got linked."""
+    in_memory_map = False
+    pending = None
+    with open(map_file) as f:
+        for line in f:
+            line = line.rstrip('\n')
+            if not in_memory_map:
+                in_memory_map = line.startswith('Linker script and memory map')
+                continue
+            if pending:
+                m = CONTINUATION_RE.match(line)
+                if m:
+                    yield pending, int(m.group(1), 16), int(m.group(2), 16), m.group(3)
+                pending = None
+                continue
+            m = SECTION_RE.match(line)
+            if not m:
+                continue
+            if m.group(4):
+                yield m.group(1), int(m.group(2), 16), int(m.group(3), 16), m.group(4)
+            else:
+                pending = m.group(1)
+
+
+def breakdown(map_file):
+    totals = collections.defaultdict(lambda: dict.fromkeys(KINDS, 0))
+    for section, address, size, owner in read_map(map_file):
+        if size == 0 or address == 0:
+            continue
+        totals[component_of(owner)][kind_of(section, address)] += size
+    return {component: dict(kinds) for component, kinds in totals.items()}
+
+
+def top_symbols(nm, elf, count):
+    symbols = []
+    output = subprocess.run([nm, '-S', '--size-sort', '--defined-only', elf], check=True,
+                            stdout=subprocess.PIPE, universal_newlines=True).stdout
+    for line in output.splitlines():
+        parts = line.split()
+        if len(parts) == 4:
+            symbols.append((int(parts[1], 16), parts[2], parts[3]))
+    return sorted(symbols, reverse=True)[:count]
+
+
+def summarize(components):
+    total = dict.fromkeys(KINDS, 0)
+    for kinds in components.values():
+        for kind in KINDS:
+            total[kind] += kinds[kind]
+    return total
+
+
+def print_table(components, baseline):
+    header = '%-14s' % 'component' + ''.join('%10s' % kind for kind in KINDS)
+    print(header)
+    print('-' * len(header))
+    rows = sorted(components.items(), key=lambda c: -sum(c[1].values()))
+    rows.append(('total', summarize(components)))
+    base_rows = dict(baseline.get('components', {}))
+    base_rows['total'] = summarize(baseline.get('components', {})) if baseline else None
+    for name, kinds in rows:
+        line = '%-14s' % name + ''.join('%10d' % kinds[kind] for kind in KINDS)
+        base = base_rows.get(name)
+        if base:
+            delta = sum(kinds.values()) - sum(base.get(kind, 0) for kind in KINDS)
+            if delta:
+                line += '  %+d' % delta
+        print(line)
+
+
+def check_growth(components, baseline, threshold, min_bytes):
+    problems = []
+    old = baseline.get('components', {})
+    for name, kinds in sorted(components.items()):
+        for kind in KINDS:
+            before = old.get(name, {}).get(kind, 0)
+            after = kinds[kind]
+            growth = after - before
+            if growth > min_bytes and growth > before * threshold / 100.0:
+                problems.append('%s %s grew by %d bytes (%d -> %d)' % (name, kind, growth, before, after))
+    return problems
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Flash and RAM budget report for an example')
+    parser.add_argument('elf', help='linked program (build/<program>.out)')
+    parser.add_argument('--map', required=True, help='linker map file')
+    parser.add_argument('--image', help='firmware image, used for the flash budget when present')
+    parser.add_argument('--flash-size', type=int, default=8, help='flash size in Mbit (FLASH_SIZE)')
+    parser.add_argument('--flash-limit', type=lambda x: int(x, 0),
+                        help='end of the area available to the image, e.g. HOMEKIT_SPI_FLASH_BASE_ADDR')
+    parser.add_argument('--ota', action='store_true', help='budget for two OTA slots')
+    parser.add_argument('--baseline', help='baseline JSON file to compare against')
+    parser.add_argument('--update-baseline', action='store_true', help='write the baseline and exit')
+    parser.add_argument('--threshold', type=float, default=2.0,
+                        help='allowed growth per component and section, in percent (default: %(default)s)')
+    parser.add_argument('--min-bytes', type=int, default=128,
+                        help='growth below this many bytes is never flagged (default: %(default)s)')
+    parser.add_argument('--top', type=int, default=15, help='number of largest symbols to list')
+    parser.add_argument('--cross', default=os.environ.get('CROSS', 'xtensa-lx106-elf-'))
+    args = parser.parse_args()
+
+    components = breakdown(args.map)
+    total = summarize(components)
+
+    if args.update_baseline:
+        with open(args.baseline, 'w') as f:
+            json.dump({'components': components}, f, indent=2, sort_keys=True)
+            f.write('\n')
+        print('Baseline written to %s' % args.baseline)
+        return 0
+
+    baseline = {}
+    if args.baseline and os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+
+    print_table(components, baseline)
+
+    flash_bytes = args.flash_size * 1024 * 1024 // 8
+    limit = args.flash_limit or flash_bytes
+    if args.ota:
+        limit //= 2
+    if args.image and os.path.exists(args.image):
+        image = os.path.getsize(args.image)
+    else:
+        image = total['text'] + total['rodata'] + total['data'] + total['iram']
+
+    ram = total['data'] + total['bss']
+    print()
+    print('Flash: image %d of %d bytes%s, %d free (%.1f%%)' % (
+        image, limit, ' per OTA slot' if args.ota else '', limit - image, 100.0 * (limit - image) / limit))
+    print('IRAM:  %d of %d bytes, %d free' % (total['iram'], IRAM_SIZE, IRAM_SIZE - total['iram']))
+    print('DRAM:  %d bytes static (data %d + bss %d), %d left for heap and stacks' % (
+        ram, total['data'], total['bss'], DRAM_SIZE - ram))
+
+    print()
+    print('Largest symbols:')
+    for size, kind, name in top_symbols(args.cross + 'nm', args.elf, args.top):
+        print('  %8d %s %s' % (size, kind, name))
+
+    status = 0
+    if image > limit:
+        print()
+        print('ERROR: image does not fit')
+        status = 1
+
+    if baseline:
+        problems = check_growth(components, baseline, args.threshold, args.min_bytes)
+        if problems:
+            print()
+            print('Growth over %.1f%% since baseline:' % args.threshold)
+            for problem in problems:
+                print('  ' + problem)
+            status = 1
+
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,312 @@
+// Peripherals of the soak runner's device model: GPIO levels, esp-button,
+// esp-wifi-config and the flash the config_store component writes.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp8266.h>
+#include <button.h>
+#include <wifi_config.h>
+#include <spiflash.h>
+#include <flash_scheduler.h>
+
+#include "runtime.h"
+
+#define GPIO_COUNT 17
+#define MAX_BUTTONS 8
+
+// Timing of a user's presses, in milliseconds
+#define PRESS_TIME 100
+#define PRESS_GAP 150
+// esp-button waits this long for a repeated press before reporting
+#define REPEAT_PRESS_TIMEOUT 300
+
+// Flash sectors mapped at once, erased on first use
+#define FLASH_SECTORS 16
+#define FLASH_SECTOR_SIZE 4096
+
+typedef struct {
+    uint8_t gpio;
+    button_config_t config;
+    button_callback_fn callback;
+    void *context;
+} button_t;
+
+typedef struct {
+    button_t *buttons[2];
+    int button_count;
+    button_event_t event;
+    int presses;
+} press_t;
+
+
+static bool gpio_levels[GPIO_COUNT];
+
+static button_t *buttons[MAX_BUTTONS];
+static int button_count = 0;
+
+static void (*wifi_on_event)(wifi_config_event_t event) = NULL;
+static void (*wifi_on_ready)() = NULL;
+static bool wifi_connected = false;
+
+static struct {
+    uint32_t address;
+    bool mapped;
+    uint8_t data[FLASH_SECTOR_SIZE];
+} flash_sectors[FLASH_SECTORS];
+
+
+/*------------------------------------------------------------------------------
+ * GPIO
+ *----------------------------------------------------------------------------*/
+
+void gpio_enable(uint8_t gpio, gpio_direction_t direction) {
+}
+
+
+void gpio_set_pullup(uint8_t gpio, bool enabled, bool enabled_during_sleep) {
+}
+
+
+void gpio_write(uint8_t gpio, bool value) {
+    if (gpio < GPIO_COUNT)
+        gpio_levels[gpio] = value;
+}
+
+
+bool gpio_read(uint8_t gpio) {
+    return gpio < GPIO_COUNT ? gpio_levels[gpio] : false;
+}
+
+
+void soak_gpio_set(uint8_t gpio, bool level) {
+    gpio_write(gpio, level);
+}
+
+
+/*------------------------------------------------------------------------------
+ * Buttons
+ *----------------------------------------------------------------------------*/
+
+static button_t *button_find(uint8_t gpio) {
+    for (int i = 0; i < button_count; i++) {
+        if (buttons[i]->gpio == gpio)
+            return buttons[i];
+    }
+    return NULL;
+}
+
+
+int button_create(uint8_t gpio_num, button_config_t config, button_callback_fn callback, void *context) {
+    if (gpio_num >= GPIO_COUNT || button_count == MAX_BUTTONS || button_find(gpio_num))
+        return -1;
+
+    button_t *button = malloc(sizeof(button_t));
+    if (!button)
+        return -2;
+
+    button->gpio = gpio_num;
+    button->config = config;
+    button->callback = callback;
+    button->context = context;
+    buttons[button_count++] = button;
+
+    gpio_levels[gpio_num] = config.active_level == button_active_low;
+    return 0;
+}
+
+
+void button_destroy(uint8_t gpio_num) {
+    for (int i = 0; i < button_count; i++) {
+        if (buttons[i]->gpio == gpio_num) {
+            free(buttons[i]);
+            buttons[i] = buttons[--button_count];
+            return;
+        }
+    }
+}
+
+
+int soak_button_count() {
+    return button_count;
+}
+
+
+uint8_t soak_button_gpio(int index) {
+    return buttons[index]->gpio;
+}
+
+
+static void press_set(press_t *press, bool pressed) {
+    for (int i = 0; i < press->button_count; i++) {
+        button_t *button = press->buttons[i];
+        gpio_levels[button->gpio] = pressed == (button->config.active_level == button_active_high);
+    }
+}
+
+
+static void press_report(void *arg) {
+    press_t *press = arg;
+    for (int i = 0; i < press->button_count; i++)
+        press->buttons[i]->callback(press->event, press->buttons[i]->context);
+}
+
+
+static void press_release(void *arg);
+
+static void press_down(void *arg) {
+    press_t *press = arg;
+    press_set(press, true);
+
+    if (press->event == button_event_long_press) {
+        // Reported while the button is still held
+        uint32_t long_press_time = press->buttons[0]->config.long_press_time;
+        soak_after(long_press_time, press_report, press);
+        soak_after(long_press_time + PRESS_TIME + soak_random(PRESS_TIME), press_release, press);
+    } else {
+        soak_after(PRESS_TIME / 2 + soak_random(PRESS_TIME), press_release, press);
+    }
+}
+
+
+static void press_free(void *arg) {
+    soak_free_untracked(arg);
+}
+
+
+static void press_release(void *arg) {
+    press_t *press = arg;
+    press_set(press, false);
+
+    if (press->event == button_event_long_press) {
+        press_free(press);
+    } else if (--press->presses) {
+        soak_after(PRESS_GAP, press_down, press);
+    } else {
+        soak_after(REPEAT_PRESS_TIMEOUT, press_report, press);
+        soak_after(REPEAT_PRESS_TIMEOUT, press_free, press);
+    }
+}
+
+
+static void press_start(button_t **pressed, int count, button_event_t event) {
+    press_t *press = soak_alloc_untracked(sizeof(press_t));
+    for (int i = 0; i < count; i++)
+        press->buttons[i] = pressed[i];
+    press->button_count = count;
+    press->event = event;
+    switch (event) {
+        case button_event_double_press: press->presses = 2; break;
+        case button_event_tripple_press: press->presses = 3; break;
+        default: press->presses = 1;
+    }
+    press_down(press);
+}
+
+
+void soak_button_press(uint8_t gpio, button_event_t event) {
+    button_t *button = button_find(gpio);
+    if (!button)
+        soak_fatal("no button on GPIO %d", gpio);
+    press_start(&button, 1, event);
+}
+
+
+void soak_button_chord(uint8_t gpio1, uint8_t gpio2, bool long_press) {
+    button_t *pressed[2] = { button_find(gpio1), button_find(gpio2) };
+    if (!pressed[0] || !pressed[1])
+        soak_fatal("no button on GPIO %d or %d", gpio1, gpio2);
+    press_start(pressed, 2, long_press ? button_event_long_press : button_event_single_press);
+}
+
+
+/*------------------------------------------------------------------------------
+ * WiFi
+ *----------------------------------------------------------------------------*/
+
+static void wifi_report(wifi_config_event_t event) {
+    if (wifi_on_event)
+        wifi_on_event(event);
+    if (wifi_on_ready && event == WIFI_CONFIG_CONNECTED)
+        wifi_on_ready();
+}
+
+
+static void wifi_connect(void *arg) {
+    wifi_connected = true;
+    wifi_report(WIFI_CONFIG_CONNECTED);
+}
+
+
+void wifi_config_init(const char *ssid_prefix, const char *password, void (*on_wifi_ready)()) {
+    wifi_on_ready = on_wifi_ready;
+}
+
+
+void wifi_config_init2(const char *ssid_prefix, const char *password,
+                       void (*on_event)(wifi_config_event_t)) {
+    wifi_on_event = on_event;
+}
+
+
+void wifi_config_reset() {
+}
+
+
+void soak_wifi_drop(uint32_t duration_ms) {
+    if (!wifi_connected)
+        return;
+
+    wifi_connected = false;
+    wifi_report(WIFI_CONFIG_DISCONNECTED);
+    soak_after(duration_ms, wifi_connect, NULL);
+}
+
+
+/*------------------------------------------------------------------------------
+ * Flash
+ *----------------------------------------------------------------------------*/
+
+static uint8_t *flash_map(uint32_t address) {
+    uint32_t sector = address - address % FLASH_SECTOR_SIZE;
+    for (int i = 0; i < FLASH_SECTORS; i++) {
+        if (flash_sectors[i].mapped && flash_sectors[i].address == sector)
+            return flash_sectors[i].data + address - sector;
+    }
+    for (int i = 0; i < FLASH_SECTORS; i++) {
+        if (!flash_sectors[i].mapped) {
+            flash_sectors[i].mapped = true;
+            flash_sectors[i].address = sector;
+            memset(flash_sectors[i].data, 0xFF, FLASH_SECTOR_SIZE);
+            return flash_sectors[i].data + address - sector;
+        }
+    }
+    soak_fatal("more than %d flash sectors used", FLASH_SECTORS);
+}
+
+
+bool spiflash_read(uint32_t address, uint8_t *buffer, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++)
+        buffer[i] = *flash_map(address + i);
+    return true;
+}
+
+
+bool flash_scheduler_erase_sector(uint32_t address) {
+    memset(flash_map(address), 0xFF, FLASH_SECTOR_SIZE);
+    return true;
+}
+
+
+bool flash_scheduler_write(uint32_t address, const uint8_t *data, uint32_t length) {
+    // Programming only clears bits
+    for (uint32_t i = 0; i < length; i++)
+        *flash_map(address + i) &= data[i];
+    return true;
+}
+
+
+void soak_devices_start() {
+    if (wifi_on_event || wifi_on_ready)
+        soak_after(2000 + soak_random(3000), wifi_connect, NULL);
+}
@@ -0,0 +1,364 @@
+// Heap tracking of the soak runner.
+//
+// The firmware is linked with --wrap for malloc, calloc, realloc, free and
+// strdup, so only its own allocations (and those of the device model made
+// on its behalf, like task stacks) are seen here; the C library's are not.
+// Each allocation is attributed to a call site, the innermost few frames
+// of its backtrace.
+//
+// Live heap is sampled every few simulated minutes. A boot leaks if the
+// lowest live heap of its last simulated day is above the lowest of its
+// first day after warm-up by more than the threshold. Taking the lowest
+// point of a day ignores whatever is in flight at the moment of sampling.
+// A boot whose live heap passes the limit is cut short and judged leaking
+// straight away: the device would be out of memory by then.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <execinfo.h>
+
+#include "runtime.h"
+
+#define MAX_ALLOCATIONS (1 << 16)       // power of two
+#define MAX_SITES 1024
+#define SITE_FRAMES 4
+#define MAX_SAMPLES (1 << 16)
+
+// Frames of the wrappers themselves: track() and __wrap_*
+#define SKIP_FRAMES 2
+
+typedef struct {
+    void *frames[SITE_FRAMES];
+    uint32_t live_count;
+    uint32_t live_bytes;
+    uint32_t total_count;
+
+    // Live at the end of warm-up
+    uint32_t warm_count;
+    uint32_t warm_bytes;
+} site_t;
+
+typedef struct {
+    void *ptr;
+    uint32_t size;
+    uint16_t site;
+    bool since_warmup;          // allocated after warm-up ended
+} allocation_t;
+
+typedef struct {
+    uint64_t time;
+    uint32_t live_bytes;
+} sample_t;
+
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static allocation_t *allocations;
+static site_t *sites;
+static uint32_t site_count;
+static sample_t *samples;
+static uint32_t sample_count;
+
+static bool tracking = false;
+static bool warmed_up = false;
+static bool exhausted = false;
+static uint32_t live_bytes = 0;
+static uint64_t warmup_end = 0;
+static uint32_t untracked_frees = 0;
+
+
+void *soak_alloc_untracked(size_t size) {
+    void *ptr = __real_calloc(1, size);
+    if (!ptr)
+        soak_fatal("out of host memory");
+    return ptr;
+}
+
+
+void soak_free_untracked(void *ptr) {
+    __real_free(ptr);
+}
+
+
+static uint32_t hash_pointer(const void *ptr) {
+    uint64_t h = (uintptr_t)ptr * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(h >> 40) & (MAX_ALLOCATIONS - 1);
+}
+
+
+static uint16_t site_for(void **frames) {
+    for (uint32_t i = 0; i < site_count; i++) {
+        if (!memcmp(sites[i].frames, frames, sizeof(sites[i].frames)))
+            return i;
+    }
+    if (site_count == MAX_SITES)
+        soak_fatal("more than %d allocation sites", MAX_SITES);
+
+    memcpy(sites[site_count].frames, frames, sizeof(sites[site_count].frames));
+    return site_count++;
+}
+
+
+static __attribute__((noinline)) void track(void *ptr, size_t size) {
+    if (!tracking || !ptr)
+        return;
+
+    void *trace[SKIP_FRAMES + SITE_FRAMES];
+    void *frames[SITE_FRAMES] = { 0 };
+    int depth = backtrace(trace, SKIP_FRAMES + SITE_FRAMES);
+    for (int i = SKIP_FRAMES; i < depth; i++)
+        frames[i - SKIP_FRAMES] = trace[i];
+
+    uint32_t i = hash_pointer(ptr);
+    uint32_t probes = 0;
+    while (allocations[i].ptr) {
+        if (++probes == MAX_ALLOCATIONS)
+            soak_fatal("more than %d live allocations", MAX_ALLOCATIONS);
+        i = (i + 1) & (MAX_ALLOCATIONS - 1);
+    }
+
+    uint16_t site = site_for(frames);
+    allocations[i] = (allocation_t) {
+        .ptr = ptr,
+        .size = size,
+        .site = site,
+        .since_warmup = warmed_up,
+    };
+
+    sites[site].live_count++;
+    sites[site].live_bytes += size;
+    sites[site].total_count++;
+    live_bytes += size;
+}
+
+
+static void untrack(void *ptr) {
+    if (!tracking || !ptr)
+        return;
+
+    uint32_t i = hash_pointer(ptr);
+    while (allocations[i].ptr != ptr) {
+        if (!allocations[i].ptr) {
+            untracked_frees++;
+            return;
+        }
+        i = (i + 1) & (MAX_ALLOCATIONS - 1);
+    }
+
+    site_t *site = &sites[allocations[i].site];
+    site->live_count--;
+    site->live_bytes -= allocations[i].size;
+    live_bytes -= allocations[i].size;
+
+    // Backward shift deletion keeps linear probing free of tombstones
+    uint32_t hole = i;
+    allocations[hole].ptr = NULL;
+    for (uint32_t j = (hole + 1) & (MAX_ALLOCATIONS - 1); allocations[j].ptr;
+            j = (j + 1) & (MAX_ALLOCATIONS - 1)) {
+        uint32_t home = hash_pointer(allocations[j].ptr);
+        if (((j - home) & (MAX_ALLOCATIONS - 1)) >= ((j - hole) & (MAX_ALLOCATIONS - 1))) {
+            allocations[hole] = allocations[j];
+            allocations[j].ptr = NULL;
+            hole = j;
+        }
+    }
+}
+
+
+void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    track(ptr, size);
+    return ptr;
+}
+
+
+void *__wrap_calloc(size_t count, size_t size) {
+    void *ptr = __real_calloc(count, size);
+    track(ptr, count * size);
+    return ptr;
+}
+
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    void *result = __real_realloc(ptr, size);
+    if (result || !size) {
+        untrack(ptr);
+        track(result, size);
+    }
+    return result;
+}
+
+
+void __wrap_free(void *ptr) {
+    untrack(ptr);
+    __real_free(ptr);
+}
+
+
+char *__wrap_strdup(const char *s) {
+    size_t size = strlen(s) + 1;
+    char *copy = __real_malloc(size);
+    if (copy)
+        memcpy(copy, s, size);
+    track(copy, size);
+    return copy;
+}
+
+
+void soak_heap_start() {
+    // The first backtrace() loads the unwinder, which allocates
+    void *trace[1];
+    backtrace(trace, 1);
+
+    allocations = soak_alloc_untracked(MAX_ALLOCATIONS * sizeof(allocation_t));
+    sites = soak_alloc_untracked(MAX_SITES * sizeof(site_t));
+    samples = soak_alloc_untracked(MAX_SAMPLES * sizeof(sample_t));
+    tracking = true;
+}
+
+
+void soak_heap_end_warmup() {
+    warmed_up = true;
+    warmup_end = soak_now();
+    for (uint32_t i = 0; i < site_count; i++) {
+        sites[i].warm_count = sites[i].live_count;
+        sites[i].warm_bytes = sites[i].live_bytes;
+    }
+}
+
+
+// Returns false once live heap is over limit
+bool soak_heap_sample(uint32_t limit) {
+    if (sample_count < MAX_SAMPLES)
+        samples[sample_count++] = (sample_t) { soak_now(), live_bytes };
+    if (limit && live_bytes > limit)
+        exhausted = true;
+    return !exhausted;
+}
+
+
+static uint32_t lowest_live(uint64_t from, uint64_t to) {
+    uint32_t lowest = UINT32_MAX;
+    for (uint32_t i = 0; i < sample_count; i++) {
+        if (samples[i].time >= from && samples[i].time < to && samples[i].live_bytes < lowest)
+            lowest = samples[i].live_bytes;
+    }
+    return lowest;
+}
+
+
+// Resolves the frames of the given sites with addr2line, in one go
+static void print_sites(const char *title, const uint16_t *list, int count, bool growth) {
+    if (!count)
+        return;
+
+    fprintf(stderr, "  %s:\n", title);
+
+    char command[64 + SITE_FRAMES * 20 * 32];
+    int n = snprintf(command, sizeof(command), "addr2line -f -s -C -e /proc/%d/exe", getpid());
+    int frames = 0;
+    for (int i = 0; i < count && i < 32; i++) {
+        for (int f = 0; f < SITE_FRAMES && sites[list[i]].frames[f]; f++, frames++) {
+            // Return addresses point past the call
+            n += snprintf(command + n, sizeof(command) - n, " %p",
+                          (char *)sites[list[i]].frames[f] - 1);
+        }
+    }
+
+    FILE *symbols = frames ? popen(command, "r") : NULL;
+
+    for (int i = 0; i < count && i < 32; i++) {
+        const site_t *site = &sites[list[i]];
+        if (growth) {
+            fprintf(stderr, "    %+6d allocations %+8d bytes  ",
+                    (int)(site->live_count - site->warm_count),
+                    (int)(site->live_bytes - site->warm_bytes));
+        } else {
+            fprintf(stderr, "    %6u allocations %8u bytes  ", site->live_count, site->live_bytes);
+        }
+
+        for (int f = 0; f < SITE_FRAMES && site->frames[f]; f++) {
+            char function[256] = "?", location[256] = "?";
+            if (symbols && fgets(function, sizeof(function), symbols) &&
+                    fgets(location, sizeof(location), symbols)) {
+                function[strcspn(function, "\n")] = 0;
+                location[strcspn(location, " \n")] = 0;
+            }
+            fprintf(stderr, "%s%s (%s)", f ? " <- " : "", function, location);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    if (symbols)
+        pclose(symbols);
+}
+
+
+static int compare_growth(const void *a, const void *b) {
+    const site_t *x = &sites[*(const uint16_t *)a], *y = &sites[*(const uint16_t *)b];
+    int64_t gx = (int64_t)x->live_bytes - x->warm_bytes, gy = (int64_t)y->live_bytes - y->warm_bytes;
+    return gx < gy ? 1 : gx > gy ? -1 : 0;
+}
+
+
+soak_verdict_t soak_heap_report(uint64_t warmup_ms, uint32_t threshold) {
+    tracking = false;
+    soak_heap_sample(0);
+
+    uint64_t end = soak_now();
+    soak_verdict_t verdict = SOAK_TOO_SHORT;
+    uint32_t first = 0, last = 0;
+
+    if (warmed_up && end >= warmup_end + 2 * SOAK_DAY) {
+        first = lowest_live(warmup_end, warmup_end + SOAK_DAY);
+        last = lowest_live(end - SOAK_DAY, end + 1);
+        verdict = last > first + threshold ? SOAK_LEAK : SOAK_OK;
+    }
+    if (exhausted)
+        verdict = SOAK_LEAK;
+
+    if (exhausted) {
+        fprintf(stderr, "  live heap %u bytes, past the limit: LEAK\n", live_bytes);
+    } else if (verdict == SOAK_TOO_SHORT) {
+        fprintf(stderr, "  too short to judge: needs %llu h of warm-up and two days after\n",
+                (unsigned long long)(warmup_ms / SOAK_HOUR));
+    } else {
+        fprintf(stderr, "  live heap %u bytes on the first day after warm-up, %u on the last: %s\n",
+                first, last, verdict == SOAK_LEAK ? "LEAK" : "ok");
+    }
+
+    // Everything still held from before warm-up ended: allocations done once
+    // per boot and never freed. Harmless unless the code runs again.
+    uint16_t held[MAX_SITES];
+    int held_count = 0;
+    uint16_t grown[MAX_SITES];
+    int grown_count = 0;
+
+    uint32_t *held_since_boot = soak_alloc_untracked(site_count * sizeof(uint32_t));
+    for (uint32_t i = 0; i < MAX_ALLOCATIONS; i++) {
+        if (allocations[i].ptr && !allocations[i].since_warmup)
+            held_since_boot[allocations[i].site]++;
+    }
+    for (uint32_t i = 0; i < site_count; i++) {
+        if (held_since_boot[i] && held_since_boot[i] == sites[i].live_count)
+            held[held_count++] = i;
+        if (warmed_up && sites[i].live_bytes > sites[i].warm_bytes)
+            grown[grown_count++] = i;
+    }
+    soak_free_untracked(held_since_boot);
+
+    qsort(grown, grown_count, sizeof(grown[0]), compare_growth);
+    print_sites("held since boot", held, held_count, false);
+    if (verdict == SOAK_LEAK)
+        print_sites("grown since warm-up", grown, grown_count, true);
+
+    if (untracked_frees)
+        fprintf(stderr, "  %u frees of memory allocated outside the firmware\n", untracked_frees);
+
+    return verdict;
+}
@@ -0,0 +1,173 @@
+// esp-homekit model of the soak runner: accessory constructors, the server
+// task and characteristic writes from a controller.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <homekit/homekit.h>
+
+#include "runtime.h"
+
+#define SERVER_TASK_STACK 2048
+#define SERVER_WRITE_QUEUE 4
+#define MAX_WRITABLE 64
+
+typedef struct {
+    homekit_characteristic_t *ch;
+    homekit_value_t value;
+} write_request_t;
+
+typedef struct {
+    homekit_server_config_t *config;
+    QueueHandle_t writes;
+
+    // Stands in for the rest of the library's server state, its request
+    // buffer included
+    uint8_t data[1024];
+} server_t;
+
+
+// The server writes go to, the latest one started
+static server_t *server = NULL;
+
+
+homekit_characteristic_t *homekit_characteristic_clone(homekit_characteristic_t *ch) {
+    homekit_characteristic_t *clone = malloc(sizeof(homekit_characteristic_t));
+    *clone = *ch;
+    return clone;
+}
+
+
+homekit_service_t *homekit_service_clone(homekit_service_t *service) {
+    int count = 0;
+    while (service->characteristics[count])
+        count++;
+
+    // One block for the service and its list, as the library does
+    homekit_service_t *clone = malloc(sizeof(homekit_service_t) +
+                                      (count + 1) * sizeof(homekit_characteristic_t *));
+    *clone = *service;
+    clone->characteristics = (homekit_characteristic_t **)(clone + 1);
+    memcpy(clone->characteristics, service->characteristics,
+           (count + 1) * sizeof(homekit_characteristic_t *));
+    return clone;
+}
+
+
+homekit_accessory_t *homekit_accessory_clone(homekit_accessory_t *accessory) {
+    int count = 0;
+    while (accessory->services[count])
+        count++;
+
+    homekit_accessory_t *clone = malloc(sizeof(homekit_accessory_t) +
+                                        (count + 1) * sizeof(homekit_service_t *));
+    *clone = *accessory;
+    clone->services = (homekit_service_t **)(clone + 1);
+    memcpy(clone->services, accessory->services, (count + 1) * sizeof(homekit_service_t *));
+    return clone;
+}
+
+
+void homekit_characteristic_notify(homekit_characteristic_t *ch, const homekit_value_t value) {
+    for (homekit_characteristic_change_callback_t *callback = ch->callback; callback;
+            callback = callback->next)
+        callback->function(ch, value, callback->context);
+}
+
+
+static void server_write(write_request_t *request) {
+    homekit_characteristic_t *ch = request->ch;
+    if (ch->setter_ex)
+        ch->setter_ex(ch, request->value);
+    else if (ch->setter)
+        ch->setter(request->value);
+    else
+        ch->value = request->value;
+
+    homekit_characteristic_notify(ch, request->value);
+}
+
+
+static void server_task(void *arg) {
+    server_t *this = arg;
+    write_request_t request;
+
+    while (true) {
+        if (xQueueReceive(this->writes, &request, portMAX_DELAY) == pdTRUE)
+            server_write(&request);
+    }
+}
+
+
+void homekit_server_init(homekit_server_config_t *config) {
+    unsigned int id = 1;
+    for (homekit_accessory_t **accessory = config->accessories; *accessory; accessory++) {
+        for (homekit_service_t **service = (*accessory)->services; *service; service++) {
+            (*service)->accessory = *accessory;
+            (*service)->id = id++;
+            for (homekit_characteristic_t **ch = (*service)->characteristics; *ch; ch++) {
+                (*ch)->service = *service;
+                (*ch)->id = id++;
+            }
+        }
+    }
+
+    server_t *this = malloc(sizeof(server_t));
+    this->config = config;
+    this->writes = xQueueCreate(SERVER_WRITE_QUEUE, sizeof(write_request_t));
+    xTaskCreate(server_task, "HomeKit Server", SERVER_TASK_STACK, this, 1, NULL);
+    server = this;
+
+    if (config->on_event)
+        config->on_event(HOMEKIT_EVENT_SERVER_INITIALIZED);
+}
+
+
+void homekit_server_reset() {
+}
+
+
+static homekit_value_t random_value(homekit_characteristic_t *ch) {
+    float min = ch->min_value ? *ch->min_value : 0;
+    float max = ch->max_value ? *ch->max_value : 100;
+
+    switch (ch->format) {
+        case homekit_format_bool:
+            return HOMEKIT_BOOL(soak_random(2));
+        case homekit_format_float:
+            return HOMEKIT_FLOAT(min + (max - min) * soak_random(1001) / 1000);
+        default: {
+            homekit_value_t value = HOMEKIT_INT(min + soak_random(max - min + 1));
+            value.format = ch->format;
+            return value;
+        }
+    }
+}
+
+
+bool soak_homekit_write() {
+    if (!server)
+        return false;
+
+    homekit_characteristic_t *writable[MAX_WRITABLE];
+    int count = 0;
+    for (homekit_accessory_t **accessory = server->config->accessories; *accessory; accessory++) {
+        for (homekit_service_t **service = (*accessory)->services; *service; service++) {
+            for (homekit_characteristic_t **ch = (*service)->characteristics; *ch; ch++) {
+                if (((*ch)->permissions & homekit_permissions_paired_write) &&
+                        (*ch)->format != homekit_format_string && count < MAX_WRITABLE)
+                    writable[count++] = *ch;
+            }
+        }
+    }
+    if (!count)
+        return false;
+
+    write_request_t request;
+    request.ch = writable[soak_random(count)];
+    request.value = random_value(request.ch);
+    return xQueueSend(server->writes, &request, 0) == pdTRUE;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// The FreeRTOS subset the soak runner provides, see tools/soak/runtime.c
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t StackType_t;
+
+typedef struct soak_task *TaskHandle_t;
+typedef struct soak_queue *QueueHandle_t;
+typedef QueueHandle_t SemaphoreHandle_t;
+typedef struct soak_timer *TimerHandle_t;
+
+typedef void (*TaskFunction_t)(void *);
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t);
+
+// Sizes as on the ESP8266, so that static buffers take what they take there
+typedef struct { uint8_t reserved[96]; } StaticTask_t;
+typedef struct { uint8_t reserved[80]; } StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+typedef struct { uint8_t reserved[44]; } StaticTimer_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+#define errQUEUE_EMPTY 0
+#define errQUEUE_FULL 0
+
+#define portTICK_PERIOD_MS 10
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) / portTICK_PERIOD_MS)
+
+#define configMAX_PRIORITIES 15
+#define configMAX_TASK_NAME_LEN 16
+#define configSUPPORT_STATIC_ALLOCATION 1
+#define configSUPPORT_DYNAMIC_ALLOCATION 1
+#define tskIDLE_PRIORITY 0
+
+// Tasks never preempt each other, see runtime.c
+#define taskENTER_CRITICAL() do {} while (0)
+#define taskEXIT_CRITICAL() do {} while (0)
+#define portENTER_CRITICAL() do {} while (0)
+#define portEXIT_CRITICAL() do {} while (0)
+#define portYIELD_FROM_ISR(woken) (void)(woken)
+
+#define IRAM
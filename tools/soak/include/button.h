@@ -0,0 +1,38 @@
+#pragma once
+
+// Model of esp-button: the scenario presses buttons with
+// soak_button_press() and soak_button_chord(), which drive the GPIO level
+// and report the resulting event the way the library does.
+
+#include <stdint.h>
+
+typedef enum {
+    button_active_low = 0,
+    button_active_high = 1,
+} button_active_level_t;
+
+typedef enum {
+    button_event_single_press,
+    button_event_double_press,
+    button_event_tripple_press,
+    button_event_long_press,
+} button_event_t;
+
+typedef void (*button_callback_fn)(button_event_t event, void *context);
+
+typedef struct {
+    button_active_level_t active_level;
+    uint32_t long_press_time;
+    uint8_t max_repeat_presses;
+} button_config_t;
+
+#define BUTTON_CONFIG(level, ...)                                             \
+    (button_config_t) {                                                       \
+        .active_level = (level),                                              \
+        .long_press_time = 1000,                                              \
+        .max_repeat_presses = 1,                                              \
+        __VA_ARGS__                                                           \
+    }
+
+int button_create(uint8_t gpio_num, button_config_t config, button_callback_fn callback, void *context);
+void button_destroy(uint8_t gpio_num);
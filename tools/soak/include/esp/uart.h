@@ -0,0 +1,5 @@
+#pragma once
+
+#include <stdint.h>
+
+static inline void uart_set_baud(int uart, int baud) {}
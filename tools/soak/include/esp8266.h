@@ -0,0 +1,18 @@
+#pragma once
+
+// GPIO levels are kept by the soak runner; inputs read back what the
+// scenario set, see soak_gpio_set()
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    GPIO_INPUT,
+    GPIO_OUTPUT,
+    GPIO_OUT_OPEN_DRAIN,
+} gpio_direction_t;
+
+void gpio_enable(uint8_t gpio, gpio_direction_t direction);
+void gpio_set_pullup(uint8_t gpio, bool enabled, bool enabled_during_sleep);
+void gpio_write(uint8_t gpio, bool value);
+bool gpio_read(uint8_t gpio);
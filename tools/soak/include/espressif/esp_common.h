@@ -0,0 +1,4 @@
+#pragma once
+
+#include "esp_system.h"
+#include "esp_wifi.h"
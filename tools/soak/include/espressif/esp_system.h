@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+// Ends the current boot of the soak runner, which starts the next one
+void sdk_system_restart();
+
+// Virtual microseconds since boot, wrapping like the hardware counter
+uint32_t sdk_system_get_time();
+
+uint32_t sdk_system_get_free_heap_size();
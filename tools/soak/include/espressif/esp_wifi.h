@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define STATION_IF 0
+#define SOFTAP_IF 1
+
+bool sdk_wifi_get_macaddr(uint8_t if_index, uint8_t *macaddr);
@@ -0,0 +1,10 @@
+#pragma once
+
+// Flash does not survive a soak boot, a reset is just a restart
+
+#include <espressif/esp_system.h>
+
+typedef void (*factory_reset_fn)();
+
+static inline void factory_reset() { sdk_system_restart(); }
+static inline int factory_reset_init(factory_reset_fn reset) { return 0; }
@@ -0,0 +1,59 @@
+#pragma once
+
+// The characteristics and services the soaked examples use. Add the
+// declarations of another example from esp-homekit before soaking it.
+
+#include "types.h"
+
+#define HOMEKIT_SERVICE_ACCESSORY_INFORMATION "3E"
+#define HOMEKIT_SERVICE_SWITCH "49"
+#define HOMEKIT_SERVICE_LIGHTBULB "43"
+#define HOMEKIT_SERVICE_STATELESS_PROGRAMMABLE_SWITCH "89"
+
+#define HOMEKIT_DECLARE_INFO_STRING(_type, _description, _value, ...)         \
+    .type = _type,                                                            \
+    .description = _description,                                              \
+    .format = homekit_format_string,                                          \
+    .permissions = homekit_permissions_paired_read,                           \
+    .value = HOMEKIT_STRING_(_value),                                         \
+    ##__VA_ARGS__
+
+#define HOMEKIT_DECLARE_CHARACTERISTIC_NAME(_value, ...) \
+    HOMEKIT_DECLARE_INFO_STRING("23", "Name", _value, ##__VA_ARGS__)
+#define HOMEKIT_DECLARE_CHARACTERISTIC_MANUFACTURER(_value, ...) \
+    HOMEKIT_DECLARE_INFO_STRING("20", "Manufacturer", _value, ##__VA_ARGS__)
+#define HOMEKIT_DECLARE_CHARACTERISTIC_SERIAL_NUMBER(_value, ...) \
+    HOMEKIT_DECLARE_INFO_STRING("30", "Serial Number", _value, ##__VA_ARGS__)
+#define HOMEKIT_DECLARE_CHARACTERISTIC_MODEL(_value, ...) \
+    HOMEKIT_DECLARE_INFO_STRING("21", "Model", _value, ##__VA_ARGS__)
+#define HOMEKIT_DECLARE_CHARACTERISTIC_FIRMWARE_REVISION(_value, ...) \
+    HOMEKIT_DECLARE_INFO_STRING("52", "Firmware Revision", _value, ##__VA_ARGS__)
+
+#define HOMEKIT_DECLARE_CHARACTERISTIC_IDENTIFY(_value, ...)                  \
+    .type = "14",                                                             \
+    .description = "Identify",                                                \
+    .format = homekit_format_bool,                                            \
+    .permissions = homekit_permissions_paired_write,                          \
+    .setter = _value,                                                         \
+    ##__VA_ARGS__
+
+#define HOMEKIT_DECLARE_CHARACTERISTIC_ON(_value, ...)                        \
+    .type = "25",                                                             \
+    .description = "On",                                                      \
+    .format = homekit_format_bool,                                            \
+    .permissions = homekit_permissions_paired_read                            \
+                 | homekit_permissions_paired_write                           \
+                 | homekit_permissions_notify,                                \
+    .value = HOMEKIT_BOOL_(_value),                                           \
+    ##__VA_ARGS__
+
+#define HOMEKIT_DECLARE_CHARACTERISTIC_PROGRAMMABLE_SWITCH_EVENT(_value, ...) \
+    .type = "73",                                                             \
+    .description = "Programmable Switch Event",                               \
+    .format = homekit_format_uint8,                                           \
+    .permissions = homekit_permissions_paired_read                            \
+                 | homekit_permissions_notify,                                \
+    .min_value = (float[]) {0},                                               \
+    .max_value = (float[]) {2},                                               \
+    .value = HOMEKIT_UINT8_(_value),                                          \
+    ##__VA_ARGS__
@@ -0,0 +1,32 @@
+#pragma once
+
+// Model of the esp-homekit server: homekit_server_init() allocates the
+// server and starts its task like the library, and that task applies the
+// writes the scenario injects with soak_homekit_write().
+
+#include "types.h"
+
+typedef enum {
+    HOMEKIT_EVENT_SERVER_INITIALIZED,
+    HOMEKIT_EVENT_CLIENT_CONNECTED,
+    HOMEKIT_EVENT_CLIENT_VERIFIED,
+    HOMEKIT_EVENT_CLIENT_DISCONNECTED,
+    HOMEKIT_EVENT_PAIRING_ADDED,
+    HOMEKIT_EVENT_PAIRING_REMOVED,
+} homekit_event_t;
+
+typedef struct {
+    homekit_accessory_t **accessories;
+    homekit_accessory_category_t category;
+    int config_number;
+
+    char *password;
+    char *setupId;
+
+    void (*on_event)(homekit_event_t event);
+} homekit_server_config_t;
+
+void homekit_server_init(homekit_server_config_t *config);
+void homekit_server_reset();
+
+void homekit_characteristic_notify(homekit_characteristic_t *ch, const homekit_value_t value);
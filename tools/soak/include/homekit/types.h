@@ -0,0 +1,134 @@
+#pragma once
+
+// Model of the esp-homekit accessory types. The NEW_HOMEKIT_* constructors
+// allocate like the library does, so their heap use is attributed to the
+// example code that calls them.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    homekit_format_bool,
+    homekit_format_uint8,
+    homekit_format_uint16,
+    homekit_format_uint32,
+    homekit_format_uint64,
+    homekit_format_int,
+    homekit_format_float,
+    homekit_format_string,
+    homekit_format_tlv,
+    homekit_format_data,
+} homekit_format_t;
+
+typedef enum {
+    homekit_permissions_paired_read = 1,
+    homekit_permissions_paired_write = 2,
+    homekit_permissions_notify = 4,
+} homekit_permissions_t;
+
+typedef struct {
+    bool is_null;
+    homekit_format_t format;
+    union {
+        bool bool_value;
+        int int_value;
+        float float_value;
+        char *string_value;
+    };
+} homekit_value_t;
+
+#define HOMEKIT_NULL_(...) { .is_null = true, ##__VA_ARGS__ }
+#define HOMEKIT_BOOL_(value, ...) { .format = homekit_format_bool, .bool_value = (value), ##__VA_ARGS__ }
+#define HOMEKIT_UINT8_(value, ...) { .format = homekit_format_uint8, .int_value = (value), ##__VA_ARGS__ }
+#define HOMEKIT_INT_(value, ...) { .format = homekit_format_int, .int_value = (value), ##__VA_ARGS__ }
+#define HOMEKIT_FLOAT_(value, ...) { .format = homekit_format_float, .float_value = (value), ##__VA_ARGS__ }
+#define HOMEKIT_STRING_(value, ...) { .format = homekit_format_string, .string_value = (value), ##__VA_ARGS__ }
+
+#define HOMEKIT_NULL(...) (homekit_value_t) HOMEKIT_NULL_(__VA_ARGS__)
+#define HOMEKIT_BOOL(value, ...) (homekit_value_t) HOMEKIT_BOOL_(value, ##__VA_ARGS__)
+#define HOMEKIT_UINT8(value, ...) (homekit_value_t) HOMEKIT_UINT8_(value, ##__VA_ARGS__)
+#define HOMEKIT_INT(value, ...) (homekit_value_t) HOMEKIT_INT_(value, ##__VA_ARGS__)
+#define HOMEKIT_FLOAT(value, ...) (homekit_value_t) HOMEKIT_FLOAT_(value, ##__VA_ARGS__)
+#define HOMEKIT_STRING(value, ...) (homekit_value_t) HOMEKIT_STRING_(value, ##__VA_ARGS__)
+
+typedef struct _homekit_accessory homekit_accessory_t;
+typedef struct _homekit_service homekit_service_t;
+typedef struct _homekit_characteristic homekit_characteristic_t;
+
+typedef void (*homekit_characteristic_change_callback_fn)(homekit_characteristic_t *ch,
+                                                          homekit_value_t value, void *context);
+
+typedef struct _homekit_characteristic_change_callback {
+    homekit_characteristic_change_callback_fn function;
+    void *context;
+    struct _homekit_characteristic_change_callback *next;
+} homekit_characteristic_change_callback_t;
+
+#define HOMEKIT_CHARACTERISTIC_CALLBACK(f, ...) \
+    &(homekit_characteristic_change_callback_t) { .function = f, ##__VA_ARGS__ }
+
+struct _homekit_characteristic {
+    homekit_service_t *service;
+
+    unsigned int id;
+    const char *type;
+    const char *description;
+    homekit_format_t format;
+    unsigned int permissions;
+    float *min_value;
+    float *max_value;
+
+    homekit_value_t value;
+
+    homekit_value_t (*getter)();
+    void (*setter)(const homekit_value_t);
+    homekit_value_t (*getter_ex)(const homekit_characteristic_t *ch);
+    void (*setter_ex)(homekit_characteristic_t *ch, const homekit_value_t value);
+
+    homekit_characteristic_change_callback_t *callback;
+};
+
+struct _homekit_service {
+    homekit_accessory_t *accessory;
+
+    unsigned int id;
+    const char *type;
+    bool hidden;
+    bool primary;
+
+    homekit_characteristic_t **characteristics;
+};
+
+typedef enum {
+    homekit_accessory_category_other = 1,
+    homekit_accessory_category_bridge = 2,
+    homekit_accessory_category_lightbulb = 5,
+    homekit_accessory_category_switch = 8,
+    homekit_accessory_category_programmable_switch = 15,
+    homekit_accessory_category_sensor = 10,
+} homekit_accessory_category_t;
+
+struct _homekit_accessory {
+    unsigned int id;
+    homekit_accessory_category_t category;
+    int config_number;
+
+    homekit_service_t **services;
+};
+
+homekit_characteristic_t *homekit_characteristic_clone(homekit_characteristic_t *ch);
+homekit_service_t *homekit_service_clone(homekit_service_t *service);
+homekit_accessory_t *homekit_accessory_clone(homekit_accessory_t *accessory);
+
+#define HOMEKIT_CHARACTERISTIC_(name, ...) { HOMEKIT_DECLARE_CHARACTERISTIC_##name(__VA_ARGS__) }
+#define HOMEKIT_CHARACTERISTIC(name, ...) &(homekit_characteristic_t) HOMEKIT_CHARACTERISTIC_(name, ##__VA_ARGS__)
+#define NEW_HOMEKIT_CHARACTERISTIC(name, ...) \
+    homekit_characteristic_clone(HOMEKIT_CHARACTERISTIC(name, ##__VA_ARGS__))
+
+#define HOMEKIT_SERVICE_(_type, ...) { .type = HOMEKIT_SERVICE_##_type, ##__VA_ARGS__ }
+#define HOMEKIT_SERVICE(_type, ...) &(homekit_service_t) HOMEKIT_SERVICE_(_type, ##__VA_ARGS__)
+#define NEW_HOMEKIT_SERVICE(_type, ...) homekit_service_clone(HOMEKIT_SERVICE(_type, ##__VA_ARGS__))
+
+#define HOMEKIT_ACCESSORY_(...) { .config_number = 1, ##__VA_ARGS__ }
+#define HOMEKIT_ACCESSORY(...) &(homekit_accessory_t) HOMEKIT_ACCESSORY_(__VA_ARGS__)
+#define NEW_HOMEKIT_ACCESSORY(...) homekit_accessory_clone(HOMEKIT_ACCESSORY(__VA_ARGS__))
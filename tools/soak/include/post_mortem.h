@@ -0,0 +1,14 @@
+#pragma once
+
+// RTC memory does not survive a soak boot, the record is not kept
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define POST_MORTEM_EVENT_BOOT 1
+#define POST_MORTEM_EVENT_USER 0x100
+
+static inline bool post_mortem_init() { return false; }
+static inline void post_mortem_trace(uint16_t event, uint16_t arg) {}
+static inline void post_mortem_print() {}
+static inline void post_mortem_serve(uint16_t port) {}
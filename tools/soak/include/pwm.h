@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+static inline void pwm_init(uint8_t npins, const uint8_t *pins, bool reverse) {}
+static inline void pwm_set_freq(uint16_t freq) {}
+static inline void pwm_set_duty(uint16_t duty) {}
+static inline void pwm_start() {}
+static inline void pwm_stop() {}
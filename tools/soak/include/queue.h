@@ -0,0 +1,22 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size,
+                                 uint8_t *storage, StaticQueue_t *buffer);
+void vQueueDelete(QueueHandle_t queue);
+
+BaseType_t soak_queue_send(QueueHandle_t queue, const void *item, TickType_t timeout, bool front);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout);
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t timeout);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+BaseType_t xQueueReset(QueueHandle_t queue);
+
+#define xQueueSend(q, item, timeout) soak_queue_send((q), (item), (timeout), false)
+#define xQueueSendToBack(q, item, timeout) soak_queue_send((q), (item), (timeout), false)
+#define xQueueSendToFront(q, item, timeout) soak_queue_send((q), (item), (timeout), true)
+#define xQueueSendFromISR(q, item, woken) soak_queue_send((q), (item), 0, false)
+#define xQueueSendToBackFromISR(q, item, woken) soak_queue_send((q), (item), 0, false)
+#define xQueueSendToFrontFromISR(q, item, woken) soak_queue_send((q), (item), 0, true)
+#define xQueueReceiveFromISR(q, item, woken) xQueueReceive((q), (item), 0)
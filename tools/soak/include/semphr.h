@@ -0,0 +1,15 @@
+#pragma once
+
+#include "queue.h"
+
+// Semaphores are queues of empty items, as in FreeRTOS
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer);
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer);
+
+#define vSemaphoreDelete(s) vQueueDelete(s)
+#define xSemaphoreTake(s, timeout) xQueueReceive((s), NULL, (timeout))
+#define xSemaphoreGive(s) soak_queue_send((s), NULL, 0, false)
+#define xSemaphoreTakeFromISR(s, woken) xQueueReceive((s), NULL, 0)
+#define xSemaphoreGiveFromISR(s, woken) soak_queue_send((s), NULL, 0, false)
@@ -0,0 +1,8 @@
+#pragma once
+
+// Flash of the device model, see devices.c
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool spiflash_read(uint32_t address, uint8_t *buffer, uint32_t size);
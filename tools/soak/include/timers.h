@@ -0,0 +1,19 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *id, TimerCallbackFunction_t callback);
+TimerHandle_t xTimerCreateStatic(const char *name, TickType_t period, UBaseType_t auto_reload,
+                                 void *id, TimerCallbackFunction_t callback, StaticTimer_t *buffer);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t timeout);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t timeout);
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t timeout);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t timeout);
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t timeout);
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer);
+void *pvTimerGetTimerID(TimerHandle_t timer);
+
+#define xTimerStartFromISR(t, woken) xTimerStart((t), 0)
+#define xTimerStopFromISR(t, woken) xTimerStop((t), 0)
+#define xTimerResetFromISR(t, woken) xTimerReset((t), 0)
@@ -0,0 +1,18 @@
+#pragma once
+
+// Model of esp-wifi-config: the station connects a few seconds after
+// init and the scenario drops and restores the connection with
+// soak_wifi_drop(). Every reconnect reports WIFI_CONFIG_CONNECTED (and
+// calls on_wifi_ready) again, as the library does.
+
+typedef enum {
+    WIFI_CONFIG_CONNECTED = 1,
+    WIFI_CONFIG_DISCONNECTED = 2,
+    WIFI_CONFIG_AP_START = 3,
+    WIFI_CONFIG_AP_STOP = 4,
+} wifi_config_event_t;
+
+void wifi_config_init(const char *ssid_prefix, const char *password, void (*on_wifi_ready)());
+void wifi_config_init2(const char *ssid_prefix, const char *password,
+                       void (*on_event)(wifi_config_event_t));
+void wifi_config_reset();
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+#include <esp8266.h>
+
+static inline void ws2812_set(uint8_t gpio, uint32_t rgb) {}
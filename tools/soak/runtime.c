@@ -0,0 +1,974 @@
+// Device model of the soak runner: a FreeRTOS subset on a virtual clock.
+//
+// Tasks are ucontext coroutines and run one at a time, highest priority
+// first. A task runs until it blocks (delay, queue, semaphore,
+// notification) or wakes a task of higher priority; there is no
+// preemption otherwise. When no task is ready, the clock jumps to the next
+// thing due: a delay ending, a FreeRTOS timer, or an input the scenario
+// scheduled. Timer callbacks and scenario inputs run in the context of the
+// timer task, like FreeRTOS timer callbacks, and must not block.
+//
+// Every boot runs in a forked child, so a firmware restart starts over
+// from pristine globals while the parent keeps count of the simulated
+// days.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <fcntl.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <semphr.h>
+#include <timers.h>
+#include <espressif/esp_common.h>
+
+#include "runtime.h"
+
+// Host stack of every task, whatever its depth on the device
+#define HOST_STACK_SIZE (256 * 1024)
+
+#define HEAP_SAMPLE_PERIOD (10 * SOAK_MINUTE)
+
+typedef enum {
+    TASK_READY,
+    TASK_BLOCKED,
+    TASK_DELETED,
+} task_state_t;
+
+struct soak_task {
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t priority;
+    task_state_t state;
+    uint64_t last_run;
+
+    TaskFunction_t function;
+    void *arg;
+    ucontext_t context;
+    void *host_stack;
+
+    // TCB and stack as xTaskCreate takes them from the device heap,
+    // NULL for static tasks
+    void *tcb;
+    StackType_t *stack;
+
+    const void *waiting_on;
+    uint64_t wake_time;         // UINT64_MAX if not waiting for a time
+    bool timed_out;
+    uint32_t notify;
+
+    struct soak_task *next;
+};
+
+struct soak_queue {
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *storage;
+    bool is_static;
+};
+
+struct soak_timer {
+    const char *name;
+    TickType_t period;
+    bool auto_reload;
+    void *id;
+    TimerCallbackFunction_t callback;
+    bool is_static;
+
+    bool active;
+    uint64_t expiry;
+
+    struct soak_timer *next;
+};
+
+typedef struct _soak_event {
+    uint64_t time;
+    uint64_t sequence;
+    void (*function)(void *arg);
+    void *arg;
+    struct _soak_event *next;
+} soak_event_t;
+
+
+extern void user_init();
+
+static uint64_t now = 0;                // ms since boot
+static uint64_t run_sequence = 0;
+static uint64_t event_sequence = 0;
+static bool restart_requested = false;
+static bool out_of_heap = false;
+
+static struct soak_task *tasks = NULL;
+static struct soak_task *current = NULL;
+static struct soak_task timer_task = { .name = "Tmr Svc", .priority = configMAX_PRIORITIES - 1 };
+static ucontext_t scheduler_context;
+
+static struct soak_timer *timers = NULL;
+static soak_event_t *events = NULL;
+
+static uint64_t random_state;
+
+static struct {
+    uint64_t days_ms;
+    uint64_t seed;
+    uint64_t warmup_ms;
+    uint32_t threshold;
+    uint32_t heap_limit;
+    bool verbose;
+} options = {
+    .days_ms = 7 * SOAK_DAY,
+    .warmup_ms = SOAK_HOUR,
+    .threshold = 64,
+    // Host pointers are twice the size of the device's, so this is about
+    // twice the heap an ESP8266 has free after boot
+    .heap_limit = 128 * 1024,
+};
+
+
+void soak_fatal(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "soak: fatal at %llu ms in task '%s': ",
+            (unsigned long long)now, current ? current->name : "scheduler");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    _exit(SOAK_FATAL);
+}
+
+
+uint32_t soak_random(uint32_t n) {
+    // xorshift64*
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return n ? (uint32_t)((random_state * 0x2545F4914F6CDD1DULL) >> 32) % n : 0;
+}
+
+
+uint64_t soak_now() {
+    return now;
+}
+
+
+void soak_after(uint32_t delay_ms, void (*function)(void *arg), void *arg) {
+    soak_event_t *event = soak_alloc_untracked(sizeof(soak_event_t));
+    event->time = now + delay_ms;
+    event->sequence = event_sequence++;
+    event->function = function;
+    event->arg = arg;
+
+    soak_event_t **e = &events;
+    while (*e && (*e)->time <= event->time)
+        e = &(*e)->next;
+    event->next = *e;
+    *e = event;
+}
+
+
+/*------------------------------------------------------------------------------
+ * Scheduler
+ *----------------------------------------------------------------------------*/
+
+static uint64_t ticks_to_ms(TickType_t ticks) {
+    return (uint64_t)ticks * portTICK_PERIOD_MS;
+}
+
+
+static uint64_t deadline(TickType_t timeout) {
+    if (timeout == portMAX_DELAY)
+        return UINT64_MAX;
+    // Delays count from the current tick, as in FreeRTOS
+    return (now / portTICK_PERIOD_MS) * portTICK_PERIOD_MS + ticks_to_ms(timeout);
+}
+
+
+static bool in_task() {
+    return current && current != &timer_task;
+}
+
+
+static void switch_to_scheduler() {
+    struct soak_task *task = current;
+    swapcontext(&task->context, &scheduler_context);
+}
+
+
+// Blocks the current task until object is signalled or the deadline
+// passes. Returns false on timeout.
+static bool block_on(const void *object, uint64_t until) {
+    if (until <= now)
+        return false;
+    if (!in_task())
+        soak_fatal("blocking call outside a task");
+
+    current->state = TASK_BLOCKED;
+    current->waiting_on = object;
+    current->wake_time = until;
+    current->timed_out = false;
+    switch_to_scheduler();
+
+    return !current->timed_out;
+}
+
+
+static struct soak_task *highest_ready() {
+    struct soak_task *best = NULL;
+    for (struct soak_task *t = tasks; t; t = t->next) {
+        if (t->state != TASK_READY)
+            continue;
+        if (!best || t->priority > best->priority ||
+                (t->priority == best->priority && t->last_run < best->last_run))
+            best = t;
+    }
+    return best;
+}
+
+
+// Lets a task of higher priority than the current one run right away
+static void preempt() {
+    if (in_task()) {
+        struct soak_task *next = highest_ready();
+        if (next && next->priority > current->priority)
+            switch_to_scheduler();
+    }
+}
+
+
+// Readies the tasks waiting on object
+static void wake_waiters(const void *object) {
+    for (struct soak_task *t = tasks; t; t = t->next) {
+        if (t->state == TASK_BLOCKED && t->waiting_on == object) {
+            t->state = TASK_READY;
+            t->waiting_on = NULL;
+            t->wake_time = UINT64_MAX;
+        }
+    }
+    preempt();
+}
+
+
+static void task_entry() {
+    current->function(current->arg);
+    soak_fatal("task function returned");
+}
+
+
+static struct soak_task *task_create(TaskFunction_t function, const char *name, void *arg,
+                                     UBaseType_t priority) {
+    struct soak_task *task = soak_alloc_untracked(sizeof(struct soak_task));
+    strncpy(task->name, name, sizeof(task->name) - 1);
+    task->priority = priority < configMAX_PRIORITIES ? priority : configMAX_PRIORITIES - 1;
+    task->state = TASK_READY;
+    task->last_run = run_sequence;
+    task->function = function;
+    task->arg = arg;
+    task->wake_time = UINT64_MAX;
+
+    task->host_stack = mmap(NULL, HOST_STACK_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (task->host_stack == MAP_FAILED)
+        soak_fatal("out of host memory for task stacks");
+
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = task->host_stack;
+    task->context.uc_stack.ss_size = HOST_STACK_SIZE;
+    task->context.uc_link = NULL;
+    makecontext(&task->context, task_entry, 0);
+
+    struct soak_task **t = &tasks;
+    while (*t)
+        t = &(*t)->next;
+    *t = task;
+
+    return task;
+}
+
+
+static void task_free(struct soak_task *task) {
+    struct soak_task **t = &tasks;
+    while (*t && *t != task)
+        t = &(*t)->next;
+    if (*t)
+        *t = task->next;
+
+    // The idle task frees these on the device
+    free(task->stack);
+    free(task->tcb);
+    munmap(task->host_stack, HOST_STACK_SIZE);
+    soak_free_untracked(task);
+}
+
+
+static void timer_fire(struct soak_timer *timer) {
+    if (timer->auto_reload)
+        timer->expiry += ticks_to_ms(timer->period ? timer->period : 1);
+    else
+        timer->active = false;
+    timer->callback(timer);
+}
+
+
+static void heap_sample(void *arg) {
+    if (soak_heap_sample(options.heap_limit))
+        soak_after(HEAP_SAMPLE_PERIOD, heap_sample, NULL);
+    else
+        out_of_heap = true;
+}
+
+
+static void heap_end_warmup(void *arg) {
+    soak_heap_end_warmup();
+}
+
+
+// Runs the boot until the firmware restarts or end is reached
+static void run(uint64_t end) {
+    while (!restart_requested && !out_of_heap) {
+        for (struct soak_task *t = tasks, *next; t; t = next) {
+            next = t->next;
+            if (t->state == TASK_DELETED)
+                task_free(t);
+        }
+
+        struct soak_task *task = highest_ready();
+        if (task) {
+            current = task;
+            task->last_run = ++run_sequence;
+            swapcontext(&scheduler_context, &task->context);
+            current = NULL;
+            continue;
+        }
+
+        // Nothing to run: move the clock to whatever is due next
+        uint64_t next = end;
+        struct soak_task *waking = NULL;
+        struct soak_timer *expiring = NULL;
+
+        for (struct soak_task *t = tasks; t; t = t->next) {
+            if (t->state == TASK_BLOCKED && t->wake_time < next) {
+                next = t->wake_time;
+                waking = t;
+            }
+        }
+        for (struct soak_timer *t = timers; t; t = t->next) {
+            if (t->active && t->expiry < next) {
+                next = t->expiry;
+                waking = NULL;
+                expiring = t;
+            }
+        }
+        if (events && events->time < next) {
+            next = events->time;
+            waking = NULL;
+            expiring = NULL;
+        }
+
+        if (next >= end) {
+            now = end;
+            return;
+        }
+        if (next > now)
+            now = next;
+
+        current = &timer_task;
+        if (waking) {
+            waking->state = TASK_READY;
+            waking->waiting_on = NULL;
+            waking->wake_time = UINT64_MAX;
+            waking->timed_out = true;
+        } else if (expiring) {
+            timer_fire(expiring);
+        } else {
+            soak_event_t *event = events;
+            events = event->next;
+            event->function(event->arg);
+            soak_free_untracked(event);
+        }
+        current = NULL;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ * Tasks
+ *----------------------------------------------------------------------------*/
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint16_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *handle) {
+    // Allocated in the caller's name, the way pvPortMalloc would see it
+    void *tcb = malloc(sizeof(StaticTask_t));
+    StackType_t *stack = malloc(stack_depth * sizeof(StackType_t));
+    if (!tcb || !stack) {
+        free(tcb);
+        free(stack);
+        return pdFAIL;
+    }
+
+    struct soak_task *task = task_create(function, name, arg, priority);
+    task->tcb = tcb;
+    task->stack = stack;
+    if (handle)
+        *handle = task;
+
+    preempt();
+    return pdPASS;
+}
+
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                               void *arg, UBaseType_t priority,
+                               StackType_t *stack, StaticTask_t *buffer) {
+    struct soak_task *task = task_create(function, name, arg, priority);
+    preempt();
+    return task;
+}
+
+
+void vTaskDelete(TaskHandle_t task) {
+    if (!task)
+        task = current;
+    if (task == &timer_task || !task)
+        soak_fatal("vTaskDelete outside a task");
+    if (task->state == TASK_DELETED)
+        soak_fatal("task '%s' deleted twice", task->name);
+
+    task->state = TASK_DELETED;
+    if (task == current)
+        switch_to_scheduler();
+}
+
+
+void vTaskDelay(TickType_t ticks) {
+    if (!ticks) {
+        taskYIELD();
+        return;
+    }
+    block_on(NULL, deadline(ticks));
+}
+
+
+void vTaskDelayUntil(TickType_t *previous_wake_time, TickType_t period) {
+    *previous_wake_time += period;
+    uint64_t until = ticks_to_ms(*previous_wake_time);
+    // The tick count wraps on the device, here it starts at zero each boot
+    block_on(NULL, until);
+}
+
+
+void taskYIELD() {
+    if (!in_task())
+        return;
+    current->last_run = ++run_sequence;
+    switch_to_scheduler();
+}
+
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)(now / portTICK_PERIOD_MS);
+}
+
+
+TickType_t xTaskGetTickCountFromISR() {
+    return xTaskGetTickCount();
+}
+
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return current;
+}
+
+
+char *pcTaskGetName(TaskHandle_t task) {
+    task = task ? task : current;
+    return task ? task->name : "";
+}
+
+
+UBaseType_t uxTaskGetNumberOfTasks() {
+    UBaseType_t count = 0;
+    for (struct soak_task *t = tasks; t; t = t->next)
+        count++;
+    return count;
+}
+
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    // Host stacks say nothing about the device's
+    return 0;
+}
+
+
+void vTaskSuspendAll() {
+}
+
+
+BaseType_t xTaskResumeAll() {
+    return pdFALSE;
+}
+
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout) {
+    if (!in_task())
+        soak_fatal("ulTaskNotifyTake outside a task");
+
+    uint64_t until = deadline(timeout);
+    while (!current->notify) {
+        if (!block_on(&current->notify, until))
+            return 0;
+    }
+
+    uint32_t value = current->notify;
+    current->notify = clear_on_exit ? 0 : value - 1;
+    return value;
+}
+
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    task->notify++;
+    wake_waiters(&task->notify);
+    return pdPASS;
+}
+
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+    xTaskNotifyGive(task);
+}
+
+
+/*------------------------------------------------------------------------------
+ * Queues and semaphores
+ *----------------------------------------------------------------------------*/
+
+static struct soak_queue *queue_create(UBaseType_t length, UBaseType_t item_size,
+                                       uint8_t *storage, bool is_static) {
+    struct soak_queue *queue;
+    if (is_static) {
+        queue = soak_alloc_untracked(sizeof(struct soak_queue));
+    } else {
+        // One block for header and storage, as in FreeRTOS
+        queue = malloc(sizeof(struct soak_queue) + length * item_size);
+        if (!queue)
+            return NULL;
+        memset(queue, 0, sizeof(struct soak_queue));
+        storage = (uint8_t *)(queue + 1);
+    }
+
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->storage = storage;
+    queue->is_static = is_static;
+    return queue;
+}
+
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    return queue_create(length, item_size, NULL, false);
+}
+
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size,
+                                 uint8_t *storage, StaticQueue_t *buffer) {
+    return queue_create(length, item_size, storage, true);
+}
+
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (queue->is_static)
+        soak_free_untracked(queue);
+    else
+        free(queue);
+}
+
+
+BaseType_t soak_queue_send(QueueHandle_t queue, const void *item, TickType_t timeout, bool front) {
+    uint64_t until = deadline(timeout);
+    while (queue->count == queue->length) {
+        if (!block_on(queue, until))
+            return errQUEUE_FULL;
+    }
+
+    UBaseType_t slot;
+    if (front) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        slot = queue->head;
+    } else {
+        slot = (queue->head + queue->count) % queue->length;
+    }
+    if (queue->item_size)
+        memcpy(queue->storage + slot * queue->item_size, item, queue->item_size);
+    queue->count++;
+
+    wake_waiters(queue);
+    return pdPASS;
+}
+
+
+static BaseType_t queue_get(QueueHandle_t queue, void *item, TickType_t timeout, bool remove) {
+    uint64_t until = deadline(timeout);
+    while (!queue->count) {
+        if (!block_on(queue, until))
+            return errQUEUE_EMPTY;
+    }
+
+    if (queue->item_size && item)
+        memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+    if (remove) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        wake_waiters(queue);
+    }
+    return pdPASS;
+}
+
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout) {
+    return queue_get(queue, item, timeout, true);
+}
+
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t timeout) {
+    return queue_get(queue, item, timeout, false);
+}
+
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return queue->count;
+}
+
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    queue->count = 0;
+    queue->head = 0;
+    wake_waiters(queue);
+    return pdPASS;
+}
+
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return queue_create(1, 0, NULL, false);
+}
+
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer) {
+    return queue_create(1, 0, NULL, true);
+}
+
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    SemaphoreHandle_t mutex = queue_create(1, 0, NULL, false);
+    if (mutex)
+        mutex->count = 1;
+    return mutex;
+}
+
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) {
+    SemaphoreHandle_t mutex = queue_create(1, 0, NULL, true);
+    mutex->count = 1;
+    return mutex;
+}
+
+
+/*------------------------------------------------------------------------------
+ * Timers
+ *----------------------------------------------------------------------------*/
+
+static struct soak_timer *timer_new(const char *name, TickType_t period, UBaseType_t auto_reload,
+                                       void *id, TimerCallbackFunction_t callback, bool is_static) {
+    struct soak_timer *timer = is_static
+        ? soak_alloc_untracked(sizeof(struct soak_timer))
+        : malloc(sizeof(struct soak_timer));
+    if (!timer)
+        return NULL;
+
+    memset(timer, 0, sizeof(*timer));
+    timer->name = name;
+    timer->period = period;
+    timer->auto_reload = auto_reload;
+    timer->id = id;
+    timer->callback = callback;
+    timer->is_static = is_static;
+
+    timer->next = timers;
+    timers = timer;
+    return timer;
+}
+
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *id, TimerCallbackFunction_t callback) {
+    return timer_new(name, period, auto_reload, id, callback, false);
+}
+
+
+TimerHandle_t xTimerCreateStatic(const char *name, TickType_t period, UBaseType_t auto_reload,
+                                 void *id, TimerCallbackFunction_t callback, StaticTimer_t *buffer) {
+    return timer_new(name, period, auto_reload, id, callback, true);
+}
+
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t timeout) {
+    timer->active = true;
+    timer->expiry = now + ticks_to_ms(timer->period ? timer->period : 1);
+    return pdPASS;
+}
+
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t timeout) {
+    timer->active = false;
+    return pdPASS;
+}
+
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t timeout) {
+    return xTimerStart(timer, timeout);
+}
+
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t timeout) {
+    timer->period = period;
+    return xTimerStart(timer, timeout);
+}
+
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t timeout) {
+    struct soak_timer **t = &timers;
+    while (*t && *t != timer)
+        t = &(*t)->next;
+    if (*t)
+        *t = timer->next;
+
+    if (timer->is_static)
+        soak_free_untracked(timer);
+    else
+        free(timer);
+    return pdPASS;
+}
+
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer) {
+    return timer->active;
+}
+
+
+void *pvTimerGetTimerID(TimerHandle_t timer) {
+    return timer->id;
+}
+
+
+/*------------------------------------------------------------------------------
+ * SDK
+ *----------------------------------------------------------------------------*/
+
+void sdk_system_restart() {
+    restart_requested = true;
+    if (in_task()) {
+        current->state = TASK_BLOCKED;
+        switch_to_scheduler();
+    }
+}
+
+
+uint32_t sdk_system_get_time() {
+    return (uint32_t)(now * 1000);
+}
+
+
+uint32_t sdk_system_get_free_heap_size() {
+    return 0;
+}
+
+
+bool sdk_wifi_get_macaddr(uint8_t if_index, uint8_t *macaddr) {
+    static const uint8_t mac[6] = { 0x5c, 0xcf, 0x7f, 0x50, 0x4d, 0x01 };
+    memcpy(macaddr, mac, sizeof(mac));
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ * Boots
+ *----------------------------------------------------------------------------*/
+
+typedef struct {
+    uint64_t elapsed;
+    bool restarted;
+} boot_result_t;
+
+
+static void format_duration(char *buffer, size_t size, uint64_t ms) {
+    snprintf(buffer, size, "%llud %02llu:%02llu",
+             (unsigned long long)(ms / SOAK_DAY),
+             (unsigned long long)(ms % SOAK_DAY / SOAK_HOUR),
+             (unsigned long long)(ms % SOAK_HOUR / SOAK_MINUTE));
+}
+
+
+static soak_verdict_t run_boot(int boot, uint64_t length, boot_result_t *result) {
+    random_state = options.seed * 0x9E3779B97F4A7C15ULL + boot;
+    if (!random_state)
+        random_state = 1;
+
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    soak_heap_start();
+    soak_after(options.warmup_ms, heap_end_warmup, NULL);
+    soak_after(0, heap_sample, NULL);
+
+    current = &timer_task;
+    user_init();
+    soak_devices_start();
+    scenario_start();
+    current = NULL;
+
+    run(length);
+
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    double seconds = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+
+    char duration[32];
+    format_duration(duration, sizeof(duration), now);
+    fprintf(stderr, "boot %d: %s simulated in %.1f s (%.0fx real time), %s\n",
+            boot, duration, seconds, now / 1000.0 / (seconds > 0 ? seconds : 1e-9),
+            restart_requested ? "restarted by the firmware" :
+            out_of_heap ? "out of heap" : "end of soak");
+
+    result->elapsed = now;
+    result->restarted = restart_requested;
+    return soak_heap_report(options.warmup_ms, options.threshold);
+}
+
+
+static void usage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --days N          simulated days to run (default 7)\n"
+        "  --seed N          random seed (default: time based, printed)\n"
+        "  --warmup-hours N  heap use settles within this after boot (default 1)\n"
+        "  --threshold N     bytes of heap growth tolerated per boot (default 64)\n"
+        "  --heap-limit N    KB of live heap that ends a boot as leaking (default 128)\n"
+        "  --verbose         show the firmware's output\n",
+        program);
+}
+
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        { "days", required_argument, NULL, 'd' },
+        { "seed", required_argument, NULL, 's' },
+        { "warmup-hours", required_argument, NULL, 'w' },
+        { "threshold", required_argument, NULL, 't' },
+        { "heap-limit", required_argument, NULL, 'l' },
+        { "verbose", no_argument, NULL, 'v' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    options.seed = time(NULL);
+
+    int option;
+    while ((option = getopt_long(argc, argv, "d:s:w:t:l:vh", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'd': options.days_ms = strtod(optarg, NULL) * SOAK_DAY; break;
+            case 's': options.seed = strtoull(optarg, NULL, 0); break;
+            case 'w': options.warmup_ms = strtod(optarg, NULL) * SOAK_HOUR; break;
+            case 't': options.threshold = strtoul(optarg, NULL, 0); break;
+            case 'l': options.heap_limit = strtoul(optarg, NULL, 0) * 1024; break;
+            case 'v': options.verbose = true; break;
+            default:
+                usage(argv[0]);
+                return option == 'h' ? 0 : 2;
+        }
+    }
+
+    fprintf(stderr, "soak: seed %llu\n", (unsigned long long)options.seed);
+
+    uint64_t remaining = options.days_ms;
+    int boots = 0, leaks = 0, judged = 0, failures = 0;
+
+    while (remaining) {
+        boots++;
+
+        int channel[2];
+        if (pipe(channel)) {
+            perror("soak: pipe");
+            return SOAK_FATAL;
+        }
+
+        fflush(NULL);
+        pid_t child = fork();
+        if (child < 0) {
+            perror("soak: fork");
+            return SOAK_FATAL;
+        }
+
+        if (!child) {
+            close(channel[0]);
+            if (!options.verbose) {
+                int null = open("/dev/null", O_WRONLY);
+                dup2(null, STDOUT_FILENO);
+            }
+
+            boot_result_t result = { 0 };
+            soak_verdict_t verdict = run_boot(boots, remaining, &result);
+            fflush(NULL);
+            if (write(channel[1], &result, sizeof(result)) != sizeof(result))
+                _exit(SOAK_FATAL);
+            _exit(verdict);
+        }
+
+        close(channel[1]);
+        boot_result_t result = { 0 };
+        ssize_t n = read(channel[0], &result, sizeof(result));
+        close(channel[0]);
+
+        int status;
+        waitpid(child, &status, 0);
+        if (n != sizeof(result) || !WIFEXITED(status) || WEXITSTATUS(status) == SOAK_FATAL) {
+            if (WIFSIGNALED(status))
+                fprintf(stderr, "boot %d: crashed with signal %d\n", boots, WTERMSIG(status));
+            failures++;
+            break;
+        }
+
+        switch (WEXITSTATUS(status)) {
+            case SOAK_LEAK: leaks++; judged++; break;
+            case SOAK_OK: judged++; break;
+        }
+        // One leaking boot is enough, the next ones would say the same
+        if (leaks)
+            break;
+
+        if (!result.elapsed)
+            break;
+        remaining -= result.elapsed < remaining ? result.elapsed : remaining;
+    }
+
+    fprintf(stderr, "soak: %d boots, %d long enough to judge, %d leaking, %d failed\n",
+            boots, judged, leaks, failures);
+    if (failures)
+        return SOAK_FATAL;
+    if (leaks) {
+        fprintf(stderr, "soak: FAILED, rerun with --seed %llu to reproduce\n",
+                (unsigned long long)options.seed);
+        return SOAK_LEAK;
+    }
+    if (!judged) {
+        fprintf(stderr, "soak: no boot ran long enough to judge, raise --days\n");
+        return SOAK_TOO_SHORT;
+    }
+    return SOAK_OK;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// Shared by the parts of the soak runner, not meant for scenarios
+
+#include <stddef.h>
+#include "soak.h"
+
+#define SOAK_MINUTE (60 * 1000ULL)
+#define SOAK_HOUR (60 * SOAK_MINUTE)
+#define SOAK_DAY (24 * SOAK_HOUR)
+
+typedef enum {
+    SOAK_OK = 0,
+    SOAK_LEAK = 1,
+    SOAK_TOO_SHORT = 2,
+    SOAK_FATAL = 3,
+} soak_verdict_t;
+
+// runtime.c
+void soak_fatal(const char *format, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+// heap.c
+void *soak_alloc_untracked(size_t size);
+void soak_free_untracked(void *ptr);
+void soak_heap_start();
+void soak_heap_end_warmup();
+bool soak_heap_sample(uint32_t limit);
+soak_verdict_t soak_heap_report(uint64_t warmup_ms, uint32_t threshold);
+
+// devices.c
+void soak_devices_start();
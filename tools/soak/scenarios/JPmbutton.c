@@ -0,0 +1,55 @@
+// Soak scenario for examples/JPmbutton: someone using the four buttons and
+// the two chords, a controller asking the accessory to identify itself,
+// and WiFi dropping out now and then.
+
+#include "../soak.h"
+
+// Inputs come every MEAN_INTERVAL on average
+#define MEAN_INTERVAL (30 * 1000)
+
+// Buttons of the chords, in the order main.c creates the buttons
+static const uint8_t chords[][2] = { { 0, 1 }, { 2, 3 } };
+
+
+static void next_input(void *arg);
+
+static void schedule_next() {
+    soak_after(soak_random(2 * MEAN_INTERVAL), next_input, NULL);
+}
+
+
+static uint8_t random_button() {
+    return soak_button_gpio(soak_random(soak_button_count()));
+}
+
+
+static void next_input(void *arg) {
+    uint32_t dice = soak_random(100);
+
+    if (dice < 45) {
+        soak_button_press(random_button(), button_event_single_press);
+    } else if (dice < 55) {
+        soak_button_press(random_button(), button_event_long_press);
+    } else if (dice < 63) {
+        soak_button_press(random_button(), button_event_tripple_press);
+    } else if (dice < 64) {
+        // Two of these within ten seconds reset the device, keep them rare
+        soak_button_press(random_button(), button_event_double_press);
+    } else if (dice < 80) {
+        const uint8_t *chord = chords[soak_random(2)];
+        soak_button_chord(soak_button_gpio(chord[0]), soak_button_gpio(chord[1]),
+                          soak_random(5) == 0);
+    } else if (dice < 97) {
+        soak_homekit_write();
+    } else {
+        // From a blip to a router reboot
+        soak_wifi_drop(1000 + soak_random(10 * 60 * 1000));
+    }
+
+    schedule_next();
+}
+
+
+void scenario_start() {
+    schedule_next();
+}
@@ -0,0 +1,18 @@
+# examples/JPmbutton and the components it is built with
+
+SCENARIO_SRC = \
+	$(ROOT)/examples/JPmbutton/main.c \
+	$(ROOT)/examples/JPmbutton/utils.c \
+	$(ROOT)/components/common/gesture/gesture.c \
+	$(ROOT)/components/esp8266-open-rtos/chord/chord.c \
+	$(ROOT)/components/esp8266-open-rtos/event_loop/event_loop.c \
+	$(ROOT)/components/esp8266-open-rtos/config_store/config_store.c
+
+SCENARIO_CFLAGS = \
+	-I$(ROOT)/components/common/gesture \
+	-I$(ROOT)/components/esp8266-open-rtos/chord \
+	-I$(ROOT)/components/esp8266-open-rtos/event_loop \
+	-I$(ROOT)/components/esp8266-open-rtos/heap_profile \
+	-I$(ROOT)/components/esp8266-open-rtos/flash_scheduler \
+	-I$(ROOT)/components/esp8266-open-rtos/config_store \
+	-DDEV_SERIAL=1200345 -DDEV_PASS=111-11-111 -DDEV_SETUP=SOAK
@@ -0,0 +1,50 @@
+#pragma once
+
+// Host soak runner: runs an example's firmware on a virtual clock under
+// randomized input and watches its heap. See runtime.c for the model of
+// the device and heap.c for the leak check.
+//
+// Each example to soak has scenarios/<example>.mk, listing the sources to
+// build, and scenarios/<example>.c, which implements scenario_start().
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <button.h>
+
+// Implemented by the scenario: called once per boot, after user_init()
+void scenario_start();
+
+// Random number in [0, n), reproducible for a given --seed
+uint32_t soak_random(uint32_t n);
+
+// Milliseconds since this boot started
+uint64_t soak_now();
+
+// Runs function(arg) after delay_ms of virtual time, in the context of the
+// FreeRTOS timer task: it must not block.
+void soak_after(uint32_t delay_ms, void (*function)(void *arg), void *arg);
+
+// Drives an input pin, as a sensor or a switch would
+void soak_gpio_set(uint8_t gpio, bool level);
+
+// Buttons created by the firmware with button_create()
+int soak_button_count();
+uint8_t soak_button_gpio(int index);
+
+// Presses a button the way a user does to produce event: the pin goes
+// active and back (once per press of a repeated press, held for a long
+// press), then the button's callback gets event.
+void soak_button_press(uint8_t gpio, button_event_t event);
+
+// Presses two buttons together and releases them, then reports a single
+// (or long) press on both, as esp-button does for each of them.
+void soak_button_chord(uint8_t gpio1, uint8_t gpio2, bool long_press);
+
+// Writes a random valid value to a random writable characteristic of the
+// running HomeKit server, as a controller would. Returns false if there is
+// no server or nothing writable.
+bool soak_homekit_write();
+
+// Drops the WiFi connection for duration_ms
+void soak_wifi_drop(uint32_t duration_ms);
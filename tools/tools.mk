@@ -0,0 +1,128 @@
+# Host-side analysis targets shared by the esp-open-rtos examples.
+# Include from an example Makefile after $(SDK_PATH)/common.mk:
+#
+#   include $(abspath ../../tools/tools.mk)
+
+TOOLS_DIR := $(dir $(lastword $(MAKEFILE_LIST)))
+PROGRAM_MAP ?= $(BUILD_DIR)$(PROGRAM).map
+
+# Lists functions reachable from interrupt handlers that are not in IRAM,
+# plus the IRAM annotations to fix them. Extra entry points: ISR="a b"
+.PHONY: iram-audit
+iram-audit: $(PROGRAM_OUT)
+	$(TOOLS_DIR)iram_audit.py $(PROGRAM_OUT) --cross $(CROSS) --annotate . \
+		$(if $(wildcard $(PROGRAM_MAP)),--map $(PROGRAM_MAP)) \
+		$(foreach isr,$(ISR),--isr $(isr))
+
+# Flash/RAM budget per component, compared against the baseline committed
+# next to the example. Refresh the baseline with make size-baseline.
+SIZE_BASELINE ?= size-baseline.json
+SIZE_THRESHOLD ?= 2
+SIZE_REPORT_ARGS = $(PROGRAM_OUT) --map $(PROGRAM_MAP) --cross $(CROSS) \
+	--baseline $(SIZE_BASELINE) --flash-size $(FLASH_SIZE) \
+	$(if $(HOMEKIT_SPI_FLASH_BASE_ADDR),--flash-limit $(HOMEKIT_SPI_FLASH_BASE_ADDR)) \
+	$(if $(SIZE_OTA),--ota)
+
+.PHONY: size-report size-baseline
+size-report: $(PROGRAM_OUT)
+	$(TOOLS_DIR)size_report.py $(SIZE_REPORT_ARGS) --image $(FW_FILE) --threshold $(SIZE_THRESHOLD)
+
+size-baseline: $(PROGRAM_OUT)
+	$(TOOLS_DIR)size_report.py $(SIZE_REPORT_ARGS) --update-baseline
+
+# Sends the current build to a device running the delta_ota component, as a
+# delta against OTA_BASE (a copy of the image the device runs) when given.
+#   make delta-ota OTA_HOST=192.168.1.50 OTA_BASE=firmware/previous.bin
+DELTA_FILE = $(BUILD_DIR)$(PROGRAM).delta
+
+.PHONY: delta-ota
+delta-ota: $(FW_FILE)
+ifdef OTA_BASE
+	$(TOOLS_DIR)delta_ota.py diff $(OTA_BASE) $(FW_FILE) $(DELTA_FILE)
+	$(TOOLS_DIR)delta_ota.py send $(OTA_HOST) $(DELTA_FILE)
+else
+	$(TOOLS_DIR)delta_ota.py send $(OTA_HOST) $(FW_FILE)
+endif
+
+# Decodes and symbolizes the record left by the post_mortem component, from
+# a serial log or straight from the device's dump port.
+#   make post-mortem DUMP=serial.log
+#   make post-mortem DUMP_HOST=192.168.1.50
+DUMP_PORT ?= 3333
+POST_MORTEM_ARGS = --elf $(PROGRAM_OUT) --cross $(CROSS)
+
+.PHONY: post-mortem
+post-mortem: $(PROGRAM_OUT)
+ifdef DUMP_HOST
+	nc $(DUMP_HOST) $(DUMP_PORT) | $(TOOLS_DIR)post_mortem.py $(POST_MORTEM_ARGS)
+else
+	$(TOOLS_DIR)post_mortem.py $(POST_MORTEM_ARGS) $(DUMP)
+endif
+
+# Runs the example on the host soak runner for DAYS simulated days of
+# randomized input and fails if its heap keeps growing. Needs a scenario in
+# tools/soak/scenarios.
+#   make soak DAYS=14 SEED=1234
+.PHONY: soak
+soak:
+	$(MAKE) -C $(TOOLS_DIR)soak EXAMPLE=$(PROGRAM) $(if $(DAYS),DAYS=$(DAYS)) $(if $(SEED),SEED=$(SEED))
+
+# Symbolizes heap_profile reports (build with HEAP_PROFILE=1), from a serial
+# log or straight from the device's report port.
+#   make heap-profile DUMP=serial.log
+#   make heap-profile DUMP_HOST=192.168.1.50
+HEAP_PROFILE_PORT ?= 3335
+
+.PHONY: heap-profile
+heap-profile: $(PROGRAM_OUT)
+ifdef DUMP_HOST
+	nc $(DUMP_HOST) $(HEAP_PROFILE_PORT) | $(TOOLS_DIR)heap_profile.py --elf $(PROGRAM_OUT) --cross $(CROSS)
+else
+	$(TOOLS_DIR)heap_profile.py --elf $(PROGRAM_OUT) --cross $(CROSS) $(DUMP)
+endif
+
+# Writes keys to the config_store region of the device on ESPPORT: pairing
+# identity, pins and such, read at boot instead of being built in. Replaces
+# all keys the region held.
+#   make config-store CONFIG="serial=1200345 password=123-45-678 setup_id=J81Q"
+#   make config-store CONFIG_FILE=device.conf
+CONFIG_STORE_IMAGE = $(BUILD_DIR)config_store.bin
+
+.PHONY: config-store
+config-store:
+	@mkdir -p $(BUILD_DIR)
+	$(TOOLS_DIR)config_store.py image -o $(CONFIG_STORE_IMAGE) $(CONFIG) \
+		$(if $(CONFIG_FILE),--file $(CONFIG_FILE)) --sectors $(or $(CONFIG_STORE_SECTORS),4)
+	$(ESPTOOL) -p $(ESPPORT) --baud $(ESPBAUD) write_flash $(or $(CONFIG_STORE_BASE_ADDR),0xF8000) $(CONFIG_STORE_IMAGE)
+
+# Checks and benchmarks the local_control endpoint of a light built with
+# LOCAL_CONTROL_KEY; HAP_CMD, a command doing a HAP write through a paired
+# controller, is timed next to it.
+#   make local-control LOCAL_CONTROL_HOST=192.168.1.50 LOCAL_CONTROL_KEY=...
+#   make local-control LOCAL_CONTROL_HOST=192.168.1.50 LOCAL_CONTROL_KEY=... HAP_CMD='...'
+LOCAL_CONTROL_CLIENT = $(TOOLS_DIR)local_control.py --host $(LOCAL_CONTROL_HOST) \
+	--port $(or $(LOCAL_CONTROL_PORT),4210) --key $(LOCAL_CONTROL_KEY)
+
+.PHONY: local-control
+local-control:
+	$(LOCAL_CONTROL_CLIENT) check
+	$(LOCAL_CONTROL_CLIENT) bench $(if $(HAP_CMD),--compare-cmd '$(HAP_CMD)')
+
+# Prints the batches the mqtt_telemetry component publishes to the broker
+# the example was built with, and the publish rate on Ctrl-C.
+#   make mqtt-watch MQTT_HOST=192.168.1.10
+#   make mqtt-watch MQTT_HOST=192.168.1.10 MQTT_USER=sensors MQTT_PASSWORD=...
+.PHONY: mqtt-watch
+mqtt-watch:
+	$(TOOLS_DIR)mqtt_telemetry.py --host $(MQTT_HOST) --port $(or $(MQTT_PORT),1883) watch \
+		$(if $(MQTT_USER),--user $(MQTT_USER) --password '$(MQTT_PASSWORD)')
+
+# Checks and benchmarks the /metrics page of a device built with the
+# metrics component.
+#   make metrics METRICS_HOST=192.168.1.50
+METRICS_URL = http://$(METRICS_HOST):$(or $(METRICS_PORT),9100)/metrics
+
+.PHONY: metrics
+metrics:
+	$(TOOLS_DIR)metrics.py check --url $(METRICS_URL)
+	$(TOOLS_DIR)metrics.py bench --url $(METRICS_URL)
@@ -0,0 +1,322 @@
+// Host bench of the work_queue component: how long a HomeKit write takes
+// to be answered with the hardware work done in the setters, and with it
+// posted to the queue.
+//
+//   build/work_queue_bench --controllers 3 --writes 200 --apply-us 3000
+//
+// A server task stands in for the HomeKit server: it takes write requests
+// one at a time, as esp-homekit does, and calls the setters of each. A
+// request sets hue and saturation together, as the Home app does for a
+// colour, and each setter applies the colour, as led_strip_animation did
+// (or lightSET in ZemiSmart). Controller threads each send a request,
+// wait for its answer, then wait a random think time before the next.
+// Latency is from sending a request to its answer.
+//
+// The apply is a busy wait of --apply-us. Its cost on the device was not
+// measured, the default is a guess for an HSI conversion, a strip update
+// and a line on the UART. The latencies are those of this model on the
+// host, not of a device: they show the shape, compare the two rows.
+//
+// Before the bench, the queue's order is checked: highest priority first,
+// oldest first within a priority, a raised entry by when it was first
+// posted, a repeated post coalesced, a post to a full pool dropped.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <semphr.h>
+#include <espressif/esp_common.h>
+
+#include "work_queue.h"
+
+#define MAX_CONTROLLERS 16
+#define MAX_REQUESTS 100000
+
+typedef struct {
+    uint32_t sent_us;
+    int controller;
+} request_t;
+
+static int failures = 0;
+
+static uint32_t apply_us = 3000;
+static bool queued = false;
+static uint32_t applies = 0;
+
+static QueueHandle_t requests;
+static StaticQueue_t requests_buffer;
+static request_t requests_storage[MAX_CONTROLLERS];
+
+static SemaphoreHandle_t answered[MAX_CONTROLLERS];
+static StaticSemaphore_t answered_buffers[MAX_CONTROLLERS];
+
+static StaticTask_t server_task_buffer;
+
+static uint32_t latencies_us[MAX_REQUESTS];
+static int latency_count = 0;
+
+
+size_t xPortGetFreeHeapSize() {
+    return 0;
+}
+
+
+static void fail(const char *message) {
+    printf("FAIL: %s\n", message);
+    failures++;
+}
+
+
+// The order checks
+
+static char order[64];
+static SemaphoreHandle_t gate, started, finished;
+static StaticSemaphore_t gate_buffer, started_buffer, finished_buffer;
+
+static void record(void *arg) {
+    size_t length = strlen(order);
+    if (length < sizeof(order) - 1)
+        order[length] = (char)(uintptr_t)arg;
+}
+
+// Holds the worker while the entries to check are posted
+static void block(void *arg) {
+    xSemaphoreGive(started);
+    xSemaphoreTake(gate, portMAX_DELAY);
+}
+
+static void finish(void *arg) {
+    xSemaphoreGive(finished);
+}
+
+#define POST(c, priority) work_queue_post(record, (void *)(uintptr_t)(c), WORK_QUEUE_PRIORITY_##priority)
+
+static void hold_worker() {
+    memset(order, 0, sizeof(order));
+    work_queue_post(block, NULL, WORK_QUEUE_PRIORITY_HIGH);
+    xSemaphoreTake(started, portMAX_DELAY);
+}
+
+static void expect_order(const char *name, const char *expected) {
+    work_queue_post(finish, NULL, WORK_QUEUE_PRIORITY_LOW);
+    xSemaphoreGive(gate);
+    xSemaphoreTake(finished, portMAX_DELAY);
+
+    if (strcmp(order, expected)) {
+        char message[128];
+        snprintf(message, sizeof(message), "%s: ran %s, not %s", name, order, expected);
+        fail(message);
+    } else {
+        printf("%-40s %s\n", name, order);
+    }
+}
+
+static void check_order() {
+    gate = xSemaphoreCreateBinaryStatic(&gate_buffer);
+    started = xSemaphoreCreateBinaryStatic(&started_buffer);
+    finished = xSemaphoreCreateBinaryStatic(&finished_buffer);
+
+    hold_worker();
+    POST('a', LOW);
+    POST('b', NORMAL);
+    POST('c', HIGH);
+    POST('d', NORMAL);
+    expect_order("priority, then posting order", "cbda");
+
+    hold_worker();
+    POST('a', LOW);
+    POST('b', LOW);
+    POST('c', NORMAL);
+    POST('b', NORMAL);
+    expect_order("raised entry keeps its first post", "bca");
+
+    work_queue_stats_t stats;
+    work_queue_get_stats(&stats, true);
+    hold_worker();
+    POST('a', NORMAL);
+    POST('a', NORMAL);
+    POST('a', LOW);
+    expect_order("repeated post coalesced", "a");
+    work_queue_get_stats(&stats, true);
+    if (stats.coalesced != 2)
+        fail("repeated post: coalesced not counted");
+
+    // The blocker keeps its entry while it runs: one post too many for
+    // the rest, and no room for finish either
+    hold_worker();
+    for (int i = 0; i < WORK_QUEUE_SIZE; i++)
+        POST('a' + i, NORMAL);
+    xSemaphoreGive(gate);
+    for (int i = 0; i < 1000 && strlen(order) < WORK_QUEUE_SIZE - 1; i++)
+        usleep(1000);
+    usleep(10000);
+    char expected[WORK_QUEUE_SIZE];
+    for (int i = 0; i < WORK_QUEUE_SIZE - 1; i++)
+        expected[i] = 'a' + i;
+    expected[WORK_QUEUE_SIZE - 1] = 0;
+    work_queue_get_stats(&stats, true);
+    if (strcmp(order, expected) || stats.dropped != 1)
+        fail("full pool: the last post was not the one dropped");
+    else
+        printf("%-40s %s\n", "full pool drops the last post", order);
+}
+
+
+// The bench
+
+static void apply(void *arg) {
+    uint32_t until = sdk_system_get_time() + apply_us;
+    while ((int32_t)(sdk_system_get_time() - until) < 0);
+    taskENTER_CRITICAL();
+    applies++;
+    taskEXIT_CRITICAL();
+}
+
+static void colour_set() {
+    if (queued)
+        work_queue_post(apply, NULL, WORK_QUEUE_PRIORITY_NORMAL);
+    else
+        apply(NULL);
+}
+
+static void server_task(void *arg) {
+    request_t request;
+    while (true) {
+        xQueueReceive(requests, &request, portMAX_DELAY);
+        colour_set();       // hue
+        colour_set();       // saturation
+        xSemaphoreGive(answered[request.controller]);
+    }
+}
+
+typedef struct {
+    pthread_t thread;
+    int id;
+    int writes;
+    int think_ms;
+} controller_t;
+
+static void *controller(void *arg) {
+    controller_t *c = arg;
+    unsigned seed = c->id + 1;
+    for (int i = 0; i < c->writes; i++) {
+        request_t request = { sdk_system_get_time(), c->id };
+        xQueueSendToBack(requests, &request, portMAX_DELAY);
+        xSemaphoreTake(answered[c->id], portMAX_DELAY);
+        uint32_t latency = sdk_system_get_time() - request.sent_us;
+
+        taskENTER_CRITICAL();
+        if (latency_count < MAX_REQUESTS)
+            latencies_us[latency_count++] = latency;
+        taskEXIT_CRITICAL();
+
+        usleep((rand_r(&seed) % (2 * c->think_ms + 1)) * 1000);
+    }
+    return NULL;
+}
+
+static int compare_latency(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench(int controllers, int writes, int think_ms) {
+    latency_count = 0;
+    applies = 0;
+    work_queue_stats_t stats;
+    work_queue_get_stats(&stats, true);
+
+    controller_t threads[MAX_CONTROLLERS];
+    for (int i = 0; i < controllers; i++) {
+        threads[i] = (controller_t) { .id = i, .writes = writes, .think_ms = think_ms };
+        pthread_create(&threads[i].thread, NULL, controller, &threads[i]);
+    }
+    for (int i = 0; i < controllers; i++)
+        pthread_join(threads[i].thread, NULL);
+
+    // The last applies may still be running
+    while (queued) {
+        work_queue_get_stats(&stats, false);
+        if (stats.posted == stats.coalesced + stats.dropped + applies)
+            break;
+        usleep(1000);
+    }
+    work_queue_get_stats(&stats, true);
+
+    qsort(latencies_us, latency_count, sizeof(*latencies_us), compare_latency);
+    printf("%-8s %8.2f %8.2f %8.2f ms %8u applies",
+           queued ? "queued" : "inline",
+           latencies_us[latency_count / 2] / 1000.0,
+           latencies_us[latency_count * 99 / 100] / 1000.0,
+           latencies_us[latency_count - 1] / 1000.0,
+           applies);
+    if (queued)
+        printf(", %u coalesced, %u dropped, longest wait %.2f ms",
+               stats.coalesced, stats.dropped, stats.max_wait_us / 1000.0);
+    printf("\n");
+}
+
+
+int main(int argc, char **argv) {
+    int controllers = 3;
+    int writes = 200;
+    int think_ms = 20;
+
+    static const struct option options[] = {
+        { "controllers", required_argument, NULL, 'c' },
+        { "writes", required_argument, NULL, 'w' },
+        { "think-ms", required_argument, NULL, 't' },
+        { "apply-us", required_argument, NULL, 'a' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'c': controllers = atoi(optarg); break;
+            case 'w': writes = atoi(optarg); break;
+            case 't': think_ms = atoi(optarg); break;
+            case 'a': apply_us = atoi(optarg); break;
+            default: return 2;
+        }
+    }
+    if (controllers < 1 || controllers > MAX_CONTROLLERS || writes < 1 ||
+            controllers * writes > MAX_REQUESTS || think_ms < 0) {
+        fprintf(stderr, "--controllers takes 1 to %d, at most %d writes in all\n",
+                MAX_CONTROLLERS, MAX_REQUESTS);
+        return 2;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    if (work_queue_init() < 0) {
+        printf("FAIL: work_queue_init\n");
+        return 1;
+    }
+
+    check_order();
+
+    requests = xQueueCreateStatic(MAX_CONTROLLERS, sizeof(request_t),
+                                  (uint8_t *)requests_storage, &requests_buffer);
+    for (int i = 0; i < controllers; i++)
+        answered[i] = xSemaphoreCreateBinaryStatic(&answered_buffers[i]);
+    xTaskCreateStatic(server_task, "HomeKit", 0, NULL, WORK_QUEUE_TASK_PRIORITY,
+                      NULL, &server_task_buffer);
+
+    printf("%d controllers, %d writes each, %d ms think time, %u us per apply\n",
+           controllers, writes, think_ms, apply_us);
+    printf("write answered p50      p99      max\n");
+    queued = false;
+    bench(controllers, writes, think_ms);
+    queued = true;
+    bench(controllers, writes, think_ms);
+
+    if (failures)
+        return 1;
+    printf("OK\n");
+    return 0;
+}